@@ -58,6 +58,7 @@
 #include <sys/stat.h>
 #include <sys/types.h>  // above two for mkdir
 #include "shapefil.h"  // Make file must specify the include directory
+#include "instrument.h"  // from ../imageprocessing
 
 /* global flag to control message output */
 int bVerbose = 0;
@@ -69,11 +70,14 @@ int bVerbose = 0;
 void usage()
 {
   printf("Usage: \n");
-  printf("prepareShpFiles <shapefile> [-v | -check]\n");
+  printf("prepareShpFiles <shapefile> <outpath> [-v | -check] [-stats | -perf]\n");
   printf("  shapefile   - name of file to process, no suffix\n");
   printf("  outpath     - output path, assumed to exist\n");
   printf("  -v          - verbose mode; give progress messages\n");
   printf("  -check      - checks to make sure the filetype is valid\n");
+  printf("  -stats      - write the time for each stage and shape counts to\n");
+  printf("                <outpath>/<shapefile>.stats.json\n");
+  printf("  -perf       - as -stats, adding CPU cycles and cache misses\n");
   printf("Creates output files with the same name, in the 'outpath' subdirectory\n");
   exit(0);
 }
@@ -195,6 +199,7 @@ int allFeaturesSimple(SHPHandle shpIn)
        bOk = 0;
        break;
        }
+     INSTR_COUNT("shapes_checked",1);
      if (readShp->nParts > 1) /* can't handle - exit */
        {
        bOk = 0;
@@ -240,6 +245,9 @@ int restructureFeatures(SHPHandle shpIn,SHPHandle shpOut,
      if (bVerbose)
        printf("Shape %d has %d part(s), %d vertices\n",in,readShp->nParts,
 	      readShp->nVertices);
+     INSTR_COUNT("shapes_read",1);
+     INSTR_COUNT("parts",readShp->nParts);
+     INSTR_COUNT("vertices",readShp->nVertices);
      if (readShp->nParts == 1) /* just copy */
        {
        newShp = SHPCreateSimpleObject(SHPT_ARC,readShp->nVertices,
@@ -252,6 +260,7 @@ int restructureFeatures(SHPHandle shpIn,SHPHandle shpOut,
        out = SHPWriteObject(shpOut,-1,newShp);
        bOk = copyAttributes(dbfIn,dbfOut,in,out);
        SHPDestroyObject(newShp);
+       INSTR_COUNT("shapes_written",1);
        }
      else
        {
@@ -294,6 +303,7 @@ int restructureFeatures(SHPHandle shpIn,SHPHandle shpOut,
 	   out = SHPWriteObject(shpOut,-1,newShp);
 	   bOk = copyAttributes(dbfIn,dbfOut,in,out);
 	   SHPDestroyObject(newShp);
+	   INSTR_COUNT("shapes_written",1);
 	   free(pX);
 	   free(pY);
 	   }
@@ -322,6 +332,11 @@ int main(int argc, char* argv[])
   int bCheckOnly = 0;
   int shapeType = 0;
   int shapeCount = 0;
+  char statsfile[528];
+  int bStats = 0;
+  int bPerf = 0;
+  int i = 0;
+  INSTR_TIMER_T timer;
   if (argc < 3)
     usage();
   strcpy(shapefile,argv[1]);
@@ -331,12 +346,22 @@ int main(int argc, char* argv[])
   else if ((argc > 3) && (strcasecmp(argv[3],"-check") == 0))
     bCheckOnly = 1;
   /* note check and verbose are mutually exclusive */
+  for (i = 3; i < argc; i++)
+    {
+    if (strcasecmp(argv[i],"-stats") == 0)
+      bStats = 1;
+    else if (strcasecmp(argv[i],"-perf") == 0)
+      bStats = bPerf = 1;
+    }
+  if (bStats)
+    instrumentInit("prepareShpFiles",bPerf);
   char * lastSlash = strrchr(shapefile,'/');
   if (lastSlash == NULL)
      lastSlash = shapefile;
   else 
      lastSlash++;
   sprintf(outputfile,"%s/%s",outputDirectory,lastSlash);
+  INSTR_START(&timer);
   shpIn = SHPOpen(shapefile,"rb");
   if (shpIn == NULL)
     {
@@ -359,14 +384,20 @@ int main(int argc, char* argv[])
      printf("ERROR - Failed to open input attribute %s.dbf\n",shapefile);
      exit(2);
      }
+  INSTR_STOP(&timer,"open");
   if (bCheckOnly)
     {
-    if (!allFeaturesSimple(shpIn))
+    int bSimple;
+    INSTR_START(&timer);
+    bSimple = allFeaturesSimple(shpIn);
+    INSTR_STOP(&timer,"check");
+    if (!bSimple)
 	{
 	printf("Some features have multiple parts - use prepareShpFiles utility to convert\n");
 	exit(7);
 	}
     }
+  INSTR_START(&timer);
   dbfOut = DBFCreate(outputfile);  
   if (dbfOut == NULL)
     {
@@ -387,7 +418,11 @@ int main(int argc, char* argv[])
        printf("ERROR - Failed to create output shapefile %s.shp\n",outputfile);
        exit(3);
        }
-    if (!restructureFeatures(shpIn,shpOut,dbfIn,dbfOut))
+    INSTR_STOP(&timer,"create");
+    INSTR_START(&timer);
+    bOk = restructureFeatures(shpIn,shpOut,dbfIn,dbfOut);
+    INSTR_STOP(&timer,"restructure");
+    if (!bOk)
       {
       printf("ERROR - Failed to copy data from input to output files.\n");
       exit(6);
@@ -397,6 +432,8 @@ int main(int argc, char* argv[])
     {
     int row;
     int inputCount;
+    INSTR_STOP(&timer,"create");
+    INSTR_START(&timer);
     SHPGetInfo(shpIn, &inputCount,&shapeType,NULL,NULL);
     for (row = 0; (row < inputCount) && (bOk > 0); row++)
       {
@@ -405,11 +442,20 @@ int main(int argc, char* argv[])
     /* just copy the .shp part */
     sprintf(command,"cp -p %s.shp %s",shapefile,outputDirectory);
     system(command);
+    INSTR_STOP(&timer,"copy_points");
+    INSTR_COUNT("points_copied",inputCount);
     }
+  INSTR_START(&timer);
   SHPClose(shpIn);
   if (shpOut != NULL) 
     SHPClose(shpOut);
   DBFClose(dbfIn);
   DBFClose(dbfOut);
+  INSTR_STOP(&timer,"close");
+  if (bStats)
+    {
+    sprintf(statsfile,"%s.stats.json",outputfile);
+    instrumentWrite(statsfile);
+    }
   exit(0);
 }
@@ -0,0 +1,630 @@
+/* assignment.c
+ *
+ *  Component of the MapEval point matching.
+ *  Chooses matches from the candidate pairs of reference and target
+ *  points, so that each point is used at most once.
+ *
+ *  The candidate pairs form a sparse bipartite graph. It is divided
+ *  into connected components (union-find), which can be solved
+ *  independently; a pool of threads takes components, largest first.
+ *
+ *  ASSIGN_GREEDY sorts the pairs of a component by cost and takes
+ *  each pair whose points are both still free.
+ *
+ *  ASSIGN_OPTIMAL finds the matching with the most pairs and, among
+ *  those, the lowest total cost. Every reference point is given a
+ *  dummy target and every target a dummy reference, with the edges
+ *  to them costing more than any rearrangement of real pairs could
+ *  save, and dummy references are joined to the dummy targets of
+ *  their real neighbours at no cost. A minimum cost perfect matching
+ *  of this graph always exists; it is found with the Hungarian
+ *  method, one shortest augmenting path (Dijkstra on reduced costs)
+ *  per row, over only the edges that exist.
+ *
+ * Copyright 2020 Sally E. Goldin
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+
+#include "structures.h"
+#include "assignment.h"
+
+/* cost added to an optimal solver pair for each unit of tie score
+ * it lacks; small enough to matter only between equal distances
+ */
+#define TIE_COST 1.0e-6
+
+/* one pair prepared for sorting by the greedy solver */
+typedef struct _greedyPair
+{
+  double cost;
+  double tieScore;
+  int ref;
+  int target;
+  int pair;             /* index in the caller's array */
+} GREEDY_PAIR_T;
+
+/* entry in the Dijkstra priority queue */
+typedef struct _heapEntry
+{
+  double dist;
+  int col;
+} HEAP_ENTRY_T;
+
+/* work shared by the threads solving the components */
+typedef struct _assignPool
+{
+  pthread_mutex_t lock;       /* protects 'next' and 'bError' */
+  int next;                   /* next entry in 'order' to be claimed */
+  int componentCount;
+  int* order;                 /* components, largest first */
+  int* compStart;             /* first entry of each component in compPairs */
+  int* compPairs;             /* pair indices grouped by component */
+  POINT_PAIR_T* pairs;
+  const double* costs;
+  const double* tieScores;
+  int method;
+  int* chosen;                /* pair chosen for each reference point */
+  BOOL* targetUsed;           /* for the greedy solver */
+  int* refLocal;              /* row of each reference point in its component */
+  int* targetLocal;           /* column of each target point in its component */
+  BOOL bError;                /* TRUE if memory ran out */
+} ASSIGN_POOL_T;
+
+/* Find the root of a union-find set, halving the path
+ * @param parent    parent of each element
+ * @param i         element
+ * @return root element of the set containing i
+ */
+static int findRoot(int* parent, int i)
+{
+  while (parent[i] != i)
+     {
+     parent[i] = parent[parent[i]];
+     i = parent[i];
+     }
+  return i;
+}
+
+/* comparison function for the greedy solver: cost ascending, then
+ * tie score descending, then reference and target index
+ */
+static int compareGreedy(const void* p1, const void* p2)
+{
+  const GREEDY_PAIR_T* pPair1 = (const GREEDY_PAIR_T*) p1;
+  const GREEDY_PAIR_T* pPair2 = (const GREEDY_PAIR_T*) p2;
+  if (pPair1->cost != pPair2->cost)
+     return (pPair1->cost < pPair2->cost) ? -1 : 1;
+  if (pPair1->tieScore != pPair2->tieScore)
+     return (pPair1->tieScore > pPair2->tieScore) ? -1 : 1;
+  if (pPair1->ref != pPair2->ref)
+     return pPair1->ref - pPair2->ref;
+  return pPair1->target - pPair2->target;
+}
+
+/* Solve one component by taking the cheapest free pairs first
+ * @param pPool     shared work
+ * @param list      indices of the pairs in the component
+ * @param count     number of pairs
+ * @return TRUE if successful, FALSE if memory ran out
+ */
+static BOOL solveGreedy(ASSIGN_POOL_T* pPool, const int* list, int count)
+{
+  GREEDY_PAIR_T* sorted = calloc(count,sizeof(GREEDY_PAIR_T));
+  int i = 0;
+  if (sorted == NULL)
+     return FALSE;
+  for (i = 0; i < count; i++)
+     {
+     int p = list[i];
+     sorted[i].cost = pPool->costs[p];
+     sorted[i].tieScore = (pPool->tieScores != NULL) ? pPool->tieScores[p] : 0.0;
+     sorted[i].ref = pPool->pairs[p].ref;
+     sorted[i].target = pPool->pairs[p].target;
+     sorted[i].pair = p;
+     }
+  qsort(sorted,count,sizeof(GREEDY_PAIR_T),compareGreedy);
+  for (i = 0; i < count; i++)
+     {
+     GREEDY_PAIR_T* pPair = &sorted[i];
+     if ((pPool->chosen[pPair->ref] < 0) && (!pPool->targetUsed[pPair->target]))
+        {
+	pPool->chosen[pPair->ref] = pPair->pair;
+	pPool->targetUsed[pPair->target] = TRUE;
+        }
+     }
+  free(sorted);
+  return TRUE;
+}
+
+/* Add an entry to a binary heap ordered by distance
+ * @param heap      heap array, large enough for the new entry
+ * @param pCount    number of entries, updated
+ * @param dist      distance of the new entry
+ * @param col       column of the new entry
+ */
+static void heapPush(HEAP_ENTRY_T* heap, int* pCount, double dist, int col)
+{
+  int i = (*pCount)++;
+  while (i > 0)
+     {
+     int parent = (i - 1) / 2;
+     if (heap[parent].dist <= dist)
+        break;
+     heap[i] = heap[parent];
+     i = parent;
+     }
+  heap[i].dist = dist;
+  heap[i].col = col;
+}
+
+/* Remove the entry with the smallest distance from a binary heap
+ * @param heap      heap array
+ * @param pCount    number of entries (at least one), updated
+ * @return the removed entry
+ */
+static HEAP_ENTRY_T heapPop(HEAP_ENTRY_T* heap, int* pCount)
+{
+  HEAP_ENTRY_T top = heap[0];
+  HEAP_ENTRY_T last = heap[--(*pCount)];
+  int i = 0;
+  while (TRUE)
+     {
+     int child = 2*i + 1;
+     if (child >= *pCount)
+        break;
+     if ((child + 1 < *pCount) && (heap[child + 1].dist < heap[child].dist))
+        child++;
+     if (last.dist <= heap[child].dist)
+        break;
+     heap[i] = heap[child];
+     i = child;
+     }
+  if (*pCount > 0)
+     heap[i] = last;
+  return top;
+}
+
+/* Solve one component for the largest matching of lowest total cost
+ * @param pPool     shared work
+ * @param list      indices of the pairs in the component
+ * @param count     number of pairs
+ * @return TRUE if successful, FALSE if memory ran out
+ */
+static BOOL solveOptimal(ASSIGN_POOL_T* pPool, const int* list, int count)
+{
+  int rows = 0;          /* real rows (reference points) */
+  int cols = 0;          /* real columns (target points) */
+  int n = 0;             /* rows (and columns) including dummies */
+  int edgeCount = 0;
+  int* rowRef = NULL;    /* reference point of each real row */
+  int* rowStart = NULL;  /* first edge of each row */
+  int* edgeCol = NULL;
+  double* edgeCost = NULL;
+  int* edgePair = NULL;  /* caller's pair index, -1 for dummy edges */
+  int* fill = NULL;
+  double* u = NULL;      /* row potentials */
+  double* v = NULL;      /* column potentials */
+  int* rowMate = NULL;
+  int* colMate = NULL;
+  double* dist = NULL;
+  int* prevRow = NULL;
+  int* reached = NULL;   /* search number in which dist was set */
+  int* done = NULL;      /* search number in which the column was settled */
+  int* doneList = NULL;
+  HEAP_ENTRY_T* heap = NULL;
+  double maxCost = 0.0;
+  double dummyCost = 0.0;
+  int i = 0;
+  int s = 0;
+  BOOL bOk = TRUE;
+  /* number the points of this component */
+  for (i = 0; i < count; i++)
+     {
+     POINT_PAIR_T* pPair = &pPool->pairs[list[i]];
+     pPool->refLocal[pPair->ref] = -1;
+     pPool->targetLocal[pPair->target] = -1;
+     }
+  rowRef = calloc(count,sizeof(int));
+  if (rowRef == NULL)
+     return FALSE;
+  for (i = 0; i < count; i++)
+     {
+     POINT_PAIR_T* pPair = &pPool->pairs[list[i]];
+     double cost = pPool->costs[list[i]];
+     if (pPool->refLocal[pPair->ref] < 0)
+        {
+	rowRef[rows] = pPair->ref;
+	pPool->refLocal[pPair->ref] = rows++;
+        }
+     if (pPool->targetLocal[pPair->target] < 0)
+        pPool->targetLocal[pPair->target] = cols++;
+     if (cost > maxCost)
+        maxCost = cost;
+     }
+  n = rows + cols;
+  edgeCount = 2*count + n;
+  /* any extra match saves two dummy edges and costs at most n real ones */
+  dummyCost = (maxCost + 2.0*TIE_COST) * n + 1.0;
+  rowStart = calloc(n + 1,sizeof(int));
+  fill = calloc(n + 1,sizeof(int));
+  edgeCol = calloc(edgeCount,sizeof(int));
+  edgeCost = calloc(edgeCount,sizeof(double));
+  edgePair = calloc(edgeCount,sizeof(int));
+  u = calloc(n,sizeof(double));
+  v = calloc(n,sizeof(double));
+  rowMate = calloc(n,sizeof(int));
+  colMate = calloc(n,sizeof(int));
+  dist = calloc(n,sizeof(double));
+  prevRow = calloc(n,sizeof(int));
+  reached = calloc(n,sizeof(int));
+  done = calloc(n,sizeof(int));
+  doneList = calloc(n,sizeof(int));
+  heap = calloc(edgeCount + 1,sizeof(HEAP_ENTRY_T));
+  if ((rowStart == NULL) || (fill == NULL) || (edgeCol == NULL) ||
+      (edgeCost == NULL) || (edgePair == NULL) || (u == NULL) ||
+      (v == NULL) || (rowMate == NULL) || (colMate == NULL) ||
+      (dist == NULL) || (prevRow == NULL) || (reached == NULL) ||
+      (done == NULL) || (doneList == NULL) || (heap == NULL))
+     {
+     bOk = FALSE;
+     }
+  else
+     {
+     /* rows 0..rows-1 are reference points, rows..n-1 the dummy row
+      * of each target; columns 0..cols-1 are target points,
+      * cols..n-1 the dummy column of each reference point
+      */
+     for (i = 0; i < n; i++)
+        rowStart[i + 1] = 1;          /* the edge to the dummy */
+     for (i = 0; i < count; i++)
+        {
+	POINT_PAIR_T* pPair = &pPool->pairs[list[i]];
+	rowStart[pPool->refLocal[pPair->ref] + 1]++;
+	rowStart[rows + pPool->targetLocal[pPair->target] + 1]++;
+        }
+     for (i = 0; i < n; i++)
+        {
+	rowStart[i + 1] += rowStart[i];
+	fill[i] = rowStart[i];
+        }
+     for (i = 0; i < rows; i++)
+        {
+	edgeCol[fill[i]] = cols + i;
+	edgeCost[fill[i]] = dummyCost;
+	edgePair[fill[i]++] = -1;
+        }
+     for (i = 0; i < cols; i++)
+        {
+	edgeCol[fill[rows + i]] = i;
+	edgeCost[fill[rows + i]] = dummyCost;
+	edgePair[fill[rows + i]++] = -1;
+        }
+     for (i = 0; i < count; i++)
+        {
+	POINT_PAIR_T* pPair = &pPool->pairs[list[i]];
+	int row = pPool->refLocal[pPair->ref];
+	int col = pPool->targetLocal[pPair->target];
+	double tie = (pPool->tieScores != NULL) ? pPool->tieScores[list[i]] : 1.0;
+	edgeCol[fill[row]] = col;
+	edgeCost[fill[row]] = pPool->costs[list[i]] + TIE_COST * (1.0 - tie);
+	edgePair[fill[row]++] = list[i];
+	edgeCol[fill[rows + col]] = cols + row;
+	edgeCost[fill[rows + col]] = 0.0;
+	edgePair[fill[rows + col]++] = -1;
+        }
+     for (i = 0; i < n; i++)
+        {
+	rowMate[i] = -1;
+	colMate[i] = -1;
+        }
+     }
+  /* add the rows one at a time along shortest augmenting paths */
+  for (s = 0; (bOk) && (s < n); s++)
+     {
+     int heapCount = 0;
+     int doneCount = 0;
+     int sink = -1;
+     int search = s + 1;
+     int e = 0;
+     int j = 0;
+     double dSink = 0.0;
+     for (e = rowStart[s]; e < rowStart[s + 1]; e++)
+        {
+	int k = edgeCol[e];
+	double d = edgeCost[e] - u[s] - v[k];
+	if ((reached[k] != search) || (d < dist[k]))
+	   {
+	   reached[k] = search;
+	   dist[k] = d;
+	   prevRow[k] = s;
+	   heapPush(heap,&heapCount,d,k);
+	   }
+        }
+     while (heapCount > 0)
+        {
+	HEAP_ENTRY_T entry = heapPop(heap,&heapCount);
+	int r = 0;
+	j = entry.col;
+	if ((done[j] == search) || (entry.dist > dist[j]))
+	   continue;    /* already settled, or a stale entry */
+	done[j] = search;
+	doneList[doneCount++] = j;
+	if (colMate[j] < 0)
+	   {
+	   sink = j;
+	   break;
+	   }
+	r = colMate[j];
+	for (e = rowStart[r]; e < rowStart[r + 1]; e++)
+	   {
+	   int k = edgeCol[e];
+	   double d = entry.dist + edgeCost[e] - u[r] - v[k];
+	   if (done[k] == search)
+	      continue;
+	   if ((reached[k] != search) || (d < dist[k]))
+	      {
+	      reached[k] = search;
+	      dist[k] = d;
+	      prevRow[k] = r;
+	      heapPush(heap,&heapCount,d,k);
+	      }
+	   }
+        }
+     if (sink < 0)
+        break;    /* cannot happen; every row has its dummy */
+     /* update the potentials so the path and matched edges are tight */
+     dSink = dist[sink];
+     u[s] += dSink;
+     for (i = 0; i < doneCount; i++)
+        {
+	j = doneList[i];
+	if (j != sink)
+	   {
+	   double delta = dSink - dist[j];
+	   v[j] -= delta;
+	   u[colMate[j]] += delta;
+	   }
+        }
+     /* flip the matched and unmatched edges along the path */
+     j = sink;
+     while (TRUE)
+        {
+	int r = prevRow[j];
+	int next = rowMate[r];
+	rowMate[r] = j;
+	colMate[j] = r;
+	if (r == s)
+	   break;
+	j = next;
+        }
+     }
+  if (bOk)
+     {
+     for (i = 0; i < rows; i++)
+        {
+	int e = 0;
+	for (e = rowStart[i]; e < rowStart[i + 1]; e++)
+	   {
+	   if ((edgeCol[e] == rowMate[i]) && (edgePair[e] >= 0))
+	      pPool->chosen[rowRef[i]] = edgePair[e];
+	   }
+        }
+     }
+  free(rowRef);
+  free(rowStart);
+  free(fill);
+  free(edgeCol);
+  free(edgeCost);
+  free(edgePair);
+  free(u);
+  free(v);
+  free(rowMate);
+  free(colMate);
+  free(dist);
+  free(prevRow);
+  free(reached);
+  free(done);
+  free(doneList);
+  free(heap);
+  return bOk;
+}
+
+/* Worker thread function. Claims and solves components until
+ * there are none left.
+ * @param pArg    Pointer to the ASSIGN_POOL_T
+ * @return NULL
+ */
+static void* assignWorker(void* pArg)
+{
+  ASSIGN_POOL_T* pPool = (ASSIGN_POOL_T*) pArg;
+  BOOL bMore = TRUE;
+  while (bMore)
+     {
+     int index = -1;
+     pthread_mutex_lock(&pPool->lock);
+     if ((pPool->next < pPool->componentCount) && (!pPool->bError))
+        index = pPool->next++;
+     pthread_mutex_unlock(&pPool->lock);
+     if (index < 0)
+        {
+	bMore = FALSE;
+        }
+     else
+        {
+	int c = pPool->order[index];
+	const int* list = &pPool->compPairs[pPool->compStart[c]];
+	int count = pPool->compStart[c + 1] - pPool->compStart[c];
+	BOOL bOk = TRUE;
+	if (pPool->method == ASSIGN_OPTIMAL)
+	   bOk = solveOptimal(pPool,list,count);
+	else
+	   bOk = solveGreedy(pPool,list,count);
+	if (!bOk)
+	   {
+	   pthread_mutex_lock(&pPool->lock);
+	   pPool->bError = TRUE;
+	   pthread_mutex_unlock(&pPool->lock);
+	   }
+        }
+     }
+  return NULL;
+}
+
+/* component sizes, for sorting components largest first */
+static int* sortSizes = NULL;
+
+/* comparison function for sorting components, largest first */
+static int compareComponents(const void* p1, const void* p2)
+{
+  int c1 = *(const int*) p1;
+  int c2 = *(const int*) p2;
+  if (sortSizes[c1] != sortSizes[c2])
+     return sortSizes[c2] - sortSizes[c1];
+  return c1 - c2;
+}
+
+/* Choose which candidate pairs to use as matches, so that no
+ * reference or target point is in more than one. Pairs that share
+ * no points, directly or through other pairs, are solved separately
+ * and in parallel. The result does not depend on the number of threads.
+ * @param refCount    number of reference points
+ * @param targetCount number of target points
+ * @param pairs       candidate pairs
+ * @param pairCount   number of pairs
+ * @param costs       cost of matching each pair (not negative)
+ * @param tieScores   for pairs of equal cost, the one with the higher
+ *                    score is preferred; may be NULL
+ * @param method      ASSIGN_GREEDY or ASSIGN_OPTIMAL
+ * @param threads     number of threads to use
+ * @param chosen      array to receive, for each reference point, the
+ *                    index of the pair chosen for it or -1 if none
+ * @return number of reference points matched, -1 if memory ran out
+ */
+int assignPairs(int refCount, int targetCount, POINT_PAIR_T* pairs,
+		int pairCount, const double* costs, const double* tieScores,
+		int method, int threads, int* chosen)
+{
+  ASSIGN_POOL_T pool;
+  int* parent = calloc(refCount + targetCount + 1,sizeof(int));
+  int* compOf = calloc(refCount + targetCount + 1,sizeof(int));
+  int* sizes = NULL;
+  pthread_t* workers = NULL;
+  int started = 0;
+  int matched = 0;
+  int i = 0;
+  memset(&pool,0,sizeof(pool));
+  pool.pairs = pairs;
+  pool.costs = costs;
+  pool.tieScores = tieScores;
+  pool.method = method;
+  pool.chosen = chosen;
+  pool.targetUsed = calloc(targetCount + 1,sizeof(BOOL));
+  pool.refLocal = calloc(refCount + 1,sizeof(int));
+  pool.targetLocal = calloc(targetCount + 1,sizeof(int));
+  pool.compPairs = calloc(pairCount + 1,sizeof(int));
+  if ((parent == NULL) || (compOf == NULL) || (pool.targetUsed == NULL) ||
+      (pool.refLocal == NULL) || (pool.targetLocal == NULL) ||
+      (pool.compPairs == NULL))
+     {
+     pool.bError = TRUE;
+     }
+  else
+     {
+     /* reference points are elements 0..refCount-1, targets follow */
+     for (i = 0; i < refCount + targetCount; i++)
+        {
+	parent[i] = i;
+	compOf[i] = -1;
+        }
+     for (i = 0; i < pairCount; i++)
+        {
+	int a = findRoot(parent,pairs[i].ref);
+	int b = findRoot(parent,refCount + pairs[i].target);
+	if (a != b)
+	   parent[(a > b) ? a : b] = (a < b) ? a : b;
+        }
+     for (i = 0; i < pairCount; i++)
+        {
+	int root = findRoot(parent,pairs[i].ref);
+	if (compOf[root] < 0)
+	   compOf[root] = pool.componentCount++;
+        }
+     pool.compStart = calloc(pool.componentCount + 1,sizeof(int));
+     pool.order = calloc(pool.componentCount + 1,sizeof(int));
+     sizes = calloc(pool.componentCount + 1,sizeof(int));
+     if ((pool.compStart == NULL) || (pool.order == NULL) || (sizes == NULL))
+        pool.bError = TRUE;
+     }
+  if (!pool.bError)
+     {
+     for (i = 0; i < pairCount; i++)
+        sizes[compOf[findRoot(parent,pairs[i].ref)]]++;
+     for (i = 0; i < pool.componentCount; i++)
+        {
+	pool.compStart[i + 1] = pool.compStart[i] + sizes[i];
+	pool.order[i] = i;
+        }
+     memset(sizes,0,pool.componentCount * sizeof(int));
+     for (i = 0; i < pairCount; i++)
+        {
+	int c = compOf[findRoot(parent,pairs[i].ref)];
+	pool.compPairs[pool.compStart[c] + sizes[c]++] = i;
+        }
+     sortSizes = sizes;
+     qsort(pool.order,pool.componentCount,sizeof(int),compareComponents);
+     sortSizes = NULL;
+     for (i = 0; i < refCount; i++)
+        chosen[i] = -1;
+     if (threads > pool.componentCount)
+        threads = pool.componentCount;
+     if (threads < 1)
+        threads = 1;
+     workers = calloc(threads,sizeof(pthread_t));
+     if (workers == NULL)
+        threads = 1;
+     pthread_mutex_init(&pool.lock,NULL);
+     /* this thread solves components too, so start one less */
+     for (i = 0; i < threads - 1; i++)
+        {
+	if (pthread_create(&workers[started],NULL,assignWorker,&pool) == 0)
+	   started++;
+        }
+     assignWorker(&pool);
+     for (i = 0; i < started; i++)
+        pthread_join(workers[i],NULL);
+     pthread_mutex_destroy(&pool.lock);
+     }
+  for (i = 0; (!pool.bError) && (i < refCount); i++)
+     {
+     if (chosen[i] >= 0)
+        matched++;
+     }
+  free(parent);
+  free(compOf);
+  free(sizes);
+  free(workers);
+  free(pool.targetUsed);
+  free(pool.refLocal);
+  free(pool.targetLocal);
+  free(pool.compPairs);
+  free(pool.compStart);
+  free(pool.order);
+  return (pool.bError) ? -1 : matched;
+}
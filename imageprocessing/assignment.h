@@ -0,0 +1,43 @@
+/* Header file for the point assignment solvers
+ *
+ * Copyright 2020 Sally E. Goldin
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+
+/* take the lowest cost pairs first, over all the points */
+#define ASSIGN_GREEDY 1
+/* match as many points as possible, with the lowest total cost */
+#define ASSIGN_OPTIMAL 2
+
+/* Choose which candidate pairs to use as matches, so that no
+ * reference or target point is in more than one. Pairs that share
+ * no points, directly or through other pairs, are solved separately
+ * and in parallel. The result does not depend on the number of threads.
+ * @param refCount    number of reference points
+ * @param targetCount number of target points
+ * @param pairs       candidate pairs
+ * @param pairCount   number of pairs
+ * @param costs       cost of matching each pair (not negative)
+ * @param tieScores   for pairs of equal cost, the one with the higher
+ *                    score is preferred; may be NULL
+ * @param method      ASSIGN_GREEDY or ASSIGN_OPTIMAL
+ * @param threads     number of threads to use
+ * @param chosen      array to receive, for each reference point, the
+ *                    index of the pair chosen for it or -1 if none
+ * @return number of reference points matched, -1 if memory ran out
+ */
+int assignPairs(int refCount, int targetCount, POINT_PAIR_T* pairs,
+		int pairCount, const double* costs, const double* tieScores,
+		int method, int threads, int* chosen);
@@ -0,0 +1,215 @@
+/* 
+ *  bandImage.c
+ *
+ *  Reading binary road images in horizontal bands, for images that
+ *  are too large to hold in memory as a whole. A ROW_READER_T returns
+ *  the rows of a raw RGB or JPEG image in order; an IMAGE_BAND_T 
+ *  holds a range of those rows as a BITIMAGE_T whose row 0 is the 
+ *  first row of the band. Successive bands overlap, and the shared
+ *  rows are moved up rather than read again.
+ *
+ *  Copyright 2020 Sally E. Goldin
+ * 
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ * 
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "structures.h"
+#include "bitImage.h"
+#include "jpegBinarize.h"
+#include "bandImage.h"
+
+/* Open an image to be read one row at a time. If a provider is
+ * named, the image is that provider's JPEG and each row is binarized
+ * as it is decoded; otherwise it is a binary RGB file.
+ * @param imagefile  Name of the image file
+ * @param provider   Provider name or empty string
+ * @param width      Image width in pixels
+ * @param height     Image height in pixels
+ * @return new reader or NULL if error (a message has been printed)
+ */
+ROW_READER_T* openRowReader(char* imagefile, char* provider,
+			    int width, int height)
+{
+  ROW_READER_T* pRows = calloc(1,sizeof(ROW_READER_T));
+  if (pRows == NULL)
+     {
+     printf("Error allocating image reader\n");
+     return NULL;
+     }
+  pRows->width = width;
+  pRows->height = height;
+  if (strlen(provider) > 0)
+     {
+     PROVIDER_PROFILE_T* pProfile = findProviderProfile(provider);
+     if (pProfile == NULL)
+        printf("Error - no binarization profile for provider %s\n",provider);
+     else
+        pRows->pJpeg = openJpegRows(imagefile,pProfile,width,height);
+     if (pRows->pJpeg == NULL)
+        {
+	free(pRows);
+	return NULL;
+        }
+     }
+  else
+     {
+     /* buffer can hold one line, 3 bytes per pixel */
+     pRows->buffer = (BYTE*) calloc(width*3,sizeof(BYTE));
+     pRows->pIn = fopen(imagefile,"rb");
+     if ((pRows->buffer == NULL) || (pRows->pIn == NULL))
+        {
+	printf("Error opening input image %s\n", imagefile);
+	closeRowReader(pRows);
+	return NULL;
+        }
+     }
+  return pRows;
+}
+
+/* Read the next row of the image
+ * @param pRows     Reader from openRowReader
+ * @param row       BITWORDs to receive the row; set bits are WHITE
+ * @return TRUE if a row was read, FALSE at the end or on error
+ */
+BOOL readImageRow(ROW_READER_T* pRows, BITWORD* row)
+{
+  int x = 0;
+  int retval = 0;
+  int width = pRows->width;
+  if (pRows->nextRow >= pRows->height)
+     return FALSE;
+  memset(row,0,((width + BITS_PER_WORD - 1) / BITS_PER_WORD) * sizeof(BITWORD));
+  if (pRows->pJpeg != NULL)
+     {
+     if (!readJpegRow(pRows->pJpeg,row))
+        return FALSE;
+     }
+  else
+     {
+     retval = fread(pRows->buffer,sizeof(BYTE),width*3,pRows->pIn);
+     if (retval != width*3)
+        {
+	printf("ERROR - fread returned wrong value %d for line %d\n", 
+	       retval,pRows->nextRow);
+	return FALSE;
+        }
+     for (x = 0; x < width; x++)
+        {
+	if (pRows->buffer[x*3] == WHITE)  // only need first byte of triplet
+	   row[x >> 6] |= 1ULL << (x & 63);
+        }
+     }
+  pRows->nextRow++;
+  return TRUE;
+}
+
+/* Close the image file and free a reader
+ * @param pRows     Reader to free (may be NULL)
+ */
+void closeRowReader(ROW_READER_T* pRows)
+{
+  if (pRows == NULL)
+     return;
+  if (pRows->pIn != NULL)
+     fclose(pRows->pIn);
+  closeJpegRows(pRows->pJpeg);
+  free(pRows->buffer);
+  free(pRows);
+}
+
+/* Allocate a band able to hold up to 'capacity' rows of an image.
+ * The band starts out empty.
+ * @param width     Image width in pixels
+ * @param capacity  Most rows the band will hold
+ * @return new band or NULL if error
+ */
+IMAGE_BAND_T* newImageBand(int width, int capacity)
+{
+  IMAGE_BAND_T* pBand = calloc(1,sizeof(IMAGE_BAND_T));
+  if (pBand == NULL)
+     {
+     printf("Error allocating image band\n");
+     return NULL;
+     }
+  pBand->pImage = newBitImage(width,capacity);
+  if (pBand->pImage == NULL)
+     {
+     free(pBand);
+     return NULL;
+     }
+  pBand->capacity = capacity;
+  pBand->top = 0;
+  pBand->pImage->height = 0;
+  return pBand;
+}
+
+/* Free a band and its rows
+ * @param pBand     Band to free (may be NULL)
+ */
+void freeImageBand(IMAGE_BAND_T* pBand)
+{
+  if (pBand != NULL)
+     {
+     freeBitImage(pBand->pImage);
+     free(pBand);
+     }
+}
+
+/* Move a band down the image so that it holds rows 'top' to 
+ * 'bottom - 1'. Rows the band already holds are kept; the rest 
+ * are read from the image. Bands must move down the image, and
+ * each one must overlap or adjoin the one before.
+ * @param pRows     Reader for the image
+ * @param pBand     Band to update
+ * @param top       First image row wanted
+ * @param bottom    One past the last image row wanted
+ * @return TRUE if successful, FALSE if the rows could not be read
+ */
+BOOL advanceImageBand(ROW_READER_T* pRows, IMAGE_BAND_T* pBand,
+		      int top, int bottom)
+{
+  BITIMAGE_T* pImage = pBand->pImage;
+  int wordsPerRow = pImage->wordsPerRow;
+  int heldEnd = pBand->top + pImage->height;  /* one past last row held */
+  int kept = 0;
+  int y = 0;
+  if ((top < pBand->top) || (top > heldEnd) || (heldEnd != pRows->nextRow) ||
+      (bottom < heldEnd) ||       (bottom - top > pBand->capacity))
+     {
+     printf("Error - image band %d to %d cannot follow rows %d to %d\n",
+	    top,bottom - 1,pBand->top,heldEnd - 1);
+     return FALSE;
+     }
+  if (heldEnd > top)
+     {
+     kept = heldEnd - top;
+     memmove(pImage->bits,&pImage->bits[(size_t) (top - pBand->top) * wordsPerRow],
+	     (size_t) kept * wordsPerRow * sizeof(BITWORD));
+     }
+  pBand->top = top;
+  pImage->height = kept;
+  for (y = top + kept; y < bottom; y++)
+     {
+     if (!readImageRow(pRows,&pImage->bits[(size_t) pImage->height * wordsPerRow]))
+        {
+	printf("Error reading row %d of image\n",y);
+	return FALSE;
+        }
+     pImage->height++;
+     }
+  return TRUE;
+}
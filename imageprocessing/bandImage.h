@@ -0,0 +1,69 @@
+/* Header file for reading large binary images one band of
+ * rows at a time
+ * Include AFTER structures.h
+ *
+ * Copyright 2020 Sally E. Goldin
+ * 
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ * 
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+
+/* Open an image to be read one row at a time. If a provider is
+ * named, the image is that provider's JPEG and each row is binarized
+ * as it is decoded; otherwise it is a binary RGB file.
+ * @param imagefile  Name of the image file
+ * @param provider   Provider name or empty string
+ * @param width      Image width in pixels
+ * @param height     Image height in pixels
+ * @return new reader or NULL if error (a message has been printed)
+ */
+ROW_READER_T* openRowReader(char* imagefile, char* provider,
+			    int width, int height);
+
+/* Read the next row of the image
+ * @param pRows     Reader from openRowReader
+ * @param row       BITWORDs to receive the row; set bits are WHITE
+ * @return TRUE if a row was read, FALSE at the end or on error
+ */
+BOOL readImageRow(ROW_READER_T* pRows, BITWORD* row);
+
+/* Close the image file and free a reader
+ * @param pRows     Reader to free (may be NULL)
+ */
+void closeRowReader(ROW_READER_T* pRows);
+
+/* Allocate a band able to hold up to 'capacity' rows of an image.
+ * The band starts out empty.
+ * @param width     Image width in pixels
+ * @param capacity  Most rows the band will hold
+ * @return new band or NULL if error
+ */
+IMAGE_BAND_T* newImageBand(int width, int capacity);
+
+/* Free a band and its rows
+ * @param pBand     Band to free (may be NULL)
+ */
+void freeImageBand(IMAGE_BAND_T* pBand);
+
+/* Move a band down the image so that it holds rows 'top' to 
+ * 'bottom - 1'. Rows the band already holds are kept; the rest 
+ * are read from the image. Bands must move down the image, and
+ * each one must overlap or adjoin the one before.
+ * @param pRows     Reader for the image
+ * @param pBand     Band to update
+ * @param top       First image row wanted
+ * @param bottom    One past the last image row wanted
+ * @return TRUE if successful, FALSE if the rows could not be read
+ */
+BOOL advanceImageBand(ROW_READER_T* pRows, IMAGE_BAND_T* pBand,
+		      int top, int bottom);
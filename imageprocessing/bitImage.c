@@ -0,0 +1,270 @@
+/* Component of the vectorize application.
+ * Holds functions for binary images packed one bit per pixel.
+ * A 512 x 512 image takes 32K bytes, and searches can examine
+ * 64 pixels of a row with a single word operation.
+ *
+ * Copyright 2020 Sally E. Goldin
+ * 
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ * 
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "structures.h"
+#include "bitImage.h"
+
+/* Return a mask with bits lo through hi (inclusive) set
+ * 0 <= lo <= hi <= 63 
+ */
+static BITWORD spanMask(int lo, int hi)
+{
+  return (~0ULL << lo) & (~0ULL >> (BITS_PER_WORD - 1 - hi));
+}
+
+/* Allocate a bit image with all pixels BLACK
+ * @param width    number of pixels in each row
+ * @param height   number of rows in the image
+ * @return newly allocated image or NULL if error
+ */
+BITIMAGE_T* newBitImage(int width, int height)
+{
+  BITIMAGE_T* pBits = calloc(1,sizeof(BITIMAGE_T));
+  if (pBits != NULL)
+     {
+     pBits->width = width;
+     pBits->height = height;
+     pBits->wordsPerRow = (width + BITS_PER_WORD - 1) / BITS_PER_WORD;
+     pBits->bits = calloc((size_t) pBits->wordsPerRow * height,sizeof(BITWORD));
+     if (pBits->bits == NULL)
+        {
+	free(pBits);
+	pBits = NULL;
+        }
+     }
+  if (pBits == NULL)
+     printf("Error allocating %d x %d bit image\n",width,height);
+  return pBits;
+}
+
+/* Free a bit image 
+ * @param pBits    image to free (may be NULL)
+ */
+void freeBitImage(BITIMAGE_T* pBits)
+{
+  if (pBits != NULL)
+     {
+     free(pBits->bits);
+     free(pBits);
+     }
+}
+
+/* Set one pixel of a bit image to WHITE 
+ * @param pBits    image to modify
+ * @param x        column
+ * @param y        row
+ */
+void setBit(BITIMAGE_T* pBits, int x, int y)
+{
+  pBits->bits[y*pBits->wordsPerRow + (x >> 6)] |= 1ULL << (x & 63);
+}
+
+/* Create a bit image from a one byte per pixel image.
+ * Pixels that are WHITE become set bits, anything else is BLACK.
+ * @param image    byte array of image data
+ * @param width    number of pixels in each row
+ * @param height   number of rows in the image
+ * @return newly allocated image or NULL if error
+ */
+BITIMAGE_T* packBitImage(BYTE* image, int width, int height)
+{
+  int x = 0;
+  int y = 0;
+  BITIMAGE_T* pBits = newBitImage(width,height);
+  if (pBits != NULL)
+     {
+     for (y = 0; y < height; y++)
+        {
+	BITWORD* row = &pBits->bits[y*pBits->wordsPerRow];
+	for (x = 0; x < width; x++)
+	   {
+	   if (pixval(x,y,width) == WHITE)
+	      row[x >> 6] |= 1ULL << (x & 63);
+	   }
+        }
+     }
+  return pBits;
+}
+
+/* Read a raw RGB file, one byte per color per pixel, directly
+ * into a bit image. Assumed to be binary so we look only at
+ * the first BYTE of each triad, and treat WHITE as set.
+ * @param infile   name of file to read
+ * @param width    number of pixels in each row
+ * @param height   number of rows in the image
+ * @return allocated, initialized image or NULL if error 
+ */
+BITIMAGE_T* readBitImageFile(char* infile, int width, int height)
+{
+  int x = 0;
+  int y = 0;
+  FILE * pIn = NULL;
+  BYTE * buffer = NULL;
+  BITIMAGE_T * pBits = NULL;
+
+  pBits = newBitImage(width,height);
+  /* buffer can hold one line, 3 bytes per pixel */
+  buffer = (BYTE*) calloc(width*3,sizeof(BYTE));
+  if ((pBits == NULL) || (buffer == NULL))
+     {
+     printf("Error allocating image array or buffer\n");  
+     freeBitImage(pBits);
+     free(buffer);
+     return NULL;
+     }
+  pIn = fopen(infile,"rb");
+  if (pIn == NULL)
+     {
+     printf("Error opening input image %s\n", infile);
+     free(buffer);
+     freeBitImage(pBits);
+     return NULL;
+     }
+  for (y = 0; y < height; y++)
+     {
+     int retval;
+     retval = fread(buffer,sizeof(BYTE),width*3,pIn);
+     if (retval  == width*3)
+        {
+	BITWORD* row = &pBits->bits[y*pBits->wordsPerRow];
+	for (x = 0; x < width; x++)
+	    {
+	    if (buffer[x*3] == WHITE)  // only need first byte of triplet            
+	       row[x >> 6] |= 1ULL << (x & 63);
+            }
+        } 
+     else 
+        {
+	printf("ERROR - fread returned wrong value %d for line %d\n", retval,y);
+	free(buffer);
+	freeBitImage(pBits);
+	fclose(pIn);
+	return NULL;
+        } 
+     }
+  free(buffer);
+  fclose(pIn);
+  return pBits;
+}
+
+/* Find the first WHITE pixel in part of a row.
+ * The span is clipped to the image.
+ * @param pBits    image to search
+ * @param y        row to search
+ * @param x1       first column of the span
+ * @param x2       last column of the span (inclusive)
+ * @return column of the first WHITE pixel >= x1, or -1 if none
+ */
+int findFirstSet(BITIMAGE_T* pBits, int y, int x1, int x2)
+{
+  int w = 0;
+  BITWORD* row = NULL;
+  if ((y < 0) || (y >= pBits->height))
+     return -1;
+  if (x1 < 0)
+     x1 = 0;
+  if (x2 >= pBits->width)
+     x2 = pBits->width - 1;
+  if (x1 > x2)
+     return -1;
+  row = &pBits->bits[y*pBits->wordsPerRow];
+  for (w = x1 >> 6; w <= (x2 >> 6); w++)
+     {
+     int lo = (w == (x1 >> 6)) ? (x1 & 63) : 0;
+     int hi = (w == (x2 >> 6)) ? (x2 & 63) : BITS_PER_WORD - 1;
+     BITWORD word = row[w] & spanMask(lo,hi);
+     if (word != 0)
+        return w*BITS_PER_WORD + __builtin_ctzll(word);
+     }
+  return -1;
+}
+
+/* Find the last WHITE pixel in part of a row.
+ * The span is clipped to the image.
+ * @param pBits    image to search
+ * @param y        row to search
+ * @param x1       first column of the span
+ * @param x2       last column of the span (inclusive)
+ * @return column of the last WHITE pixel <= x2, or -1 if none
+ */
+int findLastSet(BITIMAGE_T* pBits, int y, int x1, int x2)
+{
+  int w = 0;
+  BITWORD* row = NULL;
+  if ((y < 0) || (y >= pBits->height))
+     return -1;
+  if (x1 < 0)
+     x1 = 0;
+  if (x2 >= pBits->width)
+     x2 = pBits->width - 1;
+  if (x1 > x2)
+     return -1;
+  row = &pBits->bits[y*pBits->wordsPerRow];
+  for (w = x2 >> 6; w >= (x1 >> 6); w--)
+     {
+     int lo = (w == (x1 >> 6)) ? (x1 & 63) : 0;
+     int hi = (w == (x2 >> 6)) ? (x2 & 63) : BITS_PER_WORD - 1;
+     BITWORD word = row[w] & spanMask(lo,hi);
+     if (word != 0)
+        return w*BITS_PER_WORD + (BITS_PER_WORD - 1 - __builtin_clzll(word));
+     }
+  return -1;
+}
+
+/* Count the WHITE pixels in a rectangular window.
+ * The window is clipped to the image.
+ * @param pBits    image to search
+ * @param x1       left column
+ * @param y1       top row
+ * @param x2       right column (inclusive)
+ * @param y2       bottom row (inclusive)
+ * @return number of WHITE pixels in the window
+ */
+int countSetBits(BITIMAGE_T* pBits, int x1, int y1, int x2, int y2)
+{
+  int count = 0;
+  int y = 0;
+  int w = 0;
+  if (x1 < 0)
+     x1 = 0;
+  if (y1 < 0)
+     y1 = 0;
+  if (x2 >= pBits->width)
+     x2 = pBits->width - 1;
+  if (y2 >= pBits->height)
+     y2 = pBits->height - 1;
+  if ((x1 > x2) || (y1 > y2))
+     return 0;
+  for (y = y1; y <= y2; y++)
+     {
+     BITWORD* row = &pBits->bits[y*pBits->wordsPerRow];
+     for (w = x1 >> 6; w <= (x2 >> 6); w++)
+        {
+	int lo = (w == (x1 >> 6)) ? (x1 & 63) : 0;
+	int hi = (w == (x2 >> 6)) ? (x2 & 63) : BITS_PER_WORD - 1;
+	count += __builtin_popcountll(row[w] & spanMask(lo,hi));
+        }
+     }
+  return count;
+}
@@ -0,0 +1,88 @@
+/* Header file with definitions of functions related
+ * to bit packed binary images
+ * Include AFTER structures.h
+ *
+ * Copyright 2020 Sally E. Goldin
+ * 
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ * 
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+
+/* Allocate a bit image with all pixels BLACK
+ * @param width    number of pixels in each row
+ * @param height   number of rows in the image
+ * @return newly allocated image or NULL if error
+ */
+BITIMAGE_T* newBitImage(int width, int height);
+
+/* Free a bit image 
+ * @param pBits    image to free (may be NULL)
+ */
+void freeBitImage(BITIMAGE_T* pBits);
+
+/* Set one pixel of a bit image to WHITE 
+ * @param pBits    image to modify
+ * @param x        column
+ * @param y        row
+ */
+void setBit(BITIMAGE_T* pBits, int x, int y);
+
+/* Create a bit image from a one byte per pixel image.
+ * Pixels that are WHITE become set bits, anything else is BLACK.
+ * @param image    byte array of image data
+ * @param width    number of pixels in each row
+ * @param height   number of rows in the image
+ * @return newly allocated image or NULL if error
+ */
+BITIMAGE_T* packBitImage(BYTE* image, int width, int height);
+
+/* Read a raw RGB file, one byte per color per pixel, directly
+ * into a bit image. Assumed to be binary so we look only at
+ * the first BYTE of each triad, and treat WHITE as set.
+ * @param infile   name of file to read
+ * @param width    number of pixels in each row
+ * @param height   number of rows in the image
+ * @return allocated, initialized image or NULL if error 
+ */
+BITIMAGE_T* readBitImageFile(char* infile, int width, int height);
+
+/* Find the first WHITE pixel in part of a row.
+ * The span is clipped to the image.
+ * @param pBits    image to search
+ * @param y        row to search
+ * @param x1       first column of the span
+ * @param x2       last column of the span (inclusive)
+ * @return column of the first WHITE pixel >= x1, or -1 if none
+ */
+int findFirstSet(BITIMAGE_T* pBits, int y, int x1, int x2);
+
+/* Find the last WHITE pixel in part of a row.
+ * The span is clipped to the image.
+ * @param pBits    image to search
+ * @param y        row to search
+ * @param x1       first column of the span
+ * @param x2       last column of the span (inclusive)
+ * @return column of the last WHITE pixel <= x2, or -1 if none
+ */
+int findLastSet(BITIMAGE_T* pBits, int y, int x1, int x2);
+
+/* Count the WHITE pixels in a rectangular window.
+ * The window is clipped to the image.
+ * @param pBits    image to search
+ * @param x1       left column
+ * @param y1       top row
+ * @param x2       right column (inclusive)
+ * @param y2       bottom row (inclusive)
+ * @return number of WHITE pixels in the window
+ */
+int countSetBits(BITIMAGE_T* pBits, int x1, int y1, int x2, int y2);
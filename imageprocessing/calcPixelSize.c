@@ -53,12 +53,9 @@
 
 #include "structures.h"
 #include "fileFunctions.h"
-
-/* global pointer to image data */
-BYTE * image = NULL;
-/* global width and height of the input image */
-int width = 0; 
-int height = 0;
+#include "instrument.h"
+#include "transform.h"
+#include "pixelSize.h"
 
 void usage()
 {
@@ -71,88 +68,71 @@ void usage()
   printf("     nw_y       - NW Y coord of red box in meters (EPSG 3857)\n");
   printf("     se_x       - SE X coord of red box in meters (EPSG 3857)\n");
   printf("     se_y       - SE Y coord of red box in meters (EPSG 3857)\n");
+  printf("  Options:\n");
+  printf("     -stats     - write the time for each stage and pixel counts\n");
+  printf("                  to <infile>.stats.json\n");
+  printf("     -perf      - as -stats, adding CPU cycles and cache misses\n");
+  printf("     -lonlat    - box coordinates are longitude and latitude (EPSG 4326)\n");
+  printf("                  rather than meters\n");
   printf(" Prints calculated pixel size (floating point, meters) to stdout\n\n");
   exit(0);
 }
 
-/* Get the R, G and B values for a pixel at a particular
- * location in the image.
- * @param    x      Column for desired pixel
- * @param    y      Row for desired pixel
- * @param    pR     Pointer to return red value
- * @param    pG     Pointer to return green value
- * @param    pB     Pointer to return blue value
- */
-void getPixelBytes(int x, int y, BYTE* pR, BYTE* pG, BYTE* pB)
-{
-   BYTE* pixStart = &image[y*width*3 + x*3];
-   *pR = *pixStart;
-   *pG = *(pixStart+1);
-   *pB = *(pixStart+2);
-}
-
 /* Main function gets arguments, allocates byte array, reads in the data */
 int main(int argc, char* argv[])
 {
-  FILE * pRef = NULL;
   char infile[256];
-  char input[256];
-  double nw_x = 0;
-  double nw_y = 0;
-  double se_x = 0;
-  double se_y = 0;
-  int xCenter = 0;
-  int yCenter = 0;
-  int ix = 0;
-  int iy = 0;
-  int boxHeight = 0;  /* box height in pixels */
-  int boxWidth = 0;    /* box width in pixels */
+  /* image data, 3 bytes per pixel */
+  BYTE * image = NULL;
+  int width = 0; 
+  int height = 0;
   double pixSizeX = 0;
   double pixSizeY = 0;
-  int radius = 50;    /* box should never be more than 100 pix wide */
+  char statsfile[256];
+  BOOL bStats = FALSE;
+  BOOL bPerf = FALSE;
+  BOOL bLonLat = FALSE;
+  double corners[4];
+  int i = 0;
+  INSTR_TIMER_T timer;
   if (argc < 8)
      usage();
+  for (i = 8; i < argc; i++)
+     {
+     if (strcmp(argv[i],"-stats") == 0)
+        bStats = TRUE;
+     else if (strcmp(argv[i],"-perf") == 0)
+        bStats = bPerf = TRUE;
+     else if (strcmp(argv[i],"-lonlat") == 0)
+        bLonLat = TRUE;
+     else
+        usage();
+     }
+  if (bStats)
+     instrumentInit("calcPixelSize",bPerf);
   width = atoi(argv[1]);
   height = atoi(argv[2]);
   strcpy(infile,argv[3]);
-  nw_x = atof(argv[4]);
-  nw_y = atof(argv[5]);
-  se_x = atof(argv[6]);
-  se_y = atof(argv[7]);
-  //printf("NW coordinates: %lf %lf\n", nw_x,nw_y);
-  //printf("SE coordinates: %lf %lf\n", se_x,se_y);
+  corners[0] = atof(argv[4]);
+  corners[1] = atof(argv[5]);
+  corners[2] = atof(argv[6]);
+  corners[3] = atof(argv[7]);
+  if (bLonLat)
+     lonLatToMercator(corners,2,corners);
+  //printf("NW coordinates: %lf %lf\n", corners[0],corners[1]);
+  //printf("SE coordinates: %lf %lf\n", corners[2],corners[3]);
 
-  if ((image = readColorImageFile(infile,width,height)) == NULL)
+  INSTR_START(&timer);
+  image = readColorImageFile(infile,width,height);
+  INSTR_STOP(&timer,"image_load");
+  if (image == NULL)
     {
     printf("Error reading image - exiting \n");
     exit(1);
     }
-  xCenter = width/2;
-  yCenter = height/2;
-  /* search for red pixels near the center, horizontally */
-  for (ix = xCenter - radius; ix < xCenter + radius; ix++)
-    { 
-    BYTE R, G, B;
-    getPixelBytes(ix,yCenter,&R,&G,&B);
-    /* values get distorted by ImageMagick during conversion 
-       so we look for values "close to" pure red
-     */
-    if ((R >= 0xF0) && (G < 0x10) && (B < 0x10))
-       boxWidth++;
-    }
-  /* search for red pixels near the center, vertically */
-  for (iy = yCenter - radius; iy < yCenter + radius; iy++)
-    { 
-    BYTE R, G, B;
-    getPixelBytes(xCenter,iy,&R,&G,&B);
-    if ((R >= 0xF0) && (G < 0x10) && (B < 0x10))
-       boxHeight++;
-    }
-  //printf("Box Width is %d and Box Height is %d\n", boxWidth, boxHeight);
-  if ((boxWidth > 0) && (boxHeight > 0))
+  INSTR_COUNT("bytes_read",(long long) width * height * 3);
+  if (estimatePixelSize(image,width,height,corners,&pixSizeX,&pixSizeY))
     {
-    pixSizeX = (se_x - nw_x)/boxWidth;
-    pixSizeY = (nw_y - se_y)/boxHeight;
     printf("%lf %lf %lf\n",(pixSizeX + pixSizeY)/2,pixSizeX,pixSizeY);
     }
   else
@@ -161,5 +141,10 @@ int main(int argc, char* argv[])
     }
  
   free(image);
+  if (bStats)
+     {
+     snprintf(statsfile,sizeof(statsfile),"%s.stats.json",infile);
+     instrumentWrite(statsfile);
+     }
   exit(0);
 }
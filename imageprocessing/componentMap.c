@@ -0,0 +1,330 @@
+/* Component of the vectorize application.
+ * Labels the connected road (WHITE) regions of a binary image, so
+ * that checking whether two matched pixels lie on the same road 
+ * network is a comparison of two labels rather than a path search.
+ * Uses a single pass over the runs of WHITE pixels in each row,
+ * joining runs that touch runs in the row above with union-find, 
+ * then a pass to replace each provisional label by its component.
+ *
+ * Copyright 2020 Sally E. Goldin
+ * 
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ * 
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "structures.h"
+#include "componentMap.h"
+
+/* one run of WHITE pixels in a row */
+typedef struct _pixelRun
+{
+  int start;          /* first column */
+  int end;            /* last column (inclusive) */
+  int label;          /* provisional label */
+} PIXEL_RUN_T;
+
+/* Find the root of a provisional label, halving the path as we go
+ * @param parent   union-find parent of each label
+ * @param label    label to look up
+ * @return root label, which is never larger than 'label'
+ */
+static int findRoot(int* parent, int label)
+{
+  while (parent[label] != label)
+     {
+     parent[label] = parent[parent[label]];
+     label = parent[label];
+     }
+  return label;
+}
+
+/* Join the sets holding two provisional labels; the smaller
+ * root becomes the root of both
+ * @param parent   union-find parent of each label
+ * @param a        first label
+ * @param b        second label
+ */
+static void joinLabels(int* parent, int a, int b)
+{
+  int rootA = findRoot(parent,a);
+  int rootB = findRoot(parent,b);
+  if (rootA < rootB)
+     parent[rootB] = rootA;
+  else if (rootB < rootA)
+     parent[rootA] = rootB;
+}
+
+/* Find the runs of WHITE pixels in one row of an image
+ * @param pImage   image 
+ * @param y        row
+ * @param runs     array to fill in, large enough for (width+1)/2 runs
+ * @return number of runs found
+ */
+static int findRuns(BITIMAGE_T* pImage, int y, PIXEL_RUN_T* runs)
+{
+  BITWORD* row = &pImage->bits[(size_t) y * pImage->wordsPerRow];
+  int wordsPerRow = pImage->wordsPerRow;
+  int count = 0;
+  int x = 0;
+  while (x < pImage->width)
+     {
+     int w = x >> 6;
+     BITWORD word = row[w] & (~0ULL << (x & 63));
+     int start = 0;
+     while (word == 0)
+        {
+	if (++w >= wordsPerRow)
+	   return count;
+	word = row[w];
+        }
+     start = w*BITS_PER_WORD + __builtin_ctzll(word);
+     /* now look for the next background pixel */
+     word = ~row[w] & (~0ULL << (start & 63));
+     while ((word == 0) && (++w < wordsPerRow))
+        word = ~row[w];
+     if (word == 0)
+        x = pImage->width;
+     else
+        x = w*BITS_PER_WORD + __builtin_ctzll(word);
+     if (x > pImage->width)
+        x = pImage->width;
+     runs[count].start = start;
+     runs[count].end = x - 1;
+     count++;
+     }
+  return count;
+}
+
+/* Give each run of WHITE pixels a provisional label, storing it in
+ * the map for every pixel of the run, and join the labels of runs
+ * that touch (including diagonally) a run in the row above.
+ * @param pImage      Binary image
+ * @param pMap        Map whose labels are filled in, initially all -1
+ * @param pParent     Pointer to union-find parent array, allocated here
+ * @param pLabelCount Pointer to return the number of provisional labels
+ * @return TRUE if successful, FALSE if allocation failed
+ */
+static BOOL labelRuns(BITIMAGE_T* pImage, COMPONENT_MAP_T* pMap,
+		      int** pParent, int* pLabelCount)
+{
+  int width = pImage->width;
+  PIXEL_RUN_T* prevRuns = calloc(width/2 + 1,sizeof(PIXEL_RUN_T));
+  PIXEL_RUN_T* curRuns = calloc(width/2 + 1,sizeof(PIXEL_RUN_T));
+  int* parent = NULL;
+  int labelMax = 0;        /* allocated size of 'parent' */
+  int labelCount = 0;      /* one provisional label per run */
+  int prevCount = 0;
+  int y = 0;
+  BOOL bOk = ((prevRuns != NULL) && (curRuns != NULL));
+  for (y = 0; (bOk) && (y < pImage->height); y++)
+     {
+     int* labels = &pMap->labels[(size_t) y * width];
+     int curCount = findRuns(pImage,y,curRuns);
+     int j = 0;
+     int r = 0;
+     PIXEL_RUN_T* swap = NULL;
+     if (labelCount + curCount > labelMax)
+        {
+	int newMax = (labelMax > 0) ? labelMax * 2 : 4096;
+	int* newParent = NULL;
+	while (newMax < labelCount + curCount)
+	   newMax *= 2;
+	newParent = realloc(parent,newMax * sizeof(int));
+	if (newParent == NULL)
+	   {
+	   bOk = FALSE;
+	   break;
+	   }
+	parent = newParent;
+	labelMax = newMax;
+        }
+     for (r = 0; r < curCount; r++)
+        {
+	PIXEL_RUN_T* pRun = &curRuns[r];
+	int x = 0;
+	int k = 0;
+	pRun->label = labelCount;
+	parent[labelCount] = labelCount;
+	labelCount++;
+	while ((j < prevCount) && (prevRuns[j].end + 1 < pRun->start))
+	   j++;
+	for (k = j; (k < prevCount) && (prevRuns[k].start <= pRun->end + 1); k++)
+	   joinLabels(parent,prevRuns[k].label,pRun->label);
+	for (x = pRun->start; x <= pRun->end; x++)
+	   labels[x] = pRun->label;
+        }
+     swap = prevRuns;
+     prevRuns = curRuns;
+     curRuns = swap;
+     prevCount = curCount;
+     }
+  free(prevRuns);
+  free(curRuns);
+  *pParent = parent;
+  *pLabelCount = labelCount;
+  return bOk;
+}
+
+/* Label the eight-connected components of WHITE pixels in an image, 
+ * and count the pixels in each.
+ * @param pImage Binary image (set bits are road)
+ * @return newly allocated map or NULL if allocation failed
+ */
+COMPONENT_MAP_T* buildComponentMap(BITIMAGE_T* pImage)
+{
+  size_t pixels = (size_t) pImage->width * pImage->height;
+  size_t i = 0;
+  COMPONENT_MAP_T* pMap = calloc(1,sizeof(COMPONENT_MAP_T));
+  int* parent = NULL;      /* union-find parent of each provisional label */
+  int* component = NULL;   /* final component for each provisional label */
+  int labelCount = 0;
+  int label = 0;
+  BOOL bOk = FALSE;
+  if (pMap != NULL)
+     {
+     pMap->width = pImage->width;
+     pMap->height = pImage->height;
+     pMap->labels = malloc(pixels * sizeof(int));
+     }
+  if ((pMap != NULL) && (pMap->labels != NULL))
+     {
+     memset(pMap->labels,0xff,pixels * sizeof(int));  /* all -1 */
+     bOk = labelRuns(pImage,pMap,&parent,&labelCount);
+     }
+  if (bOk)
+     {
+     component = calloc(labelCount + 1,sizeof(int));
+     bOk = (component != NULL);
+     }
+  if (bOk)
+     {
+     /* number the components in order of their first pixel */
+     for (label = 0; label < labelCount; label++)
+        {
+	int root = findRoot(parent,label);
+	if (root == label)
+	   component[label] = pMap->count++;
+	else
+	   component[label] = component[root];
+        }
+     pMap->sizes = calloc(pMap->count + 1,sizeof(int));
+     bOk = (pMap->sizes != NULL);
+     }
+  if (bOk)
+     {
+     for (i = 0; i < pixels; i++)
+        {
+	if (pMap->labels[i] >= 0)
+	   {
+	   pMap->labels[i] = component[pMap->labels[i]];
+	   pMap->sizes[pMap->labels[i]]++;
+	   }
+        }
+     }
+  else
+     {
+     printf("Error allocating component map for %d x %d image\n",
+	    pImage->width,pImage->height);
+     freeComponentMap(pMap);
+     pMap = NULL;
+     }
+  free(component);
+  free(parent);
+  return pMap;
+}
+
+/* Free a map created by buildComponentMap
+ * @param pMap   Map to free (may be NULL)
+ */
+void freeComponentMap(COMPONENT_MAP_T* pMap)
+{
+  if (pMap != NULL)
+     {
+     free(pMap->labels);
+     free(pMap->sizes);
+     free(pMap);
+     }
+}
+
+/* Return the component that a pixel belongs to
+ * @param pMap   Map created by buildComponentMap
+ * @param x      Column
+ * @param y      Row
+ * @return component label, or -1 if the pixel is background
+ *         or outside the image
+ */
+int componentLabel(COMPONENT_MAP_T* pMap, int x, int y)
+{
+  if ((x < 0) || (x >= pMap->width) || (y < 0) || (y >= pMap->height))
+     return -1;
+  return pMap->labels[(size_t) y * pMap->width + x];
+}
+
+/* Return the number of pixels in the component a pixel belongs to
+ * @param pMap   Map created by buildComponentMap
+ * @param x      Column
+ * @param y      Row
+ * @return pixel count, or 0 if the pixel is background
+ *         or outside the image
+ */
+int componentSize(COMPONENT_MAP_T* pMap, int x, int y)
+{
+  int label = componentLabel(pMap,x,y);
+  return (label >= 0) ? pMap->sizes[label] : 0;
+}
+
+/* Erase the components with fewer than 'minPixels' pixels from an 
+ * image, so they cannot be matched. Their pixels are also removed 
+ * from the map.
+ * @param pImage     Image the map was built from
+ * @param pMap       Map created by buildComponentMap
+ * @param minPixels  Smallest component to keep
+ * @return number of components erased
+ */
+int removeSmallComponents(BITIMAGE_T* pImage, COMPONENT_MAP_T* pMap,
+			  int minPixels)
+{
+  int removed = 0;
+  int label = 0;
+  int x = 0;
+  int y = 0;
+  for (label = 0; label < pMap->count; label++)
+     {
+     if ((pMap->sizes[label] > 0) && (pMap->sizes[label] < minPixels))
+        removed++;
+     }
+  if (removed == 0)
+     return 0;
+  for (y = 0; y < pMap->height; y++)
+     {
+     int* labels = &pMap->labels[(size_t) y * pMap->width];
+     BITWORD* row = &pImage->bits[(size_t) y * pImage->wordsPerRow];
+     for (x = 0; x < pMap->width; x++)
+        {
+	if ((labels[x] >= 0) && (pMap->sizes[labels[x]] < minPixels))
+	   {
+	   row[x >> 6] &= ~(1ULL << (x & 63));
+	   labels[x] = -1;
+	   }
+        }
+     }
+  for (label = 0; label < pMap->count; label++)
+     {
+     if (pMap->sizes[label] < minPixels)
+        pMap->sizes[label] = 0;
+     }
+  return removed;
+}
@@ -0,0 +1,60 @@
+/* Header file for labelling the connected road regions of a
+ * binary image
+ * Include AFTER structures.h
+ *
+ * Copyright 2020 Sally E. Goldin
+ * 
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ * 
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+
+/* Label the eight-connected components of WHITE pixels in an image, 
+ * and count the pixels in each.
+ * @param pImage Binary image (set bits are road)
+ * @return newly allocated map or NULL if allocation failed
+ */
+COMPONENT_MAP_T* buildComponentMap(BITIMAGE_T* pImage);
+
+/* Free a map created by buildComponentMap
+ * @param pMap   Map to free (may be NULL)
+ */
+void freeComponentMap(COMPONENT_MAP_T* pMap);
+
+/* Return the component that a pixel belongs to
+ * @param pMap   Map created by buildComponentMap
+ * @param x      Column
+ * @param y      Row
+ * @return component label, or -1 if the pixel is background
+ *         or outside the image
+ */
+int componentLabel(COMPONENT_MAP_T* pMap, int x, int y);
+
+/* Return the number of pixels in the component a pixel belongs to
+ * @param pMap   Map created by buildComponentMap
+ * @param x      Column
+ * @param y      Row
+ * @return pixel count, or 0 if the pixel is background
+ *         or outside the image
+ */
+int componentSize(COMPONENT_MAP_T* pMap, int x, int y);
+
+/* Erase the components with fewer than 'minPixels' pixels from an 
+ * image, so they cannot be matched. Their pixels are also removed 
+ * from the map.
+ * @param pImage     Image the map was built from
+ * @param pMap       Map created by buildComponentMap
+ * @param minPixels  Smallest component to keep
+ * @return number of components erased
+ */
+int removeSmallComponents(BITIMAGE_T* pImage, COMPONENT_MAP_T* pMap,
+			  int minPixels);
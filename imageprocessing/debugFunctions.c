@@ -43,6 +43,7 @@
 #include <math.h>
 #include "structures.h"
 #include "debugFunctions.h"
+#include "logger.h"
 
 char * globalLogFile = NULL;
 
@@ -200,32 +201,24 @@ void writeFeatureWithNormals(FEATURE_T* pFeature,int featureId,FILE* pOut)
   ***/
 
 /* delete the old log file if any
- * and set new log file name 
+ * and start logging to the new file 
  * @param logfilename
  */
 void initLogging(char * logfilename)
 {
    unlink(logfilename);
    globalLogFile = logfilename;
+   logStart(logfilename);
 }
 
-/* Write a message to a log file 
- * Opens and closes the log file each time
- * to avoid problems with crashes.
- * Log file name is global to this module.
+/* Write a message to the log file at INFO level.
+ * The message is queued and written by the logger's
+ * background thread; see logger.c
  * @param   message    Message to write - adds a newline
  */
 void logMessage(char* message)
 {
-  FILE* pOut = NULL;
-  pOut = fopen(globalLogFile,"a");
-  if (pOut == NULL)
-     {
-     printf("Error trying to open log file %s\n", globalLogFile);
-     return;  /* not much we can do */
-     }
-  fprintf(pOut,"%s\n",message);
-  fclose(pOut);
+  LOGINFO("%s",message);
 }
 
 /* Traverse a linked list of points to count how many
@@ -49,15 +49,14 @@ void printList(POINT_T* pHead,int featureId,int pointCount);
 void writeFeatureWithNormals(FEATURE_T* pFeature,int featureId,FILE* pOut);
 
 /* delete the old log file if any
- * and set new log file name 
+ * and start logging to the new file 
  * @param logfilename
  */
 void initLogging(char * logfilename);
 
-/* Write a message to a log file 
- * Opens and closes the log file each time
- * to avoid problems with crashes.
- * Log file name is global to this module.
+/* Write a message to the log file at INFO level.
+ * The message is queued and written by the logger's
+ * background thread; see logger.c
  * @param   message    Message to write - adds a newline
  */
 void logMessage(char* message);
@@ -0,0 +1,201 @@
+/* Component of the vectorize application.
+ * Computes a map of the nearest road (WHITE) pixel for every pixel in
+ * the image, so that finding the closest match to a reference point
+ * is a table lookup rather than a search.
+ *
+ * Copyright 2020 Sally E. Goldin
+ * 
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ * 
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include "structures.h"
+#include "distanceTransform.h"
+
+/* larger than any squared distance inside an image */
+#define INFINITE_DIST 1.0e20
+
+/* Compute the exact Euclidean distance transform of a binary image,
+ * keeping, for every pixel, the location of the closest WHITE pixel.
+ * Uses the separable lower envelope algorithm of Felzenszwalb and
+ * Huttenlocher, so the cost is linear in the number of pixels.
+ * @param pImage Binary image (set bits are road)
+ * @return newly allocated map or NULL if allocation failed
+ */
+NEAREST_MAP_T* buildNearestMap(BITIMAGE_T* pImage)
+{
+  int width = pImage->width;
+  int height = pImage->height;
+  NEAREST_MAP_T* pMap = NULL;
+  int* columnRow = NULL;  /* row of closest WHITE pixel in same column */
+  double* f = NULL;       /* squared column distances along one row */
+  int* v = NULL;          /* locations of parabolas in the lower envelope */
+  double* z = NULL;       /* boundaries between parabolas */
+  int x = 0;
+  int y = 0;
+  int n = 0;
+
+  n = (width > height) ? width : height;
+  pMap = calloc(1,sizeof(NEAREST_MAP_T));
+  columnRow = calloc(width*height,sizeof(int));
+  f = calloc(n,sizeof(double));
+  v = calloc(n,sizeof(int));
+  z = calloc(n+1,sizeof(double));
+  if ((pMap == NULL) || (columnRow == NULL) || (f == NULL) || 
+      (v == NULL) || (z == NULL))
+     {
+     printf("Error allocating distance transform arrays\n");
+     free(pMap);
+     pMap = NULL;
+     }
+  else
+     {
+     pMap->nearest = calloc(width*height,sizeof(int));
+     pMap->distSquared = calloc(width*height,sizeof(int));
+     if ((pMap->nearest == NULL) || (pMap->distSquared == NULL))
+        {
+	printf("Error allocating nearest pixel map\n");
+	freeNearestMap(pMap);
+	pMap = NULL;
+        }
+     }
+  if (pMap != NULL)
+     {
+     pMap->width = width;
+     pMap->height = height;
+     /* pass 1 - closest WHITE pixel in the same column, 
+      * scanning down and then up 
+      */
+     for (x = 0; x < width; x++)
+        {
+	int last = -1;
+	for (y = 0; y < height; y++)
+	   {
+	   if (bitval(pImage,x,y))
+	      last = y;
+	   columnRow[y*width + x] = last;
+	   }
+	last = -1;
+	for (y = height - 1; y >= 0; y--)
+	   {
+	   int above = columnRow[y*width + x];
+	   if (bitval(pImage,x,y))
+	      last = y;
+	   if ((last >= 0) && 
+	       ((above < 0) || (last - y < y - above)))
+	      columnRow[y*width + x] = last;
+	   }
+        }
+     /* pass 2 - for each row, lower envelope of the parabolas
+      * (x - q)^2 + columnDistance(q)^2
+      */
+     for (y = 0; y < height; y++)
+        {
+	int k = 0;  /* index of rightmost parabola in the envelope */
+	int q = 0;
+	for (q = 0; q < width; q++)
+	   {
+	   int row = columnRow[y*width + q];
+	   f[q] = (row < 0) ? INFINITE_DIST : (double) (row - y)*(row - y);
+	   }
+	/* skip columns with no WHITE pixels at all */
+	for (q = 0; (q < width) && (f[q] >= INFINITE_DIST); q++)
+	   ;
+	if (q == width)
+	   {
+	   for (x = 0; x < width; x++)
+	      {
+	      pMap->nearest[y*width + x] = -1;
+	      pMap->distSquared[y*width + x] = -1;
+	      }
+	   continue;
+	   }
+	v[0] = q;
+	z[0] = -INFINITE_DIST;
+	z[1] = INFINITE_DIST;
+	for (q = q + 1; q < width; q++)
+	   {
+	   double s;
+	   if (f[q] >= INFINITE_DIST)
+	      continue;
+	   s = ((f[q] + (double) q*q) - (f[v[k]] + (double) v[k]*v[k]))
+	         / (2.0*q - 2.0*v[k]);
+	   while (s <= z[k])
+	      {
+	      k--;
+	      s = ((f[q] + (double) q*q) - (f[v[k]] + (double) v[k]*v[k]))
+		   / (2.0*q - 2.0*v[k]);
+	      }
+	   k++;
+	   v[k] = q;
+	   z[k] = s;
+	   z[k+1] = INFINITE_DIST;
+	   }
+	k = 0;
+	for (x = 0; x < width; x++)
+	   {
+	   int col;
+	   int row;
+	   while (z[k+1] < x)
+	      k++;
+	   col = v[k];
+	   row = columnRow[y*width + col];
+	   pMap->nearest[y*width + x] = row*width + col;
+	   pMap->distSquared[y*width + x] = (x - col)*(x - col) + (y - row)*(y - row);
+	   }
+        }
+     }
+  free(columnRow);
+  free(f);
+  free(v);
+  free(z);
+  return pMap;
+}
+
+/* Free a map created by buildNearestMap
+ * @param pMap   Map to free (may be NULL)
+ */
+void freeNearestMap(NEAREST_MAP_T* pMap)
+{
+  if (pMap != NULL)
+     {
+     free(pMap->nearest);
+     free(pMap->distSquared);
+     free(pMap);
+     }
+}
+
+/* Look up the closest WHITE pixel to x,y.
+ * @param pMap   Map created by buildNearestMap
+ * @param x      Column, must be inside the image
+ * @param y      Row, must be inside the image
+ * @param pX     Pointer to return column of the nearest WHITE pixel
+ * @param pY     Pointer to return row of the nearest WHITE pixel
+ * @param pDist  Pointer to return the Euclidean distance in pixels
+ * @return TRUE if found, FALSE if the image has no WHITE pixels
+ */
+BOOL nearestWhitePixel(NEAREST_MAP_T* pMap, int x, int y,
+		       int* pX, int* pY, double* pDist)
+{
+  int index = pMap->nearest[y*pMap->width + x];
+  if (index < 0)
+     return FALSE;
+  *pX = index % pMap->width;
+  *pY = index / pMap->width;
+  *pDist = sqrt((double) pMap->distSquared[y*pMap->width + x]);
+  return TRUE;
+}
@@ -0,0 +1,45 @@
+/* Header file with definitions of functions related
+ * to the nearest road pixel map (distance transform)
+ * Include AFTER structures.h
+ *
+ * Copyright 2020 Sally E. Goldin
+ * 
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ * 
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+
+/* Compute the exact Euclidean distance transform of a binary image,
+ * keeping, for every pixel, the location of the closest WHITE pixel.
+ * Uses the separable lower envelope algorithm of Felzenszwalb and
+ * Huttenlocher, so the cost is linear in the number of pixels.
+ * @param pImage Binary image (set bits are road)
+ * @return newly allocated map or NULL if allocation failed
+ */
+NEAREST_MAP_T* buildNearestMap(BITIMAGE_T* pImage);
+
+/* Free a map created by buildNearestMap
+ * @param pMap   Map to free (may be NULL)
+ */
+void freeNearestMap(NEAREST_MAP_T* pMap);
+
+/* Look up the closest WHITE pixel to x,y.
+ * @param pMap   Map created by buildNearestMap
+ * @param x      Column, must be inside the image
+ * @param y      Row, must be inside the image
+ * @param pX     Pointer to return column of the nearest WHITE pixel
+ * @param pY     Pointer to return row of the nearest WHITE pixel
+ * @param pDist  Pointer to return the Euclidean distance in pixels
+ * @return TRUE if found, FALSE if the image has no WHITE pixels
+ */
+BOOL nearestWhitePixel(NEAREST_MAP_T* pMap, int x, int y,
+		       int* pX, int* pY, double* pDist);
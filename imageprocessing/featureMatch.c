@@ -0,0 +1,837 @@
+/* 
+ *  featureMatch.c
+ *
+ *  Matching of reference features against a binary road image, and
+ *  writing of the matched features as SQL or COPY rows. Split out
+ *  of guidedVectorize.c so that the benchmark program (vectorizeBench)
+ *  can drive exactly the code the vectorizer uses. Everything that
+ *  belongs to one job is in its MAPEVAL_JOB_T.
+ *
+ *  Copyright 2020 Sally E. Goldin
+ * 
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ * 
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <pthread.h>
+
+#include "structures.h"
+#include "fileFunctions.h"
+#include "bitImage.h"
+#include "distanceTransform.h"
+#include "componentMap.h"
+#include "polyline.h"
+#include "pointArena.h"
+#include "paramReader.h"
+#include "outputBuffer.h"
+#include "logger.h"
+#include "instrument.h"
+#include "lineCompare.h"
+#include "transform.h"
+#include "featureMatch.h"
+
+char * directionLabels[] = {"N","NE","E","SE","S","SW","W","NW"};
+
+/* pixels examined by the searches in this thread, for instrumentation */
+static __thread long long threadProbes = 0;
+
+
+/* Calculate the mean distance between exp points and the ref points
+ * based on the match distances stored in the polyline, and the standard
+ * deviation. 
+ * @param pLine     Experimental feature
+ * @param pStdev    Pointer for returning the standard deviation
+ * Returns the mean distance as the function value
+ */
+double calculateFit(POLYLINE_T* pLine,double* pStdev)
+{
+  int count = pLine->count;
+  double sumDistance = 0.0;
+  double sumSquares = 0.0;
+  double mean = 0;
+  double* distance = pLine->matchdistance;
+  int i = 0;
+  for (i = 0; i < count; i++)
+    {
+    sumDistance += distance[i];
+    sumSquares += (distance[i] * distance[i]);
+    }
+  mean = sumDistance/count;
+  *pStdev = sqrt((sumSquares/count - mean*mean)/(count-1));
+  return mean;
+}
+
+/* Write a feature to the SQL output file, as an insert command
+ * @param pLine        Experimental feature
+ * @param pMeters      Points of the feature in meters
+ * @param experimentId Numeric Id of this experimental comparison
+ * @param refFeatureId Numeric Id of corresponding reference feature
+ * @param dataId       QueryDataId
+ * @param refPoints    Number of points in reference feature
+ * @param matchpercent What percent of ref features points were found?
+ * @param cellsize     Size of one cell in meters
+ * @param pOut         File pointer for open text file.
+ */
+void writeSqlFeature(POLYLINE_T* pLine,COORD_LIST_T* pMeters,int experimentId, int refFeatureId,int dataId, int refPoints, double matchpercent, double cellsize, OUTBUF_T* pOut)
+{
+    int i = 0;
+    double meandistance;
+    double stdevdistance;
+    meandistance = calculateFit(pLine,&stdevdistance);
+    meandistance *= cellsize;  /* change to meters */
+    stdevdistance *= cellsize; 
+
+    outBufPrintf(pOut,"INSERT INTO QUERYLINES (experimentid,dataid,uploadfeatureid,refpointcount,matchpercent,meandistance,stdevdistance,geom) VALUES (%d, %d, %d, %d, %.2lf, %.2lf, %.2lf, ST_GeomFromText('LINESTRING(",
+		 experimentId,dataId,refFeatureId,refPoints,matchpercent,meandistance,stdevdistance);
+    for (i = 0; i < pMeters->count; i++)
+      {
+      if (i > 0)
+	 {
+	 outBufString(pOut,", ");
+	 }
+      outBufFixed(pOut,pMeters->xy[2*i],6);
+      outBufChar(pOut,' ');
+      outBufFixed(pOut,pMeters->xy[2*i + 1],6);
+      }
+    // Should be Web Mercator, not lat long
+    outBufString(pOut,")',3857));\n");
+}
+
+/* Write one double for a COPY text row. Not-a-number, which
+ * a feature with all points at the same distance can give as its 
+ * standard deviation, is written in the form PostgreSQL accepts.
+ * @param value   value to write, rounded to two decimal places
+ * @param pOut    Buffered output file
+ */
+void writeCopyDouble(double value, OUTBUF_T* pOut)
+{
+  if (isnan(value))
+     outBufString(pOut,"NaN");
+  else
+     outBufFixed(pOut,value,2);
+}
+
+/* Write a feature to the COPY output file, as one tab separated row
+ * for the columns
+ *   experimentid dataid uploadfeatureid refpointcount matchpercent 
+ *   meandistance stdevdistance geom
+ * The geometry is hex EWKB: a little endian LINESTRING with SRID 3857.
+ * @param pLine        Experimental feature
+ * @param pMeters      Points of the feature in meters
+ * @param experimentId Numeric Id of this experimental comparison
+ * @param refFeatureId Numeric Id of corresponding reference feature
+ * @param dataId       QueryDataId
+ * @param refPoints    Number of points in reference feature
+ * @param matchpercent What percent of ref features points were found?
+ * @param cellsize     Size of one cell in meters
+ * @param pOut         File pointer for open text file.
+ */
+void writeCopyFeature(POLYLINE_T* pLine,COORD_LIST_T* pMeters,int experimentId, int refFeatureId,int dataId, int refPoints, double matchpercent, double cellsize, OUTBUF_T* pOut)
+{
+    static char hexDigits[] = "0123456789ABCDEF";
+    unsigned char bytes[16];
+    char hex[33];
+    int i = 0;
+    int j = 0;
+    double meandistance;
+    double stdevdistance;
+    meandistance = calculateFit(pLine,&stdevdistance);
+    meandistance *= cellsize;  /* change to meters */
+    stdevdistance *= cellsize; 
+
+    outBufInt(pOut,experimentId);
+    outBufChar(pOut,'\t');
+    outBufInt(pOut,dataId);
+    outBufChar(pOut,'\t');
+    outBufInt(pOut,refFeatureId);
+    outBufChar(pOut,'\t');
+    outBufInt(pOut,refPoints);
+    outBufChar(pOut,'\t');
+    outBufFixed(pOut,matchpercent,2);
+    outBufChar(pOut,'\t');
+    writeCopyDouble(meandistance,pOut);
+    outBufChar(pOut,'\t');
+    writeCopyDouble(stdevdistance,pOut);
+    outBufChar(pOut,'\t');
+    /* byte order, type with SRID flag, SRID, number of points */
+    bytes[0] = 1;
+    putLittleInt(bytes + 1,0x20000002);
+    putLittleInt(bytes + 5,3857);
+    putLittleInt(bytes + 9,pMeters->count);
+    for (j = 0; j < 13; j++)
+      {
+      hex[2*j] = hexDigits[bytes[j] >> 4];
+      hex[2*j + 1] = hexDigits[bytes[j] & 0xF];
+      }
+    outBufWrite(pOut,hex,26);
+    for (i = 0; i < pMeters->count; i++)
+      {
+      putLittleDouble(bytes,pMeters->xy[2*i]);
+      putLittleDouble(bytes + 8,pMeters->xy[2*i + 1]);
+      for (j = 0; j < 16; j++)
+	{
+	hex[2*j] = hexDigits[bytes[j] >> 4];
+	hex[2*j + 1] = hexDigits[bytes[j] & 0xF];
+	}
+      outBufWrite(pOut,hex,32);
+      }
+    outBufChar(pOut,'\n');
+}
+
+/* calculate the Euclidean distance between two points (in pixels).
+ * @param p1    First point
+ * @param p2    Second point
+ * @return distance
+ */
+double calculateDistance(POINT_T * p1, POINT_T * p2)
+{
+  double dist =  (p1->x - p2->x)*(p1->x - p2->x) + (p1->y - p2->y)*(p1->y - p2->y);
+  return sqrt(dist);
+}
+
+
+/* Compare two values. Return 1 if val1 > val2,
+ * -1 if val1 < val2, 0 if they are the same
+ */
+int signDiff(int val1, int val2)
+{
+  int result = 0;
+  if (val1 > val2)
+    result = 1;
+  else if (val1 < val1)
+    result = -1;
+  return result;
+}
+
+/* clear terminal and reset to row 0, column 0
+ */
+void toTop()
+{
+  char clearScreen[] = {0x1B,'[','2','J',0};
+  printf("%s",clearScreen);
+
+}
+
+/* Use character graphics to display the contents of a neighborhood
+ * around a pixel location, and optionally the current to be examined
+ * pixel.
+ * @param pImage Binary image data
+ * @param centerx   Center pixel x
+ * @param centery   Center pixel y
+ * @param tolerance Radius of neighborhood
+ * @param x  If >= 0, mark as current pixel
+ * @param y  If >= 0, mark as current pixel
+ */
+void showNeighborhood(BITIMAGE_T* pImage,
+		      int centerx, int centery, int tolerance, int x, int y)
+{
+  int r=0;  /* row counter */
+  int c=0;  /* column counter */
+  int curx;
+  int cury; 
+  int bShow = 0;
+  char buffer[32];
+  if ((x >= 0) && (y >= 0))
+    {
+    curx = x - centerx;
+    cury = y - centery;
+    bShow = 1;
+    printf("x=%d, curx=%d, y=%d, cury=%d\n",x,curx,y,cury);
+    }
+  for (r = -tolerance; r <= tolerance; r++)
+    {
+    printf("\n");
+    for (c = -tolerance; c <= tolerance; c++)
+      {
+      int xcoord = centerx + c;
+      int ycoord = centery + r;
+      if ((xcoord < 0) || (xcoord >= pImage->width) ||
+	  (ycoord < 0) || (ycoord >= pImage->height))
+	continue;
+      if ((r == 0) && (c == 0))
+	  {
+	  if (bitval(pImage,xcoord,ycoord))
+	      printf("X");
+	  else
+	      printf("O");
+	  }
+      else if (bShow && (r == cury) && (c == curx))
+	  {
+	  if (bitval(pImage,xcoord,ycoord))
+	      printf("*");
+	  else
+	      printf("o");
+	  }
+      else
+	  {
+	  if (bitval(pImage,xcoord,ycoord))
+	      printf("+");
+	  else
+	      printf(" ");
+	  }
+      }
+    }
+    printf("\nType Return to continue\n");
+    fgets(buffer,sizeof(buffer),stdin);
+    toTop();
+}
+
+
+/* Search outward from refx,refy, ring by ring, for a WHITE pixel.
+ * Returns the first WHITE pixel found on the smallest ring
+ * that has one. Must be within 'tolerance' pixels (in x and y).
+ * The smallest ring is found by scanning rows of the window a word
+ * at a time; only that ring is then examined pixel by pixel, in the
+ * order N, NE, E, SE, S, SW, W, NW, so the pixel chosen is the same
+ * as checking every ring in that order.
+ * @param pImage Binary image data
+ * @param refx   Reference point x
+ * @param refy   Reference point y
+ * @param tolerance Radius of region to search 
+ * @param pX     Pointer to return x of pixel found
+ * @param pY     Pointer to return y of pixel found
+ * @return TRUE if found, else FALSE
+ */
+BOOL spiralSearch(BITIMAGE_T* pImage, int refx, int refy, int tolerance,
+		  int* pX, int* pY)
+{
+    int bFound = 0;     /* flag telling us we've found a white pixel */
+    int xFound = -1;  /* coordinates of points found */
+    int yFound = -1;
+    int width = pImage->width;
+    int height = pImage->height;
+    int i = 0;
+    int j = 0;
+    int stepsX[] = {0,1,1,1,0,-1,-1,-1};    /* N, NE, E, SE, S, SW, W, NW */
+    int stepsY[] = {-1,-1,0,1,1,1,0,-1};    /* N, NE, E, SE, S, SW, W, NW */
+    int nextX[] = {1,0,0,-1,-1,0,0,1};
+    int nextY[] = {0,1,1,0,0,-1,-1,0};
+    int radius = tolerance + 1;  /* smallest ring with a WHITE pixel */
+    int dy = 0;
+    long probes = 1;    /* pixels examined, for instrumentation */
+    /* First examine the exact same location in the image! */
+    if ((refx >= 0) && (refx < width) && (refy >= 0) && (refy < height) &&
+	(bitval(pImage,refx,refy)))
+      {
+      xFound = refx;
+      yFound = refy;
+      bFound = 1;
+      }
+    /* Find the smallest ring holding a WHITE pixel. In each row, 
+     * the pixel closest to refx has the smallest ring radius.
+     * Rows further than the best radius so far cannot improve it.
+     */
+    for (dy = 0; (!bFound) && (dy < radius); dy++)
+      {
+      int side;
+      for (side = -1; side <= 1; side += 2)
+	{
+	int y = refy + side*dy;
+	int right = findFirstSet(pImage,y,refx,refx + radius - 1);
+	int left = findLastSet(pImage,y,refx - radius + 1,refx);
+	int dx = radius;
+	probes += 2*radius - 1;
+	if ((right >= 0) && (right - refx < dx))
+	  dx = right - refx;
+	if ((left >= 0) && (refx - left < dx))
+	  dx = refx - left;
+	if (dx < radius)
+	  radius = (dx > dy) ? dx : dy;
+	if (dy == 0)
+	  break;
+	}
+      }
+    /* Examine that ring in the original search order */
+    if ((!bFound) && (radius <= tolerance))
+      {
+      int dirX =0;
+      int dirY =0;
+      int baseIncX = 0;
+      int baseIncY = 0;
+      int incrementX = 0;
+      int incrementY = 0;
+      for (i = 0; (i < 8) && (!bFound); i++)
+	{  
+	dirX = stepsX[i];
+	dirY = stepsY[i];
+	baseIncX = dirX * radius; 
+	baseIncY = dirY * radius; 
+	for (j = 0; (j < radius) && (!bFound); j++)
+	  {
+	  incrementX = baseIncX + nextX[i]*j;
+	  incrementY = baseIncY + nextY[i]*j;
+          if ((refx + incrementX < 0) || 
+	      (refx + incrementX >= width) ||
+	      (refy + incrementY < 0) || 
+	      (refy + incrementY >= height))
+	    continue; 
+	  //showNeighborhood(pImage,refx,refy,tolerance,refx+incrementX,refy+incrementY);
+	  probes++;
+	  if (bitval(pImage,(refx+incrementX),(refy+incrementY)))
+	      {
+	      xFound = refx+incrementX;
+	      yFound = refy+incrementY;
+	      bFound = 1;
+	      }
+          } /* end j loop */
+	}   /* end i loop */
+      }
+    *pX = xFound;
+    *pY = yFound;
+    if (bInstrument)
+      threadProbes += probes;
+    return bFound;
+}
+
+/* Find the closest WHITE pixel to refx,refy using the nearest pixel
+ * map. To keep the same search window as spiralSearch, the pixel
+ * must be within 'tolerance' pixels in both x and y. If the closest
+ * pixel is outside that window but near enough that another pixel
+ * could be inside it (beyond a corner), or the reference point is
+ * outside the image, spiralSearch chooses the pixel instead.
+ * @param pMap   Nearest pixel map built from pImage
+ * @param pImage Binary image data
+ * @param refx   Reference point x
+ * @param refy   Reference point y
+ * @param tolerance Radius of region to search 
+ * @param pX     Pointer to return x of pixel found
+ * @param pY     Pointer to return y of pixel found
+ * @return TRUE if found, else FALSE
+ */
+BOOL nearestSearch(NEAREST_MAP_T* pMap, BITIMAGE_T* pImage, int refx, int refy, int tolerance,
+		   int* pX, int* pY)
+{
+    BOOL bFound = FALSE;
+    double distance;
+    if ((refx < 0) || (refx >= pImage->width) || 
+	(refy < 0) || (refy >= pImage->height))
+      return spiralSearch(pImage,refx,refy,tolerance,pX,pY);
+    if (bInstrument)
+      threadProbes++;
+    if (nearestWhitePixel(pMap,refx,refy,pX,pY,&distance))
+      {
+      bFound = ((abs(*pX - refx) <= tolerance) && 
+		(abs(*pY - refy) <= tolerance));
+      /* squared distances are whole numbers */
+      if ((!bFound) && 
+	  (distance * distance <= 2.0 * tolerance * tolerance + 0.5))
+	return spiralSearch(pImage,refx,refy,tolerance,pX,pY);
+      }
+    if (!bFound)
+      *pX = *pY = -1;
+    return bFound;
+}
+
+/* Run both searches for the same point, tally how the
+ * results compare, and log any disagreements.
+ * The spiral search result is returned, so output does not change.
+ * Arguments as for spiralSearch.
+ * @param pJob   Job holding the nearest pixel map and the tallies
+ * @return TRUE if found by the spiral search, else FALSE
+ */
+BOOL checkSearch(MAPEVAL_JOB_T* pJob, BITIMAGE_T* pImage, int refx, int refy,
+		 int tolerance, int* pX, int* pY)
+{
+    int xNear, yNear;
+    CHECK_STATS_T* pStats = &pJob->checkStats;
+    BOOL bSpiral = spiralSearch(pImage,refx,refy,tolerance,pX,pY);
+    BOOL bNear = nearestSearch(pJob->nearestMap,pImage,refx,refy,tolerance,
+			       &xNear,&yNear);
+    pthread_mutex_lock(&pJob->checkStatsLock);
+    pStats->lookups++;
+    if (bSpiral && bNear)
+      {
+      if ((*pX == xNear) && (*pY == yNear))
+	{
+	pStats->same++;
+	}
+      else
+	{
+	double spiralDist = sqrt((double) (*pX-refx)*(*pX-refx) + (*pY-refy)*(*pY-refy));
+	double nearDist = sqrt((double) (xNear-refx)*(xNear-refx) + (yNear-refy)*(yNear-refy));
+	if (nearDist < spiralDist)
+	  {
+	  pStats->closer++;
+	  pStats->totalGain += spiralDist - nearDist;
+	  }
+	else if (nearDist > spiralDist)
+	  {
+	  pStats->farther++;
+	  }
+	else 
+	  {
+	  pStats->tied++;
+	  }
+	LOGTRACE("CHECK (%d,%d): spiral (%d,%d) %.3lf  nearest (%d,%d) %.3lf",
+		 refx,refy,*pX,*pY,spiralDist,xNear,yNear,nearDist);
+	}
+      }
+    else if (bSpiral)
+      {
+      pStats->spiralOnly++;
+      LOGTRACE("CHECK (%d,%d): found (%d,%d) by spiral search only",refx,refy,*pX,*pY);
+      }
+    else if (bNear)
+      {
+      pStats->nearestOnly++;
+      LOGTRACE("CHECK (%d,%d): found (%d,%d) by nearest lookup only",refx,refy,xNear,yNear);
+      }
+    else
+      {
+      pStats->neither++;
+      }
+    pthread_mutex_unlock(&pJob->checkStatsLock);
+    return bSpiral;
+}
+
+/* Print the summary of a search comparison (-checknearest) 
+ * @param pJob      Job whose searches were compared
+ * @param jobName   Identifies the job, for batch runs
+ */
+void printCheckStats(MAPEVAL_JOB_T* pJob, char* jobName)
+{
+  CHECK_STATS_T* pStats = &pJob->checkStats;
+  printf("%s: %ld lookups; same pixel %ld; different pixel, nearest closer %ld (mean gain %.3lf pixels), ",
+	 jobName,pStats->lookups,pStats->same,pStats->closer,
+	 (pStats->closer > 0) ? pStats->totalGain/pStats->closer : 0.0);
+  printf("equal distance %ld, farther %ld; found only by spiral %ld, only by nearest %ld; not found %ld\n",
+	 pStats->tied,pStats->farther,pStats->spiralOnly,pStats->nearestOnly,
+	 pStats->neither);
+}
+
+/* Look for a WHITE pixel matching refx,refy using the search method
+ * selected by the job's 'searchMode' option.
+ * @param pJob   Job being matched
+ * @param pImage Binary image data
+ * @param refx   Reference point x
+ * @param refy   Reference point y
+ * @param tolerance Radius of region to search 
+ * @param pX     Pointer to return x of pixel found
+ * @param pY     Pointer to return y of pixel found
+ * @return TRUE if found, else FALSE
+ */
+BOOL searchPoint(MAPEVAL_JOB_T* pJob, BITIMAGE_T* pImage, int refx, int refy,
+		 int tolerance, int* pX, int* pY)
+{
+    if (pJob->options.searchMode == SEARCH_NEAREST)
+      return nearestSearch(pJob->nearestMap,pImage,refx,refy,tolerance,pX,pY);
+    else if (pJob->options.searchMode == SEARCH_CHECK)
+      return checkSearch(pJob,pImage,refx,refy,tolerance,pX,pY);
+    else
+      return spiralSearch(pImage,refx,refy,tolerance,pX,pY);
+}
+
+/* Return the number of pixels examined by searches in the calling
+ * thread so far; only counted if instrumentation is on.
+ */
+long long searchProbeCount()
+{
+    return threadProbes;
+}
+
+/* Look for match to point refx,refy, starting at the same pixel
+ * and looking in the neighborhood.
+ * Must be within 'tolerance' pixels 
+ * If found add that point to the end of the matched polyline.
+ * The job's 'searchMode' option selects the original spiral search,
+ * the nearest pixel lookup, or a comparison of the two.
+ * @param pJob   Job being matched
+ * @param pImage Binary image data
+ * @param refx   Reference feature start x
+ * @param refy   Reference feature start y
+ * @param tolerance Radius of region to search for the starting point
+ * @param direction Preferred direction for searching: 0 = N, 1 = NE, 2 = E, etc.
+ *               Based on direction between last ref point and last target point
+ *               -1 if no information (or the last ref and last target were the same)
+ * @param pLine     Matched polyline; the point found is appended, 
+ *                  with its distance from the reference point
+ * @return TRUE if a point was found, FALSE if can't find
+ */
+BOOL findPoint(MAPEVAL_JOB_T* pJob, BITIMAGE_T* pImage,
+	       int refx, int refy, int tolerance, int direction,
+	       POLYLINE_T* pLine)
+{
+    BOOL bFound = FALSE; 
+    int xFound = -1;  /* coordinates of points found */
+    int yFound = -1;
+    LOGTRACE("Looking for point at (%d,%d) direction %s",refx,refy,directionLabels[direction]);
+    //printf(message);
+    //showNeighborhood(pImage,refx,refy,tolerance,-1,-1);
+    bFound = searchPoint(pJob,pImage,refx,refy,tolerance,&xFound,&yFound);
+    if (bFound)
+      {
+      LOGTRACE("--- FOUND at (%d,%d)",xFound,yFound);
+
+      appendPolylinePoint(pLine,xFound,yFound,
+			  sqrt((double) ((refx - xFound)*(refx - xFound) +
+					 (refy - yFound)*(refy - yFound))));
+      }
+
+    return bFound;
+}
+
+/* Try to match reference feature points to white pixels in the
+ * image. We check the start and end of each line segment in
+ * the reference feature against the image, subject to the tolerance
+ * radius. If we find a match and the job's 'componentMap' is set, we
+ * check that it is in the same connected road region as the last point.
+ * @param pJob       Job being matched
+ * @param pRef       Reference feature
+ * @param pLine      Experimental feature, already holding the 
+ *                   match for the first reference point; 
+ *                   this function adds the rest
+ * @param pImage Binary image data
+ * @param tolerance Radius of point search in pixels
+ * @return number of points in the experimental feature
+ */
+int followReferenceFeature(MAPEVAL_JOB_T* pJob, POLYLINE_T* pRef,
+			   POLYLINE_T* pLine, BITIMAGE_T* pImage, int tolerance)
+{
+  COMPONENT_MAP_T* componentMap = pJob->componentMap;
+  int i = 0;
+  int direction = 0;
+  for (i = 1; i < pRef->count; i++)
+    {
+    int last = pLine->count - 1;   /* last point found */
+    direction = calculateDirection(pRef->x[i-1],pRef->y[i-1],
+				   pLine->x[last],pLine->y[last]);
+    if (!findPoint(pJob,pImage,pRef->x[i],pRef->y[i],tolerance,direction,pLine))
+       break; /* no next point */
+    /* check connectivity between this point and the last one */
+    if ((componentMap != NULL) && 
+	(componentLabel(componentMap,pLine->x[last],pLine->y[last]) !=
+	 componentLabel(componentMap,pLine->x[last+1],pLine->y[last+1])))
+       {
+       LOGTRACE("--- (%d,%d) is not connected to (%d,%d)",pLine->x[last+1],
+		pLine->y[last+1],pLine->x[last],pLine->y[last]);
+       pLine->count--;  
+       break; /* next point is on a different road */
+       }
+    }   
+  return pLine->count;
+}
+
+/* Free the linked list for the latest feature 
+ * @param pPHead   Pointer to pointer to the head
+ * @param pPTail   Pointer to pointer to the tail
+ */
+void freePointList(POINT_T** pPHead, POINT_T** pPTail)
+{
+    POINT_T* pCurrent = *pPHead;
+    POINT_T* pRemove = NULL;
+    while (pCurrent != NULL)
+      {
+      pRemove = pCurrent;
+      pCurrent = pCurrent->next;
+      free(pRemove);
+      }
+   *pPHead = *pPTail = NULL;
+}
+
+ 
+
+
+/* Given start and end coordinates of a line segment, determine
+ * the predominant direction as follows:
+ *  N = 0, NE = 1, E = 2, SE = 3, S = 4, SW = 5, W = 6, NW = 7
+ * Note the origin is at the upper left
+ * @param  x1     X coord of line segment start
+ * @param  x1     X coord of line segment start
+ * @param  x1     X coord of line segment start
+ * @param  x1     X coord of line segment start
+ * @return direction constant according to the scheme above. 
+ */ 
+int calculateDirection(int x1, int y1, int x2, int y2)
+{
+  int direction = 0;
+  if (x1 == x2)
+     {
+     if (y2 > y1)
+       direction = 4;  /* s */
+     else 
+       direction = 0;  /* n */
+     }
+  else if (y1 == y2) /* horizontal */
+     {
+     if (x2 > x1)
+       direction = 2; /* e */
+     else 
+       direction = 6; /* w */
+     }
+  else if (x2 > x1)
+     {
+     if (y2 > y1)
+       direction = 3; /* se */
+     else 
+       direction = 1; /* ne */
+     }
+  else
+     {
+     if (y2 > y1)
+       direction = 5; /* sw */
+     else 
+       direction = 7; /* nw */
+     }
+  return direction; 
+}
+
+/* Match one reference feature against the image: find the start
+ * point, then follow the rest of the reference feature.
+ * Uses only the image and the reference points, so different 
+ * features can be matched at the same time by different threads.
+ * @param pJob       Job being matched
+ * @param pMatch     Feature to match; results are stored here
+ * @param pImage     Binary image data
+ * @param tolerance  Radius of point search in pixels
+ */
+void matchFeature(MAPEVAL_JOB_T* pJob, FEATURE_MATCH_T* pMatch,
+		  BITIMAGE_T* pImage, int tolerance)
+{
+  POLYLINE_T* pRef = &pMatch->ref;
+  int startCol = pRef->x[0];
+  int startRow = pRef->y[0];
+  int direction = 0;
+  long long startProbes = threadProbes;
+  if (pRef->count > 1)
+     direction = calculateDirection(pRef->x[0],pRef->y[0],pRef->x[1],pRef->y[1]);
+  /* at most one matched point per reference point */
+  reservePolyline(&pMatch->line,pRef->count);
+  LOGDEBUG("NEW FEATURE %d READ - START AT (%d,%d) with %d points",
+	   pMatch->refFeatureId,startCol,startRow,pRef->count);
+  if (findPoint(pJob,pImage,startCol,startRow,tolerance,direction,&pMatch->line))
+     {
+     followReferenceFeature(pJob,pRef,&pMatch->line,pImage,tolerance);
+     //resetImage(image,pHead); /* set back to WHITE */
+     }
+  pMatch->probes = threadProbes - startProbes;
+}
+
+/* Set up an empty FEATURE_MATCH_T whose lists are held in its 
+ * own arena. Each thread matching features must use its own.
+ * @param pMatch     structure to initialize
+ */
+void initFeatureMatch(FEATURE_MATCH_T* pMatch)
+{
+  memset(pMatch,0,sizeof(FEATURE_MATCH_T));
+  initPointArena(&pMatch->arena);
+  initArenaPolyline(&pMatch->ref,&pMatch->arena);
+  initArenaPolyline(&pMatch->line,&pMatch->arena);
+  initArenaCoordList(&pMatch->refMeters,&pMatch->arena);
+  initArenaCoordList(&pMatch->lineMeters,&pMatch->arena);
+}
+
+/* Empty all the lists of a feature at once by resetting their arena
+ * @param pMatch     feature that has been written
+ */
+static void resetFeatureMatch(FEATURE_MATCH_T* pMatch)
+{
+  resetPointArena(&pMatch->arena);
+  initArenaPolyline(&pMatch->ref,&pMatch->arena);
+  initArenaPolyline(&pMatch->line,&pMatch->arena);
+  initArenaCoordList(&pMatch->refMeters,&pMatch->arena);
+  initArenaCoordList(&pMatch->lineMeters,&pMatch->arena);
+}
+
+/* Write the results of matching one feature to the job's output
+ * files, and compare it with the reference if the job's 'lineCompare'
+ * is set, then empty its lists.
+ * @param pJob          Job being matched, with its output files open
+ * @param pMatch        Feature that has been matched
+ * @param pFeatureCount Pointer to count of features written so far; 
+ *                      used as the vector feature Id, and updated
+ */
+void writeFeatureMatch(MAPEVAL_JOB_T* pJob, FEATURE_MATCH_T* pMatch,
+		       int* pFeatureCount)
+{
+  OUTBUF_T* pOut = pJob->pOut;
+  OUTBUF_T* pSql = pJob->pSql;
+  int expId = pJob->expId;
+  int dataId = pJob->dataId;
+  int color = 50; /* for Dragon vector file*/
+  int refFeatureId = pMatch->refFeatureId;
+  int refPoints = pMatch->ref.count;
+  int pointCount = pMatch->line.count;
+  INSTR_COUNT("pixels_probed",pMatch->probes);
+  INSTR_COUNT("vertices_matched",pointCount);
+  INSTR_COUNT("vertices_missed",refPoints - pointCount);
+  /* the whole line is converted at once, for the comparison and output */
+  reserveCoordList(&pMatch->lineMeters,pointCount);
+  pixelsToWorld(&pJob->georef,pMatch->line.x,pMatch->line.y,pointCount,
+		pMatch->lineMeters.xy);
+  pMatch->lineMeters.count = pointCount;
+  if (pJob->lineCompare != NULL)
+     {
+     compareFeature(pJob->lineCompare,refFeatureId,&pMatch->refMeters,
+		    &pMatch->lineMeters);
+     }
+  if (pointCount > 0)
+     {
+     if (pointCount > 1)
+        {
+	LOGDEBUG("  Wrote matching feature with %d out of %d points",
+		 pointCount,refPoints);
+
+	writeFeature(&pMatch->line,*pFeatureCount,pOut,color);
+	if (pJob->options.bCopyOutput)
+	   writeCopyFeature(&pMatch->line,&pMatch->lineMeters,expId,refFeatureId,dataId,refPoints,
+			    (pointCount * 100.0)/refPoints,pJob->cellsize,pSql);
+	else
+	   writeSqlFeature(&pMatch->line,&pMatch->lineMeters,expId,refFeatureId,dataId,refPoints,
+			   (pointCount * 100.0)/refPoints,pJob->cellsize,pSql);
+	//markRoadPixels(imgCopy,width,height,pHead);
+	(*pFeatureCount)++;
+	INSTR_COUNT("features_written",1);
+	}
+     else
+        {
+	int i = 0;
+	LOGDEBUG("  Only one point found for reference line %d - ref points follow:", refFeatureId);
+	INSTR_COUNT("features_one_point",1);
+	for (i = 0; i < refPoints; i++)
+	  {
+	  LOGTRACE("     (%d, %d)", pMatch->ref.x[i], pMatch->ref.y[i]);
+	  }
+	}
+     }
+  else
+     {
+     /* write message as comment to dragon vector file */
+     LOGDEBUG("  No start point found for reference line %d", refFeatureId);
+     INSTR_COUNT("features_no_start",1);
+     outBufPrintf(pOut,"#No start point found for reference line %d\n", refFeatureId);
+     }
+  resetFeatureMatch(pMatch);
+}
+
+/* Add the memory used by a feature's arena to the job totals,
+ * then free it
+ * @param pJob     job the feature belongs to
+ * @param pMatch   feature whose lists are no longer needed
+ */
+void releasePolylines(MAPEVAL_JOB_T* pJob, FEATURE_MATCH_T* pMatch)
+{
+  POINT_ARENA_T* pArena = &pMatch->arena;
+  if (pArena->peakInUse > pJob->arenaPeakBytes)
+     pJob->arenaPeakBytes = pArena->peakInUse;
+  pJob->arenaTotalBytes += pArena->total;
+  pJob->arenaCapacity += pArena->capacity;
+  freePolyline(&pMatch->ref);
+  freePolyline(&pMatch->line);
+  freeCoordList(&pMatch->refMeters);
+  freeCoordList(&pMatch->lineMeters);
+  freePointArena(pArena);
+}
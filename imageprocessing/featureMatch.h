@@ -0,0 +1,220 @@
+/* Header file for matching reference features against a binary
+ * road image and writing the matched features
+ *
+ * Copyright 2020 Sally E. Goldin
+ * 
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ * 
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+
+/* methods findPoint can use to look for a matching pixel */
+#define SEARCH_SPIRAL  0   /* search ring by ring around the point */
+#define SEARCH_NEAREST 1   /* look up closest pixel in the distance transform */
+#define SEARCH_CHECK   2   /* spiral search, compared with nearest lookup */
+
+/* Calculate the mean distance between exp points and the ref points
+ * based on the match distances stored in the polyline, and the standard
+ * deviation. 
+ * @param pLine     Experimental feature
+ * @param pStdev    Pointer for returning the standard deviation
+ * Returns the mean distance as the function value
+ */
+double calculateFit(POLYLINE_T* pLine,double* pStdev);
+
+/* Write a feature to the SQL output file, as an insert command
+ * @param pLine        Experimental feature
+ * @param pMeters      Points of the feature in meters
+ * @param experimentId Numeric Id of this experimental comparison
+ * @param refFeatureId Numeric Id of corresponding reference feature
+ * @param dataId       QueryDataId
+ * @param refPoints    Number of points in reference feature
+ * @param matchpercent What percent of ref features points were found?
+ * @param cellsize     Size of one cell in meters
+ * @param pOut         File pointer for open text file.
+ */
+void writeSqlFeature(POLYLINE_T* pLine,COORD_LIST_T* pMeters,int experimentId, int refFeatureId,int dataId, int refPoints, double matchpercent, double cellsize, OUTBUF_T* pOut);
+
+/* Write a feature to the COPY output file, as one tab separated row
+ * for the columns
+ *   experimentid dataid uploadfeatureid refpointcount matchpercent 
+ *   meandistance stdevdistance geom
+ * The geometry is hex EWKB: a little endian LINESTRING with SRID 3857.
+ * @param pLine        Experimental feature
+ * @param pMeters      Points of the feature in meters
+ * @param experimentId Numeric Id of this experimental comparison
+ * @param refFeatureId Numeric Id of corresponding reference feature
+ * @param dataId       QueryDataId
+ * @param refPoints    Number of points in reference feature
+ * @param matchpercent What percent of ref features points were found?
+ * @param cellsize     Size of one cell in meters
+ * @param pOut         File pointer for open text file.
+ */
+void writeCopyFeature(POLYLINE_T* pLine,COORD_LIST_T* pMeters,int experimentId, int refFeatureId,int dataId, int refPoints, double matchpercent, double cellsize, OUTBUF_T* pOut);
+
+/* Search outward from refx,refy, ring by ring, for a WHITE pixel.
+ * Returns the first WHITE pixel found on the smallest ring
+ * that has one. Must be within 'tolerance' pixels (in x and y).
+ * The smallest ring is found by scanning rows of the window a word
+ * at a time; only that ring is then examined pixel by pixel, in the
+ * order N, NE, E, SE, S, SW, W, NW, so the pixel chosen is the same
+ * as checking every ring in that order.
+ * @param pImage Binary image data
+ * @param refx   Reference point x
+ * @param refy   Reference point y
+ * @param tolerance Radius of region to search 
+ * @param pX     Pointer to return x of pixel found
+ * @param pY     Pointer to return y of pixel found
+ * @return TRUE if found, else FALSE
+ */
+BOOL spiralSearch(BITIMAGE_T* pImage, int refx, int refy, int tolerance,
+		  int* pX, int* pY);
+
+/* Find the closest WHITE pixel to refx,refy using the nearest pixel
+ * map. To keep the same search window as spiralSearch, the pixel
+ * must be within 'tolerance' pixels in both x and y. If the closest
+ * pixel is outside that window but near enough that another pixel
+ * could be inside it (beyond a corner), or the reference point is
+ * outside the image, spiralSearch chooses the pixel instead.
+ * @param pMap   Nearest pixel map built from pImage
+ * @param pImage Binary image data
+ * @param refx   Reference point x
+ * @param refy   Reference point y
+ * @param tolerance Radius of region to search 
+ * @param pX     Pointer to return x of pixel found
+ * @param pY     Pointer to return y of pixel found
+ * @return TRUE if found, else FALSE
+ */
+BOOL nearestSearch(NEAREST_MAP_T* pMap, BITIMAGE_T* pImage, int refx, int refy, int tolerance,
+		   int* pX, int* pY);
+
+/* Run both searches for the same point, tally how the
+ * results compare, and log any disagreements.
+ * The spiral search result is returned, so output does not change.
+ * Arguments as for spiralSearch.
+ * @param pJob   Job holding the nearest pixel map and the tallies
+ * @return TRUE if found by the spiral search, else FALSE
+ */
+BOOL checkSearch(MAPEVAL_JOB_T* pJob, BITIMAGE_T* pImage, int refx, int refy,
+		 int tolerance, int* pX, int* pY);
+
+/* Print the summary of a search comparison (-checknearest) 
+ * @param pJob      Job whose searches were compared
+ * @param jobName   Identifies the job, for batch runs
+ */
+void printCheckStats(MAPEVAL_JOB_T* pJob, char* jobName);
+
+/* Look for a WHITE pixel matching refx,refy using the search method
+ * selected by the job's 'searchMode' option.
+ * @param pJob   Job being matched
+ * @param pImage Binary image data
+ * @param refx   Reference point x
+ * @param refy   Reference point y
+ * @param tolerance Radius of region to search 
+ * @param pX     Pointer to return x of pixel found
+ * @param pY     Pointer to return y of pixel found
+ * @return TRUE if found, else FALSE
+ */
+BOOL searchPoint(MAPEVAL_JOB_T* pJob, BITIMAGE_T* pImage, int refx, int refy,
+		 int tolerance, int* pX, int* pY);
+
+/* Return the number of pixels examined by searches in the calling
+ * thread so far; only counted if instrumentation is on.
+ */
+long long searchProbeCount();
+
+/* Look for match to point refx,refy, starting at the same pixel
+ * and looking in the neighborhood.
+ * Must be within 'tolerance' pixels 
+ * If found add that point to the end of the matched polyline.
+ * The job's 'searchMode' option selects the original spiral search,
+ * the nearest pixel lookup, or a comparison of the two.
+ * @param pJob   Job being matched
+ * @param pImage Binary image data
+ * @param refx   Reference feature start x
+ * @param refy   Reference feature start y
+ * @param tolerance Radius of region to search for the starting point
+ * @param direction Preferred direction for searching: 0 = N, 1 = NE, 2 = E, etc.
+ *               Based on direction between last ref point and last target point
+ *               -1 if no information (or the last ref and last target were the same)
+ * @param pLine     Matched polyline; the point found is appended, 
+ *                  with its distance from the reference point
+ * @return TRUE if a point was found, FALSE if can't find
+ */
+BOOL findPoint(MAPEVAL_JOB_T* pJob, BITIMAGE_T* pImage,
+	       int refx, int refy, int tolerance, int direction,
+	       POLYLINE_T* pLine);
+
+/* Try to match reference feature points to white pixels in the
+ * image. We check the start and end of each line segment in
+ * the reference feature against the image, subject to the tolerance
+ * radius. If we find a match and the job's 'componentMap' is set, we
+ * check that it is in the same connected road region as the last point.
+ * @param pJob       Job being matched
+ * @param pRef       Reference feature
+ * @param pLine      Experimental feature, already holding the 
+ *                   match for the first reference point; 
+ *                   this function adds the rest
+ * @param pImage Binary image data
+ * @param tolerance Radius of point search in pixels
+ * @return number of points in the experimental feature
+ */
+int followReferenceFeature(MAPEVAL_JOB_T* pJob, POLYLINE_T* pRef,
+			   POLYLINE_T* pLine, BITIMAGE_T* pImage, int tolerance);
+
+/* Given start and end coordinates of a line segment, determine
+ * the predominant direction as follows:
+ *  N = 0, NE = 1, E = 2, SE = 3, S = 4, SW = 5, W = 6, NW = 7
+ * Note the origin is at the upper left
+ * @param  x1     X coord of line segment start
+ * @param  x1     X coord of line segment start
+ * @param  x1     X coord of line segment start
+ * @param  x1     X coord of line segment start
+ * @return direction constant according to the scheme above. 
+ */
+int calculateDirection(int x1, int y1, int x2, int y2);
+
+/* Match one reference feature against the image: find the start
+ * point, then follow the rest of the reference feature.
+ * Uses only the image and the reference points, so different 
+ * features can be matched at the same time by different threads.
+ * @param pJob       Job being matched
+ * @param pMatch     Feature to match; results are stored here
+ * @param pImage     Binary image data
+ * @param tolerance  Radius of point search in pixels
+ */
+void matchFeature(MAPEVAL_JOB_T* pJob, FEATURE_MATCH_T* pMatch,
+		  BITIMAGE_T* pImage, int tolerance);
+
+/* Set up an empty FEATURE_MATCH_T whose lists are held in its 
+ * own arena. Each thread matching features must use its own.
+ * @param pMatch     structure to initialize
+ */
+void initFeatureMatch(FEATURE_MATCH_T* pMatch);
+
+/* Write the results of matching one feature to the job's output
+ * files, and compare it with the reference if the job's 'lineCompare'
+ * is set, then empty its lists.
+ * @param pJob          Job being matched, with its output files open
+ * @param pMatch        Feature that has been matched
+ * @param pFeatureCount Pointer to count of features written so far; 
+ *                      used as the vector feature Id, and updated
+ */
+void writeFeatureMatch(MAPEVAL_JOB_T* pJob, FEATURE_MATCH_T* pMatch,
+		       int* pFeatureCount);
+
+/* Add the memory used by a feature's arena to the job totals,
+ * then free it
+ * @param pJob     job the feature belongs to
+ * @param pMatch   feature whose lists are no longer needed
+ */
+void releasePolylines(MAPEVAL_JOB_T* pJob, FEATURE_MATCH_T* pMatch);
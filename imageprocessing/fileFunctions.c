@@ -42,6 +42,8 @@
 #include <string.h>
 #include "structures.h"
 #include "fileFunctions.h"
+#include "pointArena.h"
+#include "outputBuffer.h"
 
 
 /* Return the number of points in the list.
@@ -109,6 +111,7 @@ BYTE* readImageFile(char* infile, int width, int height)
 	printf("ERROR - fread returned wrong value %d for line %d\n", retval,y);
 	free(buffer);
 	free(image);
+	fclose(pIn);
 	return NULL;
         } 
      }
@@ -163,6 +166,7 @@ BYTE* readColorImageFile(char* infile, int width, int height)
 	printf("ERROR - fread returned wrong value %d for line %d\n", retval,y);
 	free(buffer);
 	free(image);
+	fclose(pIn);
 	return NULL;
         } 
      }
@@ -175,27 +179,27 @@ BYTE* readColorImageFile(char* infile, int width, int height)
 
 /* Write a feature to the output file.
  * Currently this is in Dragon Vector format
- * @param pHead        Starting point of feature
+ * @param pLine        Feature to write
  * @param featureId    Numeric Id of the feature
- * @param pOut         File pointer for open text file.
+ * @param pOut         Buffered output file
  * @param color        If zero, calculate, otherwise use this color
  */
-void writeFeature(POINT_T* pHead,int featureId,FILE* pOut,int color)
+void writeFeature(POLYLINE_T* pLine,int featureId,OUTBUF_T* pOut,int color)
 {
-    POINT_T * pCurrent = pHead;
+    int i = 0;
     int useColor = color;
     if (useColor == 0)
        useColor = (featureId*20)%255;
     /* final item is color - want each feature to contrast with previous */
-    fprintf(pOut,"-FIGURE %d L %d %d\n",featureId,
-	    listSize(pHead),useColor);
-    fflush(pOut);
-    while (pCurrent != NULL)
+    outBufPrintf(pOut,"-FIGURE %d L %d %d\n",featureId,
+		 pLine->count,useColor);
+    for (i = 0; i < pLine->count; i++)
       {
-      fprintf(pOut,"-COORDS %.2lf %.2lf 0\n", 
-	      (double) pCurrent->x,(double) pCurrent->y);
-      fflush(pOut);
-      pCurrent = pCurrent->next;
+      outBufString(pOut,"-COORDS ");
+      outBufFixed(pOut,(double) pLine->x[i],2);
+      outBufChar(pOut,' ');
+      outBufFixed(pOut,(double) pLine->y[i],2);
+      outBufString(pOut," 0\n");
       }
 }
 
@@ -208,9 +212,13 @@ void writeFeature(POINT_T* pHead,int featureId,FILE* pOut,int color)
  *                       big enough to hold all features in file
  * @param pIn            Pointer to open input file
  * @param arraySize      Capacity of the featureArray - used for error checks
+ * @param pArena         Arena to allocate the points from; the points
+ *                       are released by freeing the arena. If NULL,
+ *                       each point is allocated separately.
  * @return number of features successfully read or -1 if an error occurs.
  */
-int readFeatures(FEATURE_T* featureArray[], FILE* pIn, int arraySize)
+int readFeatures(FEATURE_T* featureArray[], FILE* pIn, int arraySize,
+		 POINT_ARENA_T* pArena)
 {
 #define FIGURE "-FIGURE"
 #define COORDS "-COORDS"
@@ -243,7 +251,10 @@ int readFeatures(FEATURE_T* featureArray[], FILE* pIn, int arraySize)
 			      /* want to be sure we read the points for the last feature */
 	  continue;  
        sscanf(buffer,"-COORDS %lf %lf",&x,&y);
-       pNewPoint = calloc(1,sizeof(POINT_T));
+       if (pArena != NULL)
+	  pNewPoint = newArenaPoint(pArena);
+       else
+	  pNewPoint = calloc(1,sizeof(POINT_T));
        if (pNewPoint == NULL)
 	  {
 	  printf("Error allocating point structure (%lf,%lf)\n",x,y);
@@ -277,9 +288,10 @@ int readFeatures(FEATURE_T* featureArray[], FILE* pIn, int arraySize)
  * and read the data into that array.
  * @param  count     Number of features believed to be in the file
  * @param  readFile  Name of file to read
+ * @param  pArena    Arena for the points, or NULL to allocate separately
  * @return newly allocated array of features or NULL if error occurred.
  */
-FEATURE_T ** allocateAndRead(int count, char* readFile)
+FEATURE_T ** allocateAndRead(int count, char* readFile, POINT_ARENA_T* pArena)
 {
   FEATURE_T ** features = NULL;
   FILE* pIn = NULL;
@@ -301,7 +313,7 @@ FEATURE_T ** allocateAndRead(int count, char* readFile)
      features = NULL;
      return features;
      }
-  newCount = readFeatures(features,pIn,count);
+  newCount = readFeatures(features,pIn,count,pArena);
   fclose(pIn);
   printf("Read %d features of %d allocated\n", newCount,count);
   return features;
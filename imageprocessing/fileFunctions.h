@@ -68,12 +68,12 @@ BYTE* readColorImageFile(char* infile, int width, int height);
 
 /* Write a feature to the output file.
  * Currently this is in Dragon Vector format
- * @param pHead        Starting point of feature
+ * @param pLine        Feature to write
  * @param featureId    Numeric Id of the feature
- * @param pOut         File pointer for open text file.
+ * @param pOut         Buffered output file
  * @param color        If 0, calculate, otherwise use this color
  */
-void writeFeature(POINT_T* pHead,int featureId,FILE* pOut,int color);
+void writeFeature(POLYLINE_T* pLine,int featureId,OUTBUF_T* pOut,int color);
 
 
 
@@ -95,18 +95,23 @@ void writeFeatureWithNormals(FEATURE_T* pFeature,int featureId,FILE* pOut);
  *                       big enough to hold all features in file
  * @param pIn            Pointer to open input file
  * @param arraySize      Capacity of the featureArray - used for error checks
+ * @param pArena         Arena to allocate the points from; the points
+ *                       are released by freeing the arena. If NULL,
+ *                       each point is allocated separately.
  * @return number of features successfully read or -1 if an error occurs.
  */
-int readFeatures(FEATURE_T* featureArray[], FILE* pIn, int arraySize);
+int readFeatures(FEATURE_T* featureArray[], FILE* pIn, int arraySize,
+		 POINT_ARENA_T* pArena);
 
 /* Allocate an array of 'count' pointers to features. Then
  * open the passed filename (assumed to be a Dragon vector file)
  * and read the data into that array.
  * @param  count     Number of features believed to be in the file
  * @param  readFile  Name of file to read
+ * @param  pArena    Arena for the points, or NULL to allocate separately
  * @return newly allocated array of features or NULL if error occurred.
  */
-FEATURE_T ** allocateAndRead(int count, char* readFile);
+FEATURE_T ** allocateAndRead(int count, char* readFile, POINT_ARENA_T* pArena);
 
 
 /* Write the byte data to an RGB file with three bytes per pixel 
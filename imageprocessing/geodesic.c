@@ -0,0 +1,342 @@
+/* Component of the MapEval point matching.
+ * Computes distances on the WGS84 ellipsoid, so that point data
+ * sets can be compared without asking the database for the
+ * distance between every pair of points.
+ *
+ * For batches of points, the values that depend on only one point
+ * (reduced latitude, position on a sphere) are calculated once per
+ * point by setGeoPoint and kept in separate arrays, so a batch costs
+ * only the Vincenty iteration per pair. sphereFilter discards pairs
+ * that are clearly too far apart using arithmetic alone, before any
+ * ellipsoidal distance is calculated.
+ *
+ * Only the prefilter is batched for the vector units: its chord
+ * lengths are computed FILTER_BLOCK points at a time in a loop the
+ * compiler vectorizes (this file is built with VECFLAGS). The
+ * Vincenty iteration itself still runs one pair at a time, because
+ * it needs sin, cos and atan2 and a different number of iterations
+ * per pair, and because batched distances must stay identical to
+ * those from geodesicDistance.
+ *
+ * Copyright 2020 Sally E. Goldin
+ * 
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ * 
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <math.h>
+#include "structures.h"
+#include "geodesic.h"
+
+#define DEG2RAD (M_PI/180.0)
+
+/* change in lambda (radians) small enough to stop iterating; the
+ * usual 1e-12 leaves errors of several micrometers in short lines
+ */
+#define CONVERGED 1.0e-14
+
+/* most iterations of Vincenty's formula before giving up */
+#define MAX_ITERATIONS 200
+
+/* radius of the sphere used by the prefilter (mean earth radius) */
+#define SPHERE_RADIUS 6371008.8
+
+/* The spherical distance between two geodetic positions can exceed
+ * the ellipsoidal one by at most the ratio of SPHERE_RADIUS to the
+ * smallest meridional radius of curvature, a(1-e^2) = 6335439 m at
+ * the equator, which is 1.0056. Widening the prefilter limit by
+ * this factor means it never rejects a pair that is within range.
+ */
+#define SPHERE_MARGIN 1.006
+
+/* number of points handled by each pass of the prefilter */
+#define FILTER_BLOCK 256
+
+/* Calculate the distance along the ellipsoid between two points,
+ * given their difference in longitude and their reduced latitudes,
+ * by iterating Vincenty's inverse formula.
+ * @param L       difference in longitude in radians
+ * @param sinU1   sine of reduced latitude of first point
+ * @param cosU1   cosine of reduced latitude of first point
+ * @param sinU2   sine of reduced latitude of second point
+ * @param cosU2   cosine of reduced latitude of second point
+ * @return distance in meters
+ */
+static double vincenty(double L, double sinU1, double cosU1,
+		       double sinU2, double cosU2)
+{
+  double f = WGS84_F;
+  double lambda = L;
+  double lambdaPrev = 0.0;
+  double sinSigma = 0.0;
+  double cosSigma = 0.0;
+  double sigma = 0.0;
+  double cosSqAlpha = 0.0;
+  double cos2SigmaM = 0.0;
+  double uSq = 0.0;
+  double A = 0.0;
+  double B = 0.0;
+  double deltaSigma = 0.0;
+  int i = 0;
+  if ((L == 0.0) && (sinU1 == sinU2))
+     return 0.0;
+  do
+    {
+    double sinLambda = sin(lambda);
+    double cosLambda = cos(lambda);
+    double sinAlpha = 0.0;
+    double C = 0.0;
+    sinSigma = sqrt((cosU2*sinLambda) * (cosU2*sinLambda) +
+		    (cosU1*sinU2 - sinU1*cosU2*cosLambda) * 
+		    (cosU1*sinU2 - sinU1*cosU2*cosLambda));
+    if (sinSigma == 0.0)
+       return 0.0;  /* coincident points */
+    cosSigma = sinU1*sinU2 + cosU1*cosU2*cosLambda;
+    sigma = atan2(sinSigma,cosSigma);
+    sinAlpha = cosU1 * cosU2 * sinLambda / sinSigma;
+    cosSqAlpha = 1.0 - sinAlpha*sinAlpha;
+    if (cosSqAlpha != 0.0)
+       cos2SigmaM = cosSigma - 2.0*sinU1*sinU2/cosSqAlpha;
+    else
+       cos2SigmaM = 0.0;  /* both points on the equator */
+    C = f/16.0 * cosSqAlpha * (4.0 + f*(4.0 - 3.0*cosSqAlpha));
+    lambdaPrev = lambda;
+    lambda = L + (1.0 - C) * f * sinAlpha *
+      (sigma + C*sinSigma*(cos2SigmaM + C*cosSigma*(-1.0 + 2.0*cos2SigmaM*cos2SigmaM)));
+    i++;
+    }
+  while ((fabs(lambda - lambdaPrev) > CONVERGED) && (i < MAX_ITERATIONS));
+  uSq = cosSqAlpha * (WGS84_A*WGS84_A - WGS84_B*WGS84_B) / (WGS84_B*WGS84_B);
+  A = 1.0 + uSq/16384.0 * (4096.0 + uSq*(-768.0 + uSq*(320.0 - 175.0*uSq)));
+  B = uSq/1024.0 * (256.0 + uSq*(-128.0 + uSq*(74.0 - 47.0*uSq)));
+  deltaSigma = B * sinSigma * (cos2SigmaM + B/4.0 * 
+     (cosSigma*(-1.0 + 2.0*cos2SigmaM*cos2SigmaM) - 
+      B/6.0 * cos2SigmaM * (-3.0 + 4.0*sinSigma*sinSigma) *
+      (-3.0 + 4.0*cos2SigmaM*cos2SigmaM)));
+  return WGS84_B * A * (sigma - deltaSigma);
+}
+
+/* Calculate the distance along the ellipsoid between two points,
+ * using Vincenty's inverse formula. Agrees with PostGIS 
+ * ST_DistanceSpheroid on the WGS84 spheroid to well under a 
+ * millimeter, except for nearly antipodal points, where the 
+ * iteration may not converge and the result is less accurate.
+ * @param lon1    longitude of first point in degrees
+ * @param lat1    latitude of first point in degrees
+ * @param lon2    longitude of second point in degrees
+ * @param lat2    latitude of second point in degrees
+ * @return distance in meters
+ */
+double geodesicDistance(double lon1, double lat1, double lon2, double lat2)
+{
+  double U1 = atan((1.0 - WGS84_F) * tan(lat1 * DEG2RAD));   /* reduced latitudes */
+  double U2 = atan((1.0 - WGS84_F) * tan(lat2 * DEG2RAD));
+  if ((lon1 == lon2) && (lat1 == lat2))
+     return 0.0;
+  return vincenty((lon2 - lon1) * DEG2RAD,sin(U1),cos(U1),sin(U2),cos(U2));
+}
+
+/* Allocate a set of points for batched distance calculations.
+ * The positions must be filled in with setGeoPoint.
+ * @param count   number of points
+ * @return new point set, or NULL if allocation failed
+ */
+GEO_POINTS_T* newGeoPoints(int count)
+{
+  GEO_POINTS_T* pPoints = calloc(1,sizeof(GEO_POINTS_T));
+  if (pPoints == NULL)
+     return NULL;
+  pPoints->count = count;
+  pPoints->lons = calloc(count + 1,sizeof(double));
+  pPoints->sinU = calloc(count + 1,sizeof(double));
+  pPoints->cosU = calloc(count + 1,sizeof(double));
+  pPoints->x = calloc(count + 1,sizeof(double));
+  pPoints->y = calloc(count + 1,sizeof(double));
+  pPoints->z = calloc(count + 1,sizeof(double));
+  if ((pPoints->lons == NULL) || (pPoints->sinU == NULL) ||
+      (pPoints->cosU == NULL) || (pPoints->x == NULL) ||
+      (pPoints->y == NULL) || (pPoints->z == NULL))
+     {
+     freeGeoPoints(pPoints);
+     return NULL;
+     }
+  return pPoints;
+}
+
+/* Free a point set created by newGeoPoints
+ * @param pPoints   point set to free (may be NULL)
+ */
+void freeGeoPoints(GEO_POINTS_T* pPoints)
+{
+  if (pPoints != NULL)
+     {
+     free(pPoints->lons);
+     free(pPoints->sinU);
+     free(pPoints->cosU);
+     free(pPoints->x);
+     free(pPoints->y);
+     free(pPoints->z);
+     free(pPoints);
+     }
+}
+
+/* Store one position in a point set, and the values derived from
+ * it that the distance calculations need.
+ * @param pPoints   point set from newGeoPoints
+ * @param i         index of the point to set
+ * @param lon       longitude in degrees
+ * @param lat       latitude in degrees
+ */
+void setGeoPoint(GEO_POINTS_T* pPoints, int i, double lon, double lat)
+{
+  double U = atan((1.0 - WGS84_F) * tan(lat * DEG2RAD));
+  double cosLat = cos(lat * DEG2RAD);
+  pPoints->lons[i] = lon;
+  pPoints->sinU[i] = sin(U);
+  pPoints->cosU[i] = cos(U);
+  pPoints->x[i] = cosLat * cos(lon * DEG2RAD);
+  pPoints->y[i] = cosLat * sin(lon * DEG2RAD);
+  pPoints->z[i] = sin(lat * DEG2RAD);
+}
+
+/* Select the points that might be within 'maxMeters' of a given
+ * point, by comparing straight line distances through a sphere.
+ * This needs no trigonometry, so it is much cheaper than the
+ * ellipsoidal distance, and it never rejects a point that is
+ * within range. 
+ * @param pFrom     point set holding the given point
+ * @param from      index of the given point in pFrom
+ * @param pTo       points to check
+ * @param which     indices in pTo of the points to check, or NULL
+ *                  to check the first 'count' points
+ * @param count     number of points to check
+ * @param maxMeters largest distance of interest
+ * @param selected  array to receive indices in pTo of the points
+ *                  that pass; may be the same array as 'which'
+ * @return number of indices stored in 'selected'
+ */
+int sphereFilter(GEO_POINTS_T* pFrom, int from, GEO_POINTS_T* pTo,
+		 const int* which, int count, double maxMeters, int* selected)
+{
+  double x = pFrom->x[from];
+  double y = pFrom->y[from];
+  double z = pFrom->z[from];
+  double angle = SPHERE_MARGIN * maxMeters / SPHERE_RADIUS;
+  double limit = 0.0;
+  double chordSq[FILTER_BLOCK];
+  int found = 0;
+  int first = 0;
+  if (angle >= M_PI)
+     limit = 4.0;   /* everything is in range */
+  else
+     limit = 4.0 * sin(angle / 2.0) * sin(angle / 2.0);
+  limit *= 1.0 + 1.0e-12;  /* allow for rounding in the chord */
+  for (first = 0; first < count; first += FILTER_BLOCK)
+     {
+     int n = count - first;
+     int i = 0;
+     if (n > FILTER_BLOCK)
+        n = FILTER_BLOCK;
+     if (which == NULL)
+        {
+	for (i = 0; i < n; i++)
+	   {
+	   double dx = pTo->x[first + i] - x;
+	   double dy = pTo->y[first + i] - y;
+	   double dz = pTo->z[first + i] - z;
+	   chordSq[i] = dx*dx + dy*dy + dz*dz;
+	   }
+	for (i = 0; i < n; i++)
+	   {
+	   selected[found] = first + i;
+	   found += (chordSq[i] <= limit);
+	   }
+        }
+     else
+        {
+	for (i = 0; i < n; i++)
+	   {
+	   int j = which[first + i];
+	   double dx = pTo->x[j] - x;
+	   double dy = pTo->y[j] - y;
+	   double dz = pTo->z[j] - z;
+	   chordSq[i] = dx*dx + dy*dy + dz*dz;
+	   }
+	for (i = 0; i < n; i++)
+	   {
+	   selected[found] = which[first + i];
+	   found += (chordSq[i] <= limit);
+	   }
+        }
+     }
+  return found;
+}
+
+/* Calculate the ellipsoidal distances from one point to many.
+ * Gives exactly the same values as geodesicDistance.
+ * @param pFrom     point set holding the given point
+ * @param from      index of the given point in pFrom
+ * @param pTo       other points
+ * @param which     indices in pTo of the points to measure to, or
+ *                  NULL for the first 'count' points
+ * @param count     number of distances to calculate
+ * @param distances array to receive 'count' distances in meters
+ */
+void geodesicDistances(GEO_POINTS_T* pFrom, int from, GEO_POINTS_T* pTo,
+		       const int* which, int count, double* distances)
+{
+  double lon = pFrom->lons[from];
+  double sinU = pFrom->sinU[from];
+  double cosU = pFrom->cosU[from];
+  int i = 0;
+  for (i = 0; i < count; i++)
+     {
+     int j = (which != NULL) ? which[i] : i;
+     distances[i] = vincenty((pTo->lons[j] - lon) * DEG2RAD,sinU,cosU,
+			     pTo->sinU[j],pTo->cosU[j]);
+     }
+}
+
+/* Calculate the ellipsoidal distances between every point in one
+ * range of a point set and every point in a range of another.
+ * @param pRows     first point set
+ * @param firstRow  index of first point to use in pRows
+ * @param rowCount  number of points to use from pRows
+ * @param pCols     second point set
+ * @param firstCol  index of first point to use in pCols
+ * @param colCount  number of points to use from pCols
+ * @param distances array of rowCount * colCount distances in meters,
+ *                  filled in a row at a time
+ */
+void geodesicDistanceTile(GEO_POINTS_T* pRows, int firstRow, int rowCount,
+			  GEO_POINTS_T* pCols, int firstCol, int colCount,
+			  double* distances)
+{
+  int r = 0;
+  int c = 0;
+  for (r = 0; r < rowCount; r++)
+     {
+     double lon = pRows->lons[firstRow + r];
+     double sinU = pRows->sinU[firstRow + r];
+     double cosU = pRows->cosU[firstRow + r];
+     double* row = &distances[r * colCount];
+     for (c = 0; c < colCount; c++)
+        {
+	int j = firstCol + c;
+	row[c] = vincenty((pCols->lons[j] - lon) * DEG2RAD,sinU,cosU,
+			  pCols->sinU[j],pCols->cosU[j]);
+        }
+     }
+}
@@ -0,0 +1,101 @@
+/* Header file for distances on the WGS84 ellipsoid
+ *
+ * Copyright 2020 Sally E. Goldin
+ * 
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ * 
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+
+/* WGS84 ellipsoid, as used by ST_DistanceSpheroid in the server */
+#define WGS84_A  6378137.0               /* semi-major axis in meters */
+#define WGS84_F  (1.0/298.257223563)     /* flattening */
+#define WGS84_B  (WGS84_A * (1.0 - WGS84_F))  /* semi-minor axis */
+
+/* Calculate the distance along the ellipsoid between two points,
+ * using Vincenty's inverse formula. Agrees with PostGIS 
+ * ST_DistanceSpheroid on the WGS84 spheroid to well under a 
+ * millimeter, except for nearly antipodal points, where the 
+ * iteration may not converge and the result is less accurate.
+ * @param lon1    longitude of first point in degrees
+ * @param lat1    latitude of first point in degrees
+ * @param lon2    longitude of second point in degrees
+ * @param lat2    latitude of second point in degrees
+ * @return distance in meters
+ */
+double geodesicDistance(double lon1, double lat1, double lon2, double lat2);
+
+/* Allocate a set of points for batched distance calculations.
+ * The positions must be filled in with setGeoPoint.
+ * @param count   number of points
+ * @return new point set, or NULL if allocation failed
+ */
+GEO_POINTS_T* newGeoPoints(int count);
+
+/* Free a point set created by newGeoPoints
+ * @param pPoints   point set to free (may be NULL)
+ */
+void freeGeoPoints(GEO_POINTS_T* pPoints);
+
+/* Store one position in a point set, and the values derived from
+ * it that the distance calculations need.
+ * @param pPoints   point set from newGeoPoints
+ * @param i         index of the point to set
+ * @param lon       longitude in degrees
+ * @param lat       latitude in degrees
+ */
+void setGeoPoint(GEO_POINTS_T* pPoints, int i, double lon, double lat);
+
+/* Select the points that might be within 'maxMeters' of a given
+ * point, by comparing straight line distances through a sphere.
+ * Never rejects a point that is within range.
+ * @param pFrom     point set holding the given point
+ * @param from      index of the given point in pFrom
+ * @param pTo       points to check
+ * @param which     indices in pTo of the points to check, or NULL
+ *                  to check the first 'count' points
+ * @param count     number of points to check
+ * @param maxMeters largest distance of interest
+ * @param selected  array to receive indices in pTo of the points
+ *                  that pass; may be the same array as 'which'
+ * @return number of indices stored in 'selected'
+ */
+int sphereFilter(GEO_POINTS_T* pFrom, int from, GEO_POINTS_T* pTo,
+		 const int* which, int count, double maxMeters, int* selected);
+
+/* Calculate the ellipsoidal distances from one point to many.
+ * Gives exactly the same values as geodesicDistance.
+ * @param pFrom     point set holding the given point
+ * @param from      index of the given point in pFrom
+ * @param pTo       other points
+ * @param which     indices in pTo of the points to measure to, or
+ *                  NULL for the first 'count' points
+ * @param count     number of distances to calculate
+ * @param distances array to receive 'count' distances in meters
+ */
+void geodesicDistances(GEO_POINTS_T* pFrom, int from, GEO_POINTS_T* pTo,
+		       const int* which, int count, double* distances);
+
+/* Calculate the ellipsoidal distances between every point in one
+ * range of a point set and every point in a range of another.
+ * @param pRows     first point set
+ * @param firstRow  index of first point to use in pRows
+ * @param rowCount  number of points to use from pRows
+ * @param pCols     second point set
+ * @param firstCol  index of first point to use in pCols
+ * @param colCount  number of points to use from pCols
+ * @param distances array of rowCount * colCount distances in meters,
+ *                  filled in a row at a time
+ */
+void geodesicDistanceTile(GEO_POINTS_T* pRows, int firstRow, int rowCount,
+			  GEO_POINTS_T* pCols, int firstCol, int colCount,
+			  double* distances);
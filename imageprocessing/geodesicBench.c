@@ -0,0 +1,378 @@
+/*
+ *  geodesicBench.c
+ *
+ *  Accuracy check and benchmark for the WGS84 distance functions
+ *  used by pointMatch.
+ *
+ *  With -verify, compares geodesicDistance and the batched functions
+ *  with reference distances calculated by GeographicLib (Karney's
+ *  algorithm, accurate to nanometers), and checks that the sphere
+ *  prefilter keeps every pair that is within range. Exits with
+ *  status 1 if any distance is out by a tenth of a millimeter or more.
+ *
+ *  Otherwise generates random reference and target points scattered
+ *  around a location and times the distance calculations for every
+ *  pair three ways: one pair at a time with geodesicDistance, in
+ *  tiles with geodesicDistanceTile, and with sphereFilter discarding
+ *  pairs farther apart than the threshold before geodesicDistances.
+ *  The same seed always gives the same points.
+ *
+ *  Copyright 2020 Sally E. Goldin
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <time.h>
+
+#include "structures.h"
+#include "geodesic.h"
+
+/* largest acceptable difference from the reference distances */
+#define MAX_ERROR_METERS 0.0001
+
+/* rows of reference points in each tile */
+#define TILE_ROWS 16
+
+/* a pair of points and the distance between them according to
+ * GeographicLib 2.1, Geodesic.WGS84.Inverse
+ */
+typedef struct _referenceDistance
+{
+  double lon1;
+  double lat1;
+  double lon2;
+  double lat2;
+  double meters;
+} REFERENCE_DISTANCE_T;
+
+/* short lines, long lines, lines that cross the antimeridian or
+ * the equator and lines near the poles. Nearly antipodal points
+ * are left out; Vincenty's method does not converge for them.
+ */
+static REFERENCE_DISTANCE_T referenceDistances[] =
+{
+  {100.5018, 13.7563, 100.5018, 13.7563, 0.000000000},
+  {100.5018, 13.7563, 100.50181, 13.7563, 1.081468653},
+  {100.5018, 13.7563, 100.503, 13.7571, 157.085255178},
+  {100.5018, 13.7563, 100.5102, 13.7489, 1222.935251944},
+  {-0.1278, 51.5074, 2.3522, 48.8566, 343923.120090989},
+  {-74.006, 40.7128, -118.2437, 34.0522, 3944422.231489921},
+  {139.6917, 35.6895, 151.2093, -33.8688, 7792963.055309271},
+  {179.9995, -16.5, -179.9995, -16.5, 106.764154874},
+  {179.5, 10, -179.5, 10.2, 111815.698895984},
+  {0, 0, 0, 1, 110574.388557799},
+  {0, 0, 1, 0, 111319.490793274},
+  {12, 0, 13.5, 0, 166979.236189910},
+  {45, 89.9999, -135, 89.9999, 22.338795913},
+  {10, 89.5, 100, 89.6, 71518.672747688},
+  {-60, -89, 120, -89.5, 167540.840362476},
+  {0, 0, 90, 0, 10018754.171394622},
+  {18.4241, -33.9249, -58.3816, -34.6037, 6884647.870684873},
+  {30, 60, 30.00001, 60.00001, 1.246047233},
+  {-122.4194, 37.7749, -122.2711, 37.8044, 13466.783133888},
+  {100, 45, 100, -45, 9969888.755955487},
+  {0, 30, 170, -29, 19053356.656417131},
+  {-43.1729, -22.9068, 121.4737, 31.2304, 18245506.903937194},
+};
+
+/* settings for one benchmark run */
+typedef struct _geoBenchConfig
+{
+  int refCount;         /* number of reference points */
+  int targetCount;      /* number of target points */
+  double lon;           /* center of the points */
+  double lat;
+  double spread;        /* points are within this many meters of the center */
+  double threshold;     /* match distance for the filtered run */
+  int repeat;           /* number of times to time each method */
+  unsigned int seed;    /* random number seed */
+} GEO_BENCH_CONFIG_T;
+
+/* explain arguments */
+void usage()
+{
+  printf("Usage:\n");
+  printf("  geodesicBench [options]\n\n");
+  printf("  Options:\n");
+  printf("     -verify            - check the distances against reference values\n");
+  printf("                          and exit\n");
+  printf("     -points <r>x<t>    - reference and target points (default 2000x2000)\n");
+  printf("     -center <lon>,<lat> - center of the points (default 100.5,13.75)\n");
+  printf("     -spread <m>        - greatest distance of a point from the center\n");
+  printf("                          in meters (default 20000)\n");
+  printf("     -threshold <m>     - match distance for the filtered run (default 200)\n");
+  printf("     -repeat <n>        - time each method n times (default 3)\n");
+  printf("     -seed <n>          - random number seed (default 1)\n");
+  exit(0);
+}
+
+/* Return a uniformly distributed random number in [0,1) */
+double uniformRandom()
+{
+  return rand() / ((double) RAND_MAX + 1.0);
+}
+
+/* Return elapsed time between two clock readings in seconds */
+double elapsedSeconds(struct timespec* pStart, struct timespec* pEnd)
+{
+  return (pEnd->tv_sec - pStart->tv_sec) +
+         (pEnd->tv_nsec - pStart->tv_nsec) / 1.0e9;
+}
+
+/* Check every reference distance with each of the distance functions.
+ * @return 0 if all agree to within MAX_ERROR_METERS, else 1
+ */
+int verify()
+{
+  int count = sizeof(referenceDistances) / sizeof(referenceDistances[0]);
+  GEO_POINTS_T* pFrom = newGeoPoints(count);
+  GEO_POINTS_T* pTo = newGeoPoints(count);
+  double* batch = calloc(count,sizeof(double));
+  double* tile = calloc(count * count,sizeof(double));
+  double maxError = 0.0;
+  int failures = 0;
+  int i = 0;
+  if ((pFrom == NULL) || (pTo == NULL) || (batch == NULL) || (tile == NULL))
+     {
+     printf("Error allocating memory for %d reference distances\n",count);
+     exit(3);
+     }
+  for (i = 0; i < count; i++)
+     {
+     REFERENCE_DISTANCE_T* pRef = &referenceDistances[i];
+     setGeoPoint(pFrom,i,pRef->lon1,pRef->lat1);
+     setGeoPoint(pTo,i,pRef->lon2,pRef->lat2);
+     }
+  geodesicDistanceTile(pFrom,0,count,pTo,0,count,tile);
+  for (i = 0; i < count; i++)
+     {
+     REFERENCE_DISTANCE_T* pRef = &referenceDistances[i];
+     double single = geodesicDistance(pRef->lon1,pRef->lat1,pRef->lon2,pRef->lat2);
+     double error = fabs(single - pRef->meters);
+     int selected = 0;
+     int kept = 0;
+     geodesicDistances(pFrom,i,pTo,&i,1,batch);
+     kept = sphereFilter(pFrom,i,pTo,&i,1,pRef->meters,&selected);
+     if (error > maxError)
+        maxError = error;
+     printf("  (%.5f,%.5f) to (%.5f,%.5f): %.6f m, error %.3g m\n",
+	    pRef->lon1,pRef->lat1,pRef->lon2,pRef->lat2,single,error);
+     if (error >= MAX_ERROR_METERS)
+        {
+	printf("    FAILED: reference distance is %.6f m\n",pRef->meters);
+	failures++;
+        }
+     if ((batch[0] != single) || (tile[i * count + i] != single))
+        {
+	printf("    FAILED: batched distances %.9f and %.9f differ\n",
+	       batch[0],tile[i * count + i]);
+	failures++;
+        }
+     if (kept != 1)
+        {
+	printf("    FAILED: rejected by the sphere prefilter\n");
+	failures++;
+        }
+     }
+  printf("%d reference distances, largest error %.3g m, %d failures\n",
+	 count,maxError,failures);
+  freeGeoPoints(pFrom);
+  freeGeoPoints(pTo);
+  free(batch);
+  free(tile);
+  return (failures > 0) ? 1 : 0;
+}
+
+/* Read the options into the configuration, exiting on any error
+ * @param argc     number of arguments
+ * @param argv     arguments
+ * @param pConfig  configuration to fill in
+ */
+void parseOptions(int argc, char* argv[], GEO_BENCH_CONFIG_T* pConfig)
+{
+  int i = 0;
+  for (i = 1; i < argc; i++)
+     {
+     if (strcmp(argv[i],"-verify") == 0)
+        exit(verify());
+     else if ((strcmp(argv[i],"-points") == 0) && (i + 1 < argc))
+        {
+	if ((sscanf(argv[++i],"%dx%d",&pConfig->refCount,&pConfig->targetCount) != 2) ||
+	    (pConfig->refCount < 1) || (pConfig->targetCount < 1))
+	   usage();
+        }
+     else if ((strcmp(argv[i],"-center") == 0) && (i + 1 < argc))
+        {
+	if (sscanf(argv[++i],"%lf,%lf",&pConfig->lon,&pConfig->lat) != 2)
+	   usage();
+        }
+     else if ((strcmp(argv[i],"-spread") == 0) && (i + 1 < argc))
+        pConfig->spread = strtod(argv[++i],NULL);
+     else if ((strcmp(argv[i],"-threshold") == 0) && (i + 1 < argc))
+        pConfig->threshold = strtod(argv[++i],NULL);
+     else if ((strcmp(argv[i],"-repeat") == 0) && (i + 1 < argc))
+        pConfig->repeat = atoi(argv[++i]);
+     else if ((strcmp(argv[i],"-seed") == 0) && (i + 1 < argc))
+        pConfig->seed = (unsigned int) atoi(argv[++i]);
+     else
+        usage();
+     }
+  if (pConfig->repeat < 1)
+     pConfig->repeat = 1;
+}
+
+/* Fill a point set with random positions within 'spread' meters
+ * (roughly) of the center
+ * @param pPoints   point set to fill
+ * @param lats      array to receive the latitude of each point
+ * @param pConfig   benchmark settings
+ */
+void randomPoints(GEO_POINTS_T* pPoints, double* lats, GEO_BENCH_CONFIG_T* pConfig)
+{
+  double latDegrees = pConfig->spread / 110574.0;
+  double lonDegrees = pConfig->spread / (111319.0 * cos(pConfig->lat * M_PI / 180.0));
+  int i = 0;
+  for (i = 0; i < pPoints->count; i++)
+     {
+     double lon = pConfig->lon + (2.0 * uniformRandom() - 1.0) * lonDegrees;
+     lats[i] = pConfig->lat + (2.0 * uniformRandom() - 1.0) * latDegrees;
+     setGeoPoint(pPoints,i,lon,lats[i]);
+     }
+}
+
+/* Main function parses the options, generates the points and times
+ * each way of calculating the distances
+ */
+int main(int argc, char* argv[])
+{
+  GEO_BENCH_CONFIG_T config;
+  GEO_POINTS_T* pRefs = NULL;
+  GEO_POINTS_T* pTargets = NULL;
+  double* distances = NULL;
+  int* found = NULL;
+  double* lats = NULL;
+  double best[3] = {0.0, 0.0, 0.0};   /* fastest time for each method */
+  double sums[3] = {0.0, 0.0, 0.0};
+  long within = 0;
+  long filtered = 0;
+  double pairs = 0.0;
+  int rep = 0;
+  int r = 0;
+  int t = 0;
+  int m = 0;
+  config.refCount = 2000;
+  config.targetCount = 2000;
+  config.lon = 100.5;
+  config.lat = 13.75;
+  config.spread = 20000.0;
+  config.threshold = 200.0;
+  config.repeat = 3;
+  config.seed = 1;
+  parseOptions(argc,argv,&config);
+  pRefs = newGeoPoints(config.refCount);
+  pTargets = newGeoPoints(config.targetCount);
+  distances = calloc((size_t) TILE_ROWS * config.targetCount,sizeof(double));
+  found = calloc(config.targetCount,sizeof(int));
+  lats = calloc(config.refCount + config.targetCount,sizeof(double));
+  if ((pRefs == NULL) || (pTargets == NULL) || (distances == NULL) ||
+      (found == NULL) || (lats == NULL))
+     {
+     printf("Error allocating memory for %d x %d points\n",
+	    config.refCount,config.targetCount);
+     exit(3);
+     }
+  srand(config.seed);
+  randomPoints(pRefs,lats,&config);
+  randomPoints(pTargets,&lats[config.refCount],&config);
+  pairs = (double) config.refCount * config.targetCount;
+  for (rep = 0; rep < config.repeat; rep++)
+     {
+     struct timespec start;
+     struct timespec end;
+     double seconds[3];
+     /* one pair at a time */
+     clock_gettime(CLOCK_MONOTONIC,&start);
+     sums[0] = 0.0;
+     for (r = 0; r < config.refCount; r++)
+        {
+	for (t = 0; t < config.targetCount; t++)
+	   sums[0] += geodesicDistance(pRefs->lons[r],lats[r],pTargets->lons[t],
+				       lats[config.refCount + t]);
+        }
+     clock_gettime(CLOCK_MONOTONIC,&end);
+     seconds[0] = elapsedSeconds(&start,&end);
+     /* tiles of TILE_ROWS reference points by all the targets */
+     clock_gettime(CLOCK_MONOTONIC,&start);
+     sums[1] = 0.0;
+     for (r = 0; r < config.refCount; r += TILE_ROWS)
+        {
+	int rows = config.refCount - r;
+	long i = 0;
+	if (rows > TILE_ROWS)
+	   rows = TILE_ROWS;
+	geodesicDistanceTile(pRefs,r,rows,pTargets,0,config.targetCount,distances);
+	for (i = 0; i < (long) rows * config.targetCount; i++)
+	   sums[1] += distances[i];
+        }
+     clock_gettime(CLOCK_MONOTONIC,&end);
+     seconds[1] = elapsedSeconds(&start,&end);
+     /* prefilter, then distances only for the pairs that pass */
+     clock_gettime(CLOCK_MONOTONIC,&start);
+     sums[2] = 0.0;
+     within = 0;
+     filtered = 0;
+     for (r = 0; r < config.refCount; r++)
+        {
+	int n = sphereFilter(pRefs,r,pTargets,NULL,config.targetCount,
+			     config.threshold,found);
+	int i = 0;
+	geodesicDistances(pRefs,r,pTargets,found,n,distances);
+	filtered += n;
+	for (i = 0; i < n; i++)
+	   {
+	   if (distances[i] <= config.threshold)
+	      {
+	      sums[2] += distances[i];
+	      within++;
+	      }
+	   }
+        }
+     clock_gettime(CLOCK_MONOTONIC,&end);
+     seconds[2] = elapsedSeconds(&start,&end);
+     for (m = 0; m < 3; m++)
+        {
+	if ((rep == 0) || (seconds[m] < best[m]))
+	   best[m] = seconds[m];
+        }
+     }
+  printf("%d x %d points within %.0lf m of (%.4lf,%.4lf), best of %d\n",
+	 config.refCount,config.targetCount,config.spread,config.lon,config.lat,
+	 config.repeat);
+  printf("  single pairs:  %.3lf s   %.2lf M pairs/s   (sum %.6lf km)\n",
+	 best[0],pairs / best[0] / 1.0e6,sums[0] / 1000.0);
+  printf("  tiles:         %.3lf s   %.2lf M pairs/s   (sum %.6lf km)\n",
+	 best[1],pairs / best[1] / 1.0e6,sums[1] / 1000.0);
+  printf("  prefiltered:   %.3lf s   %.2lf M pairs/s   %ld of %.0lf pairs kept, %ld within %.0lf m\n",
+	 best[2],pairs / best[2] / 1.0e6,filtered,pairs,within,config.threshold);
+  freeGeoPoints(pRefs);
+  freeGeoPoints(pTargets);
+  free(distances);
+  free(found);
+  free(lats);
+  exit(0);
+}
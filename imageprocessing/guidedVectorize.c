@@ -9,6 +9,9 @@
  *    try to vectorize segment by segment
  *    using preferential direction
  *
+ *  The matching itself is done by libmapeval (mapeval.h); this is
+ *  the command line front end, for single jobs and batches.
+ *
  * Copyright 2020 Sally E. Goldin
  * 
  * Licensed under the Apache License, Version 2.0 (the "License");
@@ -125,753 +128,481 @@
 #include <sys/stat.h>
 #include <unistd.h> /* for stat */
 #include <errno.h>
+#include <pthread.h>
 
 #include "structures.h"
 #include "fileFunctions.h"
 #include "debugFunctions.h"
+#include "logger.h"
+#include "featureMatch.h"
+#include "refCache.h"
+#include "instrument.h"
+#include "mapeval.h"
 //#include "abstractHeap.h"
 
 
-void logOutput(char* message);
-int calculateDirection(int x1, int y1, int x2, int y2);
-void meters2pixels(double xm, double ym, int* pCol, int* pRow);
-double calculateSlope(int x1, int y1, int x2, int y2);
-double calcDistance(POINT_T * p1, POINT_T * p2);
+/* If not empty, input images are JPEGs from this provider, to be
+ * binarized as they are read. Set by the -provider option.
+ */
+char providerName[64] = "";
 
-/* global variables used for georeferencing pixels */
-int refcount;           /* count of reference features */
-double cellsize;        /* size of one cell in meters */
-double cellsizeX;       /* size of one cell in meters - X direction */
-double cellsizeY;       /* size of one cell in meters - Y direction */
-double origX;           /* X coordinate of origin (meters) */
-double origY;           /* Y coordinate of origin */
-double centerX;         /* X coordinate of center pixel (meters) */
-double centerY;         /* Y coordinate of center pixel */
+/* how each job is matched; set by -nearest, -checknearest, -copy,
+ * -threads, -band, -connected, -minblob and -compare
+ */
+MAPEVAL_OPTIONS_T options;
 
 int width = 0;          /* image width in pixels */ 
 int height = 0;         /* image height in pixels */
 
-char * directionLabels[] = {"N","NE","E","SE","S","SW","W","NW"};
+/* log file set by -logfile; if empty each job logs to <outprefix>.log */
+char logFilename[256] = "";
+
+/* if TRUE write <outprefix>.stats.json for each job; set by -stats */
+BOOL bStats = FALSE;
+/* if TRUE include hardware counters in the statistics; set by -perf */
+BOOL bPerf = FALSE;
+
+/* reference cache file set by -refcache; if given, the reference 
+ * features are taken from the cache rather than the parameter file 
+ */
+char refCacheFilename[256] = "";
+/* the cache, mapped into memory once and used for every job */
+REF_CACHE_T* refCache = NULL;
+
+
+/* one job read from a batch manifest */
+typedef struct _batchJob
+{
+  char imagefile[256];  /* binary input image */
+  char paramfile[256];  /* georeferencing and reference coordinates */
+  char outprefix[256];  /* output file name (no suffix) */
+  int expId;            /* DB Id of the experiment */
+  char provider[64];    /* provider, if imagefile is a JPEG */
+  int lineNum;          /* line in the manifest, for messages */
+  MAPEVAL_JOB_T* pMapeval; /* the job itself, holding the image once read */
+  int loadStatus;       /* result of reading the image */
+  double loadSeconds;   /* time taken to read the image, if instrumented */
+  pthread_t thread;     /* thread reading the image in the background */
+  BOOL bPrefetching;    /* TRUE if 'thread' is running */
+} BATCH_JOB_T;
 
 /* explain arguments */
 void usage()
 {
   printf("Usage:\n");
-  printf("  guidedVectorize <w> <h> <infile> <paramfile> <outputfile> <expId>\n\n");
+  printf("  guidedVectorize <w> <h> <infile> <paramfile> <outputfile> <expId> [options]\n\n");
   printf("     w          - width of input image in pixels\n");
   printf("     h          - height of input image in pixels\n");
-  printf("     infile     - binary input image expected to be rgb, 3 bytes per pixel\n");
+  printf("     infile     - binary input image expected to be rgb, 3 bytes per pixel,\n");
+  printf("                  or the provider's JPEG image if -provider is given\n");
   printf("     paramfile  - georeferencing information and reference coordinates\n");
+  printf("                  as text, or in the binary format written by wkbToParam;\n");
+  printf("                  reference lines are clipped to the image\n");
   printf("     outputfile - output file name to create (no suffix)\n");
-  printf("     expId      - DB Id of this experiment, used in the SQL\n");
+  printf("     expId      - DB Id of this experiment, used in the SQL\n\n");
+  printf("  guidedVectorize -batch <w> <h> <manifest> [options]\n\n");
+  printf("     manifest   - file with one job per line, or '-' to read standard input\n");
+  printf("                  each line is: <infile> <paramfile> <outputfile> <expId> [provider]\n");
+  printf("                  all images must be w x h pixels\n\n");
+  printf("  Options:\n");
+  printf("     -provider <p> - infile is the JPEG captured from provider p (google, bing,\n");
+  printf("                     here, mapquest); it is decoded and binarized directly\n");
+  printf("     -threads <n>  - match reference features using n threads (0 means one\n");
+  printf("                     per processor); output is the same as with one thread\n");
+  printf("     -copy         - write the query lines to <outputfile>.copy as a PostgreSQL\n");
+  printf("                     COPY stream for table querylines, instead of <outputfile>.sql\n");
+  printf("     -nearest      - match each reference point to the closest road pixel,\n");
+  printf("                     using a distance transform rather than a spiral search;\n");
+  printf("                     the search window is the same\n");
+  printf("     -checknearest - use the spiral search but compare every result with\n");
+  printf("                     the distance transform; prints a summary per job\n");
+  printf("     -loglevel <l> - log messages up to level l: error, warn (the default),\n");
+  printf("                     info, debug (per feature) or trace (per point)\n");
+  printf("     -logfile <f>  - write the log to f; otherwise each job writes\n");
+  printf("                     <outputfile>.log, created only if there are messages\n");
+  printf("     -connected    - stop following a reference feature when the next point\n");
+  printf("                     found is not connected to the last one by road pixels\n");
+  printf("     -minblob <n>  - ignore road regions of fewer than n pixels\n");
+  printf("     -band <n>     - read the image in bands of n rows instead of all at\n");
+  printf("                     once, for images too large to fit in memory; the\n");
+  printf("                     reference features are read first, and -threads\n");
+  printf("                     is ignored\n");
+  printf("     -stats        - write the time spent in each stage, and counts of\n");
+  printf("                     pixels probed, vertices matched and bytes written,\n");
+  printf("                     to <outputfile>.stats.json\n");
+  printf("     -perf         - as -stats, adding CPU cycles and cache misses\n");
+  printf("                     for each stage if the system allows it\n");
+  printf("     -compare      - compare each reference feature with the lines matched\n");
+  printf("                     to it (Hausdorff and Frechet distance, length difference)\n");
+  printf("                     and write <outputfile>.linematch.copy as a PostgreSQL\n");
+  printf("                     COPY stream for table linematch\n");
+  printf("     -refcache <f> - take the reference features from the cache file f,\n");
+  printf("                     written by wkbToParam -cache, clipping them to the\n");
+  printf("                     image; paramfile then supplies only the header\n");
   exit(0);
 }
-
-/* Read the next feature from the reference file, assumed to be open
- * 2019-12-27 ignore duplicate points 
- * (not dups in world coords, but map to same image coordinates)
- * @param  pFp      File pointer for open file
- * @param  input    Dynamically allocated input buffer for big lines
- * @param  bufsize  Size of dynamic buffer
- * @param  pRefId   Pointer to reference feature ID
- * @return Pointer to head of list of points in image coordinates
- *         or NULL if no more features 
+/* Run the guided vectorization for a single job, that is, one image
+ * and one parameter file. Creates <outprefix>.vec and <outprefix>.sql,
+ * and with -compare <outprefix>.linematch.copy.
+ * Log messages go to <outprefix>.log unless -logfile was given, in 
+ * which case that log is already running. With -stats, the stages
+ * and counts recorded since the last instrumentReset are written
+ * to <outprefix>.stats.json.
+ * @param pJob       Job context, with its image already loaded
+ * @param paramfile  Georeferencing information and reference coordinates
+ * @param outprefix  Output file name to create (no suffix)
+ * @param expId      DB Id of this experiment, used in the SQL
+ * @return 0 for success, otherwise the error code that the
+ *         single job program would have used as its exit status
  */
-POINT_T * readNextReferenceFeature(FILE* pFp, char* input,
-				   unsigned long bufsize, int* pRefId)
+int vectorizeJob(MAPEVAL_JOB_T* pJob, char* paramfile, char* outprefix,
+		 int expId)
 {
-  POINT_T * pHead = NULL; /* head and tail of current feature */
-  POINT_T * pTail = NULL;
-  if (fgets(input,bufsize,pFp) != NULL)
+  int status = 0;
+  char jobLogFile[256];
+  BOOL bJobLog = ((logFilename[0] == '\0') && (logLevel > LOG_ERROR));
+  if (bJobLog)
      {
-     int row, col = 0;
-     char * token = NULL;
-     double xCoord, yCoord;
-     int cellx,celly;
-     int pointCount;
-     int first = 1;
-     token = strtok(input,",\n");
-     while (token != NULL)
-       {
-       POINT_T * pPoint = NULL;
-       if (first)
-	  {
-	  sscanf(token,"%d %lf %lf",pRefId,&xCoord,&yCoord);
-	  first = 0;
-	  }
-       else
-	  {
-	  sscanf(token,"%lf %lf",&xCoord,&yCoord);
-	  }
-       meters2pixels(xCoord,yCoord,&cellx,&celly);
-       pPoint = calloc(1,sizeof(POINT_T));
-       if (pPoint == NULL)
-	 {
-	 printf("Error allocating point\n");
-	 exit(3);
-	 }
-       pPoint->x = cellx;
-       pPoint->y = celly;
-       if (pHead == NULL)
-	    {
-	    pHead = pTail = pPoint;
-	    }
-       else
-	 {
-	 pTail->next = pPoint;
-	 pPoint->prev = pTail;
-	 pTail = pPoint;
-	 }
-       // }
-       token = strtok(NULL,",\n");
-       }
+     snprintf(jobLogFile,sizeof(jobLogFile),"%s.log",outprefix);
+     logStart(jobLogFile);
      }
-  return pHead;
-}
-
-/* convert a point in meters to the closest x,y (column/line) pixel position
- * @param     xm               X coord in meters
- * @param     ym               Y coord in meters
- * @param     pCol             pointer to column number (x)
- * @param     pRow             pointer to row number (y)
- * Returns results in passed pointers - truncates any fractional part
- * Uses global origin, cell size and image size data
- */
-void meters2pixels(double xm, double ym, int* pCol, int* pRow)
-{
-
-  // revised to use center coordinates and to round to closest row/col
-  *pCol = round((xm - centerX)/cellsizeX) + width/2;
-  *pRow = round((ym - centerY)/cellsizeY * -1) + height/2;
-  
+  status = mapevalLoadReferences(pJob,paramfile);
+  if (status == 0)
+     status = mapevalOpenOutput(pJob,outprefix,expId);
+  if (status == 0)
+     {
+     int closeStatus = 0;
+     status = mapevalMatch(pJob);
+     /* a write error takes precedence over an incomplete image */
+     closeStatus = mapevalCloseOutput(pJob);
+     if (closeStatus != 0)
+        status = closeStatus;
+     }
+  if (bStats)
+     {
+     char statsfile[256];
+     snprintf(statsfile,sizeof(statsfile),"%s.stats.json",outprefix);
+     instrumentWrite(statsfile);
+     }
+  if (bJobLog)
+     logStop();
+  return status;
 }
 
-/* convert a point in pixels to x,y in meters
- * @param     col               column number (x)
- * @param     row               row number (y)
- * @param     pXm               pointer to X coord in meters
- * @param     pYm               pointer to Y coord in meters
- * Returns results in passed pointers
- * Uses global origin and cell size data
+/* Thread function that reads the image for a batch job 
+ * in the background.
+ * @param pArg   Pointer to the BATCH_JOB_T to fill in
+ * @return pArg
  */
-void pixels2meters(int col, int row, double* pXm, double* pYm)
+void* prefetchImage(void* pArg)
 {
-  *pXm = (double) centerX + ((col - width/2) * cellsizeX);
-  *pYm = (double) centerY - ((row - height/2) * cellsizeY) ;
+  BATCH_JOB_T* pJob = (BATCH_JOB_T*) pArg;
+  double start = 0.0;
+  if (bInstrument)
+     start = instrumentClock();
+  pJob->loadStatus = mapevalLoadImage(pJob->pMapeval,pJob->imagefile,
+				      pJob->provider);
+  if (bInstrument)
+     pJob->loadSeconds = instrumentClock() - start;
+  return pArg;
 }
 
-/* Calculate the mean distance between exp points and the ref points
- * based on the data stored in the POINT_T structures, and the standard
- * deviation. 
- * @param pHead     First point in experimental feature linked list
- * @param pStdev    Pointer for returning the standard deviation
- * Returns the mean distance as the function value
+/* Read the next job from a batch manifest. Each line holds
+ * an image file, a parameter file, an output prefix and an experiment Id,
+ * separated by white space, optionally followed by the provider 
+ * if the image is a JPEG. Blank lines and lines starting
+ * with '#' are skipped. Jobs without a provider use the one
+ * given by -provider, if any. A new job context is created
+ * for the job.
+ * @param pManifest   File pointer for open manifest file
+ * @param pJob        Job structure to fill in 
+ * @param pLineNum    Pointer to line number in the manifest, updated
+ * @return TRUE if a job was read, FALSE at end of file
  */
-double calculateFit(POINT_T* pHead,double* pStdev)
+BOOL readBatchJob(FILE* pManifest, BATCH_JOB_T* pJob, int* pLineNum)
 {
-  int count = 0;
-  double sumDistance = 0.0;
-  double sumSquares = 0.0;
-  double mean = 0;
-  POINT_T* pCurrent = pHead;
-  while (pCurrent != NULL)
+  char input[1024];
+  BOOL bFound = FALSE;
+  memset(pJob,0,sizeof(BATCH_JOB_T));
+  while ((!bFound) && (fgets(input,sizeof(input),pManifest) != NULL))
     {
-    count++;
-    sumDistance += pCurrent->matchdistance;
-    sumSquares += (pCurrent->matchdistance * pCurrent->matchdistance);
-    pCurrent = pCurrent->next;
-    }
-  mean = sumDistance/count;
-  *pStdev = sqrt((sumSquares/count - mean*mean)/(count-1));
-  return mean;
-}
-
-/* Write a feature to the SQL output file, as an insert command
- * @param pHead        Starting point of feature
- * @param experimentId Numeric Id of this experimental comparison
- * @param refFeatureId Numeric Id of corresponding reference feature
- * @param dataId       QueryDataId
- * @param refPoints    Number of points in reference feature
- * @param matchpercent What percent of ref features points were found?
- * @param pOut         File pointer for open text file.
- */
-void writeSqlFeature(POINT_T* pHead,int experimentId, int refFeatureId,int dataId, int refPoints, double matchpercent, FILE* pOut)
-{
-    POINT_T * pCurrent = pHead;
-    int first = 1;
-    double meandistance;
-    double stdevdistance;
-    meandistance = calculateFit(pHead,&stdevdistance);
-    meandistance *= cellsize;  /* change to meters */
-    stdevdistance *= cellsize; 
-
-    fprintf(pOut,"INSERT INTO QUERYLINES (experimentid,dataid,uploadfeatureid,refpointcount,matchpercent,meandistance,stdevdistance,geom) VALUES (%d, %d, %d, %d, %.2lf, %.2lf, %.2lf, ST_GeomFromText('LINESTRING(",
-	    experimentId,dataId,refFeatureId,refPoints,matchpercent,meandistance,stdevdistance);
-    fflush(pOut);
-    while (pCurrent != NULL)
+    char firstChar[2];
+    (*pLineNum)++;
+    if ((sscanf(input,"%1s",firstChar) != 1) || (firstChar[0] == '#'))
+      continue;
+    if (sscanf(input,"%255s %255s %255s %d %63s",pJob->imagefile,pJob->paramfile,
+	       pJob->outprefix,&pJob->expId,pJob->provider) < 4)
       {
-      double geoX; 
-      double geoY;
-      pixels2meters(pCurrent->x,pCurrent->y,&geoX,&geoY);
-      if (!first)
-	 {
-	 fprintf(pOut,", ");
-	 }
-      first = 0;
-      fprintf(pOut,"%.6lf %.6lf",geoX,geoY); 
-      fflush(pOut);
-      pCurrent = pCurrent->next;
+      printf("Error in batch manifest line %d - expected <infile> <paramfile> <outputfile> <expId> [provider]\n",
+	     *pLineNum);
+      continue;
       }
-    // Should be Web Mercator, not lat long
-    fprintf(pOut,")',3857));\n");
-}
-
-/* calculate the Euclidean distance between two points (in pixels).
- * @param p1    First point
- * @param p2    Second point
- * @return distance
- */
-double calculateDistance(POINT_T * p1, POINT_T * p2)
-{
-  double dist =  (p1->x - p2->x)*(p1->x - p2->x) + (p1->y - p2->y)*(p1->y - p2->y);
-  return sqrt(dist);
-}
-
-
-/* Compare two values. Return 1 if val1 > val2,
- * -1 if val1 < val2, 0 if they are the same
- */
-int signDiff(int val1, int val2)
-{
-  int result = 0;
-  if (val1 > val2)
-    result = 1;
-  else if (val1 < val1)
-    result = -1;
-  return result;
-}
-
-/* clear terminal and reset to row 0, column 0
- */
-void toTop()
-{
-  char clearScreen[] = {0x1B,'[','2','J',0};
-  printf("%s",clearScreen);
-
-}
-
-/* Use character graphics to display the contents of a neighborhood
- * around a pixel location, and optionally the current to be examined
- * pixel.
- * @param image  BYTE array of data values to search
- * @param width  Width of the image
- * @param height Height of the image
- * @param centerx   Center pixel x
- * @param centery   Center pixel y
- * @param tolerance Radius of neighborhood
- * @param x  If >= 0, mark as current pixel
- * @param y  If >= 0, mark as current pixel
- */
-void showNeighborhood(BYTE* image,int width, int height,
-		      int centerx, int centery, int tolerance, int x, int y)
-{
-  int r=0;  /* row counter */
-  int c=0;  /* column counter */
-  int curx;
-  int cury; 
-  int bShow = 0;
-  char buffer[32];
-  if ((x >= 0) && (y >= 0))
-    {
-    curx = x - centerx;
-    cury = y - centery;
-    bShow = 1;
-    printf("x=%d, curx=%d, y=%d, cury=%d\n",x,curx,y,cury);
+    if (strlen(pJob->provider) == 0)
+      strcpy(pJob->provider,providerName);
+    pJob->lineNum = *pLineNum;
+    bFound = TRUE;
     }
-  for (r = -tolerance; r <= tolerance; r++)
+  if (bFound)
     {
-    printf("\n");
-    for (c = -tolerance; c <= tolerance; c++)
+    pJob->pMapeval = newMapevalJob(&options,width,height,refCache);
+    if (pJob->pMapeval == NULL)
       {
-      int xcoord = centerx + c;
-      int ycoord = centery + r;
-      if ((xcoord < 0) || (xcoord >= width) ||
-	  (ycoord < 0) || (xcoord >= height))
-	continue;
-      if ((r == 0) && (c == 0))
-	  {
-	  if (pixval(xcoord,ycoord,width) == WHITE)
-	      printf("X");
-	  else
-	      printf("O");
-	  }
-      else if (bShow && (r == cury) && (c == curx))
-	  {
-	  if (pixval(xcoord,ycoord,width) == WHITE)
-	      printf("*");
-	  else
-	      printf("o");
-	  }
-      else
-	  {
-	  if (pixval(xcoord,ycoord,width) == WHITE)
-	      printf("+");
-	  else
-	      printf(" ");
-	  }
+      printf("Error allocating batch job at line %d\n",pJob->lineNum);
+      exit(3);
       }
     }
-    printf("\nType Return to continue\n");
-    fgets(buffer,sizeof(buffer),stdin);
-    toTop();
+  return bFound;
 }
 
-
-/* Look for match to point refx,refy, starting at the same pixel
- * and looking in the neighborhood.
- * Must be within 'tolerance' pixels 
- * If found allocate a POINT_T for that point and return it.
- * @param image  BYTE array of data values to search
- * @param width  Width of the image
- * @param height Height of the image
- * @param refx   Reference feature start x
- * @param refy   Reference feature start y
- * @param tolerance Radius of region to search for the starting point
- * @param direction Preferred direction for searching: 0 = N, 1 = NE, 2 = E, etc.
- *               Based on direction between last ref point and last target point
- *               -1 if no information (or the last ref and last target were the same)
- * @return newly allocated POINT_T with coordinates set, or NULL if can't find
+/* Start reading the image for a job in a background thread.
+ * If the thread cannot be created, the image will be read
+ * in the foreground by finishPrefetch instead.
+ * @param pJob    Job whose image should be read
  */
-POINT_T* findPoint(BYTE* image,int width, int height,
-		   int refx, int refy, int tolerance, int direction)
+void startPrefetch(BATCH_JOB_T* pJob)
 {
-    POINT_T * pNew = NULL;
-    POINT_T refpoint;
-    int bFound = 0;     /* flag telling us we've found a white pixel */
-    int xFound = -1;  /* coordinates of points found */
-    int yFound = -1;
-    int i = 0;
-    int j = 0;
-    char message[256]; /* for logging */
-    int stepsX[] = {0,1,1,1,0,-1,-1,-1};    /* N, NE, E, SE, S, SW, W, NW */
-    int stepsY[] = {-1,-1,0,1,1,1,0,-1};    /* N, NE, E, SE, S, SW, W, NW */
-    int nextX[] = {1,0,0,-1,-1,0,0,1};
-    int nextY[] = {0,1,1,0,0,-1,-1,0};
-    int order[] = {0,1,-1,2,-2,3,-3,4};     /* increment to add to get which direction
-					     * to check next 
-					     */
-    int radius = 1;  /* start at 1, gradually increase */
-    refpoint.x = refx;
-    refpoint.y = refy;
-    sprintf(message,"Looking for point at (%d,%d) direction %s\n",refx,refy,directionLabels[direction]);
-    logOutput(message);
-    //printf(message);
-    //showNeighborhood(image,width,height,refx,refy,tolerance,-1,-1);
-    if (direction < 0)
-       direction = 0;
-    /* First examine the exact same location in the image! */
-    if (pixval(refx,refy,width) == WHITE)
-      {
-      xFound = refx;
-      yFound = refy;
-      bFound = 1;
-      }
-    //if (bFound)
-    //  logOutput("Found exact match\n");
-
-    /* If we didn't get a match at the exact pixel, look around it.
-     * Start at preferred direction, then search one on either side, two on either side, etc.
-     */
-    while ((!bFound) & (radius <= tolerance))
-      {  
-      int dirX =0;
-      int dirY =0;
-      int dirXNext = 0;
-      int dirYNext = 0;
-      int baseIncX = 0;
-      int baseIncY = 0;
-      int incrementX = 0;
-      int incrementY = 0;
-      int signDiffX = 0;
-      int signDiffY = 0;
-      //sprintf(message,"--- RADIUS IS %d\n",radius);
-      //logOutput(message);
-      
-      for (i = 0; (i < 8) && (!bFound); i++)
-	{  
-	dirX = stepsX[i];
-	dirY = stepsY[i];
-	baseIncX = dirX * radius; 
-	baseIncY = dirY * radius; 
-	for (j = 0; (j < radius) && (!bFound); j++)
-	  {
-	  incrementX = baseIncX + nextX[i]*j;
-	  incrementY = baseIncY + nextY[i]*j;
-          if ((refx + incrementX < 0) || 
-	      (refx + incrementX >= width) ||
-	      (refy + incrementY < 0) || 
-	      (refy + incrementY >= height))
-	    continue; 
-	  sprintf(message,"--- Examining (%d,%d)\n",refx+incrementX,refy+incrementY);
-	  //logOutput(message);
-	  //printf(message);
-	  //showNeighborhood(image,width,height,refx,refy,tolerance,refx+incrementX,refy+incrementY);
-	  if (pixval((refx+incrementX),(refy+incrementY),width) == WHITE)
-	      {
-	      xFound = refx+incrementX;
-	      yFound = refy+incrementY;
-	      bFound = 1;
-	      }
-          } /* end j loop */
-	}   /* end i loop */
-      radius++;
-      }
-    if (bFound)
-      {
-      sprintf(message,"--- FOUND at (%d,%d)\n",xFound,yFound);
-      logOutput(message);
-
-      pNew = calloc(1,sizeof(POINT_T));
-      if (pNew == NULL)
-	{
-	  printf("Error allocating point structure\n");
-	  exit(100);
-	}
-      pNew->x = xFound;
-      pNew->y = yFound;
-      pNew->matchdistance = calculateDistance(&refpoint,pNew);
-      }
-
-    return pNew;
+  pJob->bPrefetching = 
+     (pthread_create(&pJob->thread,NULL,prefetchImage,pJob) == 0);
 }
 
-/* Try to match reference feature points to white pixels in the
- * image. We check the start and end of each line segment in
- * the reference feature against the image, subject to the tolerance
- * radius. If we find a match, we check that there is a connected
- * line between the two points.
- * @param pRefHead   First point in the reference feature
- * @param pPtrRefTail Used to set the tail of ref feature - for free fn
- * @param pHead      First point in the experimental feature
- * @param pPtrTail   Pointer to pointer to the tail, which this function will change.
- * @param image  BYTE array of image data
- * @param width  Width of the image
- * @param height Height of the image
- * @param tolerance Radius of point search in pixels
- * @return number of points in the experimental feature
+/* Wait until the image for a job has been read.
+ * @param pJob    Job whose image we need
+ * @return 0 if the image was read, 1 if it could not be read
  */
-int followReferenceFeature(POINT_T* pRefHead,POINT_T** pPtrRefTail, 
-			   POINT_T * pHead,POINT_T** pPtrTail,
-			   BYTE* image,int width,int height,
-			   int tolerance)
+int finishPrefetch(BATCH_JOB_T* pJob)
 {
-  int count = 1;  /* return value; we have one point, namely the head*/
-  char message[256];
-  POINT_T * pNew = NULL;
-  POINT_T * pRefCurrent = pRefHead->next;
-  POINT_T * pRefPrior = pRefHead;
-  int xFound = 0;  /* coordinates of points found */
-  int yFound = 0;
-  int direction = 0;
-  while (pRefCurrent != NULL) 
-    {
-    //direction = calculateDirection(pRefPrior->x,pRefPrior->y,pRefCurrent->x,pRefCurrent->y);
-    if (pNew == NULL)
-       direction = calculateDirection(pRefPrior->x,pRefPrior->y,pHead->x,pHead->y);
-    else
-       direction = calculateDirection(pRefPrior->x,pRefPrior->y,pNew->x,pNew->y);
- 
-    pNew = findPoint(image,width,height,pRefCurrent->x, 
-		     pRefCurrent->y,tolerance,direction);
-    if (pNew == NULL) /* no next point */
-       break; 
-    /* check connectivity between this point and the last one */
-    /* SKIP for now */
-    /**
-    if (!isConnected(image,width,height,*pPtrTail,pNew,tolerance))
-      {
-      free(pNew);
-      break;
-      }
-    **/
-    (*pPtrTail)->next = pNew;
-    pNew->prev = *pPtrTail;
-    *pPtrTail = pNew;
-    count++;
-    *pPtrRefTail = pRefCurrent;
-    pRefPrior = pRefCurrent;
-    pRefCurrent = pRefCurrent->next;
-    }   
-  if (pRefCurrent != NULL)  /* find the true tail */
-    {
-    while (pRefCurrent != NULL)
-	{
-	*pPtrRefTail = pRefCurrent;
-	pRefCurrent = pRefCurrent->next;
-	}
-    }
-  return count;
+  if (pJob->bPrefetching)
+     {
+     pthread_join(pJob->thread,NULL);
+     pJob->bPrefetching = FALSE;
+     }
+  else
+     {
+     prefetchImage(pJob);
+     }
+  return pJob->loadStatus;
 }
 
-/* Free the linked list for the latest feature 
- * @param pPHead   Pointer to pointer to the head
- * @param pPTail   Pointer to pointer to the tail
+/* Process all the jobs listed in a batch manifest in this process.
+ * While one job is being matched, the image for the next job is
+ * read by a background thread.
+ * @param manifest   Name of manifest file, or "-" for standard input
+ * @return number of jobs that failed
  */
-void freePointList(POINT_T** pPHead, POINT_T** pPTail)
+int runBatch(char* manifest)
 {
-    POINT_T* pCurrent = *pPHead;
-    POINT_T* pRemove = NULL;
-    while (pCurrent != NULL)
-      {
-      pRemove = pCurrent;
-      pCurrent = pCurrent->next;
-      free(pRemove);
-      }
-   *pPHead = *pPTail = NULL;
-}
-
- 
-
-
-/* Given start and end coordinates of a line segment, determine
- * the predominant direction as follows:
- *  N = 0, NE = 1, E = 2, SE = 3, S = 4, SW = 5, W = 6, NW = 7
- * Note the origin is at the upper left
- * @param  x1     X coord of line segment start
- * @param  x1     X coord of line segment start
- * @param  x1     X coord of line segment start
- * @param  x1     X coord of line segment start
- * @return direction constant according to the scheme above. 
- */ 
-int calculateDirection(int x1, int y1, int x2, int y2)
-{
-  int direction = 0;
-  if (x1 == x2)
+  FILE* pManifest = NULL;
+  BATCH_JOB_T jobs[2];  /* current job and next job */
+  int current = 0;
+  int lineNum = 0;
+  int failCount = 0;
+  BOOL bMore = FALSE;
+  if (strcmp(manifest,"-") == 0)
+     pManifest = stdin;
+  else
+     pManifest = fopen(manifest,"r");
+  if (pManifest == NULL)
      {
-     if (y2 > y1)
-       direction = 4;  /* s */
-     else 
-       direction = 0;  /* n */
+     printf("Error opening batch manifest %s - errno is %d\n",manifest,errno);
+     return 1;
      }
-  else if (y1 == y2) /* horizontal */
+  bMore = readBatchJob(pManifest,&jobs[current],&lineNum);
+  if ((bMore) && (options.bandRows == 0))
+     startPrefetch(&jobs[current]);
+  while (bMore)
      {
-     if (x2 > x1)
-       direction = 2; /* e */
-     else 
-       direction = 6; /* w */
+     BATCH_JOB_T* pJob = &jobs[current];
+     BATCH_JOB_T* pNext = &jobs[1 - current];
+     int loadStatus = 0;
+     INSTR_TIMER_T timer;
+     if (bInstrument)
+        instrumentReset();
+     if (options.bandRows > 0)
+        {
+	/* bands are read as the job needs them, so there is 
+	 * nothing to prefetch 
+	 */
+	loadStatus = mapevalLoadImage(pJob->pMapeval,pJob->imagefile,
+				      pJob->provider);
+        }
+     else
+        {
+	INSTR_START(&timer);
+	loadStatus = finishPrefetch(pJob);
+	INSTR_STOP(&timer,"image_wait");
+	if (bInstrument)
+	   instrumentAddTime("image_load",pJob->loadSeconds);
+        }
+     bMore = readBatchJob(pManifest,pNext,&lineNum);
+     if ((bMore) && (options.bandRows == 0))
+        startPrefetch(pNext);
+     LOGINFO("BATCH JOB AT LINE %d: %s %s %s %d",pJob->lineNum,
+	     pJob->imagefile,pJob->paramfile,pJob->outprefix,pJob->expId);
+     if (loadStatus != 0)
+        {
+	printf("Error reading image %s for batch job at line %d\n",
+	       pJob->imagefile,pJob->lineNum);
+	failCount++;
+	}
+     else if (vectorizeJob(pJob->pMapeval,pJob->paramfile,pJob->outprefix,
+			   pJob->expId) != 0)
+        {
+	printf("Batch job at line %d failed\n",pJob->lineNum);
+	failCount++;
+        }
+     freeMapevalJob(pJob->pMapeval);
+     pJob->pMapeval = NULL;
+     current = 1 - current;
      }
-  else if (x2 > x1)
+  if (pManifest != stdin)
+     fclose(pManifest);
+  return failCount;
+}
+
+/* Process the optional arguments that follow the required ones.
+ * @param argc    Argument count from main
+ * @param argv    Arguments from main
+ * @param first   Index of first optional argument
+ */
+void parseOptions(int argc, char* argv[], int first)
+{
+  int i = 0;
+  initMapevalOptions(&options);
+  for (i = first; i < argc; i++)
      {
-     if (y2 > y1)
-       direction = 3; /* se */
-     else 
-       direction = 1; /* ne */
+     if (strcmp(argv[i],"-nearest") == 0)
+        options.searchMode = SEARCH_NEAREST;
+     else if (strcmp(argv[i],"-checknearest") == 0)
+        options.searchMode = SEARCH_CHECK;
+     else if (strcmp(argv[i],"-copy") == 0)
+        options.bCopyOutput = TRUE;
+     else if ((strcmp(argv[i],"-threads") == 0) && (i + 1 < argc))
+        {
+	options.threadCount = atoi(argv[i+1]);
+	if (options.threadCount <= 0)
+	   options.threadCount = sysconf(_SC_NPROCESSORS_ONLN);
+	if (options.threadCount <= 0)
+	   options.threadCount = 1;
+	i++;
+	}
+     else if ((strcmp(argv[i],"-band") == 0) && (i + 1 < argc))
+        {
+	options.bandRows = atoi(argv[i+1]);
+	if (options.bandRows <= 0)
+	   usage();
+	i++;
+	}
+     else if (strcmp(argv[i],"-connected") == 0)
+        options.bConnected = TRUE;
+     else if ((strcmp(argv[i],"-minblob") == 0) && (i + 1 < argc))
+        {
+	options.minBlobPixels = atoi(argv[i+1]);
+	i++;
+	}
+     else if (strcmp(argv[i],"-stats") == 0)
+        bStats = TRUE;
+     else if (strcmp(argv[i],"-perf") == 0)
+        bStats = bPerf = TRUE;
+     else if (strcmp(argv[i],"-compare") == 0)
+        options.bCompare = TRUE;
+     else if ((strcmp(argv[i],"-loglevel") == 0) && (i + 1 < argc))
+        {
+	logLevel = parseLogLevel(argv[i+1]);
+	if (logLevel < 0)
+	   usage();
+	i++;
+	}
+     else if ((strcmp(argv[i],"-logfile") == 0) && (i + 1 < argc))
+        {
+	strncpy(logFilename,argv[i+1],sizeof(logFilename) - 1);
+	i++;
+	}
+     else if ((strcmp(argv[i],"-refcache") == 0) && (i + 1 < argc))
+        {
+	strncpy(refCacheFilename,argv[i+1],sizeof(refCacheFilename) - 1);
+	i++;
+	}
+     else if ((strcmp(argv[i],"-provider") == 0) && (i + 1 < argc))
+        {
+	strncpy(providerName,argv[i+1],sizeof(providerName) - 1);
+	i++;
+	}
+     else
+        usage();
      }
-  else
+  if ((options.bandRows > 0) && ((options.bConnected) || (options.minBlobPixels > 0)))
      {
-     if (y2 > y1)
-       direction = 5; /* sw */
-     else 
-       direction = 7; /* nw */
+     printf("-connected and -minblob need the whole image, so cannot be used with -band\n");
+     exit(1);
      }
-  return direction; 
-}
-
-void logOutput(char* string)
-{
-   static FILE* pLogOut = NULL;
-   if (pLogOut == NULL)
+  if (refCacheFilename[0] != '\0')
      {
-     pLogOut = fopen("/tmp/guidedVectorizeLogfile.txt","w");
-     if (pLogOut == NULL)
-       {
-       printf("Error opening log file - errno is %d\n",errno);
-       exit(21);
-       }
+     refCache = openRefCache(refCacheFilename);
+     if (refCache == NULL)
+        {
+	printf("Error opening reference cache %s - errno is %d\n",refCacheFilename,errno);
+	exit(1);
+        }
      }
-   fprintf(pLogOut,"%s\n",string);
 }
 
 /* Main function gets arguments, allocates byte array, reads in the data */
 int main(int argc, char* argv[])
 {
-  FILE * pOut = NULL;   /* vector output file */
-  FILE * pSql = NULL;   /* sql output file */
-  FILE * pRef = NULL;
   char infile[256];
   char paramfile[256];
-  char vecoutfile[256];
-  char sqloutfile[256];
-  char imgoutfile[256];
-  char input[256];
-  int x = 0;
-  int y = 0;
-  int featureCount = 0;
-  double angleThreshold = 32.0;
-  int i = 0;
-  int color = 50; /* for Dragon vector file*/
-  int dataId = 0;
+  char outprefix[256];
   int expId = 0;
-  int tolerance = 3;  /* size of region to search for pixels */
-  /* will be updated from the buffer size in the param file */ 
-  POINT_T * pRefHead = NULL;
-  /* array of bytes for image data*/
-  BYTE * image = NULL;
-  BYTE * imgCopy = NULL;
-  struct stat fileInfo;  /* for getting file size */
-  char * bigBuffer = NULL;  
-     /* dynamically allocated input buffer for ref features*/
-  unsigned long bufSize;
-     /* size of dynamic buffer (= file size) */
-  char message[256]; /* for logging */
-  BYTE remap[256][3];  /* for changing 1 byte to 3 bytes on output */
+  int status = 0;
+  INSTR_TIMER_T timer;
+  /* everything the job needs, including the image once it is read */
+  MAPEVAL_JOB_T * pJob = NULL;
+  if ((argc >= 5) && (strcmp(argv[1],"-batch") == 0))
+     {
+     width = atoi(argv[2]);
+     height = atoi(argv[3]);
+     parseOptions(argc,argv,5);
+     if (bStats)
+        instrumentInit("guidedVectorize",bPerf);
+     if (logFilename[0] != '\0')
+        logStart(logFilename);
+     status = runBatch(argv[4]);
+     closeRefCache(refCache);
+     logStop();
+     exit((status == 0) ? 0 : 1);
+     }
   if (argc < 7)
      usage();
   width = atoi(argv[1]);
   height = atoi(argv[2]);
   strcpy(infile,argv[3]);
   strcpy(paramfile,argv[4]);
-  strcpy(vecoutfile,argv[5]);
-  strcat(vecoutfile,".vec");
-  strcpy(sqloutfile,argv[5]);
-  strcat(sqloutfile,".sql");
-  sprintf(imgoutfile,"copy_%s",infile);
+  strcpy(outprefix,argv[5]);
   expId = atoi(argv[6]);
-
-  if ((image = readImageFile(infile,width,height)) == NULL)
+  parseOptions(argc,argv,7);
+  if (bStats)
+     instrumentInit("guidedVectorize",bPerf);
+  if (logFilename[0] != '\0')
+     logStart(logFilename);
+
+  pJob = newMapevalJob(&options,width,height,refCache);
+  if (pJob == NULL)
     {
-    printf("Error reading image - exiting \n");
-    exit(1);
+    printf("Error allocating job\n");
+    exit(3);
     }
-  /* make a copy for output purposes */
-  /**
-  imgCopy = calloc(width * height,sizeof(BYTE));
-  if (imgCopy == NULL)
-       {
-       printf("Error allocating duplicate image\n");
-       exit(1);
-       }
-  memcpy(imgCopy,image,width*height);
-  initRemapTable(remap);
-  **/
-
-  if (stat(paramfile,&fileInfo) == 0)
-    {
-    bufSize = fileInfo.st_size;
-    bigBuffer = calloc(bufSize,sizeof(char));
-    if (bigBuffer == NULL)
-       {
-       printf("Error allocating %ld character input buffer for file read\n",
-		bufSize);
-       exit(1);
-       }
-    } 
-  else
+  INSTR_START(&timer);
+  status = mapevalLoadImage(pJob,infile,providerName);
+  if (options.bandRows == 0)
+    INSTR_STOP(&timer,"image_load");
+  if (status != 0)
     {
-    printf("Error getting file size for file %d\n",paramfile);
-    exit(1);
-    }
-
-  pRef = fopen(paramfile,"r");
-  if (pRef == NULL)
-    {
-    printf("Error opening input parameter file %s - errno is %d\n",infile,errno);
+    printf("Error reading image - exiting \n");
     exit(1);
     }
-  /* get transformation parameters in the first line */
-  char * read = fgets(input,sizeof(input),pRef);
-  if (read != NULL)
-       { 
-       sscanf(input,"%d %lf %lf %lf %lf %lf %d %d",&refcount,&centerX,&centerY,&cellsize,&cellsizeX,&cellsizeY,&dataId,&tolerance);
-       }
-  sprintf(message,"cellsize=%lf  cellsizeX=%lf  cellsizeY=%lf\n",cellsize,cellsizeX,cellsizeY);
-  logOutput(message);
-  tolerance = round(tolerance/cellsize);  /* convert from meters to pixels */
-  /* open output file in preparation */
-  pOut = fopen(vecoutfile,"w");
-  if (pOut == NULL)
-     {
-     printf("Error opening vector output file %s - errno is %d\n", vecoutfile, errno);
-     exit(4); 
-     }
-  fprintf(pOut,"# tolerance in pixels is %d\n", tolerance);
-  pSql = fopen(sqloutfile,"w");
-  if (pSql == NULL)
-     {
-     printf("Error opening SQL output file %s - errno is %d\n", sqloutfile,errno);
-     exit(4); 
-     }
-  //fprintf(pSql,"BEGIN;\n");
-  int refFeatureId = 0;
-  /* do line following and write to output file */
-  while ((pRefHead = readNextReferenceFeature(pRef,bigBuffer,bufSize,
-                                              &refFeatureId)) != NULL)
-     {
-     int startCol, startRow, endCol, endRow;
-     int pointCount;
-     POINT_T * pRefTail = NULL;
-     POINT_T * pHead = NULL; /* head and tail of current feature */
-     POINT_T * pTail = NULL;
-     int direction = calculateDirection(pRefHead->x,pRefHead->y,pRefHead->next->x,pRefHead->next->y);
-     startCol = pRefHead->x;
-     startRow = pRefHead->y;
-     int refPoints = countPoints(pRefHead);
-     sprintf(message,"\nNEW FEATURE %d READ - START AT (%d,%d) with %d points",refFeatureId,startCol,startRow,refPoints);
-     logOutput(message);
-     pHead = pTail = findPoint(image,width,height,startCol,startRow,tolerance,direction);
-     if (pHead != NULL)
-	 {
-	 pointCount = followReferenceFeature(pRefHead,&pRefTail,
-					     pHead,&pTail,
-					     image,width,height,tolerance);
-
-	 //resetImage(image,pHead); /* set back to WHITE */
-	 if (pointCount > 1)
-	   {
-	   sprintf(message,"  Wrote matching feature with %d out of %d points",pointCount,refPoints);
-	   logOutput(message);
-
-	   writeFeature(pHead,featureCount,pOut,color);
-	   writeSqlFeature(pHead,expId,refFeatureId,dataId,refPoints,(pointCount * 100.0)/refPoints,pSql);
-           //markRoadPixels(imgCopy,width,height,pHead);
-	   featureCount++;
-	   }
-	 else
-	   {
-	   sprintf(message,"  Only one point found for reference line %d - ref points follow:", refFeatureId);
-	   logOutput(message);
-	   POINT_T * pPt = pRefHead;
-	   while (pPt != NULL)
-	     {
-	     sprintf(message,"     (%d, %d)", pPt->x, pPt->y);
-	     logOutput(message);
-	     pPt = pPt->next;
-	     }
-	   }
-	 }
-     else
-         {
-	 /* write message as comment to dragon vector file */
-	 sprintf(message,"  No start point found for reference line %d\n", refFeatureId);
-	 logOutput(message);
-         fprintf(pOut,"#No start point found for reference line %d\n", refFeatureId);
-         }
-     freePointList(&pHead,&pTail);
-     freePointList(&pRefHead,&pRefTail);
-     }
-  fprintf(pOut,"-END\n");  // for the Dragon vector file format
-  //fprintf(pSql,"COMMIT;\n");
-  //printf("Found and wrote %d of %d features\n", featureCount,refcount);
-  /**
-  if (!writeTransformedImageFile(imgoutfile, width, height,remap,imgCopy))
-      printf("Error writing transformed image to file %s\n",imgoutfile);
-  **/
-  free(image);
-  /** free(imgCopy); **/
-  free(bigBuffer);
-  fclose(pOut);
-  fclose(pRef);
-
+  status = vectorizeJob(pJob,paramfile,outprefix,expId);
+  freeMapevalJob(pJob);
+  closeRefCache(refCache);
+  logStop();
+  exit(status);
 }
-
-
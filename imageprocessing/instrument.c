@@ -0,0 +1,276 @@
+/* 
+ *  instrument.c
+ *
+ *  Records the wall time spent in each stage of a program, named
+ *  counts such as pixels probed or bytes written, and optionally CPU
+ *  cycles and cache misses from the Linux perf_event interface. The
+ *  results are written as a small JSON file that the server can store
+ *  with the experiment.
+ *
+ *  Nothing is recorded unless instrumentInit has been called; the
+ *  INSTR_ macros in instrument.h test that first.
+ *
+ *  Copyright 2020 Sally E. Goldin
+ * 
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ * 
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/time.h>
+#include <sys/resource.h>
+#ifdef __linux__
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <linux/perf_event.h>
+#endif
+#include "structures.h"
+#include "instrument.h"
+
+/* most stages and counters one program can record */
+#define MAX_STAGES 24
+#define MAX_COUNTERS 24
+
+/* time and hardware counts accumulated for one stage */
+typedef struct _instrStage
+{
+  char name[32];
+  double seconds;
+  long calls;
+  long long cycles;
+  long long cacheMisses;
+} INSTR_STAGE_T;
+
+/* one named count */
+typedef struct _instrCounter
+{
+  char name[32];
+  long long value;
+} INSTR_COUNTER_T;
+
+int bInstrument = FALSE;
+
+static char programName[64] = "";
+static double resetTime = 0.0;
+static INSTR_STAGE_T stages[MAX_STAGES];
+static int stageCount = 0;
+static INSTR_COUNTER_T counters[MAX_COUNTERS];
+static int counterCount = 0;
+static int cyclesFd = -1;       /* perf_event file descriptors */
+static int cacheMissFd = -1;
+
+/* Return the current time from a monotonic clock, in seconds */
+double instrumentClock()
+{
+  struct timespec now;
+  clock_gettime(CLOCK_MONOTONIC,&now);
+  return now.tv_sec + now.tv_nsec / 1.0e9;
+}
+
+#ifdef __linux__
+/* Open one hardware counter for this process and any threads
+ * it creates later
+ * @param config   PERF_COUNT_HW_ value
+ * @return file descriptor, or -1 if not available
+ */
+static int openPerfCounter(int config)
+{
+  struct perf_event_attr attr;
+  memset(&attr,0,sizeof(attr));
+  attr.type = PERF_TYPE_HARDWARE;
+  attr.size = sizeof(attr);
+  attr.config = config;
+  attr.inherit = 1;
+  attr.exclude_kernel = 1;
+  attr.exclude_hv = 1;
+  return (int) syscall(__NR_perf_event_open,&attr,0,-1,-1,0);
+}
+#endif
+
+/* Read a hardware counter
+ * @param fd    file descriptor from openPerfCounter, or -1
+ * @return current count, 0 if not available
+ */
+static long long readPerfCounter(int fd)
+{
+  long long value = 0;
+  if ((fd < 0) || (read(fd,&value,sizeof(value)) != sizeof(value)))
+     return 0;
+  return value;
+}
+
+/* Set up instrumentation for this process. Must be called 
+ * before any other threads are started if 'bPerf' is set, so that the 
+ * hardware counters include them.
+ * @param program  name of the program, written to the file
+ * @param bPerf    if TRUE, also count CPU cycles and cache misses
+ *                 with perf_event; ignored if not available
+ */
+void instrumentInit(char* program, int bPerf)
+{
+  strncpy(programName,program,sizeof(programName) - 1);
+#ifdef __linux__
+  if (bPerf)
+     {
+     cyclesFd = openPerfCounter(PERF_COUNT_HW_CPU_CYCLES);
+     cacheMissFd = openPerfCounter(PERF_COUNT_HW_CACHE_MISSES);
+     }
+#endif
+  bInstrument = TRUE;
+  instrumentReset();
+}
+
+/* Clear all stages and counters and restart the wall clock,
+ * for example at the start of each job in a batch
+ */
+void instrumentReset()
+{
+  stageCount = 0;
+  counterCount = 0;
+  resetTime = instrumentClock();
+}
+
+/* Return the stage with the given name, adding it if necessary
+ * @param stage   name of the stage
+ * @return pointer to the stage, or NULL if there are too many
+ */
+static INSTR_STAGE_T* findStage(char* stage)
+{
+  int i;
+  for (i = 0; i < stageCount; i++)
+     {
+     if (strcmp(stages[i].name,stage) == 0)
+        return &stages[i];
+     }
+  if (stageCount == MAX_STAGES)
+     return NULL;
+  memset(&stages[stageCount],0,sizeof(INSTR_STAGE_T));
+  strncpy(stages[stageCount].name,stage,sizeof(stages[0].name) - 1);
+  return &stages[stageCount++];
+}
+
+/* Record the starting time (and hardware counts) for a stage
+ * @param pTimer   timer to start
+ */
+void instrumentStart(INSTR_TIMER_T* pTimer)
+{
+  pTimer->cycles = readPerfCounter(cyclesFd);
+  pTimer->cacheMisses = readPerfCounter(cacheMissFd);
+  pTimer->start = instrumentClock();
+}
+
+/* Add the time since instrumentStart to a stage. Stages are
+ * created the first time they are named, and are written in that
+ * order. Call only from one thread.
+ * @param pTimer   timer started by instrumentStart
+ * @param stage    name of the stage
+ */
+void instrumentStop(INSTR_TIMER_T* pTimer, char* stage)
+{
+  double end = instrumentClock();
+  INSTR_STAGE_T* pStage = findStage(stage);
+  if (pStage == NULL)
+     return;
+  pStage->seconds += end - pTimer->start;
+  pStage->calls++;
+  if (cyclesFd >= 0)
+     pStage->cycles += readPerfCounter(cyclesFd) - pTimer->cycles;
+  if (cacheMissFd >= 0)
+     pStage->cacheMisses += readPerfCounter(cacheMissFd) - pTimer->cacheMisses;
+}
+
+/* Add time measured some other way, for example by another thread,
+ * to a stage
+ * @param stage    name of the stage
+ * @param seconds  time to add
+ */
+void instrumentAddTime(char* stage, double seconds)
+{
+  INSTR_STAGE_T* pStage = findStage(stage);
+  if (pStage == NULL)
+     return;
+  pStage->seconds += seconds;
+  pStage->calls++;
+}
+
+/* Add to a counter, creating it the first time it is named.
+ * Call only from one thread.
+ * @param counter  name of the counter
+ * @param amount   value to add
+ */
+void instrumentCount(char* counter, long long amount)
+{
+  int i;
+  for (i = 0; i < counterCount; i++)
+     {
+     if (strcmp(counters[i].name,counter) == 0)
+        {
+	counters[i].value += amount;
+	return;
+        }
+     }
+  if (counterCount == MAX_COUNTERS)
+     return;
+  strncpy(counters[counterCount].name,counter,sizeof(counters[0].name) - 1);
+  counters[counterCount].name[sizeof(counters[0].name) - 1] = '\0';
+  counters[counterCount].value = amount;
+  counterCount++;
+}
+
+/* Write the stages and counters recorded since the last
+ * instrumentReset as a JSON object
+ * @param filename  file to create
+ * @return TRUE if written, FALSE if the file could not be written
+ */
+int instrumentWrite(char* filename)
+{
+  FILE* pOut = NULL;
+  struct rusage resources;
+  BOOL bPerf = ((cyclesFd >= 0) || (cacheMissFd >= 0));
+  int i;
+  pOut = fopen(filename,"w");
+  if (pOut == NULL)
+     {
+     printf("Error opening statistics file %s\n",filename);
+     return FALSE;
+     }
+  getrusage(RUSAGE_SELF,&resources);
+  fprintf(pOut,"{\"program\": \"%s\", \"wall_seconds\": %.6lf, \"peak_rss_kb\": %ld, \"perf\": %s,\n",
+	  programName,instrumentClock() - resetTime,resources.ru_maxrss,
+	  bPerf ? "true" : "false");
+  fprintf(pOut," \"stages\": {");
+  for (i = 0; i < stageCount; i++)
+     {
+     fprintf(pOut,"%s\n  \"%s\": {\"seconds\": %.6lf, \"calls\": %ld",
+	     (i > 0) ? "," : "",stages[i].name,stages[i].seconds,stages[i].calls);
+     if (bPerf)
+        fprintf(pOut,", \"cycles\": %lld, \"cache_misses\": %lld",
+		stages[i].cycles,stages[i].cacheMisses);
+     fprintf(pOut,"}");
+     }
+  fprintf(pOut,"},\n \"counters\": {");
+  for (i = 0; i < counterCount; i++)
+     fprintf(pOut,"%s\n  \"%s\": %lld",(i > 0) ? "," : "",
+	     counters[i].name,counters[i].value);
+  fprintf(pOut,"}}\n");
+  if (fclose(pOut) != 0)
+     {
+     printf("Error writing statistics file %s\n",filename);
+     return FALSE;
+     }
+  return TRUE;
+}
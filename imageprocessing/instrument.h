@@ -0,0 +1,99 @@
+/* Header file for per-stage timing and counting, written as 
+ * a JSON file alongside a program's output
+ *
+ * Copyright 2020 Sally E. Goldin
+ * 
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ * 
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+
+/* Kept out of structures.h so that programs in other directories,
+ * such as prepareShpFiles, can use this module on its own.
+ */
+
+/* start of a timed stage */
+typedef struct _instrTimer
+{
+   double start;             /* monotonic clock, seconds */
+   long long cycles;         /* CPU cycles counted so far */
+   long long cacheMisses;    /* cache misses counted so far */
+} INSTR_TIMER_T;
+
+/* TRUE once instrumentInit has been called. Every macro below tests 
+ * this first, so instrumentation that is not enabled costs one
+ * comparison and its arguments are not evaluated.
+ */
+extern int bInstrument;
+
+/* Start timing a stage; 'pTimer' is an INSTR_TIMER_T* */
+#define INSTR_START(pTimer) \
+  do { if (bInstrument) instrumentStart(pTimer); } while (0)
+
+/* Stop timing and add the time to the named stage */
+#define INSTR_STOP(pTimer, stage) \
+  do { if (bInstrument) instrumentStop((pTimer),(stage)); } while (0)
+
+/* Add 'amount' to the named counter */
+#define INSTR_COUNT(counter, amount) \
+  do { if (bInstrument) instrumentCount((counter),(amount)); } while (0)
+
+/* Set up instrumentation for this process. Must be called 
+ * before any other threads are started if 'bPerf' is set, so that the 
+ * hardware counters include them.
+ * @param program  name of the program, written to the file
+ * @param bPerf    if TRUE, also count CPU cycles and cache misses
+ *                 with perf_event; ignored if not available
+ */
+void instrumentInit(char* program, int bPerf);
+
+/* Clear all stages and counters and restart the wall clock,
+ * for example at the start of each job in a batch
+ */
+void instrumentReset();
+
+/* Record the starting time (and hardware counts) for a stage
+ * @param pTimer   timer to start
+ */
+void instrumentStart(INSTR_TIMER_T* pTimer);
+
+/* Add the time since instrumentStart to a stage. Stages are
+ * created the first time they are named, and are written in that
+ * order. Call only from one thread.
+ * @param pTimer   timer started by instrumentStart
+ * @param stage    name of the stage
+ */
+void instrumentStop(INSTR_TIMER_T* pTimer, char* stage);
+
+/* Add time measured some other way, for example by another thread,
+ * to a stage
+ * @param stage    name of the stage
+ * @param seconds  time to add
+ */
+void instrumentAddTime(char* stage, double seconds);
+
+/* Add to a counter, creating it the first time it is named.
+ * Call only from one thread.
+ * @param counter  name of the counter
+ * @param amount   value to add
+ */
+void instrumentCount(char* counter, long long amount);
+
+/* Return the current time from a monotonic clock, in seconds */
+double instrumentClock();
+
+/* Write the stages and counters recorded since the last
+ * instrumentReset as a JSON object
+ * @param filename  file to create
+ * @return TRUE if written, FALSE if the file could not be written
+ */
+int instrumentWrite(char* filename);
@@ -0,0 +1,348 @@
+/* Component of the vectorize application.
+ * Decodes the static map JPEG captured from a provider and turns it
+ * into a binary road image in one pass, without ImageMagick or any
+ * temporary files. The per-provider settings that used to live in
+ * the *_convert.sh scripts are held in the table below.
+ *
+ * Copyright 2020 Sally E. Goldin
+ * 
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ * 
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <ctype.h>
+#include <setjmp.h>
+#include <jpeglib.h>
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+#include "structures.h"
+#include "bitImage.h"
+#include "jpegBinarize.h"
+
+/* Binarization settings for each provider. These reproduce
+ *    convert <p>gray.rgb -negate -threshold <threshold>% [-negate] 
+ * from the old conversion scripts.
+ */
+PROVIDER_PROFILE_T providerProfiles[] =
+{
+  { "google",   30, FALSE },
+  { "bing",     30, FALSE },
+  { "here",     30, FALSE },
+  { "mapquest", 88, TRUE },
+  { NULL,        0, FALSE }
+};
+
+/* libjpeg error handler that returns control to readJpegBitImage
+ * rather than exiting the program
+ */
+typedef struct _jpegError
+{
+  struct jpeg_error_mgr mgr;   /* must be first */
+  jmp_buf jumpBuffer;
+} JPEG_ERROR_T;
+
+static void jpegErrorExit(j_common_ptr pInfo)
+{
+  JPEG_ERROR_T* pError = (JPEG_ERROR_T*) pInfo->err;
+  char message[JMSG_LENGTH_MAX];
+  (*pInfo->err->format_message)(pInfo,message);
+  printf("Error decoding JPEG image - %s\n",message);
+  longjmp(pError->jumpBuffer,1);
+}
+
+/* Find the binarization profile for a provider.
+ * @param name   Provider name - only the first word matters and
+ *               case is ignored, so "Google Maps" finds "google"
+ * @return pointer to the profile or NULL if there is none
+ */
+PROVIDER_PROFILE_T* findProviderProfile(char* name)
+{
+  PROVIDER_PROFILE_T* pProfile = NULL;
+  char firstWord[64];
+  int i = 0;
+  while ((name[i] != '\0') && (isalnum((unsigned char) name[i])) &&
+	 (i < (int) sizeof(firstWord) - 1))
+     {
+     firstWord[i] = name[i];
+     i++;
+     }
+  firstWord[i] = '\0';
+  for (i = 0; (pProfile == NULL) && (providerProfiles[i].name != NULL); i++)
+     {
+     if (strcasecmp(firstWord,providerProfiles[i].name) == 0)
+        pProfile = &providerProfiles[i];
+     }
+  return pProfile;
+}
+
+/* Return the largest gray level that becomes WHITE after
+ * negating and thresholding at 'threshold' percent, or -1 if none does.
+ * ImageMagick sets a pixel to white if its (negated) value is greater 
+ * than threshold% of the quantum range; with 8 bit samples scaled by 257
+ * into a 16 bit range that is (255 - gray) * 100 > 255 * threshold.
+ * @param threshold   threshold percentage
+ * @return gray level cutoff
+ */
+static int grayCutoff(int threshold)
+{
+  int gray = 255;
+  while ((gray >= 0) && ((255 - gray) * 100 <= 255 * threshold))
+     gray--;
+  return gray;
+}
+
+/* Convert one row of gray levels to bits. Pixels whose gray level
+ * is <= cutoff are set, unless bInvert, in which case pixels > cutoff
+ * are set.
+ * @param gray     gray levels for the row
+ * @param width    number of pixels in the row
+ * @param cutoff   gray level cutoff from grayCutoff (-1 to 255)
+ * @param bInvert  TRUE to set the pixels above the cutoff instead
+ * @param row      BITWORDs for this row, assumed to be cleared
+ */
+static void binarizeRow(JSAMPLE* gray, int width, int cutoff, BOOL bInvert,
+			BITWORD* row)
+{
+  int x = 0;
+  BITWORD invert = bInvert ? ~0ULL : 0ULL;
+  if (cutoff < 0)   /* nothing is at or below the cutoff */
+     {
+     for (x = 0; x < width; x += BITS_PER_WORD)
+        row[x >> 6] = invert;
+     x = width;
+     }
+#ifdef __SSE2__
+  else
+     {
+     /* 16 pixels per compare; gray <= cutoff exactly when
+      * min(gray,cutoff) == gray
+      */
+     __m128i limit = _mm_set1_epi8((char) cutoff);
+     for (x = 0; x + BITS_PER_WORD <= width; x += BITS_PER_WORD)
+        {
+	BITWORD word = 0;
+	int k = 0;
+	for (k = 0; k < 4; k++)
+	   {
+	   __m128i pixels = _mm_loadu_si128((__m128i*) &gray[x + k*16]);
+	   __m128i below = _mm_cmpeq_epi8(_mm_min_epu8(pixels,limit),pixels);
+	   word |= ((BITWORD) (unsigned) _mm_movemask_epi8(below)) << (k*16);
+	   }
+	row[x >> 6] = word ^ invert;
+        }
+     }
+#endif
+  /* anything left over (or everything, without SSE2) */
+  for ( ; x < width; x++)
+     {
+     BOOL bSet = ((int) gray[x] <= cutoff);
+     if (bSet != bInvert)
+        row[x >> 6] |= 1ULL << (x & 63);
+     }
+  /* keep padding bits at the end of the row clear */
+  if (width % BITS_PER_WORD != 0)
+     row[width >> 6] &= (1ULL << (width % BITS_PER_WORD)) - 1;
+}
+
+/* Decode a provider's JPEG image and convert it to a binary image
+ * in a single pass. This replaces the ImageMagick steps
+ *    -colorspace Gray, then -negate -threshold N% [-negate]
+ * libjpeg delivers the luma channel directly as the gray level, 
+ * so there is no separate RGB to gray conversion.
+ * @param infile   name of JPEG file to read
+ * @param pProfile binarization profile for the provider
+ * @param width    expected number of pixels in each row
+ * @param height   expected number of rows in the image
+ * @return allocated, initialized image or NULL if error 
+ */
+BITIMAGE_T* readJpegBitImage(char* infile, PROVIDER_PROFILE_T* pProfile,
+			     int width, int height)
+{
+  struct jpeg_decompress_struct info;
+  JPEG_ERROR_T error;
+  FILE* pIn = NULL;
+  BITIMAGE_T* volatile pBits = NULL;
+  JSAMPLE* volatile scanline = NULL;
+  /* computed before setjmp, and volatile, so longjmp cannot clobber it */
+  const volatile int cutoff = grayCutoff(pProfile->threshold);
+
+  pIn = fopen(infile,"rb");
+  if (pIn == NULL)
+     {
+     printf("Error opening input image %s\n", infile);
+     return NULL;
+     }
+  info.err = jpeg_std_error(&error.mgr);
+  error.mgr.error_exit = jpegErrorExit;
+  if (setjmp(error.jumpBuffer))
+     {
+     jpeg_destroy_decompress(&info);
+     fclose(pIn);
+     free(scanline);
+     freeBitImage(pBits);
+     return NULL;
+     }
+  jpeg_create_decompress(&info);
+  jpeg_stdio_src(&info,pIn);
+  jpeg_read_header(&info,TRUE);
+  info.out_color_space = JCS_GRAYSCALE;
+  jpeg_start_decompress(&info);
+  if (((int) info.output_width != width) || ((int) info.output_height != height))
+     {
+     printf("Error - image %s is %d x %d, expected %d x %d\n",infile,
+	    info.output_width,info.output_height,width,height);
+     jpeg_destroy_decompress(&info);
+     fclose(pIn);
+     return NULL;
+     }
+  pBits = newBitImage(width,height);
+  /* extra 16 bytes so the SIMD loads never run off the end */
+  scanline = calloc(width + 16,sizeof(JSAMPLE));
+  if ((pBits == NULL) || (scanline == NULL))
+     {
+     printf("Error allocating image array or buffer\n");  
+     jpeg_destroy_decompress(&info);
+     fclose(pIn);
+     free(scanline);
+     freeBitImage(pBits);
+     return NULL;
+     }
+  while (info.output_scanline < info.output_height)
+     {
+     int y = info.output_scanline;
+     JSAMPROW rows[1];
+     rows[0] = scanline;
+     jpeg_read_scanlines(&info,rows,1);
+     binarizeRow(scanline,width,cutoff,pProfile->bDoubleNegate,
+		 &pBits->bits[y*pBits->wordsPerRow]);
+     }
+  jpeg_finish_decompress(&info);
+  jpeg_destroy_decompress(&info);
+  fclose(pIn);
+  free(scanline);
+  return pBits;
+}
+
+/* decoder state for reading a JPEG image one row at a time */
+struct _jpegRows
+{
+  struct jpeg_decompress_struct info;
+  JPEG_ERROR_T error;
+  FILE* pIn;
+  JSAMPLE* scanline;
+  int width;
+  int cutoff;          /* gray level cutoff from the profile */
+  BOOL bInvert;        /* from the profile's bDoubleNegate */
+  BOOL bFailed;        /* TRUE once libjpeg has reported an error */
+};
+
+/* Open a provider's JPEG image so that it can be decoded and 
+ * binarized one row at a time, for images too large to hold
+ * in memory.
+ * @param infile   name of JPEG file to read
+ * @param pProfile binarization profile for the provider
+ * @param width    expected number of pixels in each row
+ * @param height   expected number of rows in the image
+ * @return decoder state, or NULL if error
+ */
+JPEG_ROWS_T* openJpegRows(char* infile, PROVIDER_PROFILE_T* pProfile,
+			  int width, int height)
+{
+  JPEG_ROWS_T* volatile pRows = calloc(1,sizeof(JPEG_ROWS_T));
+  if (pRows == NULL)
+     {
+     printf("Error allocating JPEG decoder\n");
+     return NULL;
+     }
+  pRows->pIn = fopen(infile,"rb");
+  if (pRows->pIn == NULL)
+     {
+     printf("Error opening input image %s\n", infile);
+     free(pRows);
+     return NULL;
+     }
+  pRows->width = width;
+  pRows->cutoff = grayCutoff(pProfile->threshold);
+  pRows->bInvert = pProfile->bDoubleNegate;
+  pRows->info.err = jpeg_std_error(&pRows->error.mgr);
+  pRows->error.mgr.error_exit = jpegErrorExit;
+  jpeg_create_decompress(&pRows->info);
+  if (setjmp(pRows->error.jumpBuffer))
+     {
+     closeJpegRows(pRows);
+     return NULL;
+     }
+  jpeg_stdio_src(&pRows->info,pRows->pIn);
+  jpeg_read_header(&pRows->info,TRUE);
+  pRows->info.out_color_space = JCS_GRAYSCALE;
+  jpeg_start_decompress(&pRows->info);
+  if (((int) pRows->info.output_width != width) || 
+      ((int) pRows->info.output_height != height))
+     {
+     printf("Error - image %s is %d x %d, expected %d x %d\n",infile,
+	    pRows->info.output_width,pRows->info.output_height,width,height);
+     closeJpegRows(pRows);
+     return NULL;
+     }
+  /* extra 16 bytes so the SIMD loads never run off the end */
+  pRows->scanline = calloc(width + 16,sizeof(JSAMPLE));
+  if (pRows->scanline == NULL)
+     {
+     printf("Error allocating image buffer\n");  
+     closeJpegRows(pRows);
+     return NULL;
+     }
+  return pRows;
+}
+
+/* Decode and binarize the next row of a JPEG image
+ * @param pRows    decoder state from openJpegRows
+ * @param row      BITWORDs to receive the row, all zero
+ * @return TRUE if a row was read, FALSE at the end or on error
+ */
+BOOL readJpegRow(JPEG_ROWS_T* pRows, BITWORD* row)
+{
+  JSAMPROW rows[1];
+  if ((pRows->bFailed) || 
+      (pRows->info.output_scanline >= pRows->info.output_height))
+     return FALSE;
+  if (setjmp(pRows->error.jumpBuffer))
+     {
+     pRows->bFailed = TRUE;
+     return FALSE;
+     }
+  rows[0] = pRows->scanline;
+  jpeg_read_scanlines(&pRows->info,rows,1);
+  binarizeRow(pRows->scanline,pRows->width,pRows->cutoff,pRows->bInvert,row);
+  return TRUE;
+}
+
+/* Free a JPEG decoder and close its file, whether or not
+ * all the rows have been read
+ * @param pRows    decoder state from openJpegRows (may be NULL)
+ */
+void closeJpegRows(JPEG_ROWS_T* pRows)
+{
+  if (pRows == NULL)
+     return;
+  jpeg_destroy_decompress(&pRows->info);
+  if (pRows->pIn != NULL)
+     fclose(pRows->pIn);
+  free(pRows->scanline);
+  free(pRows);
+}
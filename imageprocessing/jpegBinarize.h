@@ -0,0 +1,66 @@
+/* Header file with definitions of functions that decode
+ * provider JPEG images directly into binary images
+ * Include AFTER structures.h
+ *
+ * Copyright 2020 Sally E. Goldin
+ * 
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ * 
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+
+/* Find the binarization profile for a provider.
+ * @param name   Provider name - only the first word matters and
+ *               case is ignored, so "Google Maps" finds "google"
+ * @return pointer to the profile or NULL if there is none
+ */
+PROVIDER_PROFILE_T* findProviderProfile(char* name);
+
+/* Decode a provider's JPEG image and convert it to a binary image
+ * in a single pass. This replaces the ImageMagick steps
+ *    -colorspace Gray, then -negate -threshold N% [-negate]
+ * @param infile   name of JPEG file to read
+ * @param pProfile binarization profile for the provider
+ * @param width    expected number of pixels in each row
+ * @param height   expected number of rows in the image
+ * @return allocated, initialized image or NULL if error 
+ */
+BITIMAGE_T* readJpegBitImage(char* infile, PROVIDER_PROFILE_T* pProfile,
+			     int width, int height);
+
+/* decoder state for reading a JPEG one row at a time; see jpegBinarize.c */
+typedef struct _jpegRows JPEG_ROWS_T;
+
+/* Open a provider's JPEG image so that it can be decoded and 
+ * binarized one row at a time, for images too large to hold
+ * in memory.
+ * @param infile   name of JPEG file to read
+ * @param pProfile binarization profile for the provider
+ * @param width    expected number of pixels in each row
+ * @param height   expected number of rows in the image
+ * @return decoder state, or NULL if error
+ */
+JPEG_ROWS_T* openJpegRows(char* infile, PROVIDER_PROFILE_T* pProfile,
+			  int width, int height);
+
+/* Decode and binarize the next row of a JPEG image
+ * @param pRows    decoder state from openJpegRows
+ * @param row      BITWORDs to receive the row, all zero
+ * @return TRUE if a row was read, FALSE at the end or on error
+ */
+BOOL readJpegRow(JPEG_ROWS_T* pRows, BITWORD* row);
+
+/* Free a JPEG decoder and close its file, whether or not
+ * all the rows have been read
+ * @param pRows    decoder state from openJpegRows (may be NULL)
+ */
+void closeJpegRows(JPEG_ROWS_T* pRows);
@@ -0,0 +1,183 @@
+/* Component of the MapEval road evaluation.
+ * Clips reference lines to the area covered by an image, using the
+ * Liang-Barsky algorithm, so that the lines need not be clipped by
+ * the database before they are matched. The segments of a line are
+ * all clipped in one pass, then split into the pieces that lie 
+ * inside the image.
+ *
+ * Copyright 2020 Sally E. Goldin
+ * 
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ * 
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include "structures.h"
+#include "polyline.h"
+#include "lineClip.h"
+
+/* Narrow the range of a segment parameter to one side of the box.
+ * Written without branches so that clipSegments vectorizes.
+ * @param p       rate at which the segment moves toward the outside
+ * @param q       distance from the start to the edge, positive inside
+ * @param pT0     start of the range inside so far; updated
+ * @param pT1     end of the range inside so far; updated
+ */
+static inline void clipEdge(double p, double q, double* pT0, double* pT1)
+{
+  /* infinite or not a number if p is 0, but then it is not used */
+  double t = q / p;
+  double t0 = *pT0;
+  double t1 = *pT1;
+  t0 = ((p < 0.0) && (t > t0)) ? t : t0;
+  t1 = ((p > 0.0) && (t < t1)) ? t : t1;
+  /* parallel to this edge, and outside it */
+  t1 = ((p == 0.0) && (q < 0.0)) ? -1.0 : t1;
+  *pT0 = t0;
+  *pT1 = t1;
+}
+
+/* Find the part of each segment of a polyline that is inside a box
+ * (edges included), as a range of the segment parameter t, which is
+ * 0 at the start vertex and 1 at the end. The loop has no branches,
+ * so the compiler can clip several segments at once.
+ * A line with only one point is treated as one segment of length 0.
+ * @param xy      x and y of each vertex, interleaved
+ * @param count   number of vertices, at least one
+ * @param box     minX, minY, maxX, maxY to clip to
+ * @param t0      array to receive the start of the part inside, for
+ *                each segment
+ * @param t1      array to receive the end of the part inside; less
+ *                than t0 if no part of the segment is inside
+ */
+void clipSegments(const double* xy, int count, const double* box,
+		  double* t0, double* t1)
+{
+  double minX = box[0];
+  double minY = box[1];
+  double maxX = box[2];
+  double maxY = box[3];
+  int s = 0;
+  if (count == 1)
+     {
+     double lo = 0.0;
+     double hi = 0.0;
+     clipEdge(0.0,xy[0] - minX,&lo,&hi);
+     clipEdge(0.0,maxX - xy[0],&lo,&hi);
+     clipEdge(0.0,xy[1] - minY,&lo,&hi);
+     clipEdge(0.0,maxY - xy[1],&lo,&hi);
+     t0[0] = lo;
+     t1[0] = hi;
+     return;
+     }
+  for (s = 0; s < count - 1; s++)
+     {
+     double x = xy[2*s];
+     double y = xy[2*s + 1];
+     double dx = xy[2*s + 2] - x;
+     double dy = xy[2*s + 3] - y;
+     double lo = 0.0;
+     double hi = 1.0;
+     clipEdge(-dx,x - minX,&lo,&hi);
+     clipEdge(dx,maxX - x,&lo,&hi);
+     clipEdge(-dy,y - minY,&lo,&hi);
+     clipEdge(dy,maxY - y,&lo,&hi);
+     t0[s] = lo;
+     t1[s] = hi;
+     }
+}
+
+/* Check whether a piece has any length, that is, whether it has
+ * two different points
+ * @param pPiece   piece to check
+ * @return TRUE if the piece is more than a point
+ */
+static BOOL hasLength(COORD_LIST_T* pPiece)
+{
+  int i = 0;
+  for (i = 1; i < pPiece->count; i++)
+     {
+     if ((pPiece->xy[2*i] != pPiece->xy[0]) || 
+	 (pPiece->xy[2*i + 1] != pPiece->xy[1]))
+        return TRUE;
+     }
+  return FALSE;
+}
+
+/* Get the next piece of a line clipped by clipSegments, that is,
+ * the next run of segments that stays inside the box. Pieces that
+ * reduce to a single point are skipped, unless the line itself has
+ * only one point. The points are taken from 'coords', which may be
+ * the line in a different coordinate system from the one it was 
+ * clipped in, as long as one is an affine transform of the other.
+ * @param coords  x and y of each vertex, interleaved
+ * @param count   number of vertices
+ * @param t0      start of the part of each segment inside the box
+ * @param t1      end of the part of each segment inside the box
+ * @param pNext   first segment still to be looked at; set to 0
+ *                before the first call, updated by each call
+ * @param pPiece  list to receive the piece; any points it holds
+ *                already are removed
+ * @return number of points in the piece, 0 if there are no more
+ */
+int nextClipPiece(const double* coords, int count, const double* t0,
+		  const double* t1, int* pNext, COORD_LIST_T* pPiece)
+{
+  int s = 0;
+  resetCoordList(pPiece);
+  if (count == 1)
+     {
+     if ((*pNext == 0) && (t0[0] <= t1[0]))
+        appendCoord(pPiece,coords[0],coords[1]);
+     *pNext = 1;
+     return pPiece->count;
+     }
+  for (s = *pNext; s < count - 1; s++)
+     {
+     const double* p = coords + 2*s;
+     double dx = p[2] - p[0];
+     double dy = p[3] - p[1];
+     BOOL bInside = (t0[s] <= t1[s]);
+     if (bInside)
+        {
+	/* use the vertices themselves where they are inside; the
+	 * start of a segment is already there if the one before 
+	 * ended inside. Repeated vertices are kept, as they are
+	 * when the line is not clipped.
+	 */
+	if ((pPiece->count == 0) && (t0[s] == 0.0))
+	   appendCoord(pPiece,p[0],p[1]);
+	else if (pPiece->count == 0)
+	   appendCoord(pPiece,p[0] + t0[s]*dx,p[1] + t0[s]*dy);
+	if (t1[s] == 1.0)
+	   appendCoord(pPiece,p[2],p[3]);
+	else
+	   appendCoord(pPiece,p[0] + t1[s]*dx,p[1] + t1[s]*dy);
+        }
+     if ((!bInside) || (t1[s] < 1.0))
+        {
+	/* the line leaves the box here */
+	if (hasLength(pPiece))
+	   {
+	   *pNext = s + 1;
+	   return pPiece->count;
+	   }
+	resetCoordList(pPiece);
+        }
+     }
+  *pNext = count;
+  if (!hasLength(pPiece))
+     resetCoordList(pPiece);
+  return pPiece->count;
+}
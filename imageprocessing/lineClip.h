@@ -0,0 +1,60 @@
+/* Header file for clipping reference lines to an image
+ * Include AFTER structures.h
+ *
+ *
+ * Copyright 2020 Sally E. Goldin
+ * 
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ * 
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+
+/* Points this close to the edge of the image, in pixels, count as
+ * being on it. Converting to pixels can move a point that is exactly
+ * on the edge in meters by a few billionths of a pixel.
+ */
+#define CLIP_TOLERANCE 1.0e-7
+
+/* Find the part of each segment of a polyline that is inside a box
+ * (edges included), as a range of the segment parameter t, which is
+ * 0 at the start vertex and 1 at the end. The loop has no branches,
+ * so the compiler can clip several segments at once.
+ * A line with only one point is treated as one segment of length 0.
+ * @param xy      x and y of each vertex, interleaved
+ * @param count   number of vertices, at least one
+ * @param box     minX, minY, maxX, maxY to clip to
+ * @param t0      array to receive the start of the part inside, for
+ *                each segment
+ * @param t1      array to receive the end of the part inside; less
+ *                than t0 if no part of the segment is inside
+ */
+void clipSegments(const double* xy, int count, const double* box,
+		  double* t0, double* t1);
+
+/* Get the next piece of a line clipped by clipSegments, that is,
+ * the next run of segments that stays inside the box. Pieces that
+ * reduce to a single point are skipped, unless the line itself has
+ * only one point. The points are taken from 'coords', which may be
+ * the line in a different coordinate system from the one it was 
+ * clipped in, as long as one is an affine transform of the other.
+ * @param coords  x and y of each vertex, interleaved
+ * @param count   number of vertices
+ * @param t0      start of the part of each segment inside the box
+ * @param t1      end of the part of each segment inside the box
+ * @param pNext   first segment still to be looked at; set to 0
+ *                before the first call, updated by each call
+ * @param pPiece  list to receive the piece; any points it holds
+ *                already are removed
+ * @return number of points in the piece, 0 if there are no more
+ */
+int nextClipPiece(const double* coords, int count, const double* t0,
+		  const double* t1, int* pNext, COORD_LIST_T* pPiece);
@@ -0,0 +1,620 @@
+/* Component of the MapEval road evaluation.
+ * Compares each reference line with the lines the guided vectorizer
+ * matched to it, as guidedVectorize writes them, so the server does 
+ * not need to ask PostGIS for the distances feature by feature.
+ *
+ * Distances from a point to a set of lines skip every block of 
+ * segments, and then every segment, whose bounding box is farther away
+ * than the closest segment found so far, and stop as soon as the point
+ * is known to be closer than the largest distance already found, since
+ * it can then not change the Hausdorff distance.
+ *
+ * Copyright 2020 Sally E. Goldin
+ * 
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ * 
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include "structures.h"
+#include "polyline.h"
+#include "outputBuffer.h"
+#include "lineCompare.h"
+
+/* number of lines or blocks a set can hold when the first is added */
+#define FIRST_SET_CAPACITY 8
+
+/* number of segments in each block of a line */
+#define LINE_BLOCK 16
+
+/* Initialize an empty set of lines. No memory is allocated until
+ * the first line is added.
+ * @param pSet     set to initialize
+ */
+void initLineSet(LINE_SET_T* pSet)
+{
+  memset(pSet,0,sizeof(LINE_SET_T));
+}
+
+/* Add a block of vertices, already in the set, and find its box. 
+ * Exits the program if memory cannot be allocated.
+ * @param pSet     set to extend
+ * @param first    index of the first vertex of the block
+ * @param last     index of the last vertex
+ */
+static void addBlock(LINE_SET_T* pSet, int first, int last)
+{
+  double* box = NULL;
+  double* xy = NULL;
+  int k = 0;
+  if (pSet->blockCount == pSet->blockCapacity)
+     {
+     int capacity = FIRST_SET_CAPACITY;
+     int* newFirst = NULL;
+     int* newLast = NULL;
+     double* newBox = NULL;
+     if (pSet->blockCapacity > 0)
+        capacity = pSet->blockCapacity * 2;
+     newFirst = realloc(pSet->blockFirst,capacity * sizeof(int));
+     if (newFirst != NULL)
+        pSet->blockFirst = newFirst;
+     newLast = realloc(pSet->blockLast,capacity * sizeof(int));
+     if (newLast != NULL)
+        pSet->blockLast = newLast;
+     newBox = realloc(pSet->box,4 * capacity * sizeof(double));
+     if (newBox != NULL)
+        pSet->box = newBox;
+     if ((newFirst == NULL) || (newLast == NULL) || (newBox == NULL))
+        {
+	printf("Error allocating line set of %d blocks\n",capacity);
+	exit(3);
+        }
+     pSet->blockCapacity = capacity;
+     }
+  pSet->blockFirst[pSet->blockCount] = first;
+  pSet->blockLast[pSet->blockCount] = last;
+  box = pSet->box + 4*pSet->blockCount;
+  xy = pSet->points.xy;
+  box[0] = box[2] = xy[2*first];
+  box[1] = box[3] = xy[2*first + 1];
+  for (k = first + 1; k <= last; k++)
+     {
+     if (xy[2*k] < box[0])
+        box[0] = xy[2*k];
+     else if (xy[2*k] > box[2])
+        box[2] = xy[2*k];
+     if (xy[2*k + 1] < box[1])
+        box[1] = xy[2*k + 1];
+     else if (xy[2*k + 1] > box[3])
+        box[3] = xy[2*k + 1];
+     }
+  pSet->blockCount++;
+}
+
+/* Add a line to a set. Exits the program if memory cannot be allocated.
+ * @param pSet     set to extend
+ * @param xy       x and y of each vertex, interleaved
+ * @param count    number of vertices (at least one)
+ */
+void addLine(LINE_SET_T* pSet, const double* xy, int count)
+{
+  int first = pSet->points.count;
+  int last = 0;
+  int i = 0;
+  if (pSet->count + 1 >= pSet->capacity)
+     {
+     int capacity = FIRST_SET_CAPACITY;
+     int* newStart = NULL;
+     if (pSet->capacity > 0)
+        capacity = pSet->capacity * 2;
+     newStart = realloc(pSet->start,capacity * sizeof(int));
+     if (newStart == NULL)
+        {
+	printf("Error allocating line set of %d lines\n",capacity);
+	exit(3);
+        }
+     pSet->start = newStart;
+     pSet->capacity = capacity;
+     }
+  for (i = 0; i < count; i++)
+     appendCoord(&pSet->points,xy[2*i],xy[2*i + 1]);
+  pSet->start[pSet->count] = first;
+  pSet->count++;
+  pSet->start[pSet->count] = pSet->points.count;
+  /* blocks share their end vertices; a line of one point 
+   * is a block of one vertex 
+   */
+  i = first;
+  do
+     {
+     last = i + LINE_BLOCK;
+     if (last > pSet->points.count - 1)
+        last = pSet->points.count - 1;
+     addBlock(pSet,i,last);
+     i = last;
+     }
+  while (i < pSet->points.count - 1);
+}
+
+/* Remove all lines, keeping the arrays for reuse
+ * @param pSet     set to reset
+ */
+void resetLineSet(LINE_SET_T* pSet)
+{
+  pSet->count = 0;
+  pSet->blockCount = 0;
+  resetCoordList(&pSet->points);
+}
+
+/* Free the arrays of a set and reinitialize it
+ * @param pSet     set to free
+ */
+void freeLineSet(LINE_SET_T* pSet)
+{
+  freeCoordList(&pSet->points);
+  free(pSet->start);
+  free(pSet->blockFirst);
+  free(pSet->blockLast);
+  free(pSet->box);
+  initLineSet(pSet);
+}
+
+/* Calculate the total length of the lines in a set, as ST_Length
+ * @param pSet     set of lines
+ * @return length in the units of the coordinates
+ */
+double lineSetLength(LINE_SET_T* pSet)
+{
+  double length = 0.0;
+  double* xy = pSet->points.xy;
+  int i = 0;
+  int k = 0;
+  for (i = 0; i < pSet->count; i++)
+     {
+     for (k = pSet->start[i] + 1; k < pSet->start[i + 1]; k++)
+        length += hypot(xy[2*k] - xy[2*k - 2],xy[2*k + 1] - xy[2*k - 1]);
+     }
+  return length;
+}
+
+/* Squared distance from a point to a box
+ * @param x,y      point
+ * @param minX..   box; may be given corners in either order
+ * @return squared distance, 0 if the point is inside
+ */
+static double boxDistance2(double x, double y, double minX, double minY,
+			   double maxX, double maxY)
+{
+  double dx = 0.0;
+  double dy = 0.0;
+  if (minX > maxX)
+     {
+     double t = minX;
+     minX = maxX;
+     maxX = t;
+     }
+  if (minY > maxY)
+     {
+     double t = minY;
+     minY = maxY;
+     maxY = t;
+     }
+  if (x < minX)
+     dx = minX - x;
+  else if (x > maxX)
+     dx = x - maxX;
+  if (y < minY)
+     dy = minY - y;
+  else if (y > maxY)
+     dy = y - maxY;
+  return dx*dx + dy*dy;
+}
+
+/* Squared distance from a point to a line segment
+ * @param x,y      point
+ * @param s        x1, y1, x2, y2 of the segment
+ * @return squared distance
+ */
+static double segmentDistance2(double x, double y, const double* s)
+{
+  double dx = s[2] - s[0];
+  double dy = s[3] - s[1];
+  double length2 = dx*dx + dy*dy;
+  double t = 0.0;
+  if (length2 > 0.0)
+     {
+     t = ((x - s[0])*dx + (y - s[1])*dy) / length2;
+     if (t < 0.0)
+        t = 0.0;
+     else if (t > 1.0)
+        t = 1.0;
+     }
+  dx = s[0] + t*dx - x;
+  dy = s[1] + t*dy - y;
+  return dx*dx + dy*dy;
+}
+
+/* Find the distance from a point to the closest line of a set
+ * @param pSet     set of lines
+ * @param x,y      point
+ * @param stop     as soon as a line closer than this is found, 
+ *                 its distance is returned without looking further
+ * @param pHint    block to look in first; set to the closest block
+ * @return the distance, or if less than 'stop', a distance at
+ *         least as great as the true one
+ */
+static double pointDistance(LINE_SET_T* pSet, double x, double y, 
+			    double stop, int* pHint)
+{
+  double best = HUGE_VAL;
+  double stop2 = stop * stop;
+  int hint = *pHint;
+  int n = 0;
+  int k = 0;
+  for (n = 0; n < pSet->blockCount; n++)
+     {
+     /* the hint, then the others in order */
+     int b = (n == 0) ? hint : ((n <= hint) ? n - 1 : n);
+     double* box = pSet->box + 4*b;
+     int first = pSet->blockFirst[b];
+     int last = pSet->blockLast[b];
+     if (boxDistance2(x,y,box[0],box[1],box[2],box[3]) >= best)
+        continue;
+     for (k = first; (k < last) || (k == first); k++)
+        {
+	const double* s = pSet->points.xy + 2*k;
+	double d2 = 0.0;
+	if (k == last)
+	   {
+	   /* a line of one point */
+	   d2 = (x - s[0])*(x - s[0]) + (y - s[1])*(y - s[1]);
+	   }
+	else if (boxDistance2(x,y,s[0],s[1],s[2],s[3]) >= best)
+	   {
+	   continue;
+	   }
+	else
+	   {
+	   d2 = segmentDistance2(x,y,s);
+	   }
+	if (d2 < best)
+	   {
+	   best = d2;
+	   *pHint = b;
+	   if (best < stop2)
+	      return sqrt(best);
+	   }
+        }
+     }
+  return sqrt(best);
+}
+
+/* Find a bound on the distance from any point of a segment to the
+ * closest line of a set. The distance from a point moving along the
+ * segment to any one other segment is convex, so it is never more 
+ * than the larger of its values at the two ends.
+ * @param pSet     set of lines
+ * @param s        x1, y1, x2, y2 of the segment
+ * @param stop     as soon as the bound is this small, it is returned
+ *                 without looking further
+ * @param pHint    block to look in first; set to the block giving
+ *                 the bound
+ * @return bound on the distance
+ */
+static double segmentBound(LINE_SET_T* pSet, const double* s, double stop,
+			   int* pHint)
+{
+  double best = HUGE_VAL;
+  double stop2 = stop * stop;
+  int hint = *pHint;
+  int n = 0;
+  int k = 0;
+  for (n = 0; n < pSet->blockCount; n++)
+     {
+     int b = (n == 0) ? hint : ((n <= hint) ? n - 1 : n);
+     double* box = pSet->box + 4*b;
+     int first = pSet->blockFirst[b];
+     int last = pSet->blockLast[b];
+     if ((boxDistance2(s[0],s[1],box[0],box[1],box[2],box[3]) >= best) ||
+	 (boxDistance2(s[2],s[3],box[0],box[1],box[2],box[3]) >= best))
+        continue;
+     for (k = first; (k < last) || (k == first); k++)
+        {
+	const double* t = pSet->points.xy + 2*k;
+	double d1 = 0.0;
+	double d2 = 0.0;
+	if (k == last)
+	   {
+	   d1 = (s[0] - t[0])*(s[0] - t[0]) + (s[1] - t[1])*(s[1] - t[1]);
+	   d2 = (s[2] - t[0])*(s[2] - t[0]) + (s[3] - t[1])*(s[3] - t[1]);
+	   }
+	else if ((boxDistance2(s[0],s[1],t[0],t[1],t[2],t[3]) >= best) ||
+		 (boxDistance2(s[2],s[3],t[0],t[1],t[2],t[3]) >= best))
+	   {
+	   continue;
+	   }
+	else
+	   {
+	   d1 = segmentDistance2(s[0],s[1],t);
+	   d2 = segmentDistance2(s[2],s[3],t);
+	   }
+	if (d2 > d1)
+	   d1 = d2;
+	if (d1 < best)
+	   {
+	   best = d1;
+	   *pHint = b;
+	   if (best <= stop2)
+	      return sqrt(best);
+	   }
+        }
+     }
+  return sqrt(best);
+}
+
+/* Look for points farther than 'largest' from a set of lines along
+ * a segment, splitting it in half until the bound for each piece
+ * shows that it has none.
+ * @param pSet     set of lines
+ * @param s        x1, y1, x2, y2 of the segment
+ * @param largest  largest distance found so far
+ * @param pHint    block of pSet to look in first; updated
+ * @return new largest distance
+ */
+static double refineSegment(LINE_SET_T* pSet, const double* s, double largest,
+			    int* pHint)
+{
+  double half[4];
+  double distance = 0.0;
+  if (segmentBound(pSet,s,largest + HAUSDORFF_TOLERANCE,pHint) <= 
+      largest + HAUSDORFF_TOLERANCE)
+     return largest;
+  half[0] = s[0];
+  half[1] = s[1];
+  half[2] = (s[0] + s[2]) / 2.0;
+  half[3] = (s[1] + s[3]) / 2.0;
+  /* stop once the halves cannot be told apart */
+  if (((half[2] == s[0]) && (half[3] == s[1])) ||
+      ((half[2] == s[2]) && (half[3] == s[3])))
+     return largest;
+  distance = pointDistance(pSet,half[2],half[3],largest,pHint);
+  if (distance > largest)
+     largest = distance;
+  largest = refineSegment(pSet,half,largest,pHint);
+  half[0] = s[2];
+  half[1] = s[3];
+  return refineSegment(pSet,half,largest,pHint);
+}
+
+/* Calculate the largest distance from a point of one set of lines
+ * to the closest point of another, if larger than 'largest'.
+ * The vertices are checked first, so that most segments can be 
+ * rejected by their bound without being split. Each search starts
+ * in the block that was closest to the previous point.
+ * @param pFrom    set whose points are measured
+ * @param pTo      set they are measured to
+ * @param largest  distance already known, or 0
+ * @return the larger of 'largest' and the directed distance
+ */
+static double directedHausdorff(LINE_SET_T* pFrom, LINE_SET_T* pTo,
+				double largest)
+{
+  double* xy = pFrom->points.xy;
+  int hint = 0;
+  int i = 0;
+  int k = 0;
+  for (k = 0; k < pFrom->points.count; k++)
+     {
+     double distance = pointDistance(pTo,xy[2*k],xy[2*k + 1],largest,&hint);
+     if (distance > largest)
+        largest = distance;
+     }
+  for (i = 0; i < pFrom->count; i++)
+     {
+     for (k = pFrom->start[i]; k < pFrom->start[i + 1] - 1; k++)
+        largest = refineSegment(pTo,xy + 2*k,largest,&hint);
+     }
+  return largest;
+}
+
+/* Calculate the Hausdorff distance between two sets of lines: the
+ * largest distance from any point on one set, not just a vertex, to
+ * the closest point of the other. Each segment is split only where
+ * its distance bound, taken from the segments of the other set that
+ * are nearby, could still exceed the largest distance found so far, 
+ * so the result is exact to within HAUSDORFF_TOLERANCE.
+ * @param pA       first set, not empty
+ * @param pB       second set, not empty
+ * @return distance in the units of the coordinates
+ */
+double hausdorffDistance(LINE_SET_T* pA, LINE_SET_T* pB)
+{
+  return directedHausdorff(pB,pA,directedHausdorff(pA,pB,0.0));
+}
+
+/* Calculate the discrete Frechet distance between two lines: the 
+ * shortest leash that lets one walker step through the vertices of
+ * the first line and another through the vertices of the second,
+ * both in order, neither going back.
+ * @param a        x and y of each vertex of the first line, interleaved
+ * @param aCount   number of vertices in the first line
+ * @param b        vertices of the second line
+ * @param bCount   number of vertices in the second line
+ * @param work     work space for bCount doubles
+ * @return distance in the units of the coordinates
+ */
+double frechetDistance(const double* a, int aCount, 
+		       const double* b, int bCount, double* work)
+{
+  int i = 0;
+  int j = 0;
+  /* work[j] is the squared leash needed to reach vertex i of a 
+   * and vertex j of b, for the current i
+   */
+  for (i = 0; i < aCount; i++)
+     {
+     double diagonal = 0.0;  /* work[j-1] for the previous i */
+     for (j = 0; j < bCount; j++)
+        {
+	double dx = a[2*i] - b[2*j];
+	double dy = a[2*i + 1] - b[2*j + 1];
+	double d2 = dx*dx + dy*dy;
+	double reach = 0.0;
+	if (i == 0)
+	   {
+	   reach = (j == 0) ? 0.0 : work[j - 1];
+	   }
+	else 
+	   {
+	   reach = work[j];
+	   if (j > 0)
+	      {
+	      if (diagonal < reach)
+		 reach = diagonal;
+	      if (work[j - 1] < reach)
+		 reach = work[j - 1];
+	      }
+	   diagonal = work[j];
+	   }
+	work[j] = (d2 > reach) ? d2 : reach;
+        }
+     }
+  return sqrt(work[bCount - 1]);
+}
+
+/* Start comparing reference features with their matched lines
+ * @param filename   linematch COPY file to create
+ * @param expId      DB Id of the experiment
+ * @return new comparison, or NULL if the file cannot be created
+ *         (errno is set)
+ */
+LINE_COMPARE_T* newLineCompare(char* filename, int expId)
+{
+  LINE_COMPARE_T* pCompare = calloc(1,sizeof(LINE_COMPARE_T));
+  if (pCompare == NULL)
+     return NULL;
+  pCompare->pOut = openOutBuf(filename);
+  if (pCompare->pOut == NULL)
+     {
+     free(pCompare);
+     return NULL;
+     }
+  pCompare->expId = expId;
+  return pCompare;
+}
+
+/* Write the linematch row for the reference feature collected so far,
+ * then empty the sets for the next one.
+ * @param pCompare   comparison in progress
+ */
+static void writeComparison(LINE_COMPARE_T* pCompare)
+{
+  OUTBUF_T* pOut = pCompare->pOut;
+  if (!pCompare->bCollecting)
+     return;
+  outBufInt(pOut,pCompare->expId);
+  outBufChar(pOut,'\t');
+  outBufInt(pOut,pCompare->refId);
+  outBufChar(pOut,'\t');
+  if (pCompare->lines.count > 0)
+     {
+     outBufFixed(pOut,hausdorffDistance(&pCompare->refs,&pCompare->lines),6);
+     outBufChar(pOut,'\t');
+     outBufFixed(pOut,lineSetLength(&pCompare->refs) - 
+		 lineSetLength(&pCompare->lines),6);
+     outBufChar(pOut,'\t');
+     outBufFixed(pOut,pCompare->frechet,6);
+     pCompare->matchCount++;
+     }
+  else
+     {
+     outBufString(pOut,"-1\t\\N\t-1");
+     }
+  outBufChar(pOut,'\n');
+  pCompare->refCount++;
+  resetLineSet(&pCompare->refs);
+  resetLineSet(&pCompare->lines);
+  pCompare->frechet = 0.0;
+  pCompare->bCollecting = FALSE;
+}
+
+/* Add one part of a reference feature, and the line matched to it
+ * if there is one. The parts of a feature must be added one after
+ * another; when a new reference feature Id is seen, the row for the
+ * previous feature is written, with
+ *   experimentid refid distance deltalength frechet
+ * where distance is the Hausdorff distance between all the parts
+ * and all the matched lines, deltalength the length of the parts 
+ * minus the length of the lines, and frechet the largest Frechet
+ * distance between a part and its line. A feature with no matched
+ * lines has distance and frechet -1 and a null deltalength.
+ * @param pCompare   comparison in progress
+ * @param refId      reference feature Id
+ * @param pRef       points of this part of the feature, in meters
+ * @param pLine      points matched to it, in meters; NULL or fewer
+ *                   than two points if no line was written
+ */
+void compareFeature(LINE_COMPARE_T* pCompare, int refId,
+		    COORD_LIST_T* pRef, COORD_LIST_T* pLine)
+{
+  if ((pCompare->bCollecting) && (refId != pCompare->refId))
+     writeComparison(pCompare);
+  pCompare->refId = refId;
+  pCompare->bCollecting = TRUE;
+  if (pRef->count == 0)
+     return;
+  addLine(&pCompare->refs,pRef->xy,pRef->count);
+  if ((pLine != NULL) && (pLine->count > 1))
+     {
+     double frechet = 0.0;
+     addLine(&pCompare->lines,pLine->xy,pLine->count);
+     if (pLine->count > pCompare->workCapacity)
+        {
+	double* newWork = realloc(pCompare->work,pLine->count * sizeof(double));
+	if (newWork == NULL)
+	   {
+	   printf("Error allocating Frechet work space for %d points\n",
+		  pLine->count);
+	   exit(3);
+	   }
+	pCompare->work = newWork;
+	pCompare->workCapacity = pLine->count;
+        }
+     frechet = frechetDistance(pRef->xy,pRef->count,pLine->xy,pLine->count,
+			       pCompare->work);
+     if (frechet > pCompare->frechet)
+        pCompare->frechet = frechet;
+     }
+}
+
+/* Write the row for the last reference feature, close the file 
+ * and free the comparison
+ * @param pCompare   comparison to finish (may be NULL)
+ * @return TRUE if successful, FALSE if there was a write error
+ */
+BOOL closeLineCompare(LINE_COMPARE_T* pCompare)
+{
+  BOOL bOk = TRUE;
+  if (pCompare == NULL)
+     return TRUE;
+  writeComparison(pCompare);
+  bOk = closeOutBuf(pCompare->pOut);
+  freeLineSet(&pCompare->refs);
+  freeLineSet(&pCompare->lines);
+  free(pCompare->work);
+  free(pCompare);
+  return bOk;
+}
@@ -0,0 +1,110 @@
+/* Header file for comparing reference lines with vectorized lines
+ * Include AFTER structures.h
+ *
+ * Copyright 2020 Sally E. Goldin
+ * 
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ * 
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+
+/* largest amount (meters) by which hausdorffDistance may be short */
+#define HAUSDORFF_TOLERANCE 1.0e-6
+
+/* Initialize an empty set of lines. No memory is allocated until
+ * the first line is added.
+ * @param pSet     set to initialize
+ */
+void initLineSet(LINE_SET_T* pSet);
+
+/* Add a line to a set. Exits the program if memory cannot be allocated.
+ * @param pSet     set to extend
+ * @param xy       x and y of each vertex, interleaved
+ * @param count    number of vertices (at least one)
+ */
+void addLine(LINE_SET_T* pSet, const double* xy, int count);
+
+/* Remove all lines, keeping the arrays for reuse
+ * @param pSet     set to reset
+ */
+void resetLineSet(LINE_SET_T* pSet);
+
+/* Free the arrays of a set and reinitialize it
+ * @param pSet     set to free
+ */
+void freeLineSet(LINE_SET_T* pSet);
+
+/* Calculate the total length of the lines in a set, as ST_Length
+ * @param pSet     set of lines
+ * @return length in the units of the coordinates
+ */
+double lineSetLength(LINE_SET_T* pSet);
+
+/* Calculate the Hausdorff distance between two sets of lines: the
+ * largest distance from any point on one set, not just a vertex, to
+ * the closest point of the other. Each segment is split only where
+ * its distance bound, taken from the segments of the other set that
+ * are nearby, could still exceed the largest distance found so far, 
+ * so the result is exact to within HAUSDORFF_TOLERANCE.
+ * @param pA       first set, not empty
+ * @param pB       second set, not empty
+ * @return distance in the units of the coordinates
+ */
+double hausdorffDistance(LINE_SET_T* pA, LINE_SET_T* pB);
+
+/* Calculate the discrete Frechet distance between two lines: the 
+ * shortest leash that lets one walker step through the vertices of
+ * the first line and another through the vertices of the second,
+ * both in order, neither going back.
+ * @param a        x and y of each vertex of the first line, interleaved
+ * @param aCount   number of vertices in the first line
+ * @param b        vertices of the second line
+ * @param bCount   number of vertices in the second line
+ * @param work     work space for bCount doubles
+ * @return distance in the units of the coordinates
+ */
+double frechetDistance(const double* a, int aCount, 
+		       const double* b, int bCount, double* work);
+
+/* Start comparing reference features with their matched lines
+ * @param filename   linematch COPY file to create
+ * @param expId      DB Id of the experiment
+ * @return new comparison, or NULL if the file cannot be created
+ *         (errno is set)
+ */
+LINE_COMPARE_T* newLineCompare(char* filename, int expId);
+
+/* Add one part of a reference feature, and the line matched to it
+ * if there is one. The parts of a feature must be added one after
+ * another; when a new reference feature Id is seen, the row for the
+ * previous feature is written, with
+ *   experimentid refid distance deltalength frechet
+ * where distance is the Hausdorff distance between all the parts
+ * and all the matched lines, deltalength the length of the parts 
+ * minus the length of the lines, and frechet the largest Frechet
+ * distance between a part and its line. A feature with no matched
+ * lines has distance and frechet -1 and a null deltalength.
+ * @param pCompare   comparison in progress
+ * @param refId      reference feature Id
+ * @param pRef       points of this part of the feature, in meters
+ * @param pLine      points matched to it, in meters; NULL or fewer
+ *                   than two points if no line was written
+ */
+void compareFeature(LINE_COMPARE_T* pCompare, int refId,
+		    COORD_LIST_T* pRef, COORD_LIST_T* pLine);
+
+/* Write the row for the last reference feature, close the file 
+ * and free the comparison
+ * @param pCompare   comparison to finish (may be NULL)
+ * @return TRUE if successful, FALSE if there was a write error
+ */
+BOOL closeLineCompare(LINE_COMPARE_T* pCompare);
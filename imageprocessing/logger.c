@@ -0,0 +1,320 @@
+/* 
+ *  logger.c
+ *
+ *  Levelled logging for guided vectorization. Messages are formatted
+ *  by the thread that logs them straight into a slot of a fixed size
+ *  ring buffer. Any number of threads can add messages without taking
+ *  a lock; a single background thread takes them out in order and
+ *  writes them to the log file. Messages above the current level are
+ *  never formatted at all. The thread is started by the first message
+ *  and sleeps while the ring is empty, so a log that nothing is
+ *  written to costs nothing.
+ *
+ *  The ring is the bounded queue described by Dmitry Vyukov: each
+ *  slot has a sequence number that tells producers and the consumer
+ *  whose turn it is to use it.
+ *
+ *  Copyright 2020 Sally E. Goldin
+ * 
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ * 
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <stdarg.h>
+#include <errno.h>
+#include <sched.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include "structures.h"
+#include "logger.h"
+
+/* number of slots in the ring; must be a power of two */
+#define LOG_RING_SIZE 4096
+
+/* longest message kept, including the newline; longer ones are cut */
+#define LOG_MESSAGE_SIZE 256
+
+/* one message in the ring */
+typedef struct _logSlot
+{
+  atomic_ulong sequence;         /* position this slot is ready for */
+  int length;                    /* characters in text */
+  char text[LOG_MESSAGE_SIZE];   /* message with its newline */
+} LOG_SLOT_T;
+
+int logLevel = LOG_WARN;
+
+static LOG_SLOT_T ring[LOG_RING_SIZE];
+static atomic_ulong enqueuePos;      /* next position to fill */
+static unsigned long dequeuePos = 0; /* next position to write; writer only */
+static BOOL bRingInitialized = FALSE;
+
+static pthread_t writerThread;
+static BOOL bLogStarted = FALSE;     /* between logStart and logStop */
+static atomic_int bWriterRunning;    /* writer thread has been started */
+static atomic_int bStartFailed;      /* could not start it; use stderr */
+static atomic_int bStopWriter;
+static atomic_int bWriterWaiting;    /* writer is asleep, or about to be */
+static pthread_mutex_t writerLock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t writerWake = PTHREAD_COND_INITIALIZER;
+static char logFilename[256];
+static FILE* pLogFile = NULL;
+static BOOL bOpenFailed = FALSE;
+
+static char* levelNames[] = { "error", "warn", "info", "debug", "trace" };
+
+/* Convert a level name (error, warn, info, debug, trace) or number
+ * @param name    level name
+ * @return level, or -1 if not recognized
+ */
+int parseLogLevel(char* name)
+{
+  int i;
+  if ((name[0] >= '0') && (name[0] <= '9') && (name[1] == '\0'))
+     {
+     i = name[0] - '0';
+     return (i <= LOG_TRACE) ? i : -1;
+     }
+  for (i = LOG_ERROR; i <= LOG_TRACE; i++)
+     {
+     if (strcasecmp(name,levelNames[i]) == 0)
+        return i;
+     }
+  return -1;
+}
+
+/* Set up the slot sequence numbers, once
+ */
+static void initRing()
+{
+  int i;
+  if (bRingInitialized)
+     return;
+  for (i = 0; i < LOG_RING_SIZE; i++)
+     atomic_init(&ring[i].sequence,i);
+  atomic_init(&enqueuePos,0);
+  bRingInitialized = TRUE;
+}
+
+/* Write one message to the log file, opening it if necessary
+ * @param text     message including its newline
+ * @param length   number of characters
+ */
+static void writeLogText(char* text, int length)
+{
+  if ((pLogFile == NULL) && (!bOpenFailed))
+     {
+     pLogFile = fopen(logFilename,"w");
+     if (pLogFile == NULL)
+        {
+	printf("Error opening log file %s - errno is %d\n",logFilename,errno);
+	bOpenFailed = TRUE;
+        }
+     }
+  if (pLogFile != NULL)
+     fwrite(text,1,length,pLogFile);
+}
+
+/* Take all the messages that are ready out of the ring 
+ * and write them. Called only by the writer thread.
+ * @return number of messages written
+ */
+static int drainRing()
+{
+  int count = 0;
+  while (TRUE)
+     {
+     LOG_SLOT_T* pSlot = &ring[dequeuePos & (LOG_RING_SIZE - 1)];
+     unsigned long sequence = atomic_load_explicit(&pSlot->sequence,
+						   memory_order_acquire);
+     if (sequence != dequeuePos + 1)
+        break;   /* next message not finished yet */
+     writeLogText(pSlot->text,pSlot->length);
+     atomic_store_explicit(&pSlot->sequence,dequeuePos + LOG_RING_SIZE,
+			   memory_order_release);
+     dequeuePos++;
+     count++;
+     }
+  return count;
+}
+
+/* Sleep until the next message is ready or the writer is told to 
+ * stop. The writer says it is waiting before it looks at the ring
+ * for the last time, and logWrite looks at that flag after it queues
+ * a message, so one or the other always sees the message. Called
+ * only by the writer thread.
+ */
+static void waitForMessage()
+{
+  pthread_mutex_lock(&writerLock);
+  atomic_store(&bWriterWaiting,1);
+  while ((atomic_load(&ring[dequeuePos & (LOG_RING_SIZE - 1)].sequence) 
+	  != dequeuePos + 1) && (!atomic_load(&bStopWriter)))
+     pthread_cond_wait(&writerWake,&writerLock);
+  atomic_store(&bWriterWaiting,0);
+  pthread_mutex_unlock(&writerLock);
+}
+
+/* Wake the writer thread if it is waiting for a message
+ */
+static void wakeWriter()
+{
+  pthread_mutex_lock(&writerLock);
+  pthread_cond_signal(&writerWake);
+  pthread_mutex_unlock(&writerLock);
+}
+
+/* Background thread that writes queued messages to the log file
+ * @param pArg    not used
+ * @return NULL
+ */
+static void* logWriter(void* pArg)
+{
+  BOOL bDone = FALSE;
+  (void) pArg;
+  while (!bDone)
+     {
+     if (drainRing() == 0)
+        {
+	/* check the flag before the last drain so no message is missed */
+	bDone = atomic_load(&bStopWriter);
+	drainRing();
+	if (pLogFile != NULL)
+	   fflush(pLogFile);
+	if (!bDone)
+	   waitForMessage();
+        }
+     }
+  return NULL;
+}
+
+/* Start the writer thread for the first message, unless another
+ * thread has just done so.
+ * @return TRUE if the writer is running
+ */
+static BOOL startWriter()
+{
+  pthread_mutex_lock(&writerLock);
+  if ((!atomic_load(&bWriterRunning)) && (!atomic_load(&bStartFailed)))
+     {
+     if (pthread_create(&writerThread,NULL,logWriter,NULL) == 0)
+        atomic_store(&bWriterRunning,1);
+     else
+        {
+	printf("Error starting log writer thread\n");
+	atomic_store(&bStartFailed,1);
+        }
+     }
+  pthread_mutex_unlock(&writerLock);
+  return atomic_load(&bWriterRunning);
+}
+
+/* Start writing log messages to a file, using a background thread.
+ * The thread is started and the file created when the first message
+ * arrives, so neither happens if nothing is logged. Stops any log 
+ * already started.
+ * @param filename   log file to write
+ */
+void logStart(char* filename)
+{
+  logStop();
+  initRing();
+  strncpy(logFilename,filename,sizeof(logFilename) - 1);
+  logFilename[sizeof(logFilename) - 1] = '\0';
+  bOpenFailed = FALSE;
+  atomic_store(&bStopWriter,0);
+  atomic_store(&bStartFailed,0);
+  bLogStarted = TRUE;
+}
+
+/* Write all waiting messages, stop the background thread and 
+ * close the log file. Does nothing if the log is not started.
+ */
+void logStop()
+{
+  if (!bLogStarted)
+     return;
+  bLogStarted = FALSE;
+  if (atomic_load(&bWriterRunning))
+     {
+     atomic_store(&bStopWriter,1);
+     wakeWriter();
+     pthread_join(writerThread,NULL);
+     atomic_store(&bWriterRunning,0);
+     }
+  if (pLogFile != NULL)
+     fclose(pLogFile);
+  pLogFile = NULL;
+}
+
+/* Format a message and queue it for the log file. If no log has been
+ * started the message goes to stderr. Use the LOG macros rather than
+ * calling this directly; they have already checked the level.
+ * @param format    printf format; a newline is added
+ */
+void logWrite(const char* format, ...)
+{
+  va_list args;
+  LOG_SLOT_T* pSlot = NULL;
+  unsigned long pos;
+  int length;
+  if ((!bLogStarted) || 
+      ((!atomic_load(&bWriterRunning)) && (!startWriter())))
+     {
+     va_start(args,format);
+     vfprintf(stderr,format,args);
+     va_end(args);
+     fputc('\n',stderr);
+     return;
+     }
+  /* claim a slot */
+  pos = atomic_load_explicit(&enqueuePos,memory_order_relaxed);
+  while (pSlot == NULL)
+     {
+     LOG_SLOT_T* pTry = &ring[pos & (LOG_RING_SIZE - 1)];
+     unsigned long sequence = atomic_load_explicit(&pTry->sequence,
+						   memory_order_acquire);
+     long diff = (long) sequence - (long) pos;
+     if (diff == 0)
+        {
+	if (atomic_compare_exchange_weak_explicit(&enqueuePos,&pos,pos + 1,
+						  memory_order_relaxed,
+						  memory_order_relaxed))
+	   pSlot = pTry;
+	}
+     else 
+        {
+	/* ring full: wait for the writer to catch up */
+	if (diff < 0)
+	   sched_yield();
+	pos = atomic_load_explicit(&enqueuePos,memory_order_relaxed);
+        }
+     }
+  va_start(args,format);
+  length = vsnprintf(pSlot->text,LOG_MESSAGE_SIZE - 1,format,args);
+  va_end(args);
+  if (length < 0)
+     length = 0;
+  else if (length > LOG_MESSAGE_SIZE - 2)
+     length = LOG_MESSAGE_SIZE - 2;
+  pSlot->text[length++] = '\n';
+  pSlot->length = length;
+  /* sequentially consistent, to pair with the writer's flag */
+  atomic_store(&pSlot->sequence,pos + 1);
+  if (atomic_load(&bWriterWaiting))
+     wakeWriter();
+}
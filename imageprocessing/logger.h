@@ -0,0 +1,75 @@
+/* Header file for the levelled, asynchronous logging used by
+ * guided vectorization
+ *
+ * Copyright 2020 Sally E. Goldin
+ * 
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ * 
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+
+/* log levels, most important first */
+#define LOG_ERROR 0
+#define LOG_WARN  1
+#define LOG_INFO  2
+#define LOG_DEBUG 3   /* one or two lines per feature */
+#define LOG_TRACE 4   /* lines for every point */
+
+/* Messages above this level are removed by the compiler.
+ * Build with e.g. -DLOG_COMPILE_LEVEL=LOG_INFO to take the per point
+ * messages out of the matching code completely.
+ */
+#ifndef LOG_COMPILE_LEVEL
+#define LOG_COMPILE_LEVEL LOG_TRACE
+#endif
+
+/* current runtime level; messages above it are not formatted */
+extern int logLevel;
+
+/* Log a printf style message at the given level. The arguments
+ * are not evaluated unless the message will be written.
+ */
+#define LOG_AT(level, ...) \
+  do { if (((level) <= LOG_COMPILE_LEVEL) && ((level) <= logLevel)) \
+          logWrite(__VA_ARGS__); } while (0)
+
+#define LOGERROR(...) LOG_AT(LOG_ERROR, __VA_ARGS__)
+#define LOGWARN(...)  LOG_AT(LOG_WARN, __VA_ARGS__)
+#define LOGINFO(...)  LOG_AT(LOG_INFO, __VA_ARGS__)
+#define LOGDEBUG(...) LOG_AT(LOG_DEBUG, __VA_ARGS__)
+#define LOGTRACE(...) LOG_AT(LOG_TRACE, __VA_ARGS__)
+
+/* Convert a level name (error, warn, info, debug, trace) or number
+ * @param name    level name
+ * @return level, or -1 if not recognized
+ */
+int parseLogLevel(char* name);
+
+/* Start writing log messages to a file, using a background thread.
+ * The thread is started and the file created when the first message
+ * arrives, so neither happens if nothing is logged. Stops any log 
+ * already started.
+ * @param filename   log file to write
+ */
+void logStart(char* filename);
+
+/* Write all waiting messages, stop the background thread and 
+ * close the log file. Does nothing if the log is not started.
+ */
+void logStop();
+
+/* Format a message and queue it for the log file. If no log has been
+ * started the message goes to stderr. Use the LOG macros rather than
+ * calling this directly; they have already checked the level.
+ * @param format    printf format; a newline is added
+ */
+void logWrite(const char* format, ...);
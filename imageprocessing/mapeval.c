@@ -0,0 +1,963 @@
+/* Component of the MapEval road evaluation.
+ * The guided vectorizer as a library: everything one job needs is
+ * held in a MAPEVAL_JOB_T rather than in globals, so a program can
+ * run several jobs, one after another or at the same time on 
+ * different threads. guidedVectorize is a command line front end
+ * for these functions. See mapeval.h for the order they are called in.
+ *
+ * Copyright 2020 Sally E. Goldin
+ * 
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ * 
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <errno.h>
+#include <pthread.h>
+
+#include "structures.h"
+#include "fileFunctions.h"
+#include "bitImage.h"
+#include "distanceTransform.h"
+#include "componentMap.h"
+#include "jpegBinarize.h"
+#include "bandImage.h"
+#include "polyline.h"
+#include "paramReader.h"
+#include "outputBuffer.h"
+#include "logger.h"
+#include "featureMatch.h"
+#include "lineCompare.h"
+#include "refCache.h"
+#include "lineClip.h"
+#include "transform.h"
+#include "instrument.h"
+#include "mapeval.h"
+
+/* number of features read, matched and written together
+ * when matching with several threads
+ */
+#define MATCH_BLOCK_SIZE 256
+
+/* pool of threads matching one block of features */
+typedef struct _matchPool
+{
+  pthread_mutex_t lock;       /* protects everything below */
+  pthread_cond_t workReady;   /* signalled when a new block is ready */
+  pthread_cond_t workDone;    /* signalled when a block is finished */
+  FEATURE_MATCH_T* matches;   /* features in the current block */
+  int count;                  /* number of features in the block */
+  int next;                   /* next feature to be claimed */
+  int finished;               /* number of features matched */
+  int generation;             /* incremented for each new block */
+  BOOL bShutdown;             /* TRUE when the threads should exit */
+  MAPEVAL_JOB_T* pJob;        /* job being matched */
+  BITIMAGE_T* pImage;         /* image being matched */
+  int tolerance;              /* radius of point search in pixels */
+  pthread_t* threads;         /* worker threads */
+} MATCH_POOL_T;
+
+/* Read the next feature from the reference file, assumed to be open
+ * In a text file each line is the feature Id followed by comma 
+ * separated "x y" pairs, parsed straight out of the reader's buffer.
+ * In a binary file each feature is the Id, a point count and the
+ * coordinates as doubles.
+ * @param  pReader  Reader for the open parameter file
+ * @param  pRefId   Pointer to reference feature ID
+ * @param  pMeters  List to hold the points in meters; any points 
+ *                  it holds already are removed
+ * @return TRUE if a feature was read, FALSE if no more features 
+ */
+BOOL readNextReferenceFeature(PARAM_READER_T* pReader, int* pRefId,
+			      COORD_LIST_T* pMeters)
+{
+  double xCoord = 0.0;
+  double yCoord = 0.0;
+  BOOL bFirst = TRUE;
+  resetCoordList(pMeters);
+  if (pReader->bBinary)
+     {
+     int pointCount = readBinaryFeatureStart(pReader,pRefId);
+     int i = 0;
+     for (i = 0; i < pointCount; i++)
+        {
+	if (!readBinaryPoint(pReader,&xCoord,&yCoord))
+	   break;
+	appendCoord(pMeters,xCoord,yCoord);
+	}
+     return (pMeters->count > 0);
+     }
+  while (nextParamToken(pReader))
+     {
+     /* like sscanf, stop at the first field that does not parse */
+     if ((!bFirst) || (parseParamInt(pReader,pRefId)))
+        {
+	if (parseParamDouble(pReader,&xCoord))
+	   parseParamDouble(pReader,&yCoord);
+        }
+     bFirst = FALSE;
+     endParamToken(pReader);
+     appendCoord(pMeters,xCoord,yCoord);
+     }
+  return (pMeters->count > 0);
+}
+
+/* Get ready to read the reference lines for a job, once the 
+ * georeferencing is known. If they come from the cache, find 
+ * the lines that may cross the image.
+ * @param  pJob     Job whose reference lines are to be read
+ * @return TRUE if successful, FALSE if memory ran out
+ */
+BOOL startRefCursor(MAPEVAL_JOB_T* pJob)
+{
+  REF_CURSOR_T* pCursor = &pJob->refCursor;
+  GEOREF_T* pGeoref = &pJob->georef;
+  pCursor->box[0] = pGeoref->centerX - (pJob->width/2) * pGeoref->cellsizeX;
+  pCursor->box[1] = pGeoref->centerY - (pJob->height/2) * pGeoref->cellsizeY;
+  pCursor->box[2] = pGeoref->centerX + (pJob->width/2) * pGeoref->cellsizeX;
+  pCursor->box[3] = pGeoref->centerY + (pJob->height/2) * pGeoref->cellsizeY;
+  pCursor->count = 0;
+  pCursor->next = 0;
+  pCursor->segment = 0;
+  resetCoordList(&pCursor->points);
+  if (pJob->refCache != NULL)
+     pCursor->count = findRefLines(pJob->refCache,pCursor->box,
+				    &pCursor->lines,&pCursor->capacity);
+  return (pCursor->count >= 0);
+}
+
+/* Read the next whole reference line, from the cache or the 
+ * parameter file, and clip its segments to the image. 
+ * @param  pJob     Job whose reference lines are being read
+ * @return TRUE if a line was read, FALSE if no more lines 
+ */
+BOOL readReferenceLine(MAPEVAL_JOB_T* pJob)
+{
+  REF_CURSOR_T* pCursor = &pJob->refCursor;
+  double box[4];
+  int count = 0;
+  if (pJob->refCache != NULL)
+     {
+     if (pCursor->next >= pCursor->count)
+        return FALSE;
+     readRefLine(pJob->refCache,pCursor->lines[pCursor->next],
+		 &pCursor->refId,&pCursor->points);
+     pCursor->next++;
+     }
+  else if (!readNextReferenceFeature(pJob->pReader,&pCursor->refId,&pCursor->points))
+     {
+     return FALSE;
+     }
+  count = pCursor->points.count;
+  if (count > pCursor->clipCapacity)
+     {
+     pCursor->pixels = realloc(pCursor->pixels,2 * count * sizeof(double));
+     pCursor->t0 = realloc(pCursor->t0,count * sizeof(double));
+     pCursor->t1 = realloc(pCursor->t1,count * sizeof(double));
+     pCursor->cols = realloc(pCursor->cols,count * sizeof(int));
+     pCursor->rows = realloc(pCursor->rows,count * sizeof(int));
+     if ((pCursor->pixels == NULL) || (pCursor->t0 == NULL) || 
+	 (pCursor->t1 == NULL) || (pCursor->cols == NULL) ||
+	 (pCursor->rows == NULL))
+        {
+	printf("Error allocating clipping arrays for %d points\n",count);
+	exit(3);
+        }
+     pCursor->clipCapacity = count;
+     }
+  pCursor->segment = 0;
+  if (count == 0)
+     return TRUE;
+  /* clip in pixels, against the edges of the image */
+  box[0] = box[1] = -CLIP_TOLERANCE;
+  box[2] = pJob->width + CLIP_TOLERANCE;
+  box[3] = pJob->height + CLIP_TOLERANCE;
+  worldToPixelCoords(&pJob->georef,pCursor->points.xy,count,pCursor->pixels);
+  clipSegments(pCursor->pixels,count,box,pCursor->t0,pCursor->t1);
+  return TRUE;
+}
+
+/* Read the next reference feature: the next part of a reference line
+ * that is inside the image. A line that leaves the image and comes 
+ * back becomes several features with the same Id, as it does when
+ * the database clips it.
+ * @param  pJob     Job whose reference lines are being read
+ * @param  pRefId   Pointer to reference feature ID
+ * @param  pRef     Polyline to hold the points in image coordinates;
+ *                  any points it holds already are removed
+ * @param  pMeters  If not NULL, list to hold the points in meters;
+ *                  any points it holds already are removed
+ * @return TRUE if a feature was read, FALSE if no more features 
+ */
+BOOL readClippedReferenceFeature(MAPEVAL_JOB_T* pJob, int* pRefId,
+				 POLYLINE_T* pRef, COORD_LIST_T* pMeters)
+{
+  REF_CURSOR_T* pCursor = &pJob->refCursor;
+  int i = 0;
+  resetPolyline(pRef);
+  if (pMeters != NULL)
+     resetCoordList(pMeters);
+  /* the parts are interpolated in meters, so vertices inside the 
+   * image keep the coordinates they were read with 
+   */
+  while (nextClipPiece(pCursor->points.xy,pCursor->points.count,
+		       pCursor->t0,pCursor->t1,&pCursor->segment,
+		       &pCursor->piece) == 0)
+     {
+     if (!readReferenceLine(pJob))
+        return FALSE;
+     }
+  *pRefId = pCursor->refId;
+  worldToPixels(&pJob->georef,pCursor->piece.xy,pCursor->piece.count,
+		pCursor->cols,pCursor->rows);
+  reservePolyline(pRef,pCursor->piece.count);
+  if (pMeters != NULL)
+     reserveCoordList(pMeters,pCursor->piece.count);
+  for (i = 0; i < pCursor->piece.count; i++)
+     {
+     appendPolylinePoint(pRef,pCursor->cols[i],pCursor->rows[i],0.0);
+     if (pMeters != NULL)
+        appendCoord(pMeters,pCursor->piece.xy[2*i],pCursor->piece.xy[2*i + 1]);
+     }
+  return TRUE;
+}
+
+/* Read the next reference feature into a FEATURE_MATCH_T. The points
+ * in meters are kept too if the lines are being compared.
+ * @param  pJob     Job whose reference lines are being read
+ * @param  pMatch   Structure to fill in; its polylines are reused
+ * @return TRUE if a feature was read, FALSE if no more features
+ */
+BOOL readFeatureMatch(MAPEVAL_JOB_T* pJob, FEATURE_MATCH_T* pMatch)
+{
+  resetPolyline(&pMatch->line);
+  return readClippedReferenceFeature(pJob,&pMatch->refFeatureId,&pMatch->ref,
+				     (pJob->lineCompare != NULL) ? &pMatch->refMeters : NULL);
+}
+
+/* Claim and match features from the pool's current block 
+ * until there are none left.
+ * @param pPool    Worker pool
+ */
+void matchPoolFeatures(MATCH_POOL_T* pPool)
+{
+  BOOL bMore = TRUE;
+  while (bMore)
+     {
+     int index = -1;
+     pthread_mutex_lock(&pPool->lock);
+     if (pPool->next < pPool->count)
+        index = pPool->next++;
+     pthread_mutex_unlock(&pPool->lock);
+     if (index < 0)
+        {
+	bMore = FALSE;
+        }
+     else
+        {
+	matchFeature(pPool->pJob,&pPool->matches[index],pPool->pImage,pPool->tolerance);
+	pthread_mutex_lock(&pPool->lock);
+	pPool->finished++;
+	if (pPool->finished == pPool->count)
+	   pthread_cond_signal(&pPool->workDone);
+	pthread_mutex_unlock(&pPool->lock);
+        }
+     }
+}
+
+/* Worker thread function. Waits for each new block of features,
+ * then helps to match it.
+ * @param pArg    Pointer to the MATCH_POOL_T
+ * @return NULL
+ */
+void* matchWorker(void* pArg)
+{
+  MATCH_POOL_T* pPool = (MATCH_POOL_T*) pArg;
+  int generation = 0;
+  BOOL bDone = FALSE;
+  while (!bDone)
+     {
+     pthread_mutex_lock(&pPool->lock);
+     while ((pPool->generation == generation) && (!pPool->bShutdown))
+        pthread_cond_wait(&pPool->workReady,&pPool->lock);
+     generation = pPool->generation;
+     bDone = pPool->bShutdown;
+     pthread_mutex_unlock(&pPool->lock);
+     if (!bDone)
+        matchPoolFeatures(pPool);
+     }
+  return NULL;
+}
+
+/* Match all the features in the parameter file using a pool of
+ * threads. Features are read and written in blocks of MATCH_BLOCK_SIZE;
+ * within a block the threads match features in any order, but the
+ * results are written in the order the features were read, so the
+ * output files are identical to those from a single thread.
+ * @param pJob       Job to match, with its image in memory
+ * @return number of features written
+ */
+int matchInParallel(MAPEVAL_JOB_T* pJob)
+{
+  int threadCount = pJob->options.threadCount;
+  MATCH_POOL_T pool;
+  int featureCount = 0;
+  int started = 0;    /* worker threads actually created */
+  int i = 0;
+  BOOL bMore = TRUE;
+  memset(&pool,0,sizeof(pool));
+  pool.pJob = pJob;
+  pool.pImage = pJob->pImage;
+  pool.tolerance = pJob->tolerance;
+  pool.matches = calloc(MATCH_BLOCK_SIZE,sizeof(FEATURE_MATCH_T));
+  pool.threads = calloc(threadCount,sizeof(pthread_t));
+  if ((pool.matches == NULL) || (pool.threads == NULL))
+     {
+     printf("Error allocating worker pool\n");
+     exit(3);
+     }
+  for (i = 0; i < MATCH_BLOCK_SIZE; i++)
+     initFeatureMatch(&pool.matches[i]);
+  pthread_mutex_init(&pool.lock,NULL);
+  pthread_cond_init(&pool.workReady,NULL);
+  pthread_cond_init(&pool.workDone,NULL);
+  /* this thread matches features too, so start one less */
+  for (i = 0; i < threadCount - 1; i++)
+     {
+     if (pthread_create(&pool.threads[started],NULL,matchWorker,&pool) == 0)
+        started++;
+     }
+  while (bMore)
+     {
+     int count = 0;
+     INSTR_TIMER_T timer;
+     INSTR_START(&timer);
+     while ((count < MATCH_BLOCK_SIZE) &&
+	    (readFeatureMatch(pJob,&pool.matches[count])))
+        count++;
+     INSTR_STOP(&timer,"param_read");
+     INSTR_COUNT("features_read",count);
+     bMore = (count == MATCH_BLOCK_SIZE);
+     if (count == 0)
+        break;
+     INSTR_START(&timer);
+     pthread_mutex_lock(&pool.lock);
+     pool.count = count;
+     pool.next = 0;
+     pool.finished = 0;
+     pool.generation++;
+     pthread_cond_broadcast(&pool.workReady);
+     pthread_mutex_unlock(&pool.lock);
+     matchPoolFeatures(&pool);
+     pthread_mutex_lock(&pool.lock);
+     while (pool.finished < pool.count)
+        pthread_cond_wait(&pool.workDone,&pool.lock);
+     pthread_mutex_unlock(&pool.lock);
+     INSTR_STOP(&timer,"match");
+     INSTR_START(&timer);
+     for (i = 0; i < count; i++)
+        writeFeatureMatch(pJob,&pool.matches[i],&featureCount);
+     INSTR_STOP(&timer,"write");
+     }
+  pthread_mutex_lock(&pool.lock);
+  pool.bShutdown = TRUE;
+  pthread_cond_broadcast(&pool.workReady);
+  pthread_mutex_unlock(&pool.lock);
+  for (i = 0; i < started; i++)
+     pthread_join(pool.threads[i],NULL);
+  pthread_mutex_destroy(&pool.lock);
+  pthread_cond_destroy(&pool.workReady);
+  pthread_cond_destroy(&pool.workDone);
+  for (i = 0; i < MATCH_BLOCK_SIZE; i++)
+     releasePolylines(pJob,&pool.matches[i]);
+  free(pool.matches);
+  free(pool.threads);
+  return featureCount;
+}
+
+/* Grow an array of ints if it is full
+ * @param pArray    Pointer to the array, updated if it is reallocated
+ * @param pMax      Pointer to the allocated size, updated
+ * @param count     Number of elements in use
+ */
+void growIntArray(int** pArray, int* pMax, int count)
+{
+  if (count >= *pMax)
+     {
+     int newMax = (*pMax > 0) ? *pMax * 2 : 1024;
+     int* newArray = realloc(*pArray,newMax * sizeof(int));
+     if (newArray == NULL)
+        {
+	printf("Error allocating memory for %d reference features\n",newMax);
+	exit(3);
+        }
+     *pArray = newArray;
+     *pMax = newMax;
+     }
+}
+
+/* Match all the features in the parameter file against an image
+ * that is read in bands of 'bandRows' rows, so the whole image is
+ * never in memory at once. All the reference features are read
+ * first and each vertex is assigned to the band containing its row.
+ * Each band is read with enough rows above and below to cover the
+ * search window of its vertices, and those vertices are searched for
+ * in that band. The matches are then put back together feature by 
+ * feature, across the band boundaries, and written in the original
+ * order. Since the match for a vertex depends only on its position,
+ * the output is the same as for the whole image (with -nearest, a 
+ * pixel may be chosen from several at the same distance).
+ * @param pJob       Job to match, with its image reader positioned
+ *                   at the first row
+ * @return number of features written, or -1 if the image could not be read
+ */
+int matchInBands(MAPEVAL_JOB_T* pJob)
+{
+  int bandRows = pJob->options.bandRows;
+  int tolerance = pJob->tolerance;
+  int width = pJob->width;
+  int height = pJob->height;
+  FEATURE_MATCH_T match;
+  POLYLINE_T refs;             /* vertices of all the reference features */
+  COORD_LIST_T refMeters;      /* the same vertices in meters, if comparing */
+  int* featureIds = NULL;      /* reference feature Id of each feature */
+  int* featureStart = NULL;    /* index in refs of each feature's first vertex */
+  int idMax = 0;               /* allocated sizes of the two arrays above */
+  int startMax = 0;
+  int featureCount = 0;        /* number of features read */
+  int* bandStart = NULL;       /* index in 'order' of each band's first vertex */
+  int* order = NULL;           /* vertex indices, sorted by band */
+  int* vertexBand = NULL;      /* band holding each vertex */
+  int* foundX = NULL;          /* pixel matching each vertex, -1 if none */
+  int* foundY = NULL;
+  IMAGE_BAND_T* pBand = NULL;
+  int bandCount = (height + bandRows - 1) / bandRows;
+  int lastBand = -1;           /* last band with any vertices */
+  int overlap = tolerance;     /* extra rows above and below each band */
+  int written = 0;
+  int b = 0;
+  int f = 0;
+  int i = 0;
+  long long startProbes = searchProbeCount();
+  BOOL bOk = TRUE;
+  INSTR_TIMER_T timer;
+  /* the nearest pixel can be outside the tolerance box, but
+   * never more than this far away if there is one inside
+   */
+  if (pJob->options.searchMode != SEARCH_SPIRAL)
+     overlap = (int) ceil(sqrt(2.0) * tolerance) + 1;
+  initFeatureMatch(&match);
+  memset(&refs,0,sizeof(refs));
+  memset(&refMeters,0,sizeof(refMeters));
+  INSTR_START(&timer);
+  while (readFeatureMatch(pJob,&match))
+     {
+     growIntArray(&featureIds,&idMax,featureCount);
+     growIntArray(&featureStart,&startMax,featureCount);
+     featureIds[featureCount] = match.refFeatureId;
+     featureStart[featureCount] = refs.count;
+     for (i = 0; i < match.ref.count; i++)
+        appendPolylinePoint(&refs,match.ref.x[i],match.ref.y[i],0.0);
+     for (i = 0; i < match.refMeters.count; i++)
+        appendCoord(&refMeters,match.refMeters.xy[2*i],match.refMeters.xy[2*i + 1]);
+     featureCount++;
+     }
+  growIntArray(&featureStart,&startMax,featureCount);
+  featureStart[featureCount] = refs.count;
+  INSTR_STOP(&timer,"param_read");
+  INSTR_COUNT("features_read",featureCount);
+  LOGINFO("Read %d reference features with %d points; %d bands of %d rows, overlap %d",
+	  featureCount,refs.count,bandCount,bandRows,overlap);
+
+  /* sort the vertices by band */
+  bandStart = calloc(bandCount + 1,sizeof(int));
+  order = calloc(refs.count + 1,sizeof(int));
+  vertexBand = calloc(refs.count + 1,sizeof(int));
+  foundX = calloc(refs.count + 1,sizeof(int));
+  foundY = calloc(refs.count + 1,sizeof(int));
+  if ((bandStart == NULL) || (order == NULL) || (vertexBand == NULL) ||
+      (foundX == NULL) || (foundY == NULL))
+     {
+     printf("Error allocating memory for %d reference points\n",refs.count);
+     exit(3);
+     }
+  for (i = 0; i < refs.count; i++)
+     {
+     int y = refs.y[i];
+     if (y < 0)
+        b = 0;
+     else if (y >= height)
+        b = bandCount - 1;
+     else
+        b = y / bandRows;
+     vertexBand[i] = b;
+     bandStart[b + 1]++;
+     if (b > lastBand)
+        lastBand = b;
+     foundX[i] = foundY[i] = -1;
+     }
+  for (b = 0; b < bandCount; b++)
+     bandStart[b + 1] += bandStart[b];
+  for (i = 0; i < refs.count; i++)
+     order[bandStart[vertexBand[i]]++] = i;
+  for (b = bandCount; b > 0; b--)
+     bandStart[b] = bandStart[b - 1];
+  bandStart[0] = 0;
+
+  /* search for each band's vertices in that band */
+  if (lastBand >= 0)
+     {
+     pBand = newImageBand(width,bandRows + 2*overlap);
+     if (pBand == NULL)
+        exit(3);
+     }
+  for (b = 0; (bOk) && (b <= lastBand); b++)
+     {
+     int top = b*bandRows - overlap;
+     int bottom = (b + 1)*bandRows + overlap;
+     if (top < 0)
+        top = 0;
+     if (bottom > height)
+        bottom = height;
+     INSTR_START(&timer);
+     bOk = advanceImageBand(pJob->pRows,pBand,top,bottom);
+     INSTR_STOP(&timer,"band_load");
+     if ((!bOk) || (bandStart[b] == bandStart[b + 1]))
+        continue;
+     if (pJob->options.searchMode != SEARCH_SPIRAL)
+        {
+	INSTR_START(&timer);
+	pJob->nearestMap = buildNearestMap(pBand->pImage);
+	INSTR_STOP(&timer,"nearest_map");
+	if (pJob->nearestMap == NULL)
+	   exit(3);
+        }
+     LOGDEBUG("BAND %d - rows %d to %d, %d points",b,top,bottom - 1,
+	      bandStart[b + 1] - bandStart[b]);
+     INSTR_START(&timer);
+     for (i = bandStart[b]; i < bandStart[b + 1]; i++)
+        {
+	int v = order[i];
+	int x = -1;
+	int y = -1;
+	LOGTRACE("Looking for point at (%d,%d)",refs.x[v],refs.y[v]);
+	if (searchPoint(pJob,pBand->pImage,refs.x[v],refs.y[v] - top,tolerance,&x,&y))
+	   {
+	   LOGTRACE("--- FOUND at (%d,%d)",x,y + top);
+	   foundX[v] = x;
+	   foundY[v] = y + top;
+	   }
+        }
+     INSTR_STOP(&timer,"match");
+     freeNearestMap(pJob->nearestMap);
+     pJob->nearestMap = NULL;
+     }
+  freeImageBand(pBand);
+  INSTR_COUNT("pixels_probed",searchProbeCount() - startProbes);
+
+  /* put each feature back together; like followReferenceFeature,
+   * stop at the first vertex with no match 
+   */
+  INSTR_START(&timer);
+  for (f = 0; (bOk) && (f < featureCount); f++)
+     {
+     resetPolyline(&match.ref);
+     resetPolyline(&match.line);
+     match.refFeatureId = featureIds[f];
+     match.probes = 0;
+     reservePolyline(&match.ref,featureStart[f + 1] - featureStart[f]);
+     for (i = featureStart[f]; i < featureStart[f + 1]; i++)
+        appendPolylinePoint(&match.ref,refs.x[i],refs.y[i],0.0);
+     if (pJob->lineCompare != NULL)
+        {
+	resetCoordList(&match.refMeters);
+	for (i = featureStart[f]; i < featureStart[f + 1]; i++)
+	   appendCoord(&match.refMeters,refMeters.xy[2*i],refMeters.xy[2*i + 1]);
+        }
+     for (i = featureStart[f]; (i < featureStart[f + 1]) && (foundX[i] >= 0); i++)
+        {
+	int dx = refs.x[i] - foundX[i];
+	int dy = refs.y[i] - foundY[i];
+	appendPolylinePoint(&match.line,foundX[i],foundY[i],
+			    sqrt((double) (dx*dx + dy*dy)));
+        }
+     LOGDEBUG("NEW FEATURE %d - START AT (%d,%d) with %d points",
+	      match.refFeatureId,match.ref.x[0],match.ref.y[0],match.ref.count);
+     writeFeatureMatch(pJob,&match,&written);
+     }
+  INSTR_STOP(&timer,"write");
+  releasePolylines(pJob,&match);
+  freePolyline(&refs);
+  freeCoordList(&refMeters);
+  free(featureIds);
+  free(featureStart);
+  free(bandStart);
+  free(order);
+  free(vertexBand);
+  free(foundX);
+  free(foundY);
+  return (bOk) ? written : -1;
+}
+
+/* Read the image for a job. If a provider is named, the image is
+ * that provider's JPEG and we binarize it as we decode it; otherwise
+ * it is the binary RGB file produced by the old conversion scripts.
+ * @param imagefile  Name of the image file
+ * @param provider   Provider name or empty string
+ * @param width      Image width in pixels
+ * @param height     Image height in pixels
+ * @return binary image or NULL if error
+ */
+BITIMAGE_T* readJobImage(char* imagefile, char* provider, int width, int height)
+{
+  BITIMAGE_T* pImage = NULL;
+  if (strlen(provider) > 0)
+     {
+     PROVIDER_PROFILE_T* pProfile = findProviderProfile(provider);
+     if (pProfile == NULL)
+        printf("Error - no binarization profile for provider %s\n",provider);
+     else
+        pImage = readJpegBitImage(imagefile,pProfile,width,height);
+     }
+  else
+     {
+     pImage = readBitImageFile(imagefile,width,height);
+     }
+  return pImage;
+}
+
+
+/* Set options to the defaults: spiral search, SQL output, one
+ * thread, the whole image in memory, nothing erased or compared.
+ * @param pOptions   Options to fill in
+ */
+void initMapevalOptions(MAPEVAL_OPTIONS_T* pOptions)
+{
+  memset(pOptions,0,sizeof(MAPEVAL_OPTIONS_T));
+  pOptions->searchMode = SEARCH_SPIRAL;
+  pOptions->bCopyOutput = FALSE;
+  pOptions->threadCount = 1;
+  pOptions->bandRows = 0;
+}
+
+/* Create the context for one job, that is, one image and one
+ * parameter file.
+ * @param pOptions   How the job is to be matched; copied
+ * @param width      Width of the image in pixels
+ * @param height     Height of the image in pixels
+ * @param refCache   Reference line cache to read the lines from
+ *                   instead of the parameter file, or NULL. It is
+ *                   not changed, so many jobs can share it, and it
+ *                   must stay open until they are freed.
+ * @return new job or NULL if allocation failed
+ */
+MAPEVAL_JOB_T* newMapevalJob(const MAPEVAL_OPTIONS_T* pOptions,
+			     int width, int height, REF_CACHE_T* refCache)
+{
+  MAPEVAL_JOB_T* pJob = calloc(1,sizeof(MAPEVAL_JOB_T));
+  if (pJob == NULL)
+     return NULL;
+  pJob->options = *pOptions;
+  if (pJob->options.threadCount < 1)
+     pJob->options.threadCount = 1;
+  pJob->width = width;
+  pJob->height = height;
+  pJob->refCache = refCache;
+  pJob->tolerance = 3;  /* will be updated from the buffer size in the param file */ 
+  setGeoref(&pJob->georef,0.0,0.0,0.0,0.0,width,height);
+  pthread_mutex_init(&pJob->checkStatsLock,NULL);
+  return pJob;
+}
+
+/* Free a job and everything it still holds. Output files that
+ * have not been closed by mapevalCloseOutput are closed, but
+ * errors writing them are not reported.
+ * @param pJob     Job to free (may be NULL)
+ */
+void freeMapevalJob(MAPEVAL_JOB_T* pJob)
+{
+  if (pJob == NULL)
+     return;
+  freeBitImage(pJob->pImage);
+  closeRowReader(pJob->pRows);
+  closeParamReader(pJob->pReader);
+  freeNearestMap(pJob->nearestMap);
+  freeComponentMap(pJob->componentMap);
+  closeLineCompare(pJob->lineCompare);
+  closeOutBuf(pJob->pOut);
+  closeOutBuf(pJob->pSql);
+  free(pJob->refCursor.lines);
+  free(pJob->refCursor.pixels);
+  free(pJob->refCursor.t0);
+  free(pJob->refCursor.t1);
+  free(pJob->refCursor.cols);
+  free(pJob->refCursor.rows);
+  freeCoordList(&pJob->refCursor.points);
+  freeCoordList(&pJob->refCursor.piece);
+  pthread_mutex_destroy(&pJob->checkStatsLock);
+  free(pJob);
+}
+
+/* Read the image for a job into memory or, if the 'bandRows' option
+ * is set, open it to be read in bands as it is matched. Uses nothing
+ * but the job, so it can be called in a background thread while 
+ * another job is being matched.
+ * @param pJob       Job the image is for
+ * @param imagefile  Binary RGB image, or JPEG if provider is given
+ * @param provider   Provider whose JPEG the image is, or empty string
+ * @return 0 for success, 1 if the image could not be read
+ */
+int mapevalLoadImage(MAPEVAL_JOB_T* pJob, char* imagefile, char* provider)
+{
+  if (pJob->options.bandRows > 0)
+     pJob->pRows = openRowReader(imagefile,provider,pJob->width,pJob->height);
+  else
+     pJob->pImage = readJobImage(imagefile,provider,pJob->width,pJob->height);
+  return ((pJob->pImage == NULL) && (pJob->pRows == NULL)) ? 1 : 0;
+}
+
+/* Open the parameter file for a job and read its header, which
+ * sets the georeferencing and the search tolerance, and get ready
+ * to read the reference lines from it or from the cache.
+ * @param pJob       Job the reference lines are for
+ * @param paramfile  Georeferencing information and reference coordinates
+ * @return 0 for success, 1 if the file could not be read
+ */
+int mapevalLoadReferences(MAPEVAL_JOB_T* pJob, char* paramfile)
+{
+  PARAM_HEADER_T header;
+  INSTR_TIMER_T timer;
+  INSTR_START(&timer);
+  pJob->pReader = openParamReader(paramfile);
+  if (pJob->pReader == NULL)
+    {
+    printf("Error opening input parameter file %s - errno is %d\n",paramfile,errno);
+    return 1;
+    }
+  /* get transformation parameters in the first line (or binary header) */
+  header.refcount = pJob->refcount;
+  header.centerX = pJob->georef.centerX;
+  header.centerY = pJob->georef.centerY;
+  header.cellsize = pJob->cellsize;
+  header.cellsizeX = pJob->georef.cellsizeX;
+  header.cellsizeY = pJob->georef.cellsizeY;
+  header.dataId = pJob->dataId;
+  header.tolerance = pJob->tolerance;
+  if ((!readParamHeader(pJob->pReader,&header)) && (pJob->pReader->bBinary))
+    {
+    printf("Unsupported or truncated binary parameter file %s\n",paramfile);
+    closeParamReader(pJob->pReader);
+    pJob->pReader = NULL;
+    return 1;
+    }
+  pJob->refcount = header.refcount;
+  pJob->cellsize = header.cellsize;
+  setGeoref(&pJob->georef,header.centerX,header.centerY,
+	    header.cellsizeX,header.cellsizeY,pJob->width,pJob->height);
+  pJob->dataId = header.dataId;
+  if (!startRefCursor(pJob))
+    {
+    printf("Error allocating reference cache line list\n");
+    exit(3);
+    }
+  INSTR_STOP(&timer,"param_header");
+  LOGINFO("cellsize=%lf  cellsizeX=%lf  cellsizeY=%lf",pJob->cellsize,
+	  pJob->georef.cellsizeX,pJob->georef.cellsizeY);
+  /* convert from meters to pixels */
+  pJob->tolerance = round(header.tolerance/pJob->cellsize);
+  return 0;
+}
+
+/* Create the output files for a job: <outprefix>.vec, and 
+ * <outprefix>.sql or, with the 'bCopyOutput' option, <outprefix>.copy.
+ * With the 'bCompare' option <outprefix>.linematch.copy is created too.
+ * Must be called after mapevalLoadReferences, since the search
+ * tolerance is written to the vector file.
+ * @param pJob       Job the files are for
+ * @param outprefix  Output file name to create (no suffix)
+ * @param expId      DB Id of this experiment, used in the SQL
+ * @return 0 for success, 4 if a file could not be created
+ */
+int mapevalOpenOutput(MAPEVAL_JOB_T* pJob, char* outprefix, int expId)
+{
+  char vecoutfile[256];
+  char sqloutfile[256];
+  char compareoutfile[256];
+  strncpy(pJob->outprefix,outprefix,sizeof(pJob->outprefix) - 1);
+  pJob->expId = expId;
+  strcpy(vecoutfile,outprefix);
+  strcat(vecoutfile,".vec");
+  strcpy(sqloutfile,outprefix);
+  strcat(sqloutfile,pJob->options.bCopyOutput ? ".copy" : ".sql");
+  strcpy(compareoutfile,outprefix);
+  strcat(compareoutfile,".linematch.copy");
+  pJob->pOut = openOutBuf(vecoutfile);
+  if (pJob->pOut == NULL)
+     {
+     printf("Error opening vector output file %s - errno is %d\n", vecoutfile, errno);
+     return 4; 
+     }
+  outBufPrintf(pJob->pOut,"# tolerance in pixels is %d\n", pJob->tolerance);
+  pJob->pSql = openOutBuf(sqloutfile);
+  if (pJob->pSql == NULL)
+     {
+     printf("Error opening SQL output file %s - errno is %d\n", sqloutfile,errno);
+     return 4; 
+     }
+  if (pJob->options.bCompare)
+     {
+     pJob->lineCompare = newLineCompare(compareoutfile,expId);
+     if (pJob->lineCompare == NULL)
+        {
+	printf("Error opening line comparison file %s - errno is %d\n", compareoutfile,errno);
+	return 4; 
+        }
+     }
+  return 0;
+}
+
+/* Match every reference feature against the image and write the 
+ * results to the output files. The image, the reference lines and
+ * the output files must all be ready. With the 'threadCount' option
+ * greater than one, the features are matched by a pool of threads; 
+ * with 'bandRows' set, the image is read in bands. The output is the
+ * same either way.
+ * @param pJob       Job to match
+ * @return 0 for success, 1 if the image could not be read
+ */
+int mapevalMatch(MAPEVAL_JOB_T* pJob)
+{
+  BITIMAGE_T* pImage = pJob->pImage;
+  MAPEVAL_OPTIONS_T* pOptions = &pJob->options;
+  INSTR_TIMER_T timer;
+  if ((pImage != NULL) && ((pOptions->bConnected) || (pOptions->minBlobPixels > 0)))
+     {
+     INSTR_START(&timer);
+     pJob->componentMap = buildComponentMap(pImage);
+     if (pJob->componentMap == NULL)
+	return 1;
+     LOGINFO("Image has %d road regions",pJob->componentMap->count);
+     if (pOptions->minBlobPixels > 0)
+        {
+	int removed = removeSmallComponents(pImage,pJob->componentMap,
+					    pOptions->minBlobPixels);
+	LOGINFO("Erased %d regions of less than %d pixels",removed,
+		pOptions->minBlobPixels);
+	INSTR_COUNT("regions_erased",removed);
+        }
+     if (!pOptions->bConnected)
+        {
+	freeComponentMap(pJob->componentMap);
+	pJob->componentMap = NULL;
+        }
+     INSTR_STOP(&timer,"components");
+     }
+  if ((pOptions->searchMode != SEARCH_SPIRAL) && (pImage != NULL))
+     {
+     INSTR_START(&timer);
+     pJob->nearestMap = buildNearestMap(pImage);
+     INSTR_STOP(&timer,"nearest_map");
+     if (pJob->nearestMap == NULL)
+	return 1;
+     }
+  memset(&pJob->checkStats,0,sizeof(pJob->checkStats));
+  pJob->arenaPeakBytes = 0;
+  pJob->arenaTotalBytes = 0;
+  pJob->arenaCapacity = 0;
+  pJob->featureCount = 0;
+  /* do line following and write to output file */
+  if (pImage == NULL)
+     {
+     pJob->featureCount = matchInBands(pJob);
+     }
+  else if (pOptions->threadCount > 1)
+     {
+     pJob->featureCount = matchInParallel(pJob);
+     }
+  else
+     {
+     FEATURE_MATCH_T match;
+     BOOL bMore = TRUE;
+     initFeatureMatch(&match);
+     while (bMore)
+        {
+	INSTR_START(&timer);
+	bMore = readFeatureMatch(pJob,&match);
+	INSTR_STOP(&timer,"param_read");
+	if (!bMore)
+	   break;
+	INSTR_COUNT("features_read",1);
+	INSTR_START(&timer);
+	matchFeature(pJob,&match,pImage,pJob->tolerance);
+	INSTR_STOP(&timer,"match");
+	INSTR_START(&timer);
+	writeFeatureMatch(pJob,&match,&pJob->featureCount);
+	INSTR_STOP(&timer,"write");
+	}
+     releasePolylines(pJob,&match);
+     }
+  outBufString(pJob->pOut,"-END\n");  // for the Dragon vector file format
+  LOGINFO("Point arenas: peak %ld bytes for one feature, %ld bytes handed out, %ld bytes allocated",
+	  pJob->arenaPeakBytes,pJob->arenaTotalBytes,pJob->arenaCapacity);
+  INSTR_COUNT("arena_peak_bytes",pJob->arenaPeakBytes);
+  INSTR_COUNT("arena_total_bytes",pJob->arenaTotalBytes);
+  INSTR_COUNT("arena_allocated_bytes",pJob->arenaCapacity);
+  if (pOptions->searchMode == SEARCH_CHECK)
+     printCheckStats(pJob,pJob->outprefix);
+  freeNearestMap(pJob->nearestMap);
+  pJob->nearestMap = NULL;
+  freeComponentMap(pJob->componentMap);
+  pJob->componentMap = NULL;
+  closeParamReader(pJob->pReader);
+  pJob->pReader = NULL;
+  if (pJob->featureCount < 0)
+     {
+     printf("Error reading image - output is incomplete\n");
+     return 1;
+     }
+  return 0;
+}
+
+/* Flush and close the output files of a job. Most of the output 
+ * is written here, so this is where write errors show up.
+ * @param pJob       Job whose files are to be closed
+ * @return 0 for success, 4 if writing any of the files failed
+ */
+int mapevalCloseOutput(MAPEVAL_JOB_T* pJob)
+{
+  BOOL bVecOk = TRUE;
+  BOOL bSqlOk = TRUE;
+  BOOL bCompareOk = TRUE;
+  INSTR_TIMER_T timer;
+  if ((pJob->pOut != NULL) && (pJob->pSql != NULL))
+     {
+     INSTR_COUNT("bytes_written",pJob->pOut->written + pJob->pOut->used + 
+		 pJob->pSql->written + pJob->pSql->used);
+     }
+  if (pJob->lineCompare != NULL)
+     {
+     INSTR_START(&timer);
+     bCompareOk = closeLineCompare(pJob->lineCompare);
+     pJob->lineCompare = NULL;
+     INSTR_STOP(&timer,"compare");
+     }
+  INSTR_START(&timer);
+  bVecOk = closeOutBuf(pJob->pOut);
+  bSqlOk = closeOutBuf(pJob->pSql);
+  pJob->pOut = pJob->pSql = NULL;
+  INSTR_STOP(&timer,"flush");
+  return ((bVecOk) && (bSqlOk) && (bCompareOk)) ? 0 : 4;
+}
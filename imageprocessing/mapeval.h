@@ -0,0 +1,128 @@
+/* Header file for libmapeval, the guided vectorizer as a library
+ *
+ * Copyright 2020 Sally E. Goldin
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * A job matches the reference lines in one parameter file against
+ * one image. Its state is all in its MAPEVAL_JOB_T, so any number of
+ * jobs can be run at once, each on its own thread. A job is run by
+ *
+ *    initMapevalOptions(&options);       (then change what is needed)
+ *    pJob = newMapevalJob(&options,width,height,refCache);
+ *    mapevalLoadImage(pJob,imagefile,provider);
+ *    mapevalLoadReferences(pJob,paramfile);
+ *    mapevalOpenOutput(pJob,outprefix,expId);
+ *    mapevalMatch(pJob);
+ *    mapevalCloseOutput(pJob);
+ *    freeMapevalJob(pJob);
+ *
+ * stopping at the first step that does not return 0; the value it
+ * returns is the exit status guidedVectorize uses for that error.
+ * freeMapevalJob must be called whatever happens.
+ *
+ * What is shared between jobs: the reference cache, which is only
+ * read; the log (logger.h) and the statistics (instrument.h), which
+ * belong to the process, so a program that runs jobs at the same
+ * time should leave them at their defaults. As elsewhere in MapEval,
+ * running out of memory while matching ends the process with exit
+ * status 3.
+ */
+
+/* Set options to the defaults: spiral search, SQL output, one
+ * thread, the whole image in memory, nothing erased or compared.
+ * @param pOptions   Options to fill in
+ */
+void initMapevalOptions(MAPEVAL_OPTIONS_T* pOptions);
+
+/* Create the context for one job, that is, one image and one
+ * parameter file.
+ * @param pOptions   How the job is to be matched; copied
+ * @param width      Width of the image in pixels
+ * @param height     Height of the image in pixels
+ * @param refCache   Reference line cache to read the lines from
+ *                   instead of the parameter file, or NULL. It is
+ *                   not changed, so many jobs can share it, and it
+ *                   must stay open until they are freed.
+ * @return new job or NULL if allocation failed
+ */
+MAPEVAL_JOB_T* newMapevalJob(const MAPEVAL_OPTIONS_T* pOptions,
+			     int width, int height, REF_CACHE_T* refCache);
+
+/* Free a job and everything it still holds. Output files that
+ * have not been closed by mapevalCloseOutput are closed, but
+ * errors writing them are not reported.
+ * @param pJob     Job to free (may be NULL)
+ */
+void freeMapevalJob(MAPEVAL_JOB_T* pJob);
+
+/* Read the image for a job into memory or, if the 'bandRows' option
+ * is set, open it to be read in bands as it is matched. Uses nothing
+ * but the job, so it can be called in a background thread while
+ * another job is being matched.
+ * @param pJob       Job the image is for
+ * @param imagefile  Binary RGB image, or JPEG if provider is given
+ * @param provider   Provider whose JPEG the image is, or empty string
+ * @return 0 for success, 1 if the image could not be read
+ */
+int mapevalLoadImage(MAPEVAL_JOB_T* pJob, char* imagefile, char* provider);
+
+/* Open the parameter file for a job and read its header, which
+ * sets the georeferencing and the search tolerance, and get ready
+ * to read the reference lines from it or from the cache.
+ * @param pJob       Job the reference lines are for
+ * @param paramfile  Georeferencing information and reference coordinates
+ * @return 0 for success, 1 if the file could not be read
+ */
+int mapevalLoadReferences(MAPEVAL_JOB_T* pJob, char* paramfile);
+
+/* Create the output files for a job: <outprefix>.vec, and
+ * <outprefix>.sql or, with the 'bCopyOutput' option, <outprefix>.copy.
+ * With the 'bCompare' option <outprefix>.linematch.copy is created too.
+ * Must be called after mapevalLoadReferences, since the search
+ * tolerance is written to the vector file.
+ * @param pJob       Job the files are for
+ * @param outprefix  Output file name to create (no suffix)
+ * @param expId      DB Id of this experiment, used in the SQL
+ * @return 0 for success, 4 if a file could not be created
+ */
+int mapevalOpenOutput(MAPEVAL_JOB_T* pJob, char* outprefix, int expId);
+
+/* Match every reference feature against the image and write the
+ * results to the output files. The image, the reference lines and
+ * the output files must all be ready. With the 'threadCount' option
+ * greater than one, the features are matched by a pool of threads;
+ * with 'bandRows' set, the image is read in bands. The output is the
+ * same either way.
+ * @param pJob       Job to match
+ * @return 0 for success, 1 if the image could not be read
+ */
+int mapevalMatch(MAPEVAL_JOB_T* pJob);
+
+/* Flush and close the output files of a job. Most of the output
+ * is written here, so this is where write errors show up.
+ * @param pJob       Job whose files are to be closed
+ * @return 0 for success, 4 if writing any of the files failed
+ */
+int mapevalCloseOutput(MAPEVAL_JOB_T* pJob);
+
+/* Read the image for a job. If a provider is named, the image is
+ * that provider's JPEG and we binarize it as we decode it; otherwise
+ * it is the binary RGB file produced by the old conversion scripts.
+ * @param imagefile  Name of the image file
+ * @param provider   Provider name or empty string
+ * @param width      Image width in pixels
+ * @param height     Image height in pixels
+ * @return binary image or NULL if error
+ */
+BITIMAGE_T* readJobImage(char* imagefile, char* provider, int width, int height);
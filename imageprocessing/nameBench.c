@@ -0,0 +1,274 @@
+/*
+ *  nameBench.c
+ *
+ *  Accuracy check and benchmark for the name scoring used by
+ *  pointMatch.
+ *
+ *  With -verify, scores pairs of names with scoreNames and
+ *  scoreNameBatch and compares the results with the scores the
+ *  server's Perl _matchStrings gave for the same pairs. The pairs
+ *  include short words that occur many times in the other names,
+ *  differences in case, brackets and extra spaces. Exits with status
+ *  1 if any score differs.
+ *
+ *  Otherwise generates random names from a list of words and times
+ *  scoring every name against every other one. The same seed always
+ *  gives the same names.
+ *
+ *  Copyright 2020 Sally E. Goldin
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "structures.h"
+#include "nameScorer.h"
+
+/* two names and the score _matchStrings gave them, with the first
+ * as the reference string
+ */
+typedef struct _referenceScore
+{
+  const char* name1;
+  const char* name2;
+  double score;
+} REFERENCE_SCORE_T;
+
+static REFERENCE_SCORE_T referenceScores[] =
+{
+  {"Calle A", "Avenida Alvarado", 0.5},
+  {"a a a", "Banana Avenue", 1},
+  {"Avenida Alvarado", "Calle A", 0.5},
+  {"o", "Ooo oo o", 1},
+  {"ana", "Ana Ana Ana", 1},
+  {"Wat Pho", "wat arun", 0.5},
+  {"Siam Paragon", "SIAM PARAGON", 1},
+  {"Central World (Bangkok)", "Central World", 1},
+  {"St. Louis Church", "St Louis Church", 1},
+  {"Main  Street", "Main Street", 1},
+  {"Main Street ", "main street", 1},
+  {"Big C", "Big C Extra", 1},
+  {"Lumphini Park", "Lumpini Park", 0.5},
+  {"Ko Kret", "Koh Kret", 1},
+  {"", "Somewhere", 0},
+  {"7-Eleven", "7-eleven (Silom)", 1},
+};
+
+/* words the random names are made of; some are short enough to
+ * turn up inside the others
+ */
+static const char* nameWords[] =
+{
+  "A", "Ko", "Wat", "Soi", "Big", "Park", "Road", "Market", "Temple",
+  "Central", "Station", "Hospital", "School", "Bang", "Khlong", "Thai",
+  "Siam", "Ratchada", "Sukhumvit", "Silom", "(Old)", "St.", "Lumphini",
+};
+
+/* settings for one benchmark run */
+typedef struct _nameBenchConfig
+{
+  int nameCount;        /* number of random names */
+  int maxWords;         /* most words in a name */
+  int repeat;           /* number of times to time the scoring */
+  unsigned int seed;    /* random number seed */
+} NAME_BENCH_CONFIG_T;
+
+/* explain arguments */
+void usage()
+{
+  printf("Usage:\n");
+  printf("  nameBench [options]\n\n");
+  printf("  Options:\n");
+  printf("     -verify            - check the scores against reference values\n");
+  printf("                          and exit\n");
+  printf("     -names <n>         - number of random names (default 2000)\n");
+  printf("     -words <n>         - most words in a name (default 4)\n");
+  printf("     -repeat <n>        - time the scoring n times (default 3)\n");
+  printf("     -seed <n>          - random number seed (default 1)\n");
+  exit(0);
+}
+
+/* Return elapsed time between two clock readings in seconds */
+double elapsedSeconds(struct timespec* pStart, struct timespec* pEnd)
+{
+  return (pEnd->tv_sec - pStart->tv_sec) +
+         (pEnd->tv_nsec - pStart->tv_nsec) / 1.0e9;
+}
+
+/* Score every reference pair, alone and in a batch. Each pair has
+ * a table of its own, so a short word can turn up more often than
+ * there are pieces in the table.
+ * @return 0 if all scores are the same as the reference, else 1
+ */
+int verify()
+{
+  int count = sizeof(referenceScores) / sizeof(referenceScores[0]);
+  int failures = 0;
+  int i = 0;
+  for (i = 0; i < count; i++)
+     {
+     REFERENCE_SCORE_T* pRef = &referenceScores[i];
+     NAME_TABLE_T* pTable = newNameTable();
+     int name1 = -1;
+     int name2 = -1;
+     double single = 0.0;
+     double batch = 0.0;
+     if (pTable != NULL)
+        {
+	name1 = addName(pTable,pRef->name1);
+	name2 = addName(pTable,pRef->name2);
+        }
+     if ((name1 < 0) || (name2 < 0) || (!indexNames(pTable)))
+        {
+	printf("Error allocating memory for reference score %d\n",i);
+	exit(3);
+        }
+     single = scoreNames(pTable,name1,name2);
+     scoreNameBatch(pTable,name1,&name2,1,&batch);
+     printf("  '%s' and '%s': %.6f\n",pRef->name1,pRef->name2,single);
+     if (single != pRef->score)
+        {
+	printf("    FAILED: reference score is %.6f\n",pRef->score);
+	failures++;
+        }
+     if (batch != single)
+        {
+	printf("    FAILED: batched score %.6f differs\n",batch);
+	failures++;
+        }
+     freeNameTable(pTable);
+     }
+  printf("%d reference scores, %d failures\n",count,failures);
+  return (failures > 0) ? 1 : 0;
+}
+
+/* Read the options into the configuration, exiting on any error
+ * @param argc     number of arguments
+ * @param argv     arguments
+ * @param pConfig  configuration to fill in
+ */
+void parseOptions(int argc, char* argv[], NAME_BENCH_CONFIG_T* pConfig)
+{
+  int i = 0;
+  for (i = 1; i < argc; i++)
+     {
+     if (strcmp(argv[i],"-verify") == 0)
+        exit(verify());
+     else if ((strcmp(argv[i],"-names") == 0) && (i + 1 < argc))
+        pConfig->nameCount = atoi(argv[++i]);
+     else if ((strcmp(argv[i],"-words") == 0) && (i + 1 < argc))
+        pConfig->maxWords = atoi(argv[++i]);
+     else if ((strcmp(argv[i],"-repeat") == 0) && (i + 1 < argc))
+        pConfig->repeat = atoi(argv[++i]);
+     else if ((strcmp(argv[i],"-seed") == 0) && (i + 1 < argc))
+        pConfig->seed = (unsigned int) atoi(argv[++i]);
+     else
+        usage();
+     }
+  if ((pConfig->nameCount < 1) || (pConfig->maxWords < 1))
+     usage();
+  if (pConfig->repeat < 1)
+     pConfig->repeat = 1;
+}
+
+/* Make up a name of one to maxWords words
+ * @param name      buffer to receive the name
+ * @param maxWords  most words in the name
+ */
+void randomName(char* name, int maxWords)
+{
+  int wordCount = sizeof(nameWords) / sizeof(nameWords[0]);
+  int words = 1 + rand() % maxWords;
+  int i = 0;
+  name[0] = '\0';
+  for (i = 0; i < words; i++)
+     {
+     if (i > 0)
+        strcat(name," ");
+     strcat(name,nameWords[rand() % wordCount]);
+     }
+}
+
+/* Main function parses the options, generates the names and times
+ * scoring each against all the others
+ */
+int main(int argc, char* argv[])
+{
+  NAME_BENCH_CONFIG_T config = {2000, 4, 3, 1};
+  NAME_TABLE_T* pTable = NULL;
+  int* indices = NULL;
+  double* scores = NULL;
+  char* name = NULL;
+  double total = 0.0;
+  double best = 0.0;
+  int i = 0;
+  int r = 0;
+  parseOptions(argc,argv,&config);
+  srand(config.seed);
+  pTable = newNameTable();
+  indices = calloc(config.nameCount,sizeof(int));
+  scores = calloc(config.nameCount,sizeof(double));
+  name = calloc(config.maxWords * 16,sizeof(char));
+  if ((pTable == NULL) || (indices == NULL) || (scores == NULL) ||
+      (name == NULL))
+     {
+     printf("Error allocating memory for %d names\n",config.nameCount);
+     exit(3);
+     }
+  for (i = 0; i < config.nameCount; i++)
+     {
+     randomName(name,config.maxWords);
+     if ((indices[i] = addName(pTable,name)) < 0)
+        {
+	printf("Error allocating memory for %d names\n",config.nameCount);
+	exit(3);
+        }
+     }
+  for (r = 0; r < config.repeat; r++)
+     {
+     struct timespec start;
+     struct timespec end;
+     double seconds = 0.0;
+     total = 0.0;
+     clock_gettime(CLOCK_MONOTONIC,&start);
+     if (!indexNames(pTable))
+        {
+	printf("Error allocating memory for %d names\n",config.nameCount);
+	exit(3);
+        }
+     for (i = 0; i < config.nameCount; i++)
+        {
+	int j = 0;
+	scoreNameBatch(pTable,indices[i],indices,config.nameCount,scores);
+	for (j = 0; j < config.nameCount; j++)
+	   total += scores[j];
+        }
+     clock_gettime(CLOCK_MONOTONIC,&end);
+     seconds = elapsedSeconds(&start,&end);
+     if ((r == 0) || (seconds < best))
+        best = seconds;
+     }
+  printf("%d names, up to %d words: %.3f s to index and score all pairs",
+	 config.nameCount,config.maxWords,best);
+  printf(" (mean score %.6f)\n",total / ((double) config.nameCount * config.nameCount));
+  freeNameTable(pTable);
+  free(indices);
+  free(scores);
+  free(name);
+  return 0;
+}
@@ -0,0 +1,571 @@
+/* nameScorer.c
+ *
+ *  Component of the MapEval point matching.
+ *  Scores how well feature names match, giving exactly the results
+ *  of the server's old _matchStrings function. That function split
+ *  each name at single spaces, removed parentheses from each word,
+ *  and used each word as a case insensitive regular expression
+ *  against the whole of the other name. Empty words between adjacent
+ *  spaces count (and always match), but trailing ones do not.
+ *
+ *  Rather than searching strings for every pair of names, each
+ *  distinct name is split once. Its space separated pieces and its
+ *  words are stored once each in string pools and referred to by
+ *  index. A word without spaces can only be found inside one piece
+ *  of the other name, so indexNames finds, for every word, the
+ *  sorted list of pieces that contain it, using a suffix array of
+ *  all the pieces. Whether a word is in a name is then an
+ *  intersection of two short sorted lists of integers.
+ *
+ *  The only regular expression character the names have been seen
+ *  to use is '.', which matches any character, including a space.
+ *  Words containing '.' are still searched for in the whole name.
+ *
+ * Copyright 2020 Sally E. Goldin
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+
+#include "structures.h"
+#include "nameScorer.h"
+
+/* initial size of a string pool hash table */
+#define INITIAL_SLOTS 1024
+
+/* Calculate a hash of a string (FNV-1a)
+ * @param string     characters to hash
+ * @param length     number of characters
+ * @return hash value
+ */
+static unsigned int hashString(const char* string, int length)
+{
+  unsigned int hash = 2166136261u;
+  int i = 0;
+  for (i = 0; i < length; i++)
+     {
+     hash ^= (unsigned char) string[i];
+     hash *= 16777619u;
+     }
+  return hash;
+}
+
+/* Free the memory used by a string pool
+ * @param pPool      pool to free
+ */
+static void freeStringPool(STRING_POOL_T* pPool)
+{
+  int i = 0;
+  for (i = 0; i < pPool->count; i++)
+     free(pPool->strings[i]);
+  free(pPool->strings);
+  free(pPool->slots);
+  memset(pPool,0,sizeof(STRING_POOL_T));
+}
+
+/* Find a string in a pool, adding it if it is not there
+ * @param pPool      pool to search
+ * @param string     characters of the string, need not be terminated
+ * @param length     number of characters
+ * @return index of the string, -1 if memory ran out
+ */
+static int internString(STRING_POOL_T* pPool, const char* string, int length)
+{
+  unsigned int slot = 0;
+  char* copy = NULL;
+  if ((pPool->count + 1) * 2 > pPool->slotCount)
+     {
+     int newCount = (pPool->slotCount > 0) ? pPool->slotCount * 2 : INITIAL_SLOTS;
+     int* newSlots = calloc(newCount,sizeof(int));
+     int i = 0;
+     if (newSlots == NULL)
+        return -1;
+     for (i = 0; i < pPool->count; i++)
+        {
+	slot = hashString(pPool->strings[i],strlen(pPool->strings[i])) & (newCount - 1);
+	while (newSlots[slot] != 0)
+	   slot = (slot + 1) & (newCount - 1);
+	newSlots[slot] = i + 1;
+        }
+     free(pPool->slots);
+     pPool->slots = newSlots;
+     pPool->slotCount = newCount;
+     }
+  slot = hashString(string,length) & (pPool->slotCount - 1);
+  while (pPool->slots[slot] != 0)
+     {
+     char* existing = pPool->strings[pPool->slots[slot] - 1];
+     if ((strncmp(existing,string,length) == 0) && (existing[length] == '\0'))
+        return pPool->slots[slot] - 1;
+     slot = (slot + 1) & (pPool->slotCount - 1);
+     }
+  if (pPool->count >= pPool->capacity)
+     {
+     int newCapacity = (pPool->capacity > 0) ? pPool->capacity * 2 : 256;
+     char** newStrings = realloc(pPool->strings,newCapacity * sizeof(char*));
+     if (newStrings == NULL)
+        return -1;
+     pPool->strings = newStrings;
+     pPool->capacity = newCapacity;
+     }
+  copy = malloc(length + 1);
+  if (copy == NULL)
+     return -1;
+  memcpy(copy,string,length);
+  copy[length] = '\0';
+  pPool->strings[pPool->count] = copy;
+  pPool->slots[slot] = pPool->count + 1;
+  return pPool->count++;
+}
+
+/* Create an empty name table
+ * @return new table or NULL if allocation failed
+ */
+NAME_TABLE_T* newNameTable()
+{
+  return calloc(1,sizeof(NAME_TABLE_T));
+}
+
+/* Free a table created by newNameTable
+ * @param pTable     table to free (may be NULL)
+ */
+void freeNameTable(NAME_TABLE_T* pTable)
+{
+  int i = 0;
+  if (pTable == NULL)
+     return;
+  for (i = 0; i < pTable->names.count; i++)
+     {
+     free(pTable->entries[i].words);
+     free(pTable->entries[i].pieces);
+     }
+  for (i = 0; i < pTable->words.count; i++)
+     free(pTable->wordEntries[i].pieces);
+  free(pTable->entries);
+  free(pTable->wordEntries);
+  freeStringPool(&pTable->names);
+  freeStringPool(&pTable->pieces);
+  freeStringPool(&pTable->words);
+  free(pTable);
+}
+
+/* comparison function for sorting indices */
+static int compareInt(const void* p1, const void* p2)
+{
+  int i1 = *(const int*) p1;
+  int i2 = *(const int*) p2;
+  return (i1 < i2) ? -1 : ((i1 > i2) ? 1 : 0);
+}
+
+/* Sort an array of indices and remove duplicates
+ * @param values     array to sort
+ * @param count      number of values
+ * @return number of distinct values left at the start of the array
+ */
+static int sortUnique(int* values, int count)
+{
+  int distinct = 0;
+  int i = 0;
+  qsort(values,count,sizeof(int),compareInt);
+  for (i = 0; i < count; i++)
+     {
+     if ((distinct == 0) || (values[i] != values[distinct - 1]))
+        values[distinct++] = values[i];
+     }
+  return distinct;
+}
+
+/* Split a new name into pieces and words and fill in its entry
+ * @param pTable     table holding the name
+ * @param pEntry     entry to fill in
+ * @param name       lower case name
+ * @return TRUE if successful, FALSE if memory ran out
+ */
+static BOOL splitName(NAME_TABLE_T* pTable, NAME_ENTRY_T* pEntry, const char* name)
+{
+  int fields = 1;
+  int trailing = 0;      /* empty words at the end, which split drops */
+  const char* p = name;
+  char* word = malloc(strlen(name) + 1);
+  for (p = name; *p != '\0'; p++)
+     {
+     if (*p == ' ')
+        fields++;
+     }
+  pEntry->words = calloc(fields,sizeof(int));
+  pEntry->pieces = calloc(fields,sizeof(int));
+  if ((word == NULL) || (pEntry->words == NULL) || (pEntry->pieces == NULL))
+     {
+     free(word);
+     return FALSE;
+     }
+  p = name;
+  while (TRUE)
+     {
+     const char* start = p;
+     int length = 0;
+     while ((*p != ' ') && (*p != '\0'))
+        {
+	if ((*p != '(') && (*p != ')'))
+	   word[length++] = *p;
+	p++;
+        }
+     if (p == start)
+        {
+	trailing++;     /* empty field, counted only if a word follows */
+        }
+     else
+        {
+	int piece = internString(&pTable->pieces,start,p - start);
+	pEntry->wordCount += trailing + 1;
+	pEntry->alwaysCount += trailing;   /* an empty pattern always matches */
+	trailing = 0;
+	if (piece < 0)
+	   {
+	   free(word);
+	   return FALSE;
+	   }
+	pEntry->pieces[pEntry->pieceTotal++] = piece;
+	if (length == 0)
+	   {
+	   pEntry->alwaysCount++;   /* nothing but parentheses */
+	   }
+	else
+	   {
+	   int w = internString(&pTable->words,word,length);
+	   if (w < 0)
+	      {
+	      free(word);
+	      return FALSE;
+	      }
+	   pEntry->words[pEntry->wordTotal++] = w;
+	   }
+        }
+     if (*p == '\0')
+        break;
+     p++;
+     }
+  free(word);
+  pEntry->pieceTotal = sortUnique(pEntry->pieces,pEntry->pieceTotal);
+  return TRUE;
+}
+
+/* Add a name to the table, unless a name differing only in case
+ * is already there.
+ * @param pTable     table to add to
+ * @param name       name to add, empty string if none
+ * @return index of the name in the table, -1 if memory ran out
+ */
+int addName(NAME_TABLE_T* pTable, const char* name)
+{
+  int length = strlen(name);
+  char* lower = malloc(length + 1);
+  int previous = pTable->names.count;
+  int id = 0;
+  int i = 0;
+  if (lower == NULL)
+     return -1;
+  for (i = 0; i <= length; i++)
+     lower[i] = tolower((unsigned char) name[i]);
+  id = internString(&pTable->names,lower,length);
+  if ((id < 0) || (id < previous))
+     {
+     free(lower);
+     return id;
+     }
+  if (pTable->names.capacity > pTable->entryCapacity)
+     {
+     NAME_ENTRY_T* newEntries = realloc(pTable->entries,
+					pTable->names.capacity * sizeof(NAME_ENTRY_T));
+     if (newEntries == NULL)
+        {
+	free(lower);
+	return -1;
+        }
+     pTable->entries = newEntries;
+     pTable->entryCapacity = pTable->names.capacity;
+     }
+  memset(&pTable->entries[id],0,sizeof(NAME_ENTRY_T));
+  if (!splitName(pTable,&pTable->entries[id],lower))
+     {
+     free(lower);
+     return -1;
+     }
+  free(lower);
+  if (pTable->words.count > pTable->wordCapacity)
+     {
+     WORD_ENTRY_T* newWords = realloc(pTable->wordEntries,
+				      pTable->words.capacity * sizeof(WORD_ENTRY_T));
+     if (newWords == NULL)
+        return -1;
+     memset(&newWords[pTable->wordCapacity],0,
+	    (pTable->words.capacity - pTable->wordCapacity) * sizeof(WORD_ENTRY_T));
+     pTable->wordEntries = newWords;
+     pTable->wordCapacity = pTable->words.capacity;
+     }
+  return id;
+}
+
+/* comparison function for sorting pointers to suffixes; the 
+ * suffixes are compared through the pointers, so no shared state
+ * is needed and tables can be indexed on several threads at once
+ */
+static int compareSuffix(const void* p1, const void* p2)
+{
+  return strcmp(*(const char* const*) p1,*(const char* const*) p2);
+}
+
+/* Find which pieces of the names contain each word. Must be called
+ * after the names are added and before they are scored, and again
+ * if more names are added.
+ * @param pTable     table to index
+ * @return TRUE if successful, FALSE if memory ran out
+ */
+BOOL indexNames(NAME_TABLE_T* pTable)
+{
+  STRING_POOL_T* pPieces = &pTable->pieces;
+  char* text = NULL;
+  const char** suffixes = NULL;  /* start of each suffix in 'text', sorted */
+  int* pieceAt = NULL;      /* piece that each character of 'text' is in */
+  int* found = NULL;        /* piece of each suffix starting with a word */
+  int textLength = 0;
+  int suffixCount = 0;
+  int i = 0;
+  int w = 0;
+  BOOL bOk = TRUE;
+  if ((pTable->indexedPieces == pPieces->count) &&
+      (pTable->indexedWords == pTable->words.count))
+     return TRUE;
+  if (pTable->indexedPieces != pPieces->count)
+     {
+     for (w = 0; w < pTable->indexedWords; w++)
+        {
+	free(pTable->wordEntries[w].pieces);
+	pTable->wordEntries[w].pieces = NULL;
+	pTable->wordEntries[w].pieceTotal = 0;
+        }
+     pTable->indexedWords = 0;
+     }
+  for (i = 0; i < pPieces->count; i++)
+     textLength += strlen(pPieces->strings[i]) + 1;
+  text = malloc(textLength + 1);
+  suffixes = calloc(textLength + 1,sizeof(char*));
+  pieceAt = calloc(textLength + 1,sizeof(int));
+  /* a short word can start many suffixes, several in the same 
+   * piece, so there may be more of them than pieces 
+   */
+  found = calloc(textLength + 1,sizeof(int));
+  if ((text == NULL) || (suffixes == NULL) || (pieceAt == NULL) || (found == NULL))
+     {
+     bOk = FALSE;
+     }
+  else
+     {
+     int pos = 0;
+     for (i = 0; i < pPieces->count; i++)
+        {
+	const char* piece = pPieces->strings[i];
+	int length = strlen(piece);
+	int c = 0;
+	for (c = 0; c < length; c++)
+	   {
+	   suffixes[suffixCount++] = text + pos + c;
+	   pieceAt[pos + c] = i;
+	   }
+	memcpy(text + pos,piece,length + 1);
+	pos += length + 1;
+        }
+     qsort(suffixes,suffixCount,sizeof(char*),compareSuffix);
+     }
+  for (w = pTable->indexedWords; (bOk) && (w < pTable->words.count); w++)
+     {
+     WORD_ENTRY_T* pWord = &pTable->wordEntries[w];
+     const char* word = pTable->words.strings[w];
+     int length = strlen(word);
+     int low = 0;
+     int high = suffixCount;
+     int first = 0;
+     int count = 0;
+     pWord->bWild = (strchr(word,'.') != NULL);
+     if (pWord->bWild)
+        continue;
+     /* first suffix that does not sort before the word */
+     while (low < high)
+        {
+	int mid = (low + high) / 2;
+	if (strncmp(suffixes[mid],word,length) < 0)
+	   low = mid + 1;
+	else
+	   high = mid;
+        }
+     first = low;
+     /* suffixes that start with the word follow it */
+     for (i = first; (i < suffixCount) &&
+	    (strncmp(suffixes[i],word,length) == 0); i++)
+        found[count++] = pieceAt[suffixes[i] - text];
+     count = sortUnique(found,count);
+     pWord->pieces = calloc(count + 1,sizeof(int));
+     if (pWord->pieces == NULL)
+        {
+	bOk = FALSE;
+        }
+     else
+        {
+	memcpy(pWord->pieces,found,count * sizeof(int));
+	pWord->pieceTotal = count;
+	pTable->indexedWords = w + 1;
+        }
+     }
+  free(text);
+  free(suffixes);
+  free(pieceAt);
+  free(found);
+  if (bOk)
+     {
+     pTable->indexedPieces = pPieces->count;
+     pTable->indexedWords = pTable->words.count;
+     }
+  return bOk;
+}
+
+/* Find whether a word containing '.' wildcards appears in a string
+ * @param word       lower case word
+ * @param string     lower case string to search
+ * @return TRUE if found
+ */
+static BOOL wildWordInString(const char* word, const char* string)
+{
+  const char* start = NULL;
+  for (start = string; *start != '\0'; start++)
+     {
+     int i = 0;
+     for (i = 0; (word[i] != '\0') && (start[i] != '\0'); i++)
+        {
+	if ((word[i] != '.') && (word[i] != start[i]))
+	   break;
+        }
+     if (word[i] == '\0')
+        return TRUE;
+     if (start[i] == '\0')
+        break;   /* rest of the string is too short */
+     }
+  return FALSE;
+}
+
+/* Find whether two sorted lists of indices have any in common
+ * @param list1      first list
+ * @param count1     length of first list
+ * @param list2      second list
+ * @param count2     length of second list
+ * @return TRUE if they share an index
+ */
+static BOOL listsIntersect(const int* list1, int count1, const int* list2, int count2)
+{
+  int i = 0;
+  if (count1 > count2)
+     return listsIntersect(list2,count2,list1,count1);
+  /* look up each entry of the short list in the long one */
+  for (i = 0; i < count1; i++)
+     {
+     int low = 0;
+     int high = count2;
+     while (low < high)
+        {
+	int mid = (low + high) / 2;
+	if (list2[mid] < list1[i])
+	   low = mid + 1;
+	else
+	   high = mid;
+        }
+     if ((low < count2) && (list2[low] == list1[i]))
+        return TRUE;
+     }
+  return FALSE;
+}
+
+/* Calculate the fraction of the words of one name that appear in
+ * another.
+ * @param pTable     indexed table holding the names
+ * @param words      index of name to take the words from
+ * @param name       index of name to look for them in
+ * @return fraction of words found, 0 if there are no words
+ */
+static double wordMatchFraction(NAME_TABLE_T* pTable, int words, int name)
+{
+  NAME_ENTRY_T* pWords = &pTable->entries[words];
+  NAME_ENTRY_T* pName = &pTable->entries[name];
+  int matchCount = pWords->alwaysCount;
+  int i = 0;
+  if (pWords->wordCount == 0)
+     return 0.0;
+  for (i = 0; i < pWords->wordTotal; i++)
+     {
+     int w = pWords->words[i];
+     WORD_ENTRY_T* pWord = &pTable->wordEntries[w];
+     if (pWord->bWild)
+        matchCount += wildWordInString(pTable->words.strings[w],
+				       pTable->names.strings[name]);
+     else
+        matchCount += listsIntersect(pWord->pieces,pWord->pieceTotal,
+				     pName->pieces,pName->pieceTotal);
+     }
+  return ((double) matchCount) / pWords->wordCount;
+}
+
+/* Score how well two names match, as the server's _matchStrings did.
+ * Returns the larger of the fraction of the first name's words found
+ * in the second name and the fraction of the second name's words
+ * found in the first. Will return 0 if either name is empty, 1.0 for
+ * a perfect (case insensitive) match.
+ * @param pTable     indexed table holding the names
+ * @param name1      index of reference name
+ * @param name2      index of target name
+ * @return match score
+ */
+double scoreNames(NAME_TABLE_T* pTable, int name1, int name2)
+{
+  double score1 = 0.0;
+  double score2 = 0.0;
+  if ((pTable->names.strings[name1][0] == '\0') ||
+      (pTable->names.strings[name2][0] == '\0'))
+     return 0.0;
+  score1 = wordMatchFraction(pTable,name1,name2);
+  score2 = wordMatchFraction(pTable,name2,name1);
+  return (score1 > score2) ? score1 : score2;
+}
+
+/* Score one name against many others, as scoreNames
+ * @param pTable     indexed table holding the names
+ * @param name       index of reference name
+ * @param candidates indices of the names to score it against
+ * @param count      number of candidates
+ * @param scores     array to receive 'count' scores
+ */
+void scoreNameBatch(NAME_TABLE_T* pTable, int name, const int* candidates,
+		    int count, double* scores)
+{
+  int i = 0;
+  if (pTable->names.strings[name][0] == '\0')
+     {
+     for (i = 0; i < count; i++)
+        scores[i] = 0.0;
+     return;
+     }
+  for (i = 0; i < count; i++)
+     scores[i] = scoreNames(pTable,name,candidates[i]);
+}
@@ -0,0 +1,66 @@
+/* Header file for the name scorer used in point matching
+ *
+ * Copyright 2020 Sally E. Goldin
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+
+/* Create an empty name table
+ * @return new table or NULL if allocation failed
+ */
+NAME_TABLE_T* newNameTable();
+
+/* Free a table created by newNameTable
+ * @param pTable     table to free (may be NULL)
+ */
+void freeNameTable(NAME_TABLE_T* pTable);
+
+/* Add a name to the table, unless a name differing only in case
+ * is already there.
+ * @param pTable     table to add to
+ * @param name       name to add, empty string if none
+ * @return index of the name in the table, -1 if memory ran out
+ */
+int addName(NAME_TABLE_T* pTable, const char* name);
+
+/* Find which pieces of the names contain each word. Must be called
+ * after the names are added and before they are scored, and again
+ * if more names are added. Different tables can be indexed at the 
+ * same time on different threads.
+ * @param pTable     table to index
+ * @return TRUE if successful, FALSE if memory ran out
+ */
+BOOL indexNames(NAME_TABLE_T* pTable);
+
+/* Score how well two names match, as the server's _matchStrings did.
+ * Returns the larger of the fraction of the first name's words found
+ * in the second name and the fraction of the second name's words
+ * found in the first. Will return 0 if either name is empty, 1.0 for
+ * a perfect (case insensitive) match.
+ * @param pTable     indexed table holding the names
+ * @param name1      index of reference name
+ * @param name2      index of target name
+ * @return match score
+ */
+double scoreNames(NAME_TABLE_T* pTable, int name1, int name2);
+
+/* Score one name against many others, as scoreNames
+ * @param pTable     indexed table holding the names
+ * @param name       index of reference name
+ * @param candidates indices of the names to score it against
+ * @param count      number of candidates
+ * @param scores     array to receive 'count' scores
+ */
+void scoreNameBatch(NAME_TABLE_T* pTable, int name, const int* candidates,
+		    int count, double* scores);
@@ -0,0 +1,401 @@
+/* 
+ *  outputBuffer.c
+ *
+ *  Buffered output for the vector, SQL and COPY files written by 
+ *  guided vectorization. Text goes into a large buffer that is 
+ *  written with one system call when it fills, instead of calling 
+ *  fprintf and fflush for every coordinate. Numbers are formatted
+ *  here without going through printf.
+ *
+ *  All open buffers are flushed if the program calls exit or is
+ *  stopped by SIGINT, SIGTERM or SIGHUP, so a file holds everything
+ *  written before then, as it did when every line was flushed. After
+ *  a crash (SIGSEGV, SIGABRT and so on) nothing is flushed, since the
+ *  buffers may hold a record that was only partly formatted.
+ *
+ *  Copyright 2020 Sally E. Goldin
+ * 
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ * 
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdarg.h>
+#include <math.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <unistd.h>
+#include <pthread.h>
+#include "structures.h"
+#include "outputBuffer.h"
+
+/* size of the buffer for each file */
+#define OUTBUF_SIZE 262144
+
+/* most buffered files that can be open at once; each vectorization
+ * job has up to three, and several jobs may run at the same time 
+ */
+#define MAX_OPEN_OUTBUFS 64
+
+/* files to flush if the program exits or is stopped by a signal */
+static OUTBUF_T* openBuffers[MAX_OPEN_OUTBUFS];
+static BOOL bHandlersInstalled = FALSE;
+/* held while opening or closing a file, which may be done by 
+ * different threads; not by the flush at exit, which must not wait
+ */
+static pthread_mutex_t openBuffersLock = PTHREAD_MUTEX_INITIALIZER;
+
+/* signals after which we flush the open files, then die as before.
+ * Crash signals are left with their default action: the state of the
+ * buffers cannot be trusted after one of them.
+ */
+static int stopSignals[] = { SIGINT, SIGTERM, SIGHUP };
+
+static double decimalScale[] = 
+  { 1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9 };
+static long long decimalDivisor[] = 
+  { 1LL, 10LL, 100LL, 1000LL, 10000LL, 100000LL, 1000000LL, 
+    10000000LL, 100000000LL, 1000000000LL };
+
+/* Write the buffer contents using only async-signal-safe calls
+ * @param pBuf     buffered file
+ */
+static void writeOutBuf(OUTBUF_T* pBuf)
+{
+  int done = 0;
+  while ((done < pBuf->used) && (!pBuf->bError))
+     {
+     ssize_t count = write(pBuf->fd,pBuf->buffer + done,pBuf->used - done);
+     if (count > 0)
+        {
+	done += count;
+        }
+     else if ((count < 0) && (errno == EINTR))
+        {
+	continue;
+        }
+     else
+        {
+	pBuf->bError = TRUE;
+	pBuf->errorNumber = errno;
+        }
+     }
+  pBuf->written += done;
+  pBuf->used = 0;
+}
+
+/* Flush all the files that are still open. Used at exit.
+ */
+static void flushAllOutBufs()
+{
+  int i;
+  for (i = 0; i < MAX_OPEN_OUTBUFS; i++)
+     {
+     if (openBuffers[i] != NULL)
+        writeOutBuf(openBuffers[i]);
+     }
+}
+
+/* Signal handler: flush all the open files, then let the 
+ * signal have its normal effect.
+ * @param sig    signal number
+ */
+static void flushOnSignal(int sig)
+{
+  flushAllOutBufs();
+  signal(sig,SIG_DFL);
+  raise(sig);
+}
+
+/* Install the exit and signal handlers, the first time a file is opened
+ */
+static void installFlushHandlers()
+{
+  int i;
+  if (bHandlersInstalled)
+     return;
+  bHandlersInstalled = TRUE;
+  atexit(flushAllOutBufs);
+  for (i = 0; i < (int) (sizeof(stopSignals)/sizeof(int)); i++)
+     {
+     struct sigaction action;
+     struct sigaction previous;
+     memset(&action,0,sizeof(action));
+     action.sa_handler = flushOnSignal;
+     sigemptyset(&action.sa_mask);
+     /* leave alone signals that someone has set to be ignored */
+     if ((sigaction(stopSignals[i],NULL,&previous) == 0) &&
+	 (previous.sa_handler == SIG_DFL))
+        sigaction(stopSignals[i],&action,NULL);
+     }
+}
+
+/* Create or truncate a file and open it for buffered output.
+ * Text still in the buffer is written out if the program exits,
+ * or is stopped by SIGINT, SIGTERM or SIGHUP, before the file is
+ * closed.
+ * @param filename   file to create
+ * @return new buffered file or NULL if the file cannot be created
+ *         (errno is set)
+ */
+OUTBUF_T* openOutBuf(char* filename)
+{
+  OUTBUF_T* pBuf = NULL;
+  int slot = 0;
+  int fd = -1;
+  pthread_mutex_lock(&openBuffersLock);
+  while ((slot < MAX_OPEN_OUTBUFS) && (openBuffers[slot] != NULL))
+     slot++;
+  if (slot == MAX_OPEN_OUTBUFS)
+     errno = EMFILE;
+  else
+     fd = open(filename,O_WRONLY | O_CREAT | O_TRUNC,0666);
+  if (fd < 0)
+     {
+     pthread_mutex_unlock(&openBuffersLock);
+     return NULL;
+     }
+  pBuf = calloc(1,sizeof(OUTBUF_T));
+  if (pBuf != NULL)
+     {
+     pBuf->buffer = malloc(OUTBUF_SIZE);
+     pBuf->filename = strdup(filename);
+     }
+  if ((pBuf == NULL) || (pBuf->buffer == NULL) || (pBuf->filename == NULL))
+     {
+     printf("Error allocating output buffer for %s\n",filename);
+     exit(3);
+     }
+  pBuf->fd = fd;
+  pBuf->size = OUTBUF_SIZE;
+  installFlushHandlers();
+  openBuffers[slot] = pBuf;
+  pthread_mutex_unlock(&openBuffersLock);
+  return pBuf;
+}
+
+/* Write everything in the buffer to the file
+ * @param pBuf     buffered file
+ * @return TRUE if successful, FALSE if any write has failed
+ */
+BOOL flushOutBuf(OUTBUF_T* pBuf)
+{
+  writeOutBuf(pBuf);
+  return !pBuf->bError;
+}
+
+/* Flush and close a buffered file, and free it
+ * @param pBuf     buffered file (may be NULL)
+ * @return TRUE if successful, FALSE if any write or the close failed;
+ *         a message naming the file has been printed
+ */
+BOOL closeOutBuf(OUTBUF_T* pBuf)
+{
+  BOOL bOk = TRUE;
+  int i;
+  if (pBuf == NULL)
+     return TRUE;
+  writeOutBuf(pBuf);
+  pthread_mutex_lock(&openBuffersLock);
+  for (i = 0; i < MAX_OPEN_OUTBUFS; i++)
+     {
+     if (openBuffers[i] == pBuf)
+        openBuffers[i] = NULL;
+     }
+  pthread_mutex_unlock(&openBuffersLock);
+  if ((close(pBuf->fd) != 0) && (!pBuf->bError))
+     {
+     pBuf->bError = TRUE;
+     pBuf->errorNumber = errno;
+     }
+  if (pBuf->bError)
+     {
+     printf("Error writing output file %s - errno is %d\n",
+	    pBuf->filename,pBuf->errorNumber);
+     bOk = FALSE;
+     }
+  free(pBuf->filename);
+  free(pBuf->buffer);
+  free(pBuf);
+  return bOk;
+}
+
+/* Add characters to the buffer
+ * @param pBuf     buffered file
+ * @param text     characters to add
+ * @param length   number of characters
+ */
+void outBufWrite(OUTBUF_T* pBuf, const char* text, int length)
+{
+  while (length > 0)
+     {
+     int count = pBuf->size - pBuf->used;
+     if (count == 0)
+        {
+	writeOutBuf(pBuf);
+	count = pBuf->size;
+        }
+     if (count > length)
+        count = length;
+     memcpy(pBuf->buffer + pBuf->used,text,count);
+     pBuf->used += count;
+     text += count;
+     length -= count;
+     }
+}
+
+/* Add a NUL terminated string to the buffer
+ * @param pBuf     buffered file
+ * @param text     string to add
+ */
+void outBufString(OUTBUF_T* pBuf, const char* text)
+{
+  outBufWrite(pBuf,text,strlen(text));
+}
+
+/* Add one character to the buffer
+ * @param pBuf     buffered file
+ * @param c        character to add
+ */
+void outBufChar(OUTBUF_T* pBuf, char c)
+{
+  if (pBuf->used == pBuf->size)
+     writeOutBuf(pBuf);
+  pBuf->buffer[pBuf->used++] = c;
+}
+
+/* Convert an unsigned value to decimal digits at the end of a buffer
+ * @param value    value to convert
+ * @param pEnd     one past the last character to fill
+ * @param minDigits  pad with leading zeros to at least this many digits
+ * @return pointer to the first digit
+ */
+static char* formatDigits(unsigned long long value, char* pEnd, int minDigits)
+{
+  char* p = pEnd;
+  do
+     {
+     *--p = (char) ('0' + (value % 10));
+     value /= 10;
+     minDigits--;
+     }
+  while ((value > 0) || (minDigits > 0));
+  return p;
+}
+
+/* Add an integer in decimal, as printf "%ld" would
+ * @param pBuf     buffered file
+ * @param value    value to add
+ */
+void outBufInt(OUTBUF_T* pBuf, long value)
+{
+  char text[24];
+  char* pEnd = text + sizeof(text);
+  char* p = NULL;
+  unsigned long long magnitude = (value < 0) ? 
+	 -(unsigned long long) value : (unsigned long long) value;
+  p = formatDigits(magnitude,pEnd,1);
+  if (value < 0)
+     *--p = '-';
+  outBufWrite(pBuf,p,pEnd - p);
+}
+
+/* Add a double with a fixed number of decimal places. The text is 
+ * exactly what printf "%.<decimals>f" gives in the C locale.
+ *
+ * We scale by a power of ten and round to an integer. The scaled
+ * value carries at most half a unit in the last place of error, so
+ * unless it lies very close to halfway between two integers the
+ * rounding is the same as printf's rounding of the exact value.
+ * Values near halfway, and values too large for this, go to snprintf.
+ * @param pBuf     buffered file
+ * @param value    value to add
+ * @param decimals number of decimal places, 0 to 9
+ */
+void outBufFixed(OUTBUF_T* pBuf, double value, int decimals)
+{
+  char text[64];
+  double magnitude = fabs(value);
+  double scaled = 0.0;
+  double whole = 0.0;
+  double fraction = 0.0;
+  if (isfinite(value) && (decimals >= 0) && (decimals <= 9))
+     {
+     scaled = magnitude * decimalScale[decimals];
+     whole = floor(scaled);
+     fraction = scaled - whole;
+     }
+  /* four units in the last place is comfortably more than the error */
+  if ((scaled < 1e15) && isfinite(value) && (decimals >= 0) && (decimals <= 9) &&
+      (fabs(fraction - 0.5) > ldexp(scaled,-50) + 1e-300))
+     {
+     unsigned long long rounded = (unsigned long long) whole;
+     char* pEnd = text + sizeof(text);
+     char* p = pEnd;
+     if (fraction > 0.5)
+        rounded++;
+     if (decimals > 0)
+        {
+	p = formatDigits(rounded % decimalDivisor[decimals],pEnd,decimals);
+	*--p = '.';
+        }
+     p = formatDigits(rounded / decimalDivisor[decimals],p,1);
+     if (signbit(value))
+        *--p = '-';
+     outBufWrite(pBuf,p,pEnd - p);
+     }
+  else
+     {
+     int length = snprintf(text,sizeof(text),"%.*f",decimals,value);
+     if ((length >= 0) && (length < (int) sizeof(text)))
+        outBufWrite(pBuf,text,length);
+     else
+        outBufPrintf(pBuf,"%.*f",decimals,value);
+     }
+}
+
+/* Add formatted text, as for printf. For occasional lines; 
+ * use the functions above for per point output.
+ * @param pBuf     buffered file
+ * @param format   printf format
+ */
+void outBufPrintf(OUTBUF_T* pBuf, const char* format, ...)
+{
+  char text[256];
+  char* pText = text;
+  int length;
+  va_list args;
+  va_start(args,format);
+  length = vsnprintf(text,sizeof(text),format,args);
+  va_end(args);
+  if (length < 0)
+     return;
+  if (length >= (int) sizeof(text))
+     {
+     pText = malloc(length + 1);
+     if (pText == NULL)
+        {
+	printf("Error allocating %d characters of output\n",length);
+	exit(3);
+        }
+     va_start(args,format);
+     vsnprintf(pText,length + 1,format,args);
+     va_end(args);
+     }
+  outBufWrite(pBuf,pText,length);
+  if (pText != text)
+     free(pText);
+}
@@ -0,0 +1,82 @@
+/* Header file with definitions of functions for buffered 
+ * output files
+ * Include AFTER structures.h
+ *
+ * Copyright 2020 Sally E. Goldin
+ * 
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ * 
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+
+/* Create or truncate a file and open it for buffered output.
+ * Text still in the buffer is written out if the program exits,
+ * or is stopped by SIGINT, SIGTERM or SIGHUP, before the file is
+ * closed.
+ * @param filename   file to create
+ * @return new buffered file or NULL if the file cannot be created
+ *         (errno is set)
+ */
+OUTBUF_T* openOutBuf(char* filename);
+
+/* Write everything in the buffer to the file
+ * @param pBuf     buffered file
+ * @return TRUE if successful, FALSE if any write has failed
+ */
+BOOL flushOutBuf(OUTBUF_T* pBuf);
+
+/* Flush and close a buffered file, and free it
+ * @param pBuf     buffered file (may be NULL)
+ * @return TRUE if successful, FALSE if any write or the close failed;
+ *         a message naming the file has been printed
+ */
+BOOL closeOutBuf(OUTBUF_T* pBuf);
+
+/* Add characters to the buffer
+ * @param pBuf     buffered file
+ * @param text     characters to add
+ * @param length   number of characters
+ */
+void outBufWrite(OUTBUF_T* pBuf, const char* text, int length);
+
+/* Add a NUL terminated string to the buffer
+ * @param pBuf     buffered file
+ * @param text     string to add
+ */
+void outBufString(OUTBUF_T* pBuf, const char* text);
+
+/* Add one character to the buffer
+ * @param pBuf     buffered file
+ * @param c        character to add
+ */
+void outBufChar(OUTBUF_T* pBuf, char c);
+
+/* Add an integer in decimal, as printf "%ld" would
+ * @param pBuf     buffered file
+ * @param value    value to add
+ */
+void outBufInt(OUTBUF_T* pBuf, long value);
+
+/* Add a double with a fixed number of decimal places. The text is 
+ * exactly what printf "%.<decimals>f" gives in the C locale.
+ * @param pBuf     buffered file
+ * @param value    value to add
+ * @param decimals number of decimal places, 0 to 9
+ */
+void outBufFixed(OUTBUF_T* pBuf, double value, int decimals);
+
+/* Add formatted text, as for printf. For occasional lines; 
+ * use the functions above for per point output.
+ * @param pBuf     buffered file
+ * @param format   printf format
+ */
+void outBufPrintf(OUTBUF_T* pBuf, const char* format, ...);
@@ -0,0 +1,568 @@
+/* 
+ *  paramReader.c
+ *
+ *  Functions for reading the parameter file for guidedVectorize.
+ *  The file is read through a fixed size buffer and the coordinates
+ *  are parsed directly from that buffer, so memory does not grow with
+ *  the size of the reference data set.
+ *
+ *  Binary parameter files, written by wkbToParam, hold the coordinates
+ *  as little endian doubles and need no parsing at all.
+ *
+ *  Most text coordinates are converted by a hand written parser. It 
+ *  uses exact arithmetic when the decimal digits and power of ten
+ *  allow it, and otherwise falls back to strtod, so the values are
+ *  always identical to those from sscanf.
+ *
+ *  Copyright 2020 Sally E. Goldin
+ * 
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ * 
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <float.h>
+#include <math.h>
+#include "structures.h"
+#include "paramReader.h"
+
+/* size of the block read from the file */
+#define PARAM_BUFFER_SIZE 65536
+
+/* number of characters that must be in the buffer before we parse
+ * a number, so that a number is never split between blocks
+ */
+#define PARAM_LOOKAHEAD 128
+
+/* largest integer with an exact double representation */
+#define MAX_EXACT_MANTISSA 9007199254740992ULL
+
+/* powers of ten that are exact as doubles */
+static double exactPowers[] = 
+  { 1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10, 1e11, 
+    1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22 };
+
+#if LDBL_MANT_DIG == 64
+/* powers of ten that are exact with a 64 bit mantissa */
+static long double exactLongPowers[] = 
+  { 1e0L, 1e1L, 1e2L, 1e3L, 1e4L, 1e5L, 1e6L, 1e7L, 1e8L, 1e9L, 
+    1e10L, 1e11L, 1e12L, 1e13L, 1e14L, 1e15L, 1e16L, 1e17L, 1e18L, 
+    1e19L, 1e20L, 1e21L, 1e22L, 1e23L, 1e24L, 1e25L, 1e26L, 1e27L };
+#endif
+
+/* Make sure at least 'needed' characters are in the buffer 
+ * from the current position, unless the file ends first. 
+ * @param pReader   reader
+ * @param needed    number of characters wanted
+ */
+void fillParamBuffer(PARAM_READER_T* pReader, int needed)
+{
+  if ((pReader->end - pReader->pos >= needed) || (pReader->bEof))
+     return;
+  memmove(pReader->buffer,pReader->buffer + pReader->pos,
+	  pReader->end - pReader->pos);
+  pReader->end -= pReader->pos;
+  pReader->pos = 0;
+  while ((pReader->end < needed) && (!pReader->bEof))
+     {
+     size_t count = fread(pReader->buffer + pReader->end,1,
+			  pReader->size - pReader->end,pReader->pFp);
+     if (count == 0)
+        pReader->bEof = TRUE;
+     pReader->end += count;
+     }
+  pReader->buffer[pReader->end] = '\0';
+}
+
+/* Return the character at the current position without consuming it
+ * @param pReader   reader
+ * @return the character or EOF at the end of the file
+ */
+int peekParamChar(PARAM_READER_T* pReader)
+{
+  fillParamBuffer(pReader,1);
+  if (pReader->pos >= pReader->end)
+     return EOF;
+  return (unsigned char) pReader->buffer[pReader->pos];
+}
+
+/* Skip spaces and tabs, but not newlines, which end a line
+ * @param pReader   reader
+ */
+void skipParamSpace(PARAM_READER_T* pReader)
+{
+  int c = peekParamChar(pReader);
+  while ((c == ' ') || (c == '\t') || (c == '\r') || (c == '\v') || (c == '\f'))
+     {
+     pReader->pos++;
+     c = peekParamChar(pReader);
+     }
+}
+
+/* Open a parameter file for reading
+ * @param filename   file to open
+ * @return new reader or NULL if the file cannot be opened
+ *         (errno is set by fopen)
+ */
+PARAM_READER_T* openParamReader(char* filename)
+{
+  PARAM_READER_T* pReader = NULL;
+  FILE* pFp = fopen(filename,"rb");
+  if (pFp == NULL)
+     return NULL;
+  pReader = calloc(1,sizeof(PARAM_READER_T));
+  if (pReader != NULL)
+     pReader->buffer = malloc(PARAM_BUFFER_SIZE + 1);
+  if ((pReader == NULL) || (pReader->buffer == NULL))
+     {
+     printf("Error allocating parameter file buffer\n");
+     exit(3);
+     }
+  pReader->pFp = pFp;
+  pReader->size = PARAM_BUFFER_SIZE;
+  pReader->buffer[0] = '\0';
+  fillParamBuffer(pReader,PARAM_MAGIC_SIZE);
+  pReader->bBinary = ((pReader->end >= PARAM_MAGIC_SIZE) &&
+		      (memcmp(pReader->buffer,PARAM_MAGIC,PARAM_MAGIC_SIZE) == 0));
+  return pReader;
+}
+
+/* Close the file and free the reader
+ * @param pReader   reader to close (may be NULL)
+ */
+void closeParamReader(PARAM_READER_T* pReader)
+{
+  if (pReader == NULL)
+     return;
+  fclose(pReader->pFp);
+  free(pReader->buffer);
+  free(pReader);
+}
+
+/* Copy the next line, without its newline, into 'line',
+ * as for fgets. Characters that do not fit are skipped.
+ * @param pReader   reader
+ * @param line      buffer for the line
+ * @param size      size of line
+ * @return TRUE if a line was read, FALSE at end of file
+ */
+BOOL readParamLine(PARAM_READER_T* pReader, char* line, int size)
+{
+  int length = 0;
+  int c = peekParamChar(pReader);
+  if (c == EOF)
+     return FALSE;
+  while ((c != EOF) && (c != '\n'))
+     {
+     if (length < size - 1)
+        line[length++] = (char) c;
+     pReader->pos++;
+     c = peekParamChar(pReader);
+     }
+  if (c == '\n')
+     pReader->pos++;
+  line[length] = '\0';
+  return TRUE;
+}
+
+/* Move to the start of the next comma separated token in the current
+ * line. Commas are skipped. If the line has no more tokens, its newline
+ * is consumed so the next call starts on the following line.
+ * @param pReader   reader
+ * @return TRUE if positioned at a token, FALSE at end of line or file
+ */
+BOOL nextParamToken(PARAM_READER_T* pReader)
+{
+  int c = peekParamChar(pReader);
+  while (c == ',')
+     {
+     pReader->pos++;
+     c = peekParamChar(pReader);
+     }
+  if (c == '\n')
+     pReader->pos++;
+  return ((c != '\n') && (c != EOF));
+}
+
+/* Skip the rest of the current token, up to the next comma or newline
+ * @param pReader   reader
+ */
+void endParamToken(PARAM_READER_T* pReader)
+{
+  int c = peekParamChar(pReader);
+  while ((c != ',') && (c != '\n') && (c != EOF))
+     {
+     pReader->pos++;
+     c = peekParamChar(pReader);
+     }
+}
+
+/* Parse an integer within the current token, as sscanf "%d" would
+ * @param pReader   reader
+ * @param pValue    set to the value if successful
+ * @return TRUE if a number was parsed, FALSE if not (pValue unchanged)
+ */
+BOOL parseParamInt(PARAM_READER_T* pReader, int* pValue)
+{
+  char* start = NULL;
+  char* p = NULL;
+  BOOL bNegative = FALSE;
+  long value = 0;
+  skipParamSpace(pReader);
+  fillParamBuffer(pReader,PARAM_LOOKAHEAD);
+  start = p = pReader->buffer + pReader->pos;
+  if ((*p == '-') || (*p == '+'))
+     {
+     bNegative = (*p == '-');
+     p++;
+     }
+  if ((*p < '0') || (*p > '9'))
+     return FALSE;
+  while ((*p >= '0') && (*p <= '9'))
+     {
+     value = value * 10 + (*p - '0');
+     p++;
+     }
+  *pValue = (int) (bNegative ? -value : value);
+  pReader->pos += p - start;
+  return TRUE;
+}
+
+/* Convert a decimal number that has been split into an integer
+ * mantissa and a power of ten, if this can be done exactly.
+ * With a mantissa of at most 53 bits and a power of ten that is
+ * itself exact, one multiplication or division gives the correctly
+ * rounded result. Where long double has a 64 bit mantissa we can
+ * also handle longer mantissas, unless the long double result is 
+ * so close to halfway between two doubles that rounding it again
+ * could differ from rounding the exact value.
+ * @param mantissa  decimal digits as an integer
+ * @param exponent  power of ten to apply
+ * @param pValue    set to the result if successful
+ * @return TRUE if converted, FALSE if the caller must use strtod
+ */
+BOOL exactDecimalToDouble(unsigned long long mantissa, int exponent, double* pValue)
+{
+  if ((mantissa <= MAX_EXACT_MANTISSA) && (exponent >= -22) && (exponent <= 22))
+     {
+     if (exponent >= 0)
+        *pValue = (double) mantissa * exactPowers[exponent];
+     else
+        *pValue = (double) mantissa / exactPowers[-exponent];
+     return TRUE;
+     }
+#if LDBL_MANT_DIG == 64
+  if ((exponent >= -27) && (exponent <= 27))
+     {
+     long double result;
+     long double fraction;
+     unsigned long long bits;
+     int binaryExp;
+     int lowBits;
+     if (exponent >= 0)
+        result = (long double) mantissa * exactLongPowers[exponent];
+     else
+        result = (long double) mantissa / exactLongPowers[-exponent];
+     /* the 11 bits of the long double mantissa that a double drops */
+     fraction = frexpl(result,&binaryExp);
+     bits = (unsigned long long) ldexpl(fraction,64);
+     lowBits = (int) (bits & 0x7FF);
+     if ((lowBits < 0x3FF) || (lowBits > 0x401))
+        {
+	*pValue = (double) result;
+	return TRUE;
+        }
+     }
+#endif
+  return FALSE;
+}
+
+/* Parse a double within the current token, giving exactly 
+ * the value that sscanf "%lf" would
+ * @param pReader   reader
+ * @param pValue    set to the value if successful
+ * @return TRUE if a number was parsed, FALSE if not (pValue unchanged)
+ */
+BOOL parseParamDouble(PARAM_READER_T* pReader, double* pValue)
+{
+  char* start = NULL;
+  char* p = NULL;
+  char* end = NULL;
+  BOOL bNegative = FALSE;
+  BOOL bDigits = FALSE;      /* saw at least one mantissa digit */
+  BOOL bSimple = TRUE;       /* FALSE if we need strtod */
+  unsigned long long mantissa = 0;
+  int digits = 0;            /* significant digits in mantissa */
+  int exponent = 0;
+  double value = 0.0;
+  skipParamSpace(pReader);
+  fillParamBuffer(pReader,PARAM_LOOKAHEAD);
+  start = p = pReader->buffer + pReader->pos;
+  if ((*p == '-') || (*p == '+'))
+     {
+     bNegative = (*p == '-');
+     p++;
+     }
+  /* hexadecimal, infinity and NaN are left to strtod */
+  if ((p[0] == '0') && ((p[1] == 'x') || (p[1] == 'X')))
+     bSimple = FALSE;
+  while (bSimple && (*p >= '0') && (*p <= '9'))
+     {
+     bDigits = TRUE;
+     if (digits < 19)
+        {
+	mantissa = mantissa * 10 + (*p - '0');
+	if (mantissa > 0)
+	   digits++;
+        }
+     else
+        bSimple = FALSE;
+     p++;
+     }
+  if (bSimple && (*p == '.'))
+     {
+     p++;
+     while (bSimple && (*p >= '0') && (*p <= '9'))
+        {
+	bDigits = TRUE;
+	if (digits < 19)
+	   {
+	   mantissa = mantissa * 10 + (*p - '0');
+	   if (mantissa > 0)
+	      digits++;
+	   exponent--;
+	   }
+	else
+	   bSimple = FALSE;
+	p++;
+	}
+     }
+  if (bSimple && bDigits && ((*p == 'e') || (*p == 'E')))
+     {
+     char* q = p + 1;
+     BOOL bNegExp = FALSE;
+     int expValue = 0;
+     if ((*q == '-') || (*q == '+'))
+        {
+	bNegExp = (*q == '-');
+	q++;
+        }
+     if ((*q >= '0') && (*q <= '9'))
+        {
+	while ((*q >= '0') && (*q <= '9'))
+	   {
+	   if (expValue < 10000)
+	      expValue = expValue * 10 + (*q - '0');
+	   q++;
+	   }
+	exponent += (bNegExp ? -expValue : expValue);
+	p = q;
+        }
+     }
+  if (bSimple && bDigits)
+     {
+     if (mantissa == 0)
+        value = 0.0;
+     else if (!exactDecimalToDouble(mantissa,exponent,&value))
+        bSimple = FALSE;
+     }
+  if (bSimple && bDigits)
+     {
+     *pValue = (bNegative ? -value : value);
+     pReader->pos += p - start;
+     return TRUE;
+     }
+  /* anything else is converted by strtod, in place */
+  value = strtod(start,&end);
+  if (end == start)
+     return FALSE;
+  *pValue = value;
+  pReader->pos += end - start;
+  return TRUE;
+}
+
+/* Get a little endian 32 bit integer
+ * @param bytes   first byte
+ * @return value
+ */
+int getLittleInt(unsigned char* bytes)
+{
+  unsigned int value = bytes[0] | (bytes[1] << 8) | (bytes[2] << 16) | 
+		       ((unsigned int) bytes[3] << 24);
+  return (int) value;
+}
+
+/* Get a little endian 64 bit double
+ * @param bytes   first byte
+ * @return value
+ */
+double getLittleDouble(unsigned char* bytes)
+{
+  unsigned long long bits = 0;
+  double value;
+  int i;
+  for (i = 7; i >= 0; i--)
+     bits = (bits << 8) | bytes[i];
+  memcpy(&value,&bits,sizeof(value));
+  return value;
+}
+
+/* Store a 32 bit integer in little endian order
+ * @param bytes   first byte
+ * @param value   value to store
+ */
+void putLittleInt(unsigned char* bytes, int value)
+{
+  unsigned int bits = (unsigned int) value;
+  int i;
+  for (i = 0; i < 4; i++)
+     bytes[i] = (unsigned char) (bits >> (8*i));
+}
+
+/* Store a 64 bit double in little endian order
+ * @param bytes   first byte
+ * @param value   value to store
+ */
+void putLittleDouble(unsigned char* bytes, double value)
+{
+  unsigned long long bits = 0;
+  int i;
+  memcpy(&bits,&value,sizeof(bits));
+  for (i = 0; i < 8; i++)
+     bytes[i] = (unsigned char) (bits >> (8*i));
+}
+
+/* Read the header of a text or binary parameter file. Must be
+ * called before any features are read.
+ * @param pReader   reader
+ * @param pHeader   structure to fill in
+ * @return TRUE if successful, FALSE if the header is missing or
+ *         is for an unknown version of the binary format
+ */
+BOOL readParamHeader(PARAM_READER_T* pReader, PARAM_HEADER_T* pHeader)
+{
+  if (pReader->bBinary)
+     {
+     unsigned char* bytes = NULL;
+     fillParamBuffer(pReader,PARAM_HEADER_SIZE);
+     if (pReader->end - pReader->pos < PARAM_HEADER_SIZE)
+        return FALSE;
+     bytes = (unsigned char*) pReader->buffer + pReader->pos;
+     if (getLittleInt(bytes + 8) != PARAM_VERSION)
+        return FALSE;
+     pHeader->refcount = getLittleInt(bytes + 12);
+     pHeader->centerX = getLittleDouble(bytes + 16);
+     pHeader->centerY = getLittleDouble(bytes + 24);
+     pHeader->cellsize = getLittleDouble(bytes + 32);
+     pHeader->cellsizeX = getLittleDouble(bytes + 40);
+     pHeader->cellsizeY = getLittleDouble(bytes + 48);
+     pHeader->dataId = getLittleInt(bytes + 56);
+     pHeader->tolerance = getLittleInt(bytes + 60);
+     pReader->pos += PARAM_HEADER_SIZE;
+     }
+  else
+     {
+     char input[256];
+     if (!readParamLine(pReader,input,sizeof(input)))
+        return FALSE;
+     sscanf(input,"%d %lf %lf %lf %lf %lf %d %d",&pHeader->refcount,
+	    &pHeader->centerX,&pHeader->centerY,&pHeader->cellsize,
+	    &pHeader->cellsizeX,&pHeader->cellsizeY,
+	    &pHeader->dataId,&pHeader->tolerance);
+     }
+  return TRUE;
+}
+
+/* Start reading the next feature from a binary parameter file
+ * @param pReader   reader
+ * @param pRefId    set to the reference feature ID
+ * @return number of points in the feature, or -1 at end of file
+ */
+int readBinaryFeatureStart(PARAM_READER_T* pReader, int* pRefId)
+{
+  unsigned char* bytes = NULL;
+  fillParamBuffer(pReader,8);
+  if (pReader->end - pReader->pos < 8)
+     return -1;
+  bytes = (unsigned char*) pReader->buffer + pReader->pos;
+  *pRefId = getLittleInt(bytes);
+  pReader->pos += 8;
+  return getLittleInt(bytes + 4);
+}
+
+/* Read the next point of a feature from a binary parameter file
+ * @param pReader   reader
+ * @param pX        set to X coordinate
+ * @param pY        set to Y coordinate
+ * @return TRUE if successful, FALSE if the file is truncated
+ */
+BOOL readBinaryPoint(PARAM_READER_T* pReader, double* pX, double* pY)
+{
+  unsigned char* bytes = NULL;
+  fillParamBuffer(pReader,16);
+  if (pReader->end - pReader->pos < 16)
+     return FALSE;
+  bytes = (unsigned char*) pReader->buffer + pReader->pos;
+  *pX = getLittleDouble(bytes);
+  *pY = getLittleDouble(bytes + 8);
+  pReader->pos += 16;
+  return TRUE;
+}
+
+/* Write the header of a binary parameter file
+ * @param pOut      file open for binary writing, positioned at the start
+ * @param pHeader   values to write
+ * @return TRUE if successful, FALSE if there was a write error
+ */
+BOOL writeParamHeader(FILE* pOut, PARAM_HEADER_T* pHeader)
+{
+  unsigned char bytes[PARAM_HEADER_SIZE];
+  memcpy(bytes,PARAM_MAGIC,PARAM_MAGIC_SIZE);
+  putLittleInt(bytes + 8,PARAM_VERSION);
+  putLittleInt(bytes + 12,pHeader->refcount);
+  putLittleDouble(bytes + 16,pHeader->centerX);
+  putLittleDouble(bytes + 24,pHeader->centerY);
+  putLittleDouble(bytes + 32,pHeader->cellsize);
+  putLittleDouble(bytes + 40,pHeader->cellsizeX);
+  putLittleDouble(bytes + 48,pHeader->cellsizeY);
+  putLittleInt(bytes + 56,pHeader->dataId);
+  putLittleInt(bytes + 60,pHeader->tolerance);
+  return (fwrite(bytes,1,PARAM_HEADER_SIZE,pOut) == PARAM_HEADER_SIZE);
+}
+
+/* Write one feature to a binary parameter file
+ * @param pOut       file open for binary writing
+ * @param refId      reference feature ID
+ * @param pointCount number of points
+ * @param coords     x and y of each point, interleaved
+ * @return TRUE if successful, FALSE if there was a write error
+ */
+BOOL writeParamFeature(FILE* pOut, int refId, int pointCount, double* coords)
+{
+  unsigned char bytes[16];
+  int i;
+  putLittleInt(bytes,refId);
+  putLittleInt(bytes + 4,pointCount);
+  if (fwrite(bytes,1,8,pOut) != 8)
+     return FALSE;
+  for (i = 0; i < pointCount; i++)
+     {
+     putLittleDouble(bytes,coords[2*i]);
+     putLittleDouble(bytes + 8,coords[2*i + 1]);
+     if (fwrite(bytes,1,16,pOut) != 16)
+        return FALSE;
+     }
+  return TRUE;
+}
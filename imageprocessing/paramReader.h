@@ -0,0 +1,159 @@
+/* Header file with definitions of functions for reading
+ * guidedVectorize parameter files without loading them into memory,
+ * and for writing the binary form of those files
+ * Include AFTER structures.h
+ *
+ * Copyright 2020 Sally E. Goldin
+ * 
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ * 
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+
+/* A parameter file is either text or binary. 
+ *
+ * Text: the first line is 
+ *   refcount centerX centerY cellsize cellsizeX cellsizeY dataId tolerance
+ * and each following line is a reference feature
+ *   refId x y, x y, ...
+ *
+ * Binary: all values little endian. A PARAM_HEADER_SIZE byte header
+ *   char[8]  PARAM_MAGIC
+ *   int32    PARAM_VERSION
+ *   int32    refcount
+ *   float64  centerX, centerY, cellsize, cellsizeX, cellsizeY
+ *   int32    dataId
+ *   int32    tolerance
+ * then for each reference feature
+ *   int32    refId
+ *   int32    pointCount
+ *   float64  x, y for each point
+ *
+ * Coordinates are EPSG:3857 meters in both forms.
+ */
+#define PARAM_MAGIC "MEVPARAM"
+#define PARAM_MAGIC_SIZE 8
+#define PARAM_VERSION 1
+#define PARAM_HEADER_SIZE 64
+
+/* Open a parameter file for reading
+ * @param filename   file to open
+ * @return new reader or NULL if the file cannot be opened
+ *         (errno is set by fopen)
+ */
+PARAM_READER_T* openParamReader(char* filename);
+
+/* Close the file and free the reader
+ * @param pReader   reader to close (may be NULL)
+ */
+void closeParamReader(PARAM_READER_T* pReader);
+
+/* Copy the next line, without its newline, into 'line',
+ * as for fgets. Characters that do not fit are skipped.
+ * @param pReader   reader
+ * @param line      buffer for the line
+ * @param size      size of line
+ * @return TRUE if a line was read, FALSE at end of file
+ */
+BOOL readParamLine(PARAM_READER_T* pReader, char* line, int size);
+
+/* Move to the start of the next comma separated token in the current
+ * line. Commas are skipped. If the line has no more tokens, its newline
+ * is consumed so the next call starts on the following line.
+ * @param pReader   reader
+ * @return TRUE if positioned at a token, FALSE at end of line or file
+ */
+BOOL nextParamToken(PARAM_READER_T* pReader);
+
+/* Skip the rest of the current token, up to the next comma or newline
+ * @param pReader   reader
+ */
+void endParamToken(PARAM_READER_T* pReader);
+
+/* Parse an integer within the current token, as sscanf "%d" would
+ * @param pReader   reader
+ * @param pValue    set to the value if successful
+ * @return TRUE if a number was parsed, FALSE if not (pValue unchanged)
+ */
+BOOL parseParamInt(PARAM_READER_T* pReader, int* pValue);
+
+/* Parse a double within the current token, giving exactly 
+ * the value that sscanf "%lf" would
+ * @param pReader   reader
+ * @param pValue    set to the value if successful
+ * @return TRUE if a number was parsed, FALSE if not (pValue unchanged)
+ */
+BOOL parseParamDouble(PARAM_READER_T* pReader, double* pValue);
+
+/* Read the header of a text or binary parameter file. Must be
+ * called before any features are read.
+ * @param pReader   reader
+ * @param pHeader   structure to fill in
+ * @return TRUE if successful, FALSE if the header is missing or
+ *         is for an unknown version of the binary format
+ */
+BOOL readParamHeader(PARAM_READER_T* pReader, PARAM_HEADER_T* pHeader);
+
+/* Start reading the next feature from a binary parameter file
+ * @param pReader   reader
+ * @param pRefId    set to the reference feature ID
+ * @return number of points in the feature, or -1 at end of file
+ */
+int readBinaryFeatureStart(PARAM_READER_T* pReader, int* pRefId);
+
+/* Read the next point of a feature from a binary parameter file
+ * @param pReader   reader
+ * @param pX        set to X coordinate
+ * @param pY        set to Y coordinate
+ * @return TRUE if successful, FALSE if the file is truncated
+ */
+BOOL readBinaryPoint(PARAM_READER_T* pReader, double* pX, double* pY);
+
+/* Get a little endian 32 bit integer
+ * @param bytes   first byte
+ * @return value
+ */
+int getLittleInt(unsigned char* bytes);
+
+/* Get a little endian 64 bit double
+ * @param bytes   first byte
+ * @return value
+ */
+double getLittleDouble(unsigned char* bytes);
+
+/* Store a 32 bit integer in little endian order
+ * @param bytes   first byte
+ * @param value   value to store
+ */
+void putLittleInt(unsigned char* bytes, int value);
+
+/* Store a 64 bit double in little endian order
+ * @param bytes   first byte
+ * @param value   value to store
+ */
+void putLittleDouble(unsigned char* bytes, double value);
+
+/* Write the header of a binary parameter file
+ * @param pOut      file open for binary writing, positioned at the start
+ * @param pHeader   values to write
+ * @return TRUE if successful, FALSE if there was a write error
+ */
+BOOL writeParamHeader(FILE* pOut, PARAM_HEADER_T* pHeader);
+
+/* Write one feature to a binary parameter file
+ * @param pOut       file open for binary writing
+ * @param refId      reference feature ID
+ * @param pointCount number of points
+ * @param coords     x and y of each point, interleaved
+ * @return TRUE if successful, FALSE if there was a write error
+ */
+BOOL writeParamFeature(FILE* pOut, int refId, int pointCount, double* coords);
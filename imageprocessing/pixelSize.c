@@ -0,0 +1,102 @@
+/* Component of the MapEval road evaluation.
+ * Empirical calculation of the pixel size of a static image 
+ * generated by one of the online map providers, from a small red
+ * box drawn in the center. Split out of calcPixelSize.c so that
+ * it works on an image passed in rather than a global one.
+ *
+ * Copyright 2020 Sally E. Goldin
+ * 
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ * 
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "structures.h"
+#include "instrument.h"
+#include "pixelSize.h"
+
+/* Get the R, G and B values for a pixel at a particular
+ * location in the image.
+ * @param    image  RGB image data, 3 bytes per pixel
+ * @param    width  Image width in pixels
+ * @param    x      Column for desired pixel
+ * @param    y      Row for desired pixel
+ * @param    pR     Pointer to return red value
+ * @param    pG     Pointer to return green value
+ * @param    pB     Pointer to return blue value
+ */
+void getPixelBytes(const BYTE* image, int width, int x, int y,
+		   BYTE* pR, BYTE* pG, BYTE* pB)
+{
+   const BYTE* pixStart = &image[y*width*3 + x*3];
+   *pR = *pixStart;
+   *pG = *(pixStart+1);
+   *pB = *(pixStart+2);
+}
+
+/* Estimate the pixel size of a map image captured with a small red
+ * box in the center, by counting the red pixels across the center
+ * of the box horizontally and vertically.
+ * @param image     RGB image data, 3 bytes per pixel
+ * @param width     image width in pixels
+ * @param height    image height in pixels
+ * @param corners   NW x, NW y, SE x, SE y of the box in meters (EPSG 3857)
+ * @param pSizeX    Pointer to return the pixel width in meters
+ * @param pSizeY    Pointer to return the pixel height in meters
+ * @return TRUE if the box was found, FALSE if not (the sizes are 0)
+ */
+BOOL estimatePixelSize(const BYTE* image, int width, int height,
+		       const double* corners, double* pSizeX, double* pSizeY)
+{
+  int xCenter = width/2;
+  int yCenter = height/2;
+  int ix = 0;
+  int iy = 0;
+  int boxHeight = 0;  /* box height in pixels */
+  int boxWidth = 0;    /* box width in pixels */
+  int radius = 50;    /* box should never be more than 100 pix wide */
+  INSTR_TIMER_T timer;
+  INSTR_START(&timer);
+  /* search for red pixels near the center, horizontally */
+  for (ix = xCenter - radius; ix < xCenter + radius; ix++)
+    { 
+    BYTE R, G, B;
+    getPixelBytes(image,width,ix,yCenter,&R,&G,&B);
+    /* values get distorted by ImageMagick during conversion 
+       so we look for values "close to" pure red
+     */
+    if ((R >= 0xF0) && (G < 0x10) && (B < 0x10))
+       boxWidth++;
+    }
+  /* search for red pixels near the center, vertically */
+  for (iy = yCenter - radius; iy < yCenter + radius; iy++)
+    { 
+    BYTE R, G, B;
+    getPixelBytes(image,width,xCenter,iy,&R,&G,&B);
+    if ((R >= 0xF0) && (G < 0x10) && (B < 0x10))
+       boxHeight++;
+    }
+  INSTR_STOP(&timer,"box_search");
+  INSTR_COUNT("pixels_probed",4 * radius);
+  INSTR_COUNT("box_width",boxWidth);
+  INSTR_COUNT("box_height",boxHeight);
+  //printf("Box Width is %d and Box Height is %d\n", boxWidth, boxHeight);
+  *pSizeX = *pSizeY = 0.0;
+  if ((boxWidth == 0) || (boxHeight == 0))
+    return FALSE;
+  *pSizeX = (corners[2] - corners[0])/boxWidth;
+  *pSizeY = (corners[1] - corners[3])/boxHeight;
+  return TRUE;
+}
@@ -0,0 +1,31 @@
+/* Header file for the empirical pixel size estimate
+ *
+ * Copyright 2020 Sally E. Goldin
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+
+/* Estimate the pixel size of a map image captured with a small red
+ * box in the center, by counting the red pixels across the center
+ * of the box horizontally and vertically.
+ * @param image     RGB image data, 3 bytes per pixel
+ * @param width     image width in pixels
+ * @param height    image height in pixels
+ * @param corners   NW x, NW y, SE x, SE y of the box in meters (EPSG 3857)
+ * @param pSizeX    Pointer to return the pixel width in meters
+ * @param pSizeY    Pointer to return the pixel height in meters
+ * @return TRUE if the box was found, FALSE if not (the sizes are 0)
+ */
+BOOL estimatePixelSize(const BYTE* image, int width, int height,
+		       const double* corners, double* pSizeX, double* pSizeY);
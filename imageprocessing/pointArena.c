@@ -0,0 +1,153 @@
+/* 
+ *  pointArena.c
+ *
+ *  Arena allocator for points. Guided vectorization builds several
+ *  short lists of points for every reference feature and throws them
+ *  away as soon as the feature has been written. Taking their memory
+ *  from an arena that is reset after each feature avoids calls to
+ *  malloc and free, and keeps the points of a feature next to each
+ *  other in memory. The arena hands out POINT_T structures for 
+ *  readFeatures and arrays for POLYLINE_T and COORD_LIST_T.
+ *
+ *  Copyright 2020 Sally E. Goldin
+ * 
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ * 
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "structures.h"
+#include "pointArena.h"
+
+/* size of the first chunk; each new chunk is twice as big as the last */
+#define FIRST_CHUNK_BYTES 16384
+
+/* every block handed out starts on a multiple of this */
+#define ARENA_ALIGN 8
+
+/* Initialize an empty arena. No memory is allocated until
+ * the first block is requested.
+ * @param pArena   arena to initialize
+ */
+void initPointArena(POINT_ARENA_T* pArena)
+{
+  memset(pArena,0,sizeof(POINT_ARENA_T));
+}
+
+/* Allocate a new chunk and add it to the end of the chunk list.
+ * Exits the program if memory cannot be allocated.
+ * @param pArena   arena to extend
+ * @param bytes    the chunk must hold at least this many bytes
+ */
+static void addArenaChunk(POINT_ARENA_T* pArena, long bytes)
+{
+  ARENA_CHUNK_T* pChunk = calloc(1,sizeof(ARENA_CHUNK_T));
+  long size = FIRST_CHUNK_BYTES;
+  if (pArena->last != NULL)
+     size = pArena->last->size * 2;
+  while (size < bytes)
+     size *= 2;
+  if (pChunk != NULL)
+     pChunk->bytes = malloc(size);
+  if ((pChunk == NULL) || (pChunk->bytes == NULL))
+     {
+     printf("Error allocating point arena chunk of %ld bytes\n",size);
+     exit(3);
+     }
+  pChunk->size = size;
+  if (pArena->first == NULL)
+     pArena->first = pChunk;
+  else
+     pArena->last->next = pChunk;
+  pArena->last = pChunk;
+  pArena->capacity += size;
+  pArena->chunkCount++;
+}
+
+/* Get a block of memory from the arena. Chunks too small for the
+ * block are passed over until the arena is reset. Exits the program
+ * if memory cannot be allocated, as the calls to malloc it replaces did.
+ * @param pArena   arena to allocate from
+ * @param bytes    size of the block
+ * @return pointer to the block, which is not cleared
+ */
+void* arenaAlloc(POINT_ARENA_T* pArena, long bytes)
+{
+  void* pBlock = NULL;
+  bytes = (bytes + ARENA_ALIGN - 1) & ~((long) ARENA_ALIGN - 1);
+  if (pArena->current == NULL)
+     {
+     pArena->current = pArena->first;
+     pArena->used = 0;
+     }
+  while ((pArena->current == NULL) || 
+	 (pArena->used + bytes > pArena->current->size))
+     {
+     if ((pArena->current == NULL) || (pArena->current->next == NULL))
+        addArenaChunk(pArena,bytes);
+     if (pArena->current == NULL)
+        pArena->current = pArena->first;
+     else
+        pArena->current = pArena->current->next;
+     pArena->used = 0;
+     }
+  pBlock = pArena->current->bytes + pArena->used;
+  pArena->used += bytes;
+  pArena->inUse += bytes;
+  pArena->total += bytes;
+  if (pArena->inUse > pArena->peakInUse)
+     pArena->peakInUse = pArena->inUse;
+  return pBlock;
+}
+
+/* Get a zeroed POINT_T from the arena. Exits the program
+ * if memory cannot be allocated, as the calloc calls it replaces did.
+ * @param pArena   arena to allocate from
+ * @return pointer to the new point
+ */
+POINT_T* newArenaPoint(POINT_ARENA_T* pArena)
+{
+  POINT_T* pPoint = arenaAlloc(pArena,sizeof(POINT_T));
+  memset(pPoint,0,sizeof(POINT_T));
+  return pPoint;
+}
+
+/* Make all the memory in the arena free again. Keeps the chunks
+ * for reuse and the usage counters.
+ * @param pArena   arena to reset
+ */
+void resetPointArena(POINT_ARENA_T* pArena)
+{
+  pArena->current = pArena->first;
+  pArena->used = 0;
+  pArena->inUse = 0;
+}
+
+/* Free all the memory owned by the arena and reinitialize it.
+ * Anything handed out becomes invalid.
+ * @param pArena   arena to free
+ */
+void freePointArena(POINT_ARENA_T* pArena)
+{
+  ARENA_CHUNK_T* pChunk = pArena->first;
+  while (pChunk != NULL)
+     {
+     ARENA_CHUNK_T* pNext = pChunk->next;
+     free(pChunk->bytes);
+     free(pChunk);
+     pChunk = pNext;
+     }
+  initPointArena(pArena);
+}
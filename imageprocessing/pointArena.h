@@ -0,0 +1,53 @@
+/* Header file with definitions of functions for the 
+ * point arena allocator
+ * Include AFTER structures.h
+ *
+ * Copyright 2020 Sally E. Goldin
+ * 
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ * 
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+
+/* Initialize an empty arena. No memory is allocated until
+ * the first block is requested.
+ * @param pArena   arena to initialize
+ */
+void initPointArena(POINT_ARENA_T* pArena);
+
+/* Get a block of memory from the arena. Chunks too small for the
+ * block are passed over until the arena is reset. Exits the program
+ * if memory cannot be allocated, as the calls to malloc it replaces did.
+ * @param pArena   arena to allocate from
+ * @param bytes    size of the block
+ * @return pointer to the block, which is not cleared
+ */
+void* arenaAlloc(POINT_ARENA_T* pArena, long bytes);
+
+/* Get a zeroed POINT_T from the arena. Exits the program
+ * if memory cannot be allocated, as the calloc calls it replaces did.
+ * @param pArena   arena to allocate from
+ * @return pointer to the new point
+ */
+POINT_T* newArenaPoint(POINT_ARENA_T* pArena);
+
+/* Make all the memory in the arena free again. Keeps the chunks
+ * for reuse and the usage counters.
+ * @param pArena   arena to reset
+ */
+void resetPointArena(POINT_ARENA_T* pArena);
+
+/* Free all the memory owned by the arena and reinitialize it.
+ * Anything handed out becomes invalid.
+ * @param pArena   arena to free
+ */
+void freePointArena(POINT_ARENA_T* pArena);
@@ -0,0 +1,227 @@
+/* Component of the MapEval point matching.
+ * Spatial index for finding the points of a data set that are near
+ * a location, so that each reference point is compared only with
+ * target points that could be within the match threshold.
+ *
+ * Distances in degrees are converted from meters conservatively,
+ * using the smallest size of a degree on the WGS84 ellipsoid within
+ * the search area, so no point within the distance is missed.
+ *
+ * Copyright 2020 Sally E. Goldin
+ * 
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ * 
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include "structures.h"
+#include "pointIndex.h"
+
+#define DEG2RAD (M_PI/180.0)
+
+/* shortest degree of latitude on the WGS84 ellipsoid (at the equator),
+ * reduced slightly to allow for rounding
+ */
+#define MIN_METERS_PER_DEGREE_LAT  110574.0
+
+/* length of a degree of longitude on the equator; at latitude lat a 
+ * degree of longitude is never shorter than this times cos(lat)
+ */
+#define METERS_PER_DEGREE_LON  111319.0
+
+/* smallest band height, so the number of bands fits in an int */
+#define MIN_BAND_DEGREES  1.0e-6
+
+/* POINT_INDEX_T being sorted; qsort has no argument for it */
+static POINT_INDEX_T* pSortIndex = NULL;
+
+/* Compare two entries of an index by band then longitude, for qsort
+ * @param p1   pointer to first entry's position in the index
+ * @param p2   pointer to second entry's position
+ * @return negative, zero or positive like strcmp
+ */
+static int compareEntries(const void* p1, const void* p2)
+{
+  int i1 = *((const int*) p1);
+  int i2 = *((const int*) p2);
+  if (pSortIndex->bands[i1] != pSortIndex->bands[i2])
+     return (pSortIndex->bands[i1] < pSortIndex->bands[i2]) ? -1 : 1;
+  if (pSortIndex->lons[i1] != pSortIndex->lons[i2])
+     return (pSortIndex->lons[i1] < pSortIndex->lons[i2]) ? -1 : 1;
+  return i1 - i2;
+}
+
+/* Return the band holding a latitude
+ * @param pIndex     index 
+ * @param lat        latitude in degrees
+ * @return band number
+ */
+static int latitudeBand(POINT_INDEX_T* pIndex, double lat)
+{
+  if (lat < -90.0)
+     lat = -90.0;
+  if (lat > 90.0)
+     lat = 90.0;
+  return (int) floor((lat + 90.0) / pIndex->bandDegrees);
+}
+
+/* Build an index of a point set for searches out to 'maxMeters'
+ * @param pSet       points to index
+ * @param maxMeters  largest distance that will be searched for
+ * @return new index or NULL if allocation failed
+ */
+POINT_INDEX_T* buildPointIndex(POINT_SET_T* pSet, double maxMeters)
+{
+  int i = 0;
+  int* entries = NULL;   /* positions sorted into order */
+  int* bands = NULL;
+  double* lons = NULL;
+  POINT_INDEX_T* pIndex = calloc(1,sizeof(POINT_INDEX_T));
+  if (pIndex == NULL)
+     {
+     printf("Error allocating point index\n");
+     return NULL;
+     }
+  pIndex->count = pSet->count;
+  pIndex->maxMeters = maxMeters;
+  pIndex->bandDegrees = maxMeters / MIN_METERS_PER_DEGREE_LAT;
+  if (pIndex->bandDegrees < MIN_BAND_DEGREES)
+     pIndex->bandDegrees = MIN_BAND_DEGREES;
+  pIndex->order = calloc(pSet->count + 1,sizeof(int));
+  pIndex->bands = calloc(pSet->count + 1,sizeof(int));
+  pIndex->lons = calloc(pSet->count + 1,sizeof(double));
+  entries = calloc(pSet->count + 1,sizeof(int));
+  bands = calloc(pSet->count + 1,sizeof(int));
+  lons = calloc(pSet->count + 1,sizeof(double));
+  if ((pIndex->order == NULL) || (pIndex->bands == NULL) || 
+      (pIndex->lons == NULL) || (entries == NULL) || (bands == NULL) ||
+      (lons == NULL))
+     {
+     printf("Error allocating point index for %d points\n",pSet->count);
+     freePointIndex(pIndex);
+     free(entries);
+     free(bands);
+     free(lons);
+     return NULL;
+     }
+  for (i = 0; i < pSet->count; i++)
+     {
+     entries[i] = i;
+     pIndex->bands[i] = latitudeBand(pIndex,pSet->points[i].lat);
+     pIndex->lons[i] = pSet->points[i].lon;
+     }
+  pSortIndex = pIndex;
+  qsort(entries,pSet->count,sizeof(int),compareEntries);
+  pSortIndex = NULL;
+  for (i = 0; i < pSet->count; i++)
+     {
+     pIndex->order[i] = entries[i];
+     bands[i] = pIndex->bands[entries[i]];
+     lons[i] = pIndex->lons[entries[i]];
+     }
+  free(pIndex->bands);
+  free(pIndex->lons);
+  free(entries);
+  pIndex->bands = bands;
+  pIndex->lons = lons;
+  return pIndex;
+}
+
+/* Free an index created by buildPointIndex
+ * @param pIndex     index to free (may be NULL)
+ */
+void freePointIndex(POINT_INDEX_T* pIndex)
+{
+  if (pIndex != NULL)
+     {
+     free(pIndex->order);
+     free(pIndex->bands);
+     free(pIndex->lons);
+     free(pIndex);
+     }
+}
+
+/* Add the points in one band within a range of longitude
+ * @param pIndex     index 
+ * @param band       band to search
+ * @param lonLo      smallest longitude wanted
+ * @param lonHi      largest longitude wanted
+ * @param found      array of points found
+ * @param count      number of points already in 'found'
+ * @return new number of points in 'found'
+ */
+static int searchBand(POINT_INDEX_T* pIndex, int band, double lonLo, double lonHi,
+		      int* found, int count)
+{
+  int lo = 0;
+  int hi = pIndex->count;
+  int i = 0;
+  /* binary search for the first entry at or after band,lonLo */
+  while (lo < hi)
+     {
+     int mid = lo + (hi - lo) / 2;
+     if ((pIndex->bands[mid] < band) || 
+	 ((pIndex->bands[mid] == band) && (pIndex->lons[mid] < lonLo)))
+        lo = mid + 1;
+     else
+        hi = mid;
+     }
+  for (i = lo; (i < pIndex->count) && (pIndex->bands[i] == band) &&
+	 (pIndex->lons[i] <= lonHi); i++)
+     found[count++] = pIndex->order[i];
+  return count;
+}
+
+/* Find the indexed points that may be within 'maxMeters' of a location.
+ * Every point that is within that distance is returned, along with
+ * some that are not; the caller must check the actual distances.
+ * @param pIndex     index from buildPointIndex
+ * @param lon        longitude of location in degrees
+ * @param lat        latitude of location in degrees
+ * @param found      array to receive the indices of the points;
+ *                   must be able to hold every point in the index
+ * @return number of points stored in 'found'
+ */
+int findNearbyPoints(POINT_INDEX_T* pIndex, double lon, double lat, int* found)
+{
+  int count = 0;
+  double latDegrees = pIndex->maxMeters / MIN_METERS_PER_DEGREE_LAT;
+  double latLo = lat - latDegrees;
+  double latHi = lat + latDegrees;
+  double maxLat = (fabs(latLo) > fabs(latHi)) ? fabs(latLo) : fabs(latHi);
+  double lonDegrees = 360.0;
+  int firstBand = latitudeBand(pIndex,latLo);
+  int lastBand = latitudeBand(pIndex,latHi);
+  int band = 0;
+  /* degrees of longitude are shortest at the highest latitude searched */
+  if ((maxLat < 90.0) && (latLo > -90.0) && (latHi < 90.0))
+     lonDegrees = pIndex->maxMeters / (METERS_PER_DEGREE_LON * cos(maxLat * DEG2RAD));
+  for (band = firstBand; band <= lastBand; band++)
+     {
+     if (lonDegrees >= 180.0)
+        {
+	count = searchBand(pIndex,band,-HUGE_VAL,HUGE_VAL,found,count);
+	continue;
+        }
+     count = searchBand(pIndex,band,lon - lonDegrees,lon + lonDegrees,found,count);
+     /* the search can cross the antimeridian */
+     if (lon - lonDegrees < -180.0)
+        count = searchBand(pIndex,band,lon - lonDegrees + 360.0,HUGE_VAL,found,count);
+     if (lon + lonDegrees > 180.0)
+        count = searchBand(pIndex,band,-HUGE_VAL,lon + lonDegrees - 360.0,found,count);
+     }
+  return count;
+}
@@ -0,0 +1,43 @@
+/* Header file for the spatial index used to find candidate
+ * matches between two sets of points
+ * Include AFTER structures.h
+ *
+ * Copyright 2020 Sally E. Goldin
+ * 
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ * 
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+
+/* Build an index of a point set for searches out to 'maxMeters'
+ * @param pSet       points to index
+ * @param maxMeters  largest distance that will be searched for
+ * @return new index or NULL if allocation failed
+ */
+POINT_INDEX_T* buildPointIndex(POINT_SET_T* pSet, double maxMeters);
+
+/* Free an index created by buildPointIndex
+ * @param pIndex     index to free (may be NULL)
+ */
+void freePointIndex(POINT_INDEX_T* pIndex);
+
+/* Find the indexed points that may be within 'maxMeters' of a location.
+ * Every point that is within that distance is returned, along with
+ * some that are not; the caller must check the actual distances.
+ * @param pIndex     index from buildPointIndex
+ * @param lon        longitude of location in degrees
+ * @param lat        latitude of location in degrees
+ * @param found      array to receive the indices of the points;
+ *                   must be able to hold every point in the index
+ * @return number of points stored in 'found'
+ */
+int findNearbyPoints(POINT_INDEX_T* pIndex, double lon, double lat, int* found);
@@ -0,0 +1,794 @@
+/* pointMatch.c
+ *
+ *  Matches the points of a reference data set to the points of a
+ *  target data set for a MapEval point experiment, and writes the
+ *  results as rows for the pointmatch table.
+ *
+ *  The server used to ask the database for the distance between every
+ *  reference and target point, then match them in Perl. Here the
+ *  distances are calculated locally, and only for pairs of points
+ *  that a spatial index shows could be within the threshold.
+ *
+ *  The matching is the same greedy method the server used. Reference
+ *  points are taken in order, and each is matched to the closest
+ *  target point that has not already been used. If names are being
+ *  used and that target's name does not match perfectly, a target
+ *  whose name does match perfectly is taken instead. If the match is
+ *  farther than the threshold, the reference point is left unmatched.
+ *
+ *  With -solver, the pairs within the threshold are given instead to
+ *  one of the assignment solvers in assignment.c: a greedy choice of
+ *  the closest pairs over all the points, or the matching with the
+ *  most pairs and the least total distance. Names then break ties
+ *  between equal distances, or with -nameweight add to the distance.
+ *
+ *  Input files hold one point per line in PostgreSQL COPY text format:
+ *     id  longitude  latitude  featurename
+ *  separated by tabs. The output file <outputfile>.copy holds one row
+ *  per reference point, in COPY format for the columns
+ *     experimentid refid targetid distance metascore
+ *
+ * Copyright 2020 Sally E. Goldin
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+#include <math.h>
+#include <errno.h>
+#include <unistd.h>
+
+#include "structures.h"
+#include "geodesic.h"
+#include "pointIndex.h"
+#include "nameScorer.h"
+#include "assignment.h"
+#include "outputBuffer.h"
+#include "instrument.h"
+
+/* distance stored for reference points that are not matched */
+#define NO_MATCH_DISTANCE 50000
+
+/* longest line expected in a point file */
+#define MAX_POINT_LINE 4096
+
+/* if TRUE, a perfect name match overrides the closest point; set by -names */
+BOOL bNames = FALSE;
+
+/* ASSIGN_GREEDY or ASSIGN_OPTIMAL to use an assignment solver, or 0
+ * to match in reference point order as the server did; set by -solver
+ */
+int solver = 0;
+
+/* with a solver, each pair costs its distance plus this fraction of
+ * the threshold times the fraction of the name that does not match;
+ * set by -nameweight
+ */
+double nameWeight = 0.0;
+
+/* number of threads used by the solvers; set by -threads */
+int threadCount = 1;
+
+/* explain arguments */
+void usage()
+{
+  printf("Usage:\n");
+  printf("  pointMatch <refpoints> <targetpoints> <threshold> <expId> <outputfile> [options]\n\n");
+  printf("     refpoints    - reference points, one per line as tab separated\n");
+  printf("                    id, longitude, latitude and name (COPY text format)\n");
+  printf("     targetpoints - target points, in the same format\n");
+  printf("     threshold    - largest distance in meters for two points to match\n");
+  printf("     expId        - DB Id of this experiment\n");
+  printf("     outputfile   - output file name to create (no suffix); rows for\n");
+  printf("                    the pointmatch table are written to <outputfile>.copy\n\n");
+  printf("  Options:\n");
+  printf("     -names       - prefer a target whose name matches the reference name\n");
+  printf("     -solver <s>  - choose the matches with an assignment solver:\n");
+  printf("                       greedy  - closest pairs first, over all the points\n");
+  printf("                       optimal - as many matches as possible, with the\n");
+  printf("                                 least total distance\n");
+  printf("                    Only pairs within the threshold are matched. With\n");
+  printf("                    -names, the better name match wins between equal\n");
+  printf("                    distances\n");
+  printf("     -nameweight <w> - with -solver, add w times the threshold times the\n");
+  printf("                    unmatched fraction of the name to each distance\n");
+  printf("     -threads <n> - solve separate groups of points using n threads\n");
+  printf("                    (0 means one per processor)\n");
+  printf("     -stats       - write the time spent in each stage, and counts of\n");
+  printf("                    points and distances, to <outputfile>.stats.json\n");
+  printf("     -perf        - as -stats, adding CPU cycles and cache misses\n");
+  exit(0);
+}
+
+/* Decode a field of a PostgreSQL COPY text row in place,
+ * replacing backslash escapes by the characters they stand for
+ * @param field   null terminated field
+ * @return field, or NULL if it is \N (a null value)
+ */
+char* decodeCopyField(char* field)
+{
+  char* in = field;
+  char* out = field;
+  if (strcmp(field,"\\N") == 0)
+     return NULL;
+  while (*in != '\0')
+     {
+     if ((*in != '\\') || (in[1] == '\0'))
+        {
+	*out++ = *in++;
+	continue;
+        }
+     in++;
+     switch (*in)
+        {
+	case 'b': *out++ = '\b'; in++; break;
+	case 'f': *out++ = '\f'; in++; break;
+	case 'n': *out++ = '\n'; in++; break;
+	case 'r': *out++ = '\r'; in++; break;
+	case 't': *out++ = '\t'; in++; break;
+	case 'v': *out++ = '\v'; in++; break;
+	case 'x':
+	  {
+	  int value = 0;
+	  int digits = 0;
+	  in++;
+	  while ((digits < 2) && (isxdigit((unsigned char) *in)))
+	     {
+	     value = value*16 + (isdigit((unsigned char) *in) ? *in - '0' :
+				 tolower((unsigned char) *in) - 'a' + 10);
+	     in++;
+	     digits++;
+	     }
+	  *out++ = (char) value;
+	  break;
+	  }
+	default:
+	  if ((*in >= '0') && (*in <= '7'))
+	     {
+	     int value = 0;
+	     int digits = 0;
+	     while ((digits < 3) && (*in >= '0') && (*in <= '7'))
+	        {
+		value = value*8 + (*in - '0');
+		in++;
+		digits++;
+	        }
+	     *out++ = (char) value;
+	     }
+	  else
+	     {
+	     *out++ = *in++;   /* backslash, or any other character */
+	     }
+        }
+     }
+  *out = '\0';
+  return field;
+}
+
+/* Add a point to a point set, growing it if necessary
+ * @param pSet     set to add to
+ * @param id       DB Id of the point
+ * @param lon      longitude in degrees
+ * @param lat      latitude in degrees
+ * @param name     feature name (copied), or NULL if none
+ * @return TRUE if successful, FALSE if memory could not be allocated
+ */
+BOOL addMatchPoint(POINT_SET_T* pSet, int id, double lon, double lat, char* name)
+{
+  MATCH_POINT_T* pPoint = NULL;
+  if (pSet->count == pSet->capacity)
+     {
+     int newCapacity = (pSet->capacity > 0) ? pSet->capacity * 2 : 1024;
+     MATCH_POINT_T* newPoints = realloc(pSet->points,newCapacity * sizeof(MATCH_POINT_T));
+     if (newPoints == NULL)
+        return FALSE;
+     pSet->points = newPoints;
+     pSet->capacity = newCapacity;
+     }
+  pPoint = &pSet->points[pSet->count];
+  pPoint->id = id;
+  pPoint->lon = lon;
+  pPoint->lat = lat;
+  pPoint->nameId = -1;
+  pPoint->name = strdup((name != NULL) ? name : "");
+  if (pPoint->name == NULL)
+     return FALSE;
+  pSet->count++;
+  return TRUE;
+}
+
+/* Free the points in a point set
+ * @param pSet     set to empty
+ */
+void freePointSet(POINT_SET_T* pSet)
+{
+  int i = 0;
+  for (i = 0; i < pSet->count; i++)
+     free(pSet->points[i].name);
+  free(pSet->points);
+  memset(pSet,0,sizeof(POINT_SET_T));
+}
+
+/* Read a file of points, one per line as tab separated id,
+ * longitude, latitude and name in COPY text format.
+ * @param filename   file to read
+ * @param pSet       set to hold the points, initially empty
+ * @return TRUE if successful, FALSE if error (a message has been printed)
+ */
+BOOL readPointFile(char* filename, POINT_SET_T* pSet)
+{
+  char input[MAX_POINT_LINE];
+  int lineNum = 0;
+  FILE* pIn = fopen(filename,"r");
+  if (pIn == NULL)
+     {
+     printf("Error opening point file %s - errno is %d\n",filename,errno);
+     return FALSE;
+     }
+  while (fgets(input,sizeof(input),pIn) != NULL)
+     {
+     char* fields[4];
+     char* end = NULL;
+     int count = 0;
+     int length = strlen(input);
+     lineNum++;
+     if ((length == sizeof(input) - 1) && (input[length - 1] != '\n'))
+        {
+	printf("Error - line %d of point file %s is too long\n",lineNum,filename);
+	fclose(pIn);
+	return FALSE;
+        }
+     while ((length > 0) &&
+	    ((input[length - 1] == '\n') || (input[length - 1] == '\r')))
+        input[--length] = '\0';
+     if ((length == 0) || (strcmp(input,"\\.") == 0))
+        continue;   /* blank line or end of COPY data */
+     fields[0] = input;
+     for (end = input; (*end != '\0') && (count < 3); end++)
+        {
+	if (*end == '\t')
+	   {
+	   *end = '\0';
+	   fields[++count] = end + 1;
+	   }
+        }
+     if ((count < 2) || (decodeCopyField(fields[0]) == NULL) ||
+	 (decodeCopyField(fields[1]) == NULL) || (decodeCopyField(fields[2]) == NULL))
+        {
+	printf("Error - line %d of point file %s should be id, longitude, latitude and name\n",
+	       lineNum,filename);
+	fclose(pIn);
+	return FALSE;
+        }
+     if (!addMatchPoint(pSet,atoi(fields[0]),strtod(fields[1],NULL),strtod(fields[2],NULL),
+			(count == 3) ? decodeCopyField(fields[3]) : NULL))
+        {
+	printf("Error allocating memory for %d points\n",pSet->count + 1);
+	fclose(pIn);
+	return FALSE;
+        }
+     }
+  fclose(pIn);
+  return TRUE;
+}
+
+/* Compare two pairs by distance then target, for qsort
+ * @param p1   pointer to first POINT_PAIR_T
+ * @param p2   pointer to second POINT_PAIR_T
+ * @return negative, zero or positive like strcmp
+ */
+int comparePairs(const void* p1, const void* p2)
+{
+  const POINT_PAIR_T* pPair1 = (const POINT_PAIR_T*) p1;
+  const POINT_PAIR_T* pPair2 = (const POINT_PAIR_T*) p2;
+  if (pPair1->distance != pPair2->distance)
+     return (pPair1->distance < pPair2->distance) ? -1 : 1;
+  return pPair1->target - pPair2->target;
+}
+
+/* Add a pair to an array of pairs, growing it if necessary.
+ * Exits if memory cannot be allocated.
+ * @param pPairs     pointer to the array, updated if it is reallocated
+ * @param pCapacity  pointer to the allocated size, updated
+ * @param count      number of pairs in the array
+ * @param ref        index of reference point
+ * @param target     index of target point
+ * @param distance   distance between them in meters
+ */
+void addPair(POINT_PAIR_T** pPairs, int* pCapacity, int count,
+	     int ref, int target, double distance)
+{
+  if (count >= *pCapacity)
+     {
+     int newCapacity = (*pCapacity > 0) ? *pCapacity * 2 : 4096;
+     POINT_PAIR_T* newPairs = realloc(*pPairs,newCapacity * sizeof(POINT_PAIR_T));
+     if (newPairs == NULL)
+        {
+	printf("Error allocating memory for %d point pairs\n",newCapacity);
+	exit(3);
+        }
+     *pPairs = newPairs;
+     *pCapacity = newCapacity;
+     }
+  (*pPairs)[count].ref = ref;
+  (*pPairs)[count].target = target;
+  (*pPairs)[count].distance = distance;
+}
+
+/* Find every pair of reference and target points that are no more
+ * than 'threshold' meters apart. The pairs for each reference point
+ * are together, closest first.
+ * @param pRefs      reference points
+ * @param pTargets   target points
+ * @param threshold  largest distance in meters
+ * @param pStart     pointer to return an array giving the index of
+ *                   each reference point's first pair, with a final
+ *                   entry holding the number of pairs
+ * @return array of pairs
+ */
+POINT_PAIR_T* findCandidatePairs(POINT_SET_T* pRefs, POINT_SET_T* pTargets,
+				 double threshold, int** pStart)
+{
+  POINT_PAIR_T* pairs = NULL;
+  int capacity = 0;
+  int count = 0;
+  int* start = calloc(pRefs->count + 1,sizeof(int));
+  int* found = calloc(pTargets->count + 1,sizeof(int));
+  double* distances = calloc(pTargets->count + 1,sizeof(double));
+  POINT_INDEX_T* pIndex = NULL;
+  GEO_POINTS_T* pRefGeo = NULL;
+  GEO_POINTS_T* pTargetGeo = NULL;
+  int r = 0;
+  int t = 0;
+  INSTR_TIMER_T timer;
+  INSTR_START(&timer);
+  pIndex = buildPointIndex(pTargets,threshold);
+  pRefGeo = newGeoPoints(pRefs->count);
+  pTargetGeo = newGeoPoints(pTargets->count);
+  INSTR_STOP(&timer,"index");
+  if ((start == NULL) || (found == NULL) || (distances == NULL) ||
+      (pIndex == NULL) || (pRefGeo == NULL) || (pTargetGeo == NULL))
+     {
+     printf("Error allocating memory for candidate pairs\n");
+     exit(3);
+     }
+  INSTR_START(&timer);
+  for (r = 0; r < pRefs->count; r++)
+     setGeoPoint(pRefGeo,r,pRefs->points[r].lon,pRefs->points[r].lat);
+  for (t = 0; t < pTargets->count; t++)
+     setGeoPoint(pTargetGeo,t,pTargets->points[t].lon,pTargets->points[t].lat);
+  for (r = 0; r < pRefs->count; r++)
+     {
+     MATCH_POINT_T* pRef = &pRefs->points[r];
+     int nearby = findNearbyPoints(pIndex,pRef->lon,pRef->lat,found);
+     int i = 0;
+     start[r] = count;
+     INSTR_COUNT("nearby",nearby);
+     nearby = sphereFilter(pRefGeo,r,pTargetGeo,found,nearby,threshold,found);
+     INSTR_COUNT("distances",nearby);
+     geodesicDistances(pRefGeo,r,pTargetGeo,found,nearby,distances);
+     for (i = 0; i < nearby; i++)
+        {
+	if (distances[i] <= threshold)
+	   addPair(&pairs,&capacity,count++,r,found[i],distances[i]);
+        }
+     qsort(&pairs[start[r]],count - start[r],sizeof(POINT_PAIR_T),comparePairs);
+     }
+  start[pRefs->count] = count;
+  INSTR_STOP(&timer,"candidates");
+  INSTR_COUNT("candidate_pairs",count);
+  freePointIndex(pIndex);
+  freeGeoPoints(pRefGeo);
+  freeGeoPoints(pTargetGeo);
+  free(distances);
+  free(found);
+  *pStart = start;
+  return pairs;
+}
+
+/* Put the names of all the points into a name table, setting the
+ * nameId of each point, and index it for scoring.
+ * Exits if memory cannot be allocated.
+ * @param pRefs      reference points
+ * @param pTargets   target points
+ * @return new name table
+ */
+NAME_TABLE_T* buildNameTable(POINT_SET_T* pRefs, POINT_SET_T* pTargets)
+{
+  NAME_TABLE_T* pTable = newNameTable();
+  BOOL bOk = (pTable != NULL);
+  int i = 0;
+  INSTR_TIMER_T timer;
+  INSTR_START(&timer);
+  for (i = 0; (bOk) && (i < pRefs->count); i++)
+     {
+     pRefs->points[i].nameId = addName(pTable,pRefs->points[i].name);
+     bOk = (pRefs->points[i].nameId >= 0);
+     }
+  for (i = 0; (bOk) && (i < pTargets->count); i++)
+     {
+     pTargets->points[i].nameId = addName(pTable,pTargets->points[i].name);
+     bOk = (pTargets->points[i].nameId >= 0);
+     }
+  if ((!bOk) || (!indexNames(pTable)))
+     {
+     printf("Error allocating memory for point names\n");
+     exit(3);
+     }
+  INSTR_STOP(&timer,"name_index");
+  INSTR_COUNT("distinct_names",pTable->names.count);
+  INSTR_COUNT("distinct_words",pTable->words.count);
+  return pTable;
+}
+
+/* Find every pair of reference and target points whose names match
+ * perfectly, however far apart they are. The pairs for each
+ * reference point are together, closest first.
+ * @param pRefs      reference points
+ * @param pTargets   target points
+ * @param pNames     indexed table of the names of the points
+ * @param pStart     pointer to return an array giving the index of
+ *                   each reference point's first pair, with a final
+ *                   entry holding the number of pairs
+ * @return array of pairs
+ */
+POINT_PAIR_T* findNamePairs(POINT_SET_T* pRefs, POINT_SET_T* pTargets,
+			    NAME_TABLE_T* pNames, int** pStart)
+{
+  POINT_PAIR_T* pairs = NULL;
+  int capacity = 0;
+  int count = 0;
+  int nameCount = pNames->names.count;
+  int* start = calloc(pRefs->count + 1,sizeof(int));
+  int* first = calloc(nameCount + 1,sizeof(int));   /* targets by name */
+  int* byName = calloc(pTargets->count + 1,sizeof(int));
+  int* targetNames = calloc(nameCount + 1,sizeof(int));
+  double* scores = calloc(nameCount + 1,sizeof(double));
+  int distinct = 0;
+  int r = 0;
+  int t = 0;
+  int n = 0;
+  INSTR_TIMER_T timer;
+  if ((start == NULL) || (first == NULL) || (byName == NULL) ||
+      (targetNames == NULL) || (scores == NULL))
+     {
+     printf("Error allocating memory for name pairs\n");
+     exit(3);
+     }
+  INSTR_START(&timer);
+  /* group the targets by name, so each distinct name is scored once */
+  for (t = 0; t < pTargets->count; t++)
+     first[pTargets->points[t].nameId + 1]++;
+  for (n = 0; n < nameCount; n++)
+     {
+     if (first[n + 1] > 0)
+        targetNames[distinct++] = n;
+     first[n + 1] += first[n];
+     }
+  for (t = 0; t < pTargets->count; t++)
+     byName[first[pTargets->points[t].nameId]++] = t;
+  for (n = nameCount; n > 0; n--)
+     first[n] = first[n - 1];
+  first[0] = 0;
+  for (r = 0; r < pRefs->count; r++)
+     {
+     MATCH_POINT_T* pRef = &pRefs->points[r];
+     int i = 0;
+     start[r] = count;
+     scoreNameBatch(pNames,pRef->nameId,targetNames,distinct,scores);
+     for (i = 0; i < distinct; i++)
+        {
+	int j = 0;
+	if (scores[i] != 1.0)
+	   continue;
+	for (j = first[targetNames[i]]; j < first[targetNames[i] + 1]; j++)
+	   {
+	   MATCH_POINT_T* pTarget = &pTargets->points[byName[j]];
+	   addPair(&pairs,&capacity,count++,r,byName[j],
+		   geodesicDistance(pRef->lon,pRef->lat,pTarget->lon,pTarget->lat));
+	   }
+        }
+     qsort(&pairs[start[r]],count - start[r],sizeof(POINT_PAIR_T),comparePairs);
+     }
+  start[pRefs->count] = count;
+  INSTR_STOP(&timer,"names");
+  INSTR_COUNT("name_pairs",count);
+  free(first);
+  free(byName);
+  free(targetNames);
+  free(scores);
+  *pStart = start;
+  return pairs;
+}
+
+/* Return the first pair in a list whose target has not been used
+ * @param pairs      array of pairs
+ * @param first      index of first pair in the list
+ * @param last       index after the last pair in the list
+ * @param used       TRUE for each target already matched
+ * @return pointer to the pair, or NULL if all the targets are used
+ */
+POINT_PAIR_T* firstUnusedPair(POINT_PAIR_T* pairs, int first, int last, BOOL* used)
+{
+  int i = 0;
+  for (i = first; i < last; i++)
+     {
+     if (!used[pairs[i].target])
+        return &pairs[i];
+     }
+  return NULL;
+}
+
+/* Write one row for the pointmatch table
+ * @param pOut       output file
+ * @param expId      DB Id of the experiment
+ * @param refId      DB Id of the reference point
+ * @param targetId   DB Id of the matched target point, -1 if none
+ * @param distance   distance between the points in meters
+ * @param metascore  name match score
+ */
+void writeMatchRow(OUTBUF_T* pOut, int expId, int refId, int targetId,
+		   double distance, double metascore)
+{
+  outBufInt(pOut,expId);
+  outBufChar(pOut,'\t');
+  outBufInt(pOut,refId);
+  outBufChar(pOut,'\t');
+  if (targetId < 0)
+     {
+     outBufPrintf(pOut,"-1\t%d\t",NO_MATCH_DISTANCE);
+     }
+  else
+     {
+     outBufInt(pOut,targetId);
+     outBufPrintf(pOut,"\t%.15g\t",distance);
+     }
+  outBufPrintf(pOut,"%.15g\n",metascore);
+}
+
+/* Match each reference point to a target point, greedily in the
+ * order the reference points were read, and write the pointmatch
+ * rows. Once every target has been used, no more rows are written.
+ * @param pRefs      reference points
+ * @param pTargets   target points
+ * @param pNames     indexed table of the names of the points
+ * @param threshold  largest distance in meters for a match
+ * @param expId      DB Id of the experiment
+ * @param pOut       output file
+ * @return number of reference points matched
+ */
+int matchPoints(POINT_SET_T* pRefs, POINT_SET_T* pTargets, NAME_TABLE_T* pNames,
+		double threshold, int expId, OUTBUF_T* pOut)
+{
+  POINT_PAIR_T* pairs = NULL;      /* pairs within the threshold */
+  POINT_PAIR_T* namePairs = NULL;  /* pairs with perfectly matching names */
+  int* pairStart = NULL;
+  int* nameStart = NULL;
+  BOOL* used = calloc(pTargets->count + 1,sizeof(BOOL));
+  int usedCount = 0;
+  int r = 0;
+  INSTR_TIMER_T timer;
+  if (used == NULL)
+     {
+     printf("Error allocating memory for %d target points\n",pTargets->count);
+     exit(3);
+     }
+  pairs = findCandidatePairs(pRefs,pTargets,threshold,&pairStart);
+  if (bNames)
+     namePairs = findNamePairs(pRefs,pTargets,pNames,&nameStart);
+  INSTR_START(&timer);
+  for (r = 0; (r < pRefs->count) && (usedCount < pTargets->count); r++)
+     {
+     MATCH_POINT_T* pRef = &pRefs->points[r];
+     POINT_PAIR_T* pClosest = firstUnusedPair(pairs,pairStart[r],pairStart[r+1],used);
+     int target = -1;
+     double distance = NO_MATCH_DISTANCE;
+     double metascore = 0.0;
+     if (pClosest != NULL)
+        {
+	target = pClosest->target;
+	distance = pClosest->distance;
+	metascore = scoreNames(pNames,pRef->nameId,pTargets->points[target].nameId);
+        }
+     if ((bNames) && (metascore != 1.0))
+        {
+	POINT_PAIR_T* pNamed = firstUnusedPair(namePairs,nameStart[r],nameStart[r+1],used);
+	if (pNamed != NULL)
+	   {
+	   target = pNamed->target;
+	   distance = pNamed->distance;
+	   metascore = 1.0;
+	   }
+        }
+     if ((target < 0) || (distance > threshold))
+        {
+	writeMatchRow(pOut,expId,pRef->id,-1,distance,metascore);
+        }
+     else
+        {
+	used[target] = TRUE;
+	usedCount++;
+	writeMatchRow(pOut,expId,pRef->id,pTargets->points[target].id,
+		      distance,metascore);
+        }
+     }
+  INSTR_STOP(&timer,"match");
+  INSTR_COUNT("matched",usedCount);
+  free(pairs);
+  free(pairStart);
+  free(namePairs);
+  free(nameStart);
+  free(used);
+  return usedCount;
+}
+
+/* Match the reference points to target points with an assignment
+ * solver, using only the pairs within the threshold, and write a
+ * pointmatch row for every reference point.
+ * @param pRefs      reference points
+ * @param pTargets   target points
+ * @param pNames     indexed table of the names of the points
+ * @param threshold  largest distance in meters for a match
+ * @param expId      DB Id of the experiment
+ * @param pOut       output file
+ * @return number of reference points matched
+ */
+int solveMatches(POINT_SET_T* pRefs, POINT_SET_T* pTargets, NAME_TABLE_T* pNames,
+		 double threshold, int expId, OUTBUF_T* pOut)
+{
+  int* pairStart = NULL;
+  POINT_PAIR_T* pairs = findCandidatePairs(pRefs,pTargets,threshold,&pairStart);
+  int pairCount = pairStart[pRefs->count];
+  double* costs = calloc(pairCount + 1,sizeof(double));
+  double* scores = calloc(pairCount + 1,sizeof(double));
+  int* chosen = calloc(pRefs->count + 1,sizeof(int));
+  BOOL bUseNames = (bNames) || (nameWeight > 0.0);
+  int matched = 0;
+  int i = 0;
+  INSTR_TIMER_T timer;
+  if ((costs == NULL) || (scores == NULL) || (chosen == NULL))
+     {
+     printf("Error allocating memory for %d point pairs\n",pairCount);
+     exit(3);
+     }
+  INSTR_START(&timer);
+  for (i = 0; i < pairCount; i++)
+     {
+     scores[i] = scoreNames(pNames,pRefs->points[pairs[i].ref].nameId,
+			    pTargets->points[pairs[i].target].nameId);
+     costs[i] = pairs[i].distance + nameWeight * threshold * (1.0 - scores[i]);
+     }
+  INSTR_STOP(&timer,"names");
+  INSTR_START(&timer);
+  matched = assignPairs(pRefs->count,pTargets->count,pairs,pairCount,costs,
+			(bUseNames) ? scores : NULL,solver,threadCount,chosen);
+  INSTR_STOP(&timer,"assign");
+  if (matched < 0)
+     {
+     printf("Error allocating memory to assign %d point pairs\n",pairCount);
+     exit(3);
+     }
+  INSTR_START(&timer);
+  for (i = 0; i < pRefs->count; i++)
+     {
+     int p = chosen[i];
+     if (p < 0)
+        writeMatchRow(pOut,expId,pRefs->points[i].id,-1,NO_MATCH_DISTANCE,0.0);
+     else
+        writeMatchRow(pOut,expId,pRefs->points[i].id,
+		      pTargets->points[pairs[p].target].id,pairs[p].distance,scores[p]);
+     }
+  INSTR_STOP(&timer,"match");
+  INSTR_COUNT("matched",matched);
+  free(pairs);
+  free(pairStart);
+  free(costs);
+  free(scores);
+  free(chosen);
+  return matched;
+}
+
+/* Main function gets arguments, reads the points, matches them
+ * and writes the results
+ */
+int main(int argc, char* argv[])
+{
+  POINT_SET_T refs;
+  POINT_SET_T targets;
+  char outfile[256];
+  char statsfile[256];
+  double threshold = 0.0;
+  int expId = 0;
+  BOOL bStats = FALSE;
+  BOOL bPerf = FALSE;
+  OUTBUF_T* pOut = NULL;
+  NAME_TABLE_T* pNames = NULL;
+  int i = 0;
+  INSTR_TIMER_T timer;
+  if (argc < 6)
+     usage();
+  threshold = strtod(argv[3],NULL);
+  expId = atoi(argv[4]);
+  snprintf(outfile,sizeof(outfile),"%s.copy",argv[5]);
+  snprintf(statsfile,sizeof(statsfile),"%s.stats.json",argv[5]);
+  for (i = 6; i < argc; i++)
+     {
+     if (strcmp(argv[i],"-names") == 0)
+        bNames = TRUE;
+     else if ((strcmp(argv[i],"-solver") == 0) && (i + 1 < argc))
+        {
+	i++;
+	if (strcmp(argv[i],"greedy") == 0)
+	   solver = ASSIGN_GREEDY;
+	else if (strcmp(argv[i],"optimal") == 0)
+	   solver = ASSIGN_OPTIMAL;
+	else
+	   usage();
+        }
+     else if ((strcmp(argv[i],"-nameweight") == 0) && (i + 1 < argc))
+        {
+	nameWeight = strtod(argv[++i],NULL);
+	if (nameWeight < 0.0)
+	   usage();
+        }
+     else if ((strcmp(argv[i],"-threads") == 0) && (i + 1 < argc))
+        {
+	threadCount = atoi(argv[++i]);
+	if (threadCount <= 0)
+	   threadCount = sysconf(_SC_NPROCESSORS_ONLN);
+	if (threadCount <= 0)
+	   threadCount = 1;
+        }
+     else if (strcmp(argv[i],"-stats") == 0)
+        bStats = TRUE;
+     else if (strcmp(argv[i],"-perf") == 0)
+        bStats = bPerf = TRUE;
+     else
+        usage();
+     }
+  if (bStats)
+     instrumentInit("pointMatch",bPerf);
+  memset(&refs,0,sizeof(refs));
+  memset(&targets,0,sizeof(targets));
+  INSTR_START(&timer);
+  if ((!readPointFile(argv[1],&refs)) || (!readPointFile(argv[2],&targets)))
+     exit(1);
+  INSTR_STOP(&timer,"read_points");
+  INSTR_COUNT("ref_points",refs.count);
+  INSTR_COUNT("target_points",targets.count);
+  pOut = openOutBuf(outfile);
+  if (pOut == NULL)
+     {
+     printf("Error opening output file %s - errno is %d\n",outfile,errno);
+     exit(4);
+     }
+  pNames = buildNameTable(&refs,&targets);
+  if (solver != 0)
+     solveMatches(&refs,&targets,pNames,threshold,expId,pOut);
+  else
+     matchPoints(&refs,&targets,pNames,threshold,expId,pOut);
+  INSTR_START(&timer);
+  if (!closeOutBuf(pOut))
+     exit(4);
+  INSTR_STOP(&timer,"flush");
+  if (bStats)
+     instrumentWrite(statsfile);
+  freeNameTable(pNames);
+  freePointSet(&refs);
+  freePointSet(&targets);
+  exit(0);
+}
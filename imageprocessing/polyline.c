@@ -0,0 +1,219 @@
+/* 
+ *  polyline.c
+ *
+ *  Functions for POLYLINE_T, a polyline kept as separate contiguous
+ *  x, y and matchdistance arrays. Compared with a list of POINT_T 
+ *  this needs 16 rather than 56 bytes per vertex, and loops over 
+ *  the vertices read memory sequentially. The arrays can come from
+ *  a point arena, so that the lists for one feature are discarded 
+ *  all at once when the arena is reset.
+ *
+ *  Copyright 2020 Sally E. Goldin
+ * 
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ * 
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "structures.h"
+#include "polyline.h"
+#include "pointArena.h"
+
+/* capacity of a polyline when the first vertex is added */
+#define FIRST_POLYLINE_CAPACITY 64
+
+/* Initialize an empty polyline. No memory is allocated until
+ * the first vertex is added.
+ * @param pLine    polyline to initialize
+ */
+void initPolyline(POLYLINE_T* pLine)
+{
+  memset(pLine,0,sizeof(POLYLINE_T));
+}
+
+/* Initialize an empty polyline whose arrays come from an arena.
+ * Must be called again for each polyline that uses the arena 
+ * whenever the arena is reset.
+ * @param pLine    polyline to initialize
+ * @param pArena   arena for the arrays
+ */
+void initArenaPolyline(POLYLINE_T* pLine, POINT_ARENA_T* pArena)
+{
+  memset(pLine,0,sizeof(POLYLINE_T));
+  pLine->pArena = pArena;
+}
+
+/* Get room for an array of 'count' elements of 'size' bytes, from
+ * an arena, copying the first 'used' elements of the old array, or
+ * from the heap. Exits the program if memory cannot be allocated.
+ * @param pArena   arena, or NULL to use realloc
+ * @param array    old array, may be NULL
+ * @param used     elements of the old array to keep
+ * @param count    elements the new array must hold
+ * @param size     size of one element
+ * @return the new array
+ */
+static void* growArray(POINT_ARENA_T* pArena, void* array, int used,
+		       int count, size_t size)
+{
+  void* newArray = NULL;
+  if (pArena != NULL)
+     {
+     newArray = arenaAlloc(pArena,(long) count * size);
+     if (used > 0)
+        memcpy(newArray,array,used * size);
+     }
+  else
+     {
+     newArray = realloc(array,count * size);
+     if (newArray == NULL)
+        {
+	printf("Error allocating polyline array of %d elements\n",count);
+	exit(3);
+        }
+     }
+  return newArray;
+}
+
+/* Make sure a polyline has room for at least 'count' vertices.
+ * Exits the program if memory cannot be allocated.
+ * @param pLine    polyline to grow
+ * @param count    number of vertices needed
+ */
+void reservePolyline(POLYLINE_T* pLine, int count)
+{
+  if (count > pLine->capacity)
+     {
+     int capacity = FIRST_POLYLINE_CAPACITY;
+     if (pLine->capacity > 0)
+        capacity = pLine->capacity * 2;
+     if (capacity < count)
+        capacity = count;
+     pLine->x = growArray(pLine->pArena,pLine->x,pLine->count,
+			  capacity,sizeof(int));
+     pLine->y = growArray(pLine->pArena,pLine->y,pLine->count,
+			  capacity,sizeof(int));
+     pLine->matchdistance = growArray(pLine->pArena,pLine->matchdistance,
+				      pLine->count,capacity,sizeof(double));
+     pLine->capacity = capacity;
+     }
+}
+
+/* Add a vertex to the end of a polyline, growing the arrays
+ * if necessary. Exits the program if memory cannot be allocated.
+ * @param pLine          polyline to extend
+ * @param x              column of the new vertex
+ * @param y              row of the new vertex
+ * @param matchdistance  distance to the reference point, or 0
+ */
+void appendPolylinePoint(POLYLINE_T* pLine, int x, int y, double matchdistance)
+{
+  if (pLine->count == pLine->capacity)
+     reservePolyline(pLine,pLine->count + 1);
+  pLine->x[pLine->count] = x;
+  pLine->y[pLine->count] = y;
+  pLine->matchdistance[pLine->count] = matchdistance;
+  pLine->count++;
+}
+
+/* Remove all vertices, keeping the arrays for reuse
+ * @param pLine    polyline to reset
+ */
+void resetPolyline(POLYLINE_T* pLine)
+{
+  pLine->count = 0;
+}
+
+/* Free the arrays of a polyline and reinitialize it. Arrays from 
+ * an arena are left for the arena to free.
+ * @param pLine    polyline to free
+ */
+void freePolyline(POLYLINE_T* pLine)
+{
+  if (pLine->pArena == NULL)
+     {
+     free(pLine->x);
+     free(pLine->y);
+     free(pLine->matchdistance);
+     }
+  initPolyline(pLine);
+}
+
+/* Initialize an empty list of coordinates whose array comes from an
+ * arena. Must be called again for each list that uses the arena 
+ * whenever the arena is reset.
+ * @param pList    list to initialize
+ * @param pArena   arena for the array
+ */
+void initArenaCoordList(COORD_LIST_T* pList, POINT_ARENA_T* pArena)
+{
+  memset(pList,0,sizeof(COORD_LIST_T));
+  pList->pArena = pArena;
+}
+
+/* Make sure a list of coordinates has room for at least 'count'
+ * vertices, so that they can be filled in directly. Exits the 
+ * program if memory cannot be allocated.
+ * @param pList    list to grow
+ * @param count    number of vertices needed
+ */
+void reserveCoordList(COORD_LIST_T* pList, int count)
+{
+  if (count > pList->capacity)
+     {
+     int capacity = FIRST_POLYLINE_CAPACITY;
+     if (pList->capacity > 0)
+        capacity = pList->capacity * 2;
+     if (capacity < count)
+        capacity = count;
+     pList->xy = growArray(pList->pArena,pList->xy,2 * pList->count,
+			   2 * capacity,sizeof(double));
+     pList->capacity = capacity;
+     }
+}
+
+/* Add a vertex to the end of a list of coordinates in meters, 
+ * growing it if necessary. Exits the program if memory cannot 
+ * be allocated.
+ * @param pList    list to extend
+ * @param x        X coordinate of the new vertex
+ * @param y        Y coordinate of the new vertex
+ */
+void appendCoord(COORD_LIST_T* pList, double x, double y)
+{
+  reserveCoordList(pList,pList->count + 1);
+  pList->xy[2*pList->count] = x;
+  pList->xy[2*pList->count + 1] = y;
+  pList->count++;
+}
+
+/* Remove all vertices, keeping the array for reuse
+ * @param pList    list to reset
+ */
+void resetCoordList(COORD_LIST_T* pList)
+{
+  pList->count = 0;
+}
+
+/* Free the array of a coordinate list and reinitialize it. An array
+ * from an arena is left for the arena to free.
+ * @param pList    list to free
+ */
+void freeCoordList(COORD_LIST_T* pList)
+{
+  if (pList->pArena == NULL)
+     free(pList->xy);
+  memset(pList,0,sizeof(COORD_LIST_T));
+}
@@ -0,0 +1,96 @@
+/* Header file with definitions of functions for the 
+ * structure-of-arrays polyline type
+ * Include AFTER structures.h
+ *
+ * Copyright 2020 Sally E. Goldin
+ * 
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ * 
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+
+/* Initialize an empty polyline. No memory is allocated until
+ * the first vertex is added.
+ * @param pLine    polyline to initialize
+ */
+void initPolyline(POLYLINE_T* pLine);
+
+/* Initialize an empty polyline whose arrays come from an arena.
+ * Must be called again for each polyline that uses the arena 
+ * whenever the arena is reset.
+ * @param pLine    polyline to initialize
+ * @param pArena   arena for the arrays
+ */
+void initArenaPolyline(POLYLINE_T* pLine, POINT_ARENA_T* pArena);
+
+/* Make sure a polyline has room for at least 'count' vertices.
+ * Exits the program if memory cannot be allocated.
+ * @param pLine    polyline to grow
+ * @param count    number of vertices needed
+ */
+void reservePolyline(POLYLINE_T* pLine, int count);
+
+/* Add a vertex to the end of a polyline, growing the arrays
+ * if necessary. Exits the program if memory cannot be allocated.
+ * @param pLine          polyline to extend
+ * @param x              column of the new vertex
+ * @param y              row of the new vertex
+ * @param matchdistance  distance to the reference point, or 0
+ */
+void appendPolylinePoint(POLYLINE_T* pLine, int x, int y, double matchdistance);
+
+/* Remove all vertices, keeping the arrays for reuse
+ * @param pLine    polyline to reset
+ */
+void resetPolyline(POLYLINE_T* pLine);
+
+/* Free the arrays of a polyline and reinitialize it. Arrays from 
+ * an arena are left for the arena to free.
+ * @param pLine    polyline to free
+ */
+void freePolyline(POLYLINE_T* pLine);
+
+/* Initialize an empty list of coordinates whose array comes from an
+ * arena. Must be called again for each list that uses the arena 
+ * whenever the arena is reset.
+ * @param pList    list to initialize
+ * @param pArena   arena for the array
+ */
+void initArenaCoordList(COORD_LIST_T* pList, POINT_ARENA_T* pArena);
+
+/* Make sure a list of coordinates has room for at least 'count'
+ * vertices, so that they can be filled in directly. Exits the 
+ * program if memory cannot be allocated.
+ * @param pList    list to grow
+ * @param count    number of vertices needed
+ */
+void reserveCoordList(COORD_LIST_T* pList, int count);
+
+/* Add a vertex to the end of a list of coordinates in meters, 
+ * growing it if necessary. Exits the program if memory cannot 
+ * be allocated.
+ * @param pList    list to extend
+ * @param x        X coordinate of the new vertex
+ * @param y        Y coordinate of the new vertex
+ */
+void appendCoord(COORD_LIST_T* pList, double x, double y);
+
+/* Remove all vertices, keeping the array for reuse
+ * @param pList    list to reset
+ */
+void resetCoordList(COORD_LIST_T* pList);
+
+/* Free the array of a coordinate list and reinitialize it. An array
+ * from an arena is left for the arena to free.
+ * @param pList    list to free
+ */
+void freeCoordList(COORD_LIST_T* pList);
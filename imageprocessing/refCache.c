@@ -0,0 +1,418 @@
+/* Component of the MapEval road evaluation.
+ * Keeps an uploaded reference line data set, projected to Web 
+ * Mercator, in a binary file that is mapped into memory when it is 
+ * used. Finding the lines near an image then takes a scan of the 
+ * block index and of the lines in the blocks that overlap it,
+ * instead of a spatial query and a projection of every line.
+ *
+ * Copyright 2020 Sally E. Goldin
+ * 
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ * 
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+#include "structures.h"
+#include "paramReader.h"
+#include "polyline.h"
+#include "refCache.h"
+
+/* a line and its position in Z order, for sorting */
+typedef struct _zOrder
+{
+  unsigned int key;    /* interleaved bits of the center */
+  int line;            /* line number in the input */
+} Z_ORDER_T;
+
+/* Compare two lines by Z order, then by input order
+ * @param p1    first Z_ORDER_T
+ * @param p2    second Z_ORDER_T
+ * @return negative, 0 or positive as for strcmp
+ */
+static int compareZOrder(const void* p1, const void* p2)
+{
+  const Z_ORDER_T* z1 = (const Z_ORDER_T*) p1;
+  const Z_ORDER_T* z2 = (const Z_ORDER_T*) p2;
+  if (z1->key != z2->key)
+     return (z1->key < z2->key) ? -1 : 1;
+  return z1->line - z2->line;
+}
+
+/* Compare two ints, for sorting line numbers back into input order
+ * @param p1    first pair of ints: sequence, line
+ * @param p2    second pair
+ * @return negative, 0 or positive as for strcmp
+ */
+static int compareSequence(const void* p1, const void* p2)
+{
+  return ((const int*) p1)[0] - ((const int*) p2)[0];
+}
+
+/* Spread the low 16 bits of a value out to the even bits
+ * @param value   value to spread
+ * @return spread value
+ */
+static unsigned int spreadBits(unsigned int value)
+{
+  value &= 0xFFFF;
+  value = (value | (value << 8)) & 0x00FF00FF;
+  value = (value | (value << 4)) & 0x0F0F0F0F;
+  value = (value | (value << 2)) & 0x33333333;
+  value = (value | (value << 1)) & 0x55555555;
+  return value;
+}
+
+/* Find the bounding box of some points
+ * @param xy      x and y of each point, interleaved
+ * @param count   number of points, at least one
+ * @param box     set to minX, minY, maxX, maxY
+ */
+static void findBox(const double* xy, int count, double* box)
+{
+  int i = 0;
+  box[0] = box[2] = xy[0];
+  box[1] = box[3] = xy[1];
+  for (i = 1; i < count; i++)
+     {
+     if (xy[2*i] < box[0])
+        box[0] = xy[2*i];
+     else if (xy[2*i] > box[2])
+        box[2] = xy[2*i];
+     if (xy[2*i + 1] < box[1])
+        box[1] = xy[2*i + 1];
+     else if (xy[2*i + 1] > box[3])
+        box[3] = xy[2*i + 1];
+     }
+}
+
+/* Enlarge a box to hold another
+ * @param box     minX, minY, maxX, maxY to enlarge
+ * @param other   box to add
+ */
+static void addBox(double* box, const double* other)
+{
+  if (other[0] < box[0])
+     box[0] = other[0];
+  if (other[1] < box[1])
+     box[1] = other[1];
+  if (other[2] > box[2])
+     box[2] = other[2];
+  if (other[3] > box[3])
+     box[3] = other[3];
+}
+
+/* Write a box as four little endian doubles
+ * @param bytes   first byte
+ * @param box     minX, minY, maxX, maxY
+ */
+static void putBox(unsigned char* bytes, const double* box)
+{
+  int i = 0;
+  for (i = 0; i < 4; i++)
+     putLittleDouble(bytes + 8*i,box[i]);
+}
+
+/* Check whether a box stored in the cache overlaps another
+ * @param bytes   first byte of the stored box
+ * @param box     minX, minY, maxX, maxY
+ * @return TRUE if they overlap or touch
+ */
+static BOOL boxOverlaps(unsigned char* bytes, const double* box)
+{
+  return ((getLittleDouble(bytes) <= box[2]) && 
+	  (getLittleDouble(bytes + 16) >= box[0]) &&
+	  (getLittleDouble(bytes + 8) <= box[3]) && 
+	  (getLittleDouble(bytes + 24) >= box[1]));
+}
+
+/* Write a reference cache file
+ * @param filename   file to create
+ * @param dataId     uploaddata Id
+ * @param rowCount   number of uploadlines rows the lines came from
+ * @param lineCount  number of lines
+ * @param refIds     uploadlines Id of each line
+ * @param starts     index of the first point of each line; 
+ *                   starts[lineCount] is the number of points
+ * @param pPoints    points of all the lines, in meters
+ * @return TRUE if successful, FALSE if memory ran out or there was
+ *         a write error (errno is set)
+ */
+BOOL writeRefCache(char* filename, int dataId, int rowCount, int lineCount,
+		   const int* refIds, const int* starts, COORD_LIST_T* pPoints)
+{
+  unsigned char header[REFCACHE_HEADER_SIZE];
+  unsigned char entry[REFCACHE_LINE_SIZE];
+  Z_ORDER_T* order = NULL;
+  double* boxes = NULL;     /* box of each line, in input order */
+  double extent[4] = {0.0, 0.0, 0.0, 0.0};
+  int blockCount = (lineCount + REFCACHE_BLOCK - 1) / REFCACHE_BLOCK;
+  int first = 0;            /* first point of the next line written */
+  int i = 0;
+  int b = 0;
+  FILE* pOut = NULL;
+  BOOL bOk = TRUE;
+  order = calloc(lineCount + 1,sizeof(Z_ORDER_T));
+  boxes = calloc(4*lineCount + 4,sizeof(double));
+  if ((order == NULL) || (boxes == NULL))
+     {
+     free(order);
+     free(boxes);
+     errno = ENOMEM;
+     return FALSE;
+     }
+  for (i = 0; i < lineCount; i++)
+     {
+     findBox(pPoints->xy + 2*starts[i],starts[i + 1] - starts[i],boxes + 4*i);
+     if (i == 0)
+        memcpy(extent,boxes,sizeof(extent));
+     else
+        addBox(extent,boxes + 4*i);
+     }
+  for (i = 0; i < lineCount; i++)
+     {
+     double* box = boxes + 4*i;
+     double width = extent[2] - extent[0];
+     double height = extent[3] - extent[1];
+     unsigned int x = 0;
+     unsigned int y = 0;
+     if (width > 0.0)
+        x = (unsigned int) (((box[0] + box[2])/2.0 - extent[0]) / width * 65535.0);
+     if (height > 0.0)
+        y = (unsigned int) (((box[1] + box[3])/2.0 - extent[1]) / height * 65535.0);
+     order[i].key = spreadBits(x) | (spreadBits(y) << 1);
+     order[i].line = i;
+     }
+  qsort(order,lineCount,sizeof(Z_ORDER_T),compareZOrder);
+  pOut = fopen(filename,"wb");
+  if (pOut == NULL)
+     {
+     free(order);
+     free(boxes);
+     return FALSE;
+     }
+  memset(header,0,sizeof(header));
+  memcpy(header,REFCACHE_MAGIC,REFCACHE_MAGIC_SIZE);
+  putLittleInt(header + 8,REFCACHE_VERSION);
+  putLittleInt(header + 12,dataId);
+  putLittleInt(header + 16,rowCount);
+  putLittleInt(header + 20,lineCount);
+  putLittleInt(header + 24,blockCount);
+  putLittleInt(header + 28,pPoints->count);
+  putBox(header + 32,extent);
+  bOk = (fwrite(header,1,REFCACHE_HEADER_SIZE,pOut) == REFCACHE_HEADER_SIZE);
+  for (b = 0; (bOk) && (b < blockCount); b++)
+     {
+     unsigned char block[REFCACHE_BLOCK_SIZE];
+     double box[4];
+     int count = lineCount - b*REFCACHE_BLOCK;
+     if (count > REFCACHE_BLOCK)
+        count = REFCACHE_BLOCK;
+     memcpy(box,boxes + 4*order[b*REFCACHE_BLOCK].line,sizeof(box));
+     for (i = 1; i < count; i++)
+        addBox(box,boxes + 4*order[b*REFCACHE_BLOCK + i].line);
+     putLittleInt(block,b*REFCACHE_BLOCK);
+     putLittleInt(block + 4,count);
+     putBox(block + 8,box);
+     bOk = (fwrite(block,1,REFCACHE_BLOCK_SIZE,pOut) == REFCACHE_BLOCK_SIZE);
+     }
+  for (i = 0; (bOk) && (i < lineCount); i++)
+     {
+     int line = order[i].line;
+     putLittleInt(entry,refIds[line]);
+     putLittleInt(entry + 4,line);
+     putLittleInt(entry + 8,first);
+     putLittleInt(entry + 12,starts[line + 1] - starts[line]);
+     putBox(entry + 16,boxes + 4*line);
+     bOk = (fwrite(entry,1,REFCACHE_LINE_SIZE,pOut) == REFCACHE_LINE_SIZE);
+     first += starts[line + 1] - starts[line];
+     }
+  for (i = 0; (bOk) && (i < lineCount); i++)
+     {
+     int line = order[i].line;
+     int k = 0;
+     for (k = starts[line]; (bOk) && (k < starts[line + 1]); k++)
+        {
+	unsigned char point[16];
+	putLittleDouble(point,pPoints->xy[2*k]);
+	putLittleDouble(point + 8,pPoints->xy[2*k + 1]);
+	bOk = (fwrite(point,1,16,pOut) == 16);
+        }
+     }
+  if (fclose(pOut) != 0)
+     bOk = FALSE;
+  free(order);
+  free(boxes);
+  return bOk;
+}
+
+/* Map a reference cache file into memory
+ * @param filename   file to open
+ * @return new cache, or NULL if the file cannot be opened or 
+ *         is not a valid cache file
+ */
+REF_CACHE_T* openRefCache(char* filename)
+{
+  REF_CACHE_T* pCache = NULL;
+  struct stat info;
+  void* data = NULL;
+  long long expected = 0;
+  int fd = open(filename,O_RDONLY);
+  if (fd < 0)
+     return NULL;
+  if ((fstat(fd,&info) != 0) || (info.st_size < REFCACHE_HEADER_SIZE))
+     {
+     close(fd);
+     return NULL;
+     }
+  data = mmap(NULL,info.st_size,PROT_READ,MAP_SHARED,fd,0);
+  close(fd);
+  if (data == MAP_FAILED)
+     return NULL;
+  pCache = calloc(1,sizeof(REF_CACHE_T));
+  if (pCache == NULL)
+     {
+     munmap(data,info.st_size);
+     return NULL;
+     }
+  pCache->data = (unsigned char*) data;
+  pCache->size = info.st_size;
+  pCache->dataId = getLittleInt(pCache->data + 12);
+  pCache->rowCount = getLittleInt(pCache->data + 16);
+  pCache->lineCount = getLittleInt(pCache->data + 20);
+  pCache->blockCount = getLittleInt(pCache->data + 24);
+  pCache->pointCount = getLittleInt(pCache->data + 28);
+  expected = REFCACHE_HEADER_SIZE + 
+	     (long long) pCache->blockCount * REFCACHE_BLOCK_SIZE +
+	     (long long) pCache->lineCount * REFCACHE_LINE_SIZE + 
+	     (long long) pCache->pointCount * 16;
+  if ((memcmp(pCache->data,REFCACHE_MAGIC,REFCACHE_MAGIC_SIZE) != 0) ||
+      (getLittleInt(pCache->data + 8) != REFCACHE_VERSION) ||
+      (pCache->lineCount < 0) || (pCache->blockCount < 0) ||
+      (pCache->pointCount < 0) || (expected != (long long) pCache->size))
+     {
+     closeRefCache(pCache);
+     errno = EINVAL;
+     return NULL;
+     }
+  pCache->blocks = pCache->data + REFCACHE_HEADER_SIZE;
+  pCache->lines = pCache->blocks + pCache->blockCount * REFCACHE_BLOCK_SIZE;
+  pCache->points = pCache->lines + pCache->lineCount * REFCACHE_LINE_SIZE;
+  return pCache;
+}
+
+/* Unmap the file and free the cache
+ * @param pCache     cache to close (may be NULL)
+ */
+void closeRefCache(REF_CACHE_T* pCache)
+{
+  if (pCache == NULL)
+     return;
+  munmap(pCache->data,pCache->size);
+  free(pCache);
+}
+
+/* Find the lines whose bounding boxes overlap a box
+ * @param pCache     open cache
+ * @param box        minX, minY, maxX, maxY to look in
+ * @param pLines     pointer to an array for the line numbers, in 
+ *                   the order they were read; reallocated if needed
+ * @param pCapacity  number of ints the array can hold; updated
+ * @return number of lines found, -1 if memory ran out
+ */
+int findRefLines(REF_CACHE_T* pCache, const double* box, 
+		 int** pLines, int* pCapacity)
+{
+  int* pairs = NULL;   /* sequence and line number of each line found */
+  int pairCapacity = 0;
+  int count = 0;
+  int b = 0;
+  int i = 0;
+  for (b = 0; b < pCache->blockCount; b++)
+     {
+     unsigned char* block = pCache->blocks + b*REFCACHE_BLOCK_SIZE;
+     int first = getLittleInt(block);
+     int lines = getLittleInt(block + 4);
+     if (!boxOverlaps(block + 8,box))
+        continue;
+     for (i = first; (i < first + lines) && (i < pCache->lineCount); i++)
+        {
+	unsigned char* entry = pCache->lines + i*REFCACHE_LINE_SIZE;
+	if (!boxOverlaps(entry + 16,box))
+	   continue;
+	if (count == pairCapacity)
+	   {
+	   int capacity = (pairCapacity > 0) ? pairCapacity * 2 : 256;
+	   int* newPairs = realloc(pairs,2 * capacity * sizeof(int));
+	   if (newPairs == NULL)
+	      {
+	      free(pairs);
+	      return -1;
+	      }
+	   pairs = newPairs;
+	   pairCapacity = capacity;
+	   }
+	pairs[2*count] = getLittleInt(entry + 4);
+	pairs[2*count + 1] = i;
+	count++;
+        }
+     }
+  if (count > *pCapacity)
+     {
+     int* newLines = realloc(*pLines,count * sizeof(int));
+     if (newLines == NULL)
+        {
+	free(pairs);
+	return -1;
+        }
+     *pLines = newLines;
+     *pCapacity = count;
+     }
+  if (count > 0)
+     qsort(pairs,count,2*sizeof(int),compareSequence);
+  for (i = 0; i < count; i++)
+     (*pLines)[i] = pairs[2*i + 1];
+  free(pairs);
+  return count;
+}
+
+/* Get the points of one line of the cache
+ * @param pCache     open cache
+ * @param line       line number, as returned by findRefLines
+ * @param pRefId     set to the uploadlines Id of the line
+ * @param pPoints    list to hold the points; any points it holds
+ *                   already are removed
+ * @return number of points
+ */
+int readRefLine(REF_CACHE_T* pCache, int line, int* pRefId, 
+		COORD_LIST_T* pPoints)
+{
+  unsigned char* entry = pCache->lines + line*REFCACHE_LINE_SIZE;
+  int first = getLittleInt(entry + 8);
+  int count = getLittleInt(entry + 12);
+  unsigned char* bytes = pCache->points + 16*(long long) first;
+  int i = 0;
+  *pRefId = getLittleInt(entry);
+  resetCoordList(pPoints);
+  for (i = 0; (i < count) && (first + i < pCache->pointCount); i++)
+     appendCoord(pPoints,getLittleDouble(bytes + 16*i),
+		 getLittleDouble(bytes + 16*i + 8));
+  return pPoints->count;
+}
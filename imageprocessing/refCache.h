@@ -0,0 +1,102 @@
+/* Header file for the projected reference line cache
+ * Include AFTER structures.h
+ *
+ * Copyright 2020 Sally E. Goldin
+ * 
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ * 
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+
+/* A reference cache file holds one uploaded line data set, already
+ * projected to EPSG:3857, so the lines near an image can be found 
+ * without asking the database. All values little endian.
+ * A REFCACHE_HEADER_SIZE byte header
+ *   char[8]  REFCACHE_MAGIC
+ *   int32    REFCACHE_VERSION
+ *   int32    dataId       uploaddata Id
+ *   int32    rowCount     number of uploadlines rows
+ *   int32    lineCount    number of lines (multi lines are split)
+ *   int32    blockCount   number of index blocks
+ *   int32    pointCount   total number of points
+ *   float64  minX, minY, maxX, maxY of the whole data set
+ * then for each index block, REFCACHE_BLOCK_SIZE bytes
+ *   int32    first line in the block
+ *   int32    number of lines in the block (at most REFCACHE_BLOCK)
+ *   float64  minX, minY, maxX, maxY of those lines
+ * then for each line, REFCACHE_LINE_SIZE bytes
+ *   int32    uploadlines Id
+ *   int32    sequence     position of the line in the input
+ *   int32    first point
+ *   int32    number of points
+ *   float64  minX, minY, maxX, maxY of the line
+ * then the points, as float64 x, y.
+ * Lines are stored in Z order of their centers, so that the lines of
+ * a block are close together; the sequence numbers give back the 
+ * order in which they were read.
+ */
+#define REFCACHE_MAGIC "MEVREFCH"
+#define REFCACHE_MAGIC_SIZE 8
+#define REFCACHE_VERSION 1
+#define REFCACHE_HEADER_SIZE 64
+#define REFCACHE_BLOCK_SIZE 40
+#define REFCACHE_LINE_SIZE 48
+#define REFCACHE_BLOCK 32
+
+/* Write a reference cache file
+ * @param filename   file to create
+ * @param dataId     uploaddata Id
+ * @param rowCount   number of uploadlines rows the lines came from
+ * @param lineCount  number of lines
+ * @param refIds     uploadlines Id of each line
+ * @param starts     index of the first point of each line; 
+ *                   starts[lineCount] is the number of points
+ * @param pPoints    points of all the lines, in meters
+ * @return TRUE if successful, FALSE if memory ran out or there was
+ *         a write error (errno is set)
+ */
+BOOL writeRefCache(char* filename, int dataId, int rowCount, int lineCount,
+		   const int* refIds, const int* starts, COORD_LIST_T* pPoints);
+
+/* Map a reference cache file into memory
+ * @param filename   file to open
+ * @return new cache, or NULL if the file cannot be opened or 
+ *         is not a valid cache file
+ */
+REF_CACHE_T* openRefCache(char* filename);
+
+/* Unmap the file and free the cache
+ * @param pCache     cache to close (may be NULL)
+ */
+void closeRefCache(REF_CACHE_T* pCache);
+
+/* Find the lines whose bounding boxes overlap a box
+ * @param pCache     open cache
+ * @param box        minX, minY, maxX, maxY to look in
+ * @param pLines     pointer to an array for the line numbers, in 
+ *                   the order they were read; reallocated if needed
+ * @param pCapacity  number of ints the array can hold; updated
+ * @return number of lines found, -1 if memory ran out
+ */
+int findRefLines(REF_CACHE_T* pCache, const double* box, 
+		 int** pLines, int* pCapacity);
+
+/* Get the points of one line of the cache
+ * @param pCache     open cache
+ * @param line       line number, as returned by findRefLines
+ * @param pRefId     set to the uploadlines Id of the line
+ * @param pPoints    list to hold the points; any points it holds
+ *                   already are removed
+ * @return number of points
+ */
+int readRefLine(REF_CACHE_T* pCache, int line, int* pRefId, 
+		COORD_LIST_T* pPoints);
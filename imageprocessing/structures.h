@@ -47,6 +47,8 @@
  *
  */
 
+#include <pthread.h>   /* for the locks in MAPEVAL_JOB_T */
+
 typedef unsigned char BYTE;
 typedef unsigned int BOOL;
 
@@ -60,6 +62,14 @@ typedef unsigned int BOOL;
 
 #define pixval(x,y,width) image[y*width + x]
 
+/* binary image packed 64 pixels per word, see bitImage.c */
+typedef unsigned long long BITWORD;
+#define BITS_PER_WORD 64
+
+/* TRUE if pixel x,y of a BITIMAGE_T is WHITE; x,y must be inside the image */
+#define bitval(pBits,x,y) \
+   (((pBits)->bits[(y)*(pBits)->wordsPerRow + ((x) >> 6)] >> ((x) & 63)) & 1)
+
 #define min(a,b)  ((a) > (b)) ? (a) : (b)
 
 
@@ -84,6 +94,134 @@ typedef struct _point
   struct _point * prev;
 } POINT_T;
 
+/* block of memory owned by a point arena */
+typedef struct _arenaChunk
+{
+   long size;                  /* number of bytes in this chunk */
+   char* bytes;                /* the memory itself */
+   struct _arenaChunk * next;  /* next (larger) chunk */
+} ARENA_CHUNK_T;
+
+/* arena allocator for POINT_T lists and polyline arrays. Memory is
+ * handed out from chunks in order; resetting the arena makes all of 
+ * it free again without returning any, so the points of a feature
+ * can be built and discarded without calls to malloc and free.
+ */
+typedef struct _pointArena
+{
+   ARENA_CHUNK_T * first;      /* first chunk, NULL until first allocation */
+   ARENA_CHUNK_T * current;    /* chunk memory is taken from */
+   ARENA_CHUNK_T * last;       /* last chunk */
+   long used;                  /* bytes used in the current chunk */
+   long inUse;                 /* bytes handed out since the last reset */
+   long peakInUse;             /* maximum value of inUse */
+   long total;                 /* bytes handed out since initialized */
+   long capacity;              /* total bytes in all chunks */
+   int chunkCount;             /* number of chunks allocated */
+} POINT_ARENA_T;
+
+/* polyline stored as separate contiguous arrays, one element per vertex. 
+ * Used by guided vectorization in place of POINT_T lists; the arrays
+ * grow as needed and are kept when the polyline is reset. They come
+ * from the heap or, if pArena is set, from that arena, in which case
+ * they are only valid until the arena is reset.
+ */
+typedef struct _polyline
+{
+   int count;               /* number of vertices */
+   int capacity;            /* number of vertices the arrays can hold */
+   int* x;                  /* column of each vertex */
+   int* y;                  /* row of each vertex */
+   double* matchdistance;   /* distance to the reference point in */
+                            /* fractional pixels (matched lines only) */
+   POINT_ARENA_T* pArena;   /* arena the arrays come from, or NULL */
+} POLYLINE_T;
+
+/* polyline with vertices in meters, as read from a parameter file.
+ * Grows as needed like POLYLINE_T.
+ */
+typedef struct _coordList
+{
+   int count;               /* number of vertices */
+   int capacity;            /* number of vertices xy can hold */
+   double* xy;              /* x and y of each vertex, interleaved */
+   POINT_ARENA_T* pArena;   /* arena xy comes from, or NULL */
+} COORD_LIST_T;
+
+/* tallies for comparing the two search methods */
+typedef struct _checkStats
+{
+  long lookups;      /* number of points searched for */
+  long same;         /* both found the same pixel */
+  long closer;       /* nearest lookup found a closer pixel */
+  long tied;         /* different pixel, same distance */
+  long farther;      /* nearest lookup found a farther pixel (should not happen) */
+  long spiralOnly;   /* found only by spiral search */
+  long nearestOnly;  /* found only by nearest lookup */
+  long neither;      /* found by neither */
+  double totalGain;  /* sum of distance reductions, in pixels */
+} CHECK_STATS_T;
+
+/* one reference feature and the result of matching it */
+typedef struct _featureMatch
+{
+  int refFeatureId;     /* Id of the reference feature */
+  POLYLINE_T ref;       /* reference points, in image coordinates */
+  POLYLINE_T line;      /* matched points, empty if no start point found */
+  COORD_LIST_T refMeters;  /* reference points in meters; only */
+                           /* used when the lines are being compared */
+  COORD_LIST_T lineMeters; /* matched points in meters */
+  long long probes;     /* pixels examined while matching, if instrumented */
+  POINT_ARENA_T arena;  /* holds the four lists above; reset after */
+                        /* each feature is written */
+} FEATURE_MATCH_T;
+
+/* bounded buffer reader for guidedVectorize parameter files. 
+ * The file is read in blocks and parsed in place, so memory use
+ * does not depend on the size of the file or the length of a line.
+ */
+typedef struct _paramReader
+{
+   FILE* pFp;          /* open parameter file */
+   char* buffer;       /* block of the file, NUL terminated at 'end' */
+   int size;           /* capacity of buffer, not counting the NUL */
+   int pos;            /* next character to parse */
+   int end;            /* number of valid characters in buffer */
+   BOOL bEof;          /* TRUE once the whole file is in the buffer */
+   BOOL bBinary;       /* TRUE for the binary format, FALSE for text */
+} PARAM_READER_T;
+
+/* buffered output file. Text is collected in a large buffer and 
+ * written with one system call when the buffer fills or the file is
+ * flushed or closed.
+ */
+typedef struct _outBuf
+{
+   int fd;             /* file descriptor of the open file */
+   char* filename;     /* name of the file, for messages */
+   char* buffer;       /* text not yet written */
+   int size;           /* capacity of buffer */
+   int used;           /* number of characters in buffer */
+   BOOL bError;        /* TRUE if a write has failed */
+   int errorNumber;    /* errno from the failed write */
+   long long written;  /* bytes already written to the file */
+} OUTBUF_T;
+
+/* georeferencing and matching parameters from the start 
+ * of a guidedVectorize parameter file 
+ */
+typedef struct _paramHeader
+{
+   int refcount;       /* count of reference features (DB rows) */
+   double centerX;     /* X coordinate of center pixel (meters) */
+   double centerY;     /* Y coordinate of center pixel */
+   double cellsize;    /* size of one cell in meters */
+   double cellsizeX;   /* size of one cell in meters - X direction */
+   double cellsizeY;   /* size of one cell in meters - Y direction */
+   int dataId;         /* QueryDataId */
+   int tolerance;      /* search tolerance in meters */
+} PARAM_HEADER_T;
+
 /* structure used to break a feature into segments with similar slope */
 typedef struct _arc
 {
@@ -127,6 +265,178 @@ typedef struct _featurePair
 } FEATURE_PAIR_T;
 
 
+/* binary image with one bit per pixel. Each row starts on a new word;
+ * pixel x of a row is bit (x % 64) of word (x / 64). Set bits are WHITE.
+ */
+typedef struct _bitImage
+{
+   int width;          /* image width in pixels */
+   int height;         /* image height in pixels */
+   int wordsPerRow;    /* number of BITWORDs in each row */
+   BITWORD* bits;      /* height * wordsPerRow words, row major */
+} BITIMAGE_T;
+
+/* how to turn a provider's map image into a binary road image. 
+ * Gray level is negated, then pixels brighter than 'threshold'
+ * percent become WHITE; if 'bDoubleNegate' the result is inverted.
+ */
+typedef struct _providerProfile
+{
+   char* name;         /* first word of provider name, lower case */
+   int threshold;      /* threshold percentage, as for ImageMagick */
+   BOOL bDoubleNegate; /* negate again after thresholding */
+} PROVIDER_PROFILE_T;
+
+/* reads a binary image from its file one row at a time, so that
+ * images too large to hold in memory can be processed in bands
+ */
+typedef struct _rowReader
+{
+   int width;          /* image width in pixels */
+   int height;         /* image height in pixels */
+   int nextRow;        /* row that the next read will return */
+   FILE* pIn;          /* raw RGB file, or NULL for a JPEG */
+   BYTE* buffer;       /* one row of RGB pixels */
+   struct _jpegRows* pJpeg;  /* JPEG decoder, see jpegBinarize.c */
+} ROW_READER_T;
+
+/* horizontal band of a large image. pImage holds the rows
+ * from 'top' to 'top + pImage->height - 1'; bands are read in 
+ * order from the top, and rows shared with the previous band
+ * are kept rather than read again.
+ */
+typedef struct _imageBand
+{
+   BITIMAGE_T* pImage; /* rows of the band, in band coordinates */
+   int top;            /* image row held in row 0 of pImage */
+   int capacity;       /* most rows pImage can hold */
+} IMAGE_BAND_T;
+
+/* map from every pixel to the closest WHITE (road) pixel, 
+ * computed once per image by an exact Euclidean distance transform
+ */
+typedef struct _nearestMap
+{
+   int width;          /* image width in pixels */
+   int height;         /* image height in pixels */
+   int* nearest;       /* index (y*width + x) of the closest WHITE pixel, */
+                       /* -1 if the image has no WHITE pixels */
+   int* distSquared;   /* squared distance to that pixel */
+} NEAREST_MAP_T;
+
+/* connected WHITE (road) regions of an image, eight-connected,
+ * computed once per image so that two pixels can be tested for
+ * connection by comparing labels
+ */
+typedef struct _componentMap
+{
+   int width;          /* image width in pixels */
+   int height;         /* image height in pixels */
+   int* labels;        /* component of each pixel (y*width + x), */
+                       /* -1 for background pixels */
+   int count;          /* number of components */
+   int* sizes;         /* number of pixels in each component */
+} COMPONENT_MAP_T;
+
+/* one point from a reference or target data set, for point matching */
+typedef struct _matchPoint
+{
+   int id;             /* DB Id of the point */
+   double lon;         /* longitude in degrees (EPSG 4326) */
+   double lat;         /* latitude in degrees */
+   char* name;         /* feature name, empty string if none */
+   int nameId;         /* index of the name in a NAME_TABLE_T */
+} MATCH_POINT_T;
+
+/* all the points of one data set */
+typedef struct _pointSet
+{
+   int count;              /* number of points */
+   int capacity;           /* number of points the array can hold */
+   MATCH_POINT_T* points;  /* the points, in the order they were read */
+} POINT_SET_T;
+
+/* spatial index for finding the points of a set near a location.
+ * Points are sorted into bands of latitude, each as high as the 
+ * search distance, and by longitude within each band, so a search
+ * looks at a range of longitudes in at most a few bands.
+ */
+typedef struct _pointIndex
+{
+   int count;            /* number of points indexed */
+   double bandDegrees;   /* height of each latitude band */
+   double maxMeters;     /* largest search distance */
+   int* order;           /* point indices, sorted by band and longitude */
+   int* bands;           /* band of each point in 'order' */
+   double* lons;         /* longitude of each point in 'order' */
+} POINT_INDEX_T;
+
+/* a reference point and a target point that might be matched */
+typedef struct _pointPair
+{
+   int ref;            /* index of reference point */
+   int target;         /* index of target point */
+   double distance;    /* geodesic distance in meters */
+} POINT_PAIR_T;
+
+/* points prepared for batches of geodesic distance calculations.
+ * Each value is held in its own array so the loops over many points
+ * read consecutive memory.
+ */
+typedef struct _geoPoints
+{
+   int count;          /* number of points */
+   double* lons;       /* longitude in degrees */
+   double* sinU;       /* sine of the reduced latitude */
+   double* cosU;       /* cosine of the reduced latitude */
+   double* x;          /* position on the unit sphere, for the prefilter */
+   double* y;
+   double* z;
+} GEO_POINTS_T;
+
+/* a set of distinct strings, each identified by its index */
+typedef struct _stringPool
+{
+   int count;          /* number of strings */
+   int capacity;       /* number of strings the array can hold */
+   char** strings;     /* the strings, in the order they were added */
+   int slotCount;      /* size of the hash table, a power of two */
+   int* slots;         /* hash table of string index + 1, 0 if empty */
+} STRING_POOL_T;
+
+/* a name split into the words that name matching compares */
+typedef struct _nameEntry
+{
+   int wordCount;      /* number of words the score is divided by */
+   int alwaysCount;    /* words that always match (empty ones) */
+   int wordTotal;      /* number of entries in 'words' */
+   int* words;         /* word index of each nonempty word, with repeats */
+   int pieceTotal;     /* number of entries in 'pieces' */
+   int* pieces;        /* sorted indices of the space separated pieces */
+} NAME_ENTRY_T;
+
+/* which pieces contain a word */
+typedef struct _wordEntry
+{
+   BOOL bWild;         /* word has a '.', which can match a space */
+   int pieceTotal;     /* number of entries in 'pieces' */
+   int* pieces;        /* sorted indices of the pieces containing the word */
+} WORD_ENTRY_T;
+
+/* names interned for repeated scoring against each other */
+typedef struct _nameTable
+{
+   STRING_POOL_T names;   /* lower case names */
+   STRING_POOL_T pieces;  /* lower case space separated parts of names */
+   STRING_POOL_T words;   /* pieces without parentheses */
+   NAME_ENTRY_T* entries; /* one for each name */
+   int entryCapacity;     /* number of name entries allocated */
+   WORD_ENTRY_T* wordEntries;  /* one for each word */
+   int wordCapacity;      /* number of word entries allocated */
+   int indexedWords;      /* words whose pieces are known */
+   int indexedPieces;     /* pieces that had been added when they were found */
+} NAME_TABLE_T;
+
 /* structure to put into the max heap, representing similarity 
  * between two features 
  */
@@ -138,3 +448,140 @@ typedef struct _featureSim
 
 } FEATURE_SIM_T;
  
+
+/* one or more polylines in meters, for computing distances between
+ * line geometries. Each line is divided into blocks of consecutive
+ * segments, and the bounding box of each block is kept.
+ */
+typedef struct _lineSet
+{
+   COORD_LIST_T points;  /* vertices of all the lines, one after another */
+   int count;            /* number of lines */
+   int capacity;         /* number of lines 'start' can hold */
+   int* start;           /* index of the first vertex of each line; */
+                         /* start[count] is points.count */
+   int blockCount;       /* number of blocks */
+   int blockCapacity;    /* number of blocks the arrays can hold */
+   int* blockFirst;      /* index of the first vertex of each block */
+   int* blockLast;       /* index of the last vertex of each block */
+   double* box;          /* minX, minY, maxX, maxY of each block */
+} LINE_SET_T;
+
+/* comparison of each reference line with the lines matched to it,
+ * written as COPY rows for the linematch table
+ */
+typedef struct _lineCompare
+{
+   OUTBUF_T* pOut;       /* linematch COPY file */
+   int expId;            /* DB Id of the experiment */
+   int refId;            /* reference feature being collected */
+   BOOL bCollecting;     /* TRUE once refId has been set */
+   LINE_SET_T refs;      /* parts of the reference feature */
+   LINE_SET_T lines;     /* lines matched to those parts */
+   double frechet;       /* largest Frechet distance of a part and its line */
+   double* work;         /* work space for the Frechet distance */
+   int workCapacity;     /* number of doubles work can hold */
+   int refCount;         /* reference features written */
+   int matchCount;       /* reference features with at least one line */
+} LINE_COMPARE_T;
+
+/* reference line cache file, mapped into memory. The pointers are
+ * to the sections of the file described in refCache.h
+ */
+typedef struct _refCache
+{
+   unsigned char* data;     /* start of the mapped file */
+   size_t size;             /* size of the file in bytes */
+   int dataId;              /* uploaddata Id */
+   int rowCount;            /* number of uploadlines rows */
+   int lineCount;           /* number of lines */
+   int blockCount;          /* number of index blocks */
+   int pointCount;          /* number of points */
+   unsigned char* blocks;   /* index blocks */
+   unsigned char* lines;    /* line entries */
+   unsigned char* points;   /* coordinates */
+} REF_CACHE_T;
+
+/* georeferencing of one image: where it is in EPSG:3857 and how 
+ * large its pixels are 
+ */
+typedef struct _georef
+{
+   double centerX;      /* X coordinate of center pixel (meters) */
+   double centerY;      /* Y coordinate of center pixel */
+   double cellsizeX;    /* size of one cell in meters - X direction */
+   double cellsizeY;    /* size of one cell in meters - Y direction */
+   int width;           /* image width in pixels */
+   int height;          /* image height in pixels */
+} GEOREF_T;
+
+/* position in the reference lines for a vectorization job, which are
+ * read whole and clipped to the image 
+ */
+typedef struct _refCursor
+{
+   double box[4];         /* area covered by the image, in meters */
+   int* lines;            /* cache lines that may cross the image */
+   int capacity;          /* number of ints 'lines' can hold */
+   int count;             /* number of lines found */
+   int next;              /* next line to read */
+   int refId;             /* reference feature Id of the current line */
+   int segment;           /* next segment of the current line to clip */
+   COORD_LIST_T points;   /* points of the current line, in meters */
+   double* pixels;        /* the same points in pixels, not rounded */
+   double* t0;            /* part of each segment inside the image */
+   double* t1; 
+   int* cols;             /* pixel columns and rows of the points in */
+   int* rows;             /* 'piece', which never has more than the line */
+   int clipCapacity;      /* number of points the arrays above can hold */
+   COORD_LIST_T piece;    /* part of the current line inside the image */
+} REF_CURSOR_T;
+
+/* how a vectorization job matches and writes its features; the
+ * same options can be shared by any number of jobs 
+ */
+typedef struct _mapevalOptions
+{
+   int searchMode;        /* one of the SEARCH_ methods in featureMatch.h */
+   BOOL bCopyOutput;      /* write COPY rows rather than INSERTs */
+   int threadCount;       /* threads used to match the features */
+   int bandRows;          /* if > 0, read the image in bands of this many rows */
+   BOOL bConnected;       /* matched points must be connected by road pixels */
+   int minBlobPixels;     /* erase road regions smaller than this first */
+   BOOL bCompare;         /* compare matched lines with the reference */
+} MAPEVAL_OPTIONS_T;
+
+/* everything one vectorization job needs: the image, its 
+ * georeferencing, the reference lines and the output files.
+ * Jobs share nothing but the reference cache, so several can be 
+ * run at once in one process. See mapeval.h.
+ */
+typedef struct _mapevalJob
+{
+   MAPEVAL_OPTIONS_T options;
+   int width;                  /* image width in pixels */
+   int height;                 /* image height in pixels */
+   int refcount;               /* count of reference features */
+   double cellsize;            /* size of one cell in meters */
+   GEOREF_T georef;            /* center and cell size in each direction */
+   int dataId;                 /* QueryDataId */
+   int tolerance;              /* radius of point search in pixels */
+   int expId;                  /* DB Id of the experiment */
+   char outprefix[256];        /* output file name (no suffix) */
+   BITIMAGE_T* pImage;         /* image data, if read whole */
+   ROW_READER_T* pRows;        /* or reader for the image, if read in bands */
+   PARAM_READER_T* pReader;    /* parameter file, positioned after the header */
+   REF_CACHE_T* refCache;      /* if set, reference lines come from here */
+   REF_CURSOR_T refCursor;     /* position in the reference lines */
+   NEAREST_MAP_T* nearestMap;  /* used for SEARCH_NEAREST and SEARCH_CHECK */
+   COMPONENT_MAP_T* componentMap;  /* if set, matched points must be connected */
+   LINE_COMPARE_T* lineCompare;    /* if set, matched lines are compared */
+   OUTBUF_T* pOut;             /* Dragon vector output file */
+   OUTBUF_T* pSql;             /* SQL (or COPY) output file */
+   int featureCount;           /* features written, -1 if the image could not be read */
+   CHECK_STATS_T checkStats;   /* search comparison, for SEARCH_CHECK */
+   pthread_mutex_t checkStatsLock;
+   long arenaPeakBytes;        /* most memory one feature's points used */
+   long arenaTotalBytes;       /* memory handed out for all features */
+   long arenaCapacity;         /* memory allocated by the feature arenas */
+} MAPEVAL_JOB_T;
@@ -0,0 +1,166 @@
+/* Component of the MapEval road evaluation.
+ * Converts coordinates between longitude and latitude, Web Mercator
+ * meters and image pixels, for whole arrays of points at a time.
+ * The loops are kept free of branches and calls where the formulas
+ * allow, so that the compiler can convert several points at once;
+ * the projection itself needs the trigonometric functions of libm.
+ *
+ * Copyright 2020 Sally E. Goldin
+ * 
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ * 
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <math.h>
+#include "structures.h"
+#include "transform.h"
+
+#define DEG2RAD (M_PI / 180.0)
+#define RAD2DEG (180.0 / M_PI)
+
+/* Set up the georeferencing of an image
+ * @param pGeoref    structure to fill in
+ * @param centerX    X coordinate of the center pixel in meters
+ * @param centerY    Y coordinate of the center pixel in meters
+ * @param cellsizeX  pixel width in meters
+ * @param cellsizeY  pixel height in meters
+ * @param width      image width in pixels
+ * @param height     image height in pixels
+ */
+void setGeoref(GEOREF_T* pGeoref, double centerX, double centerY,
+	       double cellsizeX, double cellsizeY, int width, int height)
+{
+  pGeoref->centerX = centerX;
+  pGeoref->centerY = centerY;
+  pGeoref->cellsizeX = cellsizeX;
+  pGeoref->cellsizeY = cellsizeY;
+  pGeoref->width = width;
+  pGeoref->height = height;
+}
+
+/* Project longitudes and latitudes (EPSG:4326) to Web Mercator 
+ * (EPSG:3857), as PostGIS ST_Transform does. Latitudes beyond 
+ * MERCATOR_MAX_LAT give points off the square map, and the poles
+ * give infinity.
+ * @param lonLat     longitude and latitude of each point in degrees,
+ *                   interleaved
+ * @param count      number of points
+ * @param xy         array to receive X and Y of each point in meters;
+ *                   may be the same array as lonLat
+ */
+void lonLatToMercator(const double* lonLat, int count, double* xy)
+{
+  int i = 0;
+  for (i = 0; i < count; i++)
+     {
+     double lon = lonLat[2*i];
+     double lat = lonLat[2*i + 1];
+     /* the same formula as PROJ's spherical Mercator */
+     xy[2*i] = MERCATOR_RADIUS * (lon * DEG2RAD);
+     xy[2*i + 1] = MERCATOR_RADIUS * asinh(tan(lat * DEG2RAD));
+     }
+}
+
+/* Convert Web Mercator coordinates back to longitude and latitude
+ * @param xy         X and Y of each point in meters, interleaved
+ * @param count      number of points
+ * @param lonLat     array to receive longitude and latitude of each
+ *                   point in degrees; may be the same array as xy
+ */
+void mercatorToLonLat(const double* xy, int count, double* lonLat)
+{
+  int i = 0;
+  for (i = 0; i < count; i++)
+     {
+     double x = xy[2*i];
+     double y = xy[2*i + 1];
+     lonLat[2*i] = (x / MERCATOR_RADIUS) * RAD2DEG;
+     lonLat[2*i + 1] = atan(sinh(y / MERCATOR_RADIUS)) * RAD2DEG;
+     }
+}
+
+/* Find the pixels closest to points in meters
+ * @param pGeoref    georeferencing of the image
+ * @param xy         X and Y of each point in meters, interleaved
+ * @param count      number of points
+ * @param cols       array to receive the column of each point
+ * @param rows       array to receive the row of each point
+ */
+void worldToPixels(const GEOREF_T* pGeoref, const double* xy, int count,
+		   int* cols, int* rows)
+{
+  double centerX = pGeoref->centerX;
+  double centerY = pGeoref->centerY;
+  double cellsizeX = pGeoref->cellsizeX;
+  double cellsizeY = pGeoref->cellsizeY;
+  int halfWidth = pGeoref->width/2;
+  int halfHeight = pGeoref->height/2;
+  int i = 0;
+  for (i = 0; i < count; i++)
+     {
+     /* round the offset from the center, as meters2pixels always has */
+     cols[i] = (int) round((xy[2*i] - centerX)/cellsizeX) + halfWidth;
+     rows[i] = (int) round((centerY - xy[2*i + 1])/cellsizeY) + halfHeight;
+     }
+}
+
+/* Convert points in meters to pixel positions without rounding, so
+ * that the image covers columns 0 to width and rows 0 to height
+ * @param pGeoref    georeferencing of the image
+ * @param xy         X and Y of each point in meters, interleaved
+ * @param count      number of points
+ * @param pixels     array to receive column and row of each point
+ */
+void worldToPixelCoords(const GEOREF_T* pGeoref, const double* xy, 
+			int count, double* pixels)
+{
+  double centerX = pGeoref->centerX;
+  double centerY = pGeoref->centerY;
+  double cellsizeX = pGeoref->cellsizeX;
+  double cellsizeY = pGeoref->cellsizeY;
+  double halfWidth = pGeoref->width/2;
+  double halfHeight = pGeoref->height/2;
+  int i = 0;
+  for (i = 0; i < count; i++)
+     {
+     pixels[2*i] = (xy[2*i] - centerX)/cellsizeX + halfWidth;
+     pixels[2*i + 1] = (centerY - xy[2*i + 1])/cellsizeY + halfHeight;
+     }
+}
+
+/* Convert pixels to the coordinates of their centers in meters
+ * @param pGeoref    georeferencing of the image
+ * @param cols       column of each pixel
+ * @param rows       row of each pixel
+ * @param count      number of pixels
+ * @param xy         array to receive X and Y of each pixel in meters,
+ *                   interleaved
+ */
+void pixelsToWorld(const GEOREF_T* pGeoref, const int* cols, const int* rows,
+		   int count, double* xy)
+{
+  double centerX = pGeoref->centerX;
+  double centerY = pGeoref->centerY;
+  double cellsizeX = pGeoref->cellsizeX;
+  double cellsizeY = pGeoref->cellsizeY;
+  int halfWidth = pGeoref->width/2;
+  int halfHeight = pGeoref->height/2;
+  int i = 0;
+  for (i = 0; i < count; i++)
+     {
+     xy[2*i] = centerX + ((cols[i] - halfWidth) * cellsizeX);
+     xy[2*i + 1] = centerY - ((rows[i] - halfHeight) * cellsizeY);
+     }
+}
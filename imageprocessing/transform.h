@@ -0,0 +1,86 @@
+/* Header file for the coordinate transformations
+ * Include AFTER structures.h
+ *
+ * Copyright 2020 Sally E. Goldin
+ * 
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ * 
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+
+/* sphere used by Web Mercator, EPSG:3857 */
+#define MERCATOR_RADIUS 6378137.0
+/* Web Mercator is cut off at the latitude that makes the map square */
+#define MERCATOR_MAX_LAT 85.0511287798066
+
+/* Set up the georeferencing of an image
+ * @param pGeoref    structure to fill in
+ * @param centerX    X coordinate of the center pixel in meters
+ * @param centerY    Y coordinate of the center pixel in meters
+ * @param cellsizeX  pixel width in meters
+ * @param cellsizeY  pixel height in meters
+ * @param width      image width in pixels
+ * @param height     image height in pixels
+ */
+void setGeoref(GEOREF_T* pGeoref, double centerX, double centerY,
+	       double cellsizeX, double cellsizeY, int width, int height);
+
+/* Project longitudes and latitudes (EPSG:4326) to Web Mercator 
+ * (EPSG:3857), as PostGIS ST_Transform does. Latitudes beyond 
+ * MERCATOR_MAX_LAT give points off the square map, and the poles
+ * give infinity.
+ * @param lonLat     longitude and latitude of each point in degrees,
+ *                   interleaved
+ * @param count      number of points
+ * @param xy         array to receive X and Y of each point in meters;
+ *                   may be the same array as lonLat
+ */
+void lonLatToMercator(const double* lonLat, int count, double* xy);
+
+/* Convert Web Mercator coordinates back to longitude and latitude
+ * @param xy         X and Y of each point in meters, interleaved
+ * @param count      number of points
+ * @param lonLat     array to receive longitude and latitude of each
+ *                   point in degrees; may be the same array as xy
+ */
+void mercatorToLonLat(const double* xy, int count, double* lonLat);
+
+/* Find the pixels closest to points in meters
+ * @param pGeoref    georeferencing of the image
+ * @param xy         X and Y of each point in meters, interleaved
+ * @param count      number of points
+ * @param cols       array to receive the column of each point
+ * @param rows       array to receive the row of each point
+ */
+void worldToPixels(const GEOREF_T* pGeoref, const double* xy, int count,
+		   int* cols, int* rows);
+
+/* Convert points in meters to pixel positions without rounding, so
+ * that the image covers columns 0 to width and rows 0 to height
+ * @param pGeoref    georeferencing of the image
+ * @param xy         X and Y of each point in meters, interleaved
+ * @param count      number of points
+ * @param pixels     array to receive column and row of each point
+ */
+void worldToPixelCoords(const GEOREF_T* pGeoref, const double* xy, 
+			int count, double* pixels);
+
+/* Convert pixels to the coordinates of their centers in meters
+ * @param pGeoref    georeferencing of the image
+ * @param cols       column of each pixel
+ * @param rows       row of each pixel
+ * @param count      number of pixels
+ * @param xy         array to receive X and Y of each pixel in meters,
+ *                   interleaved
+ */
+void pixelsToWorld(const GEOREF_T* pGeoref, const int* cols, const int* rows,
+		   int count, double* xy);
@@ -0,0 +1,491 @@
+/*
+ *  transformBench.c
+ *
+ *  Accuracy check and benchmark for the coordinate transformations
+ *  in transform.c.
+ *
+ *  With -verify, compares lonLatToMercator and mercatorToLonLat with
+ *  reference values of the spherical Mercator formulas that PostGIS
+ *  (through PROJ) uses for EPSG:3857, calculated to 50 digits, checks
+ *  that points survive the round trip, and checks that converting
+ *  points to pixels and back gives the same results in a batch as one
+ *  at a time, and the same results as the per-point functions they
+ *  replaced. Exits with status 1 if any check fails.
+ *
+ *  The reference values were not produced by ST_Transform itself. 
+ *  They were calculated from the formulas, so they show that
+ *  transform.c follows the formulas, not that it agrees with a
+ *  particular PostGIS installation. To check against one, add rows
+ *  to the tables from, for instance,
+ *     select ST_X(p), ST_Y(p) from (select ST_Transform(
+ *        ST_SetSRID(ST_MakePoint(lon,lat),4326),3857) as p) t;
+ *
+ *  Otherwise generates random points scattered around a location
+ *  and times each transformation over the whole array, and the
+ *  pixel conversions one point at a time as well. The same seed 
+ *  always gives the same points.
+ *
+ *  Copyright 2020 Sally E. Goldin
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <time.h>
+
+#include "structures.h"
+#include "transform.h"
+
+/* largest acceptable differences from the reference values */
+#define MAX_ERROR_METERS 1.0e-6
+#define MAX_ERROR_DEGREES 1.0e-11
+
+/* a point in both coordinate systems; which one is the input 
+ * depends on the table
+ */
+typedef struct _referencePoint
+{
+  double lon;
+  double lat;
+  double x;
+  double y;
+} REFERENCE_POINT_T;
+
+/* longitude and latitude projected to Web Mercator meters, 
+ * calculated from the formulas rather than by PostGIS. The points at
+ * longitude 180 are corners of the square map, which the EPSG:3857
+ * definition puts 20037508.342789244 m from the origin.
+ */
+static REFERENCE_POINT_T forwardPoints[] =
+{
+  {0, 0, 0.000000000, 0.000000000},
+  {100.5018, 13.7563, 11187809.199807422, 1546272.214978068},
+  {100.49, 13.7, 11186495.629816061, 1539820.622407939},
+  {-0.1278, 51.5074, -14226.630923380, 6711542.475587637},
+  {-74.006, 40.7128, -8238310.235647004, 4970071.579142427},
+  {151.2093, -33.8688, 16832542.279207342, -4011198.647307572},
+  {-58.3816, -34.6037, -6499009.983696580, -4110155.126083804},
+  {139.6917, 35.6895, 15550408.912046734, 4257980.732184108},
+  {18.4241, -33.9249, 2050961.430324352, -4018722.383190346},
+  {-122.4194, 37.7749, -13627665.271218075, 4547675.354340557},
+  {179.9995, -16.5, 20037452.683043846, -1862698.872150687},
+  {-179.9995, 70.25, -20037452.683043846, 11150576.690899871},
+  {180, 85.0511287798066, 20037508.342789243, 20037508.342789253},
+  {-180, -85.0511287798066, -20037508.342789243, -20037508.342789253},
+  {45, 60, 5009377.085697311, 8399737.889818360},
+  {0.001, -0.001, 111.319490793, -111.319490799},
+  {10, 89.5, 1113194.907932736, 34662081.070585738},
+};
+
+/* Web Mercator meters converted to longitude and latitude, also
+ * calculated from the formulas; here x and y are the input
+ */
+static REFERENCE_POINT_T inversePoints[] =
+{
+  {100.501209808588292, 13.754738439552695, 11187743.5, 1546093.25},
+  {0.000000000000000, 0.000000000000000, 0, 0},
+  {-180.000000000000008, 85.051128779806593, -20037508.342789244, 20037508.342789244},
+  {-74.006000039103628, 40.713955845247090, -8238310.24, 4970241.33},
+  {151.210008957542798, -33.871558259890664, 16832621.2, -4011568.45},
+  {0.000013474729262, -0.000022457882103, 1.5, -2.5},
+  {-122.416666685142857, 37.774901034254071, -13627361.0, 4547675.5},
+};
+
+/* settings for one benchmark run */
+typedef struct _transformBenchConfig
+{
+  int count;            /* number of points */
+  double lon;           /* center of the points */
+  double lat;
+  double spread;        /* points are within this many degrees of the center */
+  int repeat;           /* number of times to time each transformation */
+  unsigned int seed;    /* random number seed */
+} TRANSFORM_BENCH_CONFIG_T;
+
+/* explain arguments */
+void usage()
+{
+  printf("Usage:\n");
+  printf("  transformBench [options]\n\n");
+  printf("  Options:\n");
+  printf("     -verify            - check the transformations against reference\n");
+  printf("                          values and exit\n");
+  printf("     -points <n>        - number of points (default 1000000)\n");
+  printf("     -center <lon>,<lat> - center of the points (default 100.5,13.75)\n");
+  printf("     -spread <deg>      - greatest distance of a point from the center\n");
+  printf("                          in degrees (default 0.05)\n");
+  printf("     -repeat <n>        - time each transformation n times (default 3)\n");
+  printf("     -seed <n>          - random number seed (default 1)\n");
+  exit(0);
+}
+
+/* Return a uniformly distributed random number in [0,1) */
+double uniformRandom()
+{
+  return rand() / ((double) RAND_MAX + 1.0);
+}
+
+/* Return elapsed time between two clock readings in seconds */
+double elapsedSeconds(struct timespec* pStart, struct timespec* pEnd)
+{
+  return (pEnd->tv_sec - pStart->tv_sec) +
+         (pEnd->tv_nsec - pStart->tv_nsec) / 1.0e9;
+}
+
+/* Check the projection in both directions against the reference
+ * points, one at a time and in a batch
+ * @return number of failures
+ */
+int verifyProjection()
+{
+  int forwardCount = sizeof(forwardPoints) / sizeof(forwardPoints[0]);
+  int inverseCount = sizeof(inversePoints) / sizeof(inversePoints[0]);
+  int count = (forwardCount > inverseCount) ? forwardCount : inverseCount;
+  double* input = calloc(2 * count,sizeof(double));
+  double* batch = calloc(2 * count,sizeof(double));
+  double maxMeters = 0.0;
+  double maxDegrees = 0.0;
+  int failures = 0;
+  int i = 0;
+  if ((input == NULL) || (batch == NULL))
+     {
+     printf("Error allocating memory for %d reference points\n",count);
+     exit(3);
+     }
+  for (i = 0; i < forwardCount; i++)
+     {
+     input[2*i] = forwardPoints[i].lon;
+     input[2*i + 1] = forwardPoints[i].lat;
+     }
+  lonLatToMercator(input,forwardCount,batch);
+  for (i = 0; i < forwardCount; i++)
+     {
+     REFERENCE_POINT_T* pRef = &forwardPoints[i];
+     double xy[2];
+     double lonLat[2];
+     double error = 0.0;
+     lonLatToMercator(input + 2*i,1,xy);
+     error = fabs(xy[0] - pRef->x);
+     if (fabs(xy[1] - pRef->y) > error)
+        error = fabs(xy[1] - pRef->y);
+     if (error > maxMeters)
+        maxMeters = error;
+     printf("  (%.7f,%.7f) to (%.6f,%.6f), error %.3g m\n",
+	    pRef->lon,pRef->lat,xy[0],xy[1],error);
+     if (error >= MAX_ERROR_METERS)
+        {
+	printf("    FAILED: reference point is (%.6f,%.6f)\n",pRef->x,pRef->y);
+	failures++;
+        }
+     if ((batch[2*i] != xy[0]) || (batch[2*i + 1] != xy[1]))
+        {
+	printf("    FAILED: batch gives (%.9f,%.9f)\n",batch[2*i],batch[2*i + 1]);
+	failures++;
+        }
+     /* and back again */
+     mercatorToLonLat(xy,1,lonLat);
+     if ((fabs(lonLat[0] - pRef->lon) >= MAX_ERROR_DEGREES) ||
+	 (fabs(lonLat[1] - pRef->lat) >= MAX_ERROR_DEGREES))
+        {
+	printf("    FAILED: round trip gives (%.15f,%.15f)\n",lonLat[0],lonLat[1]);
+	failures++;
+        }
+     }
+  for (i = 0; i < inverseCount; i++)
+     {
+     input[2*i] = inversePoints[i].x;
+     input[2*i + 1] = inversePoints[i].y;
+     }
+  mercatorToLonLat(input,inverseCount,batch);
+  for (i = 0; i < inverseCount; i++)
+     {
+     REFERENCE_POINT_T* pRef = &inversePoints[i];
+     double lonLat[2];
+     double error = 0.0;
+     mercatorToLonLat(input + 2*i,1,lonLat);
+     error = fabs(lonLat[0] - pRef->lon);
+     if (fabs(lonLat[1] - pRef->lat) > error)
+        error = fabs(lonLat[1] - pRef->lat);
+     if (error > maxDegrees)
+        maxDegrees = error;
+     printf("  (%.6f,%.6f) to (%.12f,%.12f), error %.3g deg\n",
+	    pRef->x,pRef->y,lonLat[0],lonLat[1],error);
+     if (error >= MAX_ERROR_DEGREES)
+        {
+	printf("    FAILED: reference point is (%.12f,%.12f)\n",pRef->lon,pRef->lat);
+	failures++;
+        }
+     if ((batch[2*i] != lonLat[0]) || (batch[2*i + 1] != lonLat[1]))
+        {
+	printf("    FAILED: batch gives (%.15f,%.15f)\n",batch[2*i],batch[2*i + 1]);
+	failures++;
+        }
+     }
+  printf("%d + %d reference points, largest errors %.3g m and %.3g deg\n",
+	 forwardCount,inverseCount,maxMeters,maxDegrees);
+  free(input);
+  free(batch);
+  return failures;
+}
+
+/* Check the conversions between meters and pixels for a grid of
+ * points around an image, against the expressions guidedVectorize
+ * used for one point at a time before the batch functions
+ * @return number of failures
+ */
+int verifyPixels()
+{
+  GEOREF_T georef;
+  int side = 40;
+  int count = side * side;
+  double* xy = calloc(2 * count,sizeof(double));
+  double* back = calloc(2 * count,sizeof(double));
+  double* pixels = calloc(2 * count,sizeof(double));
+  int* cols = calloc(count,sizeof(int));
+  int* rows = calloc(count,sizeof(int));
+  int failures = 0;
+  int i = 0;
+  if ((xy == NULL) || (back == NULL) || (pixels == NULL) || 
+      (cols == NULL) || (rows == NULL))
+     {
+     printf("Error allocating memory for %d points\n",count);
+     exit(3);
+     }
+  /* an image the server might store, near Bangkok */
+  setGeoref(&georef,11187809.199807422,1546272.214978068,
+	    0.5867819,0.5870374,512,511);
+  for (i = 0; i < count; i++)
+     {
+     /* from well outside the image to well inside, off the pixel grid */
+     xy[2*i] = georef.centerX + ((i % side) - side/2) * 17.3 + 0.01 * i;
+     xy[2*i + 1] = georef.centerY - ((i / side) - side/2) * 16.9 - 0.02 * i;
+     }
+  worldToPixels(&georef,xy,count,cols,rows);
+  worldToPixelCoords(&georef,xy,count,pixels);
+  pixelsToWorld(&georef,cols,rows,count,back);
+  for (i = 0; i < count; i++)
+     {
+     int col = round((xy[2*i] - georef.centerX)/georef.cellsizeX) + georef.width/2;
+     int row = round((xy[2*i + 1] - georef.centerY)/georef.cellsizeY * -1) + georef.height/2;
+     double x = (double) georef.centerX + ((col - georef.width/2) * georef.cellsizeX);
+     double y = (double) georef.centerY - ((row - georef.height/2) * georef.cellsizeY);
+     int oneCol, oneRow;
+     double oneXy[2];
+     worldToPixels(&georef,xy + 2*i,1,&oneCol,&oneRow);
+     pixelsToWorld(&georef,&col,&row,1,oneXy);
+     if ((cols[i] != col) || (rows[i] != row) || 
+	 (oneCol != col) || (oneRow != row))
+        {
+	printf("  FAILED: (%.6f,%.6f) gives pixel (%d,%d), expected (%d,%d)\n",
+	       xy[2*i],xy[2*i + 1],cols[i],rows[i],col,row);
+	failures++;
+        }
+     if ((back[2*i] != x) || (back[2*i + 1] != y) ||
+	 (oneXy[0] != x) || (oneXy[1] != y))
+        {
+	printf("  FAILED: pixel (%d,%d) gives (%.9f,%.9f), expected (%.9f,%.9f)\n",
+	       col,row,back[2*i],back[2*i + 1],x,y);
+	failures++;
+        }
+     if ((fabs(pixels[2*i] - col) > 0.5) || (fabs(pixels[2*i + 1] - row) > 0.5))
+        {
+	printf("  FAILED: (%.6f,%.6f) is at (%.6f,%.6f), not near pixel (%d,%d)\n",
+	       xy[2*i],xy[2*i + 1],pixels[2*i],pixels[2*i + 1],col,row);
+	failures++;
+        }
+     }
+  printf("%d points converted to pixels and back\n",count);
+  free(xy);
+  free(back);
+  free(pixels);
+  free(cols);
+  free(rows);
+  return failures;
+}
+
+/* Run all the checks
+ * @return 0 if all pass, else 1
+ */
+int verify()
+{
+  int failures = verifyProjection() + verifyPixels();
+  printf("%d failures\n",failures);
+  return (failures > 0) ? 1 : 0;
+}
+
+/* Read the options into the configuration, exiting on any error
+ * @param argc     number of arguments
+ * @param argv     arguments
+ * @param pConfig  configuration to fill in
+ */
+void parseOptions(int argc, char* argv[], TRANSFORM_BENCH_CONFIG_T* pConfig)
+{
+  int i = 0;
+  for (i = 1; i < argc; i++)
+     {
+     if (strcmp(argv[i],"-verify") == 0)
+        exit(verify());
+     else if ((strcmp(argv[i],"-points") == 0) && (i + 1 < argc))
+        {
+	pConfig->count = atoi(argv[++i]);
+	if (pConfig->count < 1)
+	   usage();
+        }
+     else if ((strcmp(argv[i],"-center") == 0) && (i + 1 < argc))
+        {
+	if (sscanf(argv[++i],"%lf,%lf",&pConfig->lon,&pConfig->lat) != 2)
+	   usage();
+        }
+     else if ((strcmp(argv[i],"-spread") == 0) && (i + 1 < argc))
+        pConfig->spread = strtod(argv[++i],NULL);
+     else if ((strcmp(argv[i],"-repeat") == 0) && (i + 1 < argc))
+        pConfig->repeat = atoi(argv[++i]);
+     else if ((strcmp(argv[i],"-seed") == 0) && (i + 1 < argc))
+        pConfig->seed = (unsigned int) atoi(argv[++i]);
+     else
+        usage();
+     }
+  if (pConfig->repeat < 1)
+     pConfig->repeat = 1;
+}
+
+/* Print the fastest of the timings of one transformation
+ * @param label     name of the transformation
+ * @param seconds   fastest time over all repeats
+ * @param count     number of points transformed
+ */
+void reportTime(const char* label, double seconds, int count)
+{
+  printf("  %-28s %10.3f ms  %8.2f ns/point\n",label,seconds * 1000.0,
+	 seconds * 1.0e9 / count);
+}
+
+/* Main function parses the options, generates the points and times
+ * each transformation
+ */
+int main(int argc, char* argv[])
+{
+  TRANSFORM_BENCH_CONFIG_T config;
+  GEOREF_T georef;
+  double* lonLat = NULL;
+  double* xy = NULL;
+  double* back = NULL;
+  int* cols = NULL;
+  int* rows = NULL;
+  double center[2];
+  double best[7];
+  double checksum = 0.0;
+  int r = 0;
+  int i = 0;
+  int j = 0;
+  config.count = 1000000;
+  config.lon = 100.5;
+  config.lat = 13.75;
+  config.spread = 0.05;
+  config.repeat = 3;
+  config.seed = 1;
+  parseOptions(argc,argv,&config);
+
+  lonLat = calloc(2 * config.count,sizeof(double));
+  xy = calloc(2 * config.count,sizeof(double));
+  back = calloc(2 * config.count,sizeof(double));
+  cols = calloc(config.count,sizeof(int));
+  rows = calloc(config.count,sizeof(int));
+  if ((lonLat == NULL) || (xy == NULL) || (back == NULL) || 
+      (cols == NULL) || (rows == NULL))
+     {
+     printf("Error allocating memory for %d points\n",config.count);
+     exit(3);
+     }
+  srand(config.seed);
+  for (i = 0; i < config.count; i++)
+     {
+     lonLat[2*i] = config.lon + (2.0 * uniformRandom() - 1.0) * config.spread;
+     lonLat[2*i + 1] = config.lat + (2.0 * uniformRandom() - 1.0) * config.spread;
+     }
+  /* an image centered on the points, with pixels of 10 meters */
+  center[0] = config.lon;
+  center[1] = config.lat;
+  lonLatToMercator(center,1,center);
+  setGeoref(&georef,center[0],center[1],10.0,10.0,4096,4096);
+
+  for (j = 0; j < 7; j++)
+     best[j] = 1.0e30;
+  for (r = 0; r < config.repeat; r++)
+     {
+     struct timespec start, end;
+     double seconds[7];
+     clock_gettime(CLOCK_MONOTONIC,&start);
+     lonLatToMercator(lonLat,config.count,xy);
+     clock_gettime(CLOCK_MONOTONIC,&end);
+     seconds[0] = elapsedSeconds(&start,&end);
+
+     clock_gettime(CLOCK_MONOTONIC,&start);
+     mercatorToLonLat(xy,config.count,back);
+     clock_gettime(CLOCK_MONOTONIC,&end);
+     seconds[1] = elapsedSeconds(&start,&end);
+
+     clock_gettime(CLOCK_MONOTONIC,&start);
+     worldToPixels(&georef,xy,config.count,cols,rows);
+     clock_gettime(CLOCK_MONOTONIC,&end);
+     seconds[2] = elapsedSeconds(&start,&end);
+
+     clock_gettime(CLOCK_MONOTONIC,&start);
+     for (i = 0; i < config.count; i++)
+        worldToPixels(&georef,xy + 2*i,1,cols + i,rows + i);
+     clock_gettime(CLOCK_MONOTONIC,&end);
+     seconds[3] = elapsedSeconds(&start,&end);
+
+     clock_gettime(CLOCK_MONOTONIC,&start);
+     worldToPixelCoords(&georef,xy,config.count,back);
+     clock_gettime(CLOCK_MONOTONIC,&end);
+     seconds[4] = elapsedSeconds(&start,&end);
+
+     clock_gettime(CLOCK_MONOTONIC,&start);
+     pixelsToWorld(&georef,cols,rows,config.count,back);
+     clock_gettime(CLOCK_MONOTONIC,&end);
+     seconds[5] = elapsedSeconds(&start,&end);
+
+     clock_gettime(CLOCK_MONOTONIC,&start);
+     for (i = 0; i < config.count; i++)
+        pixelsToWorld(&georef,cols + i,rows + i,1,back + 2*i);
+     clock_gettime(CLOCK_MONOTONIC,&end);
+     seconds[6] = elapsedSeconds(&start,&end);
+
+     for (j = 0; j < 7; j++)
+        {
+	if (seconds[j] < best[j])
+	   best[j] = seconds[j];
+        }
+     checksum += back[0] + cols[config.count - 1];
+     }
+  printf("%d points around (%.4f,%.4f), best of %d runs (checksum %.3f)\n",
+	 config.count,config.lon,config.lat,config.repeat,checksum);
+  reportTime("lonLatToMercator",best[0],config.count);
+  reportTime("mercatorToLonLat",best[1],config.count);
+  reportTime("worldToPixels",best[2],config.count);
+  reportTime("worldToPixels, one at a time",best[3],config.count);
+  reportTime("worldToPixelCoords",best[4],config.count);
+  reportTime("pixelsToWorld",best[5],config.count);
+  reportTime("pixelsToWorld, one at a time",best[6],config.count);
+  free(lonLat);
+  free(xy);
+  free(back);
+  free(cols);
+  free(rows);
+  exit(0);
+}
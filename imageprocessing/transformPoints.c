@@ -0,0 +1,134 @@
+/* transformPoints.c
+ *
+ *  Converts points between longitude and latitude (EPSG:4326) and
+ *  Web Mercator meters (EPSG:3857), so that the MapEval server does 
+ *  not need to ask the database to transform single points. Points
+ *  are given as arguments, or if there are none, read from standard
+ *  input one "x y" pair per line. Each converted point is written
+ *  to standard output on a line of its own.
+ *
+ * Copyright 2020 Sally E. Goldin
+ * 
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ * 
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+#include "structures.h"
+#include "transform.h"
+
+/* points converted in one call to the transformation */
+#define POINT_BATCH 1024
+
+void usage()
+{
+  printf("Usage:\n");
+  printf("  transformPoints -forward|-inverse [<x> <y> ...]\n\n");
+  printf("     -forward   - convert longitude and latitude (EPSG 4326) to\n");
+  printf("                  meters (EPSG 3857)\n");
+  printf("     -inverse   - convert meters to longitude and latitude\n");
+  printf("     x y        - points to convert; read from standard input,\n");
+  printf("                  one pair per line, if none are given\n");
+  printf(" Prints each converted point as x y (or longitude latitude)\n\n");
+  exit(0);
+}
+
+/* Convert a batch of points and print them
+ * @param bForward    TRUE to project lon/lat to meters, FALSE for 
+ *                    the inverse
+ * @param points      x and y of each point, interleaved; converted 
+ *                    in place
+ * @param count       number of points
+ */
+void convertPoints(BOOL bForward, double* points, int count)
+{
+  int i = 0;
+  if (bForward)
+     lonLatToMercator(points,count,points);
+  else
+     mercatorToLonLat(points,count,points);
+  /* enough digits to read back exactly the same doubles */
+  for (i = 0; i < count; i++)
+     printf("%.17g %.17g\n",points[2*i],points[2*i + 1]);
+}
+
+/* Main function reads the direction and the points, and converts them
+ * in batches
+ */
+int main(int argc, char* argv[])
+{
+  double points[2*POINT_BATCH];
+  int count = 0;
+  BOOL bForward = TRUE;
+  int i = 0;
+  if (argc < 2)
+     usage();
+  if (strcmp(argv[1],"-forward") == 0)
+     bForward = TRUE;
+  else if (strcmp(argv[1],"-inverse") == 0)
+     bForward = FALSE;
+  else
+     usage();
+  if (argc > 2)
+     {
+     if ((argc % 2) != 0)
+        usage();
+     for (i = 2; i < argc; i += 2)
+        {
+	char* end1 = NULL;
+	char* end2 = NULL;
+	points[2*count] = strtod(argv[i],&end1);
+	points[2*count + 1] = strtod(argv[i + 1],&end2);
+	if ((*end1 != '\0') || (*end2 != '\0'))
+	   {
+	   printf("Invalid point %s %s\n",argv[i],argv[i + 1]);
+	   exit(1);
+	   }
+	count++;
+	if (count == POINT_BATCH)
+	   {
+	   convertPoints(bForward,points,count);
+	   count = 0;
+	   }
+        }
+     }
+  else
+     {
+     char input[256];
+     int lineNum = 0;
+     while (fgets(input,sizeof(input),stdin) != NULL)
+        {
+	lineNum++;
+	if (strspn(input," \t\r\n") == strlen(input))
+	   continue;
+	if (sscanf(input,"%lf %lf",&points[2*count],&points[2*count + 1]) != 2)
+	   {
+	   printf("Invalid point on line %d: %s",lineNum,input);
+	   exit(1);
+	   }
+	count++;
+	if (count == POINT_BATCH)
+	   {
+	   convertPoints(bForward,points,count);
+	   count = 0;
+	   }
+        }
+     }
+  if (count > 0)
+     convertPoints(bForward,points,count);
+  exit(0);
+}
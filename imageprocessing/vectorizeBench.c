@@ -0,0 +1,484 @@
+/*
+ *  vectorizeBench.c
+ *
+ *  Benchmark for guided vectorization. Generates a synthetic road
+ *  raster and a matching set of reference features, then times
+ *  findPoint, followReferenceFeature and the output writers on every
+ *  feature, using the same code as guidedVectorize.
+ *
+ *  Roads are random walks drawn with a fixed line width. The reference
+ *  features are the road vertices, moved by normally distributed
+ *  jitter, so the amount of searching each point needs can be
+ *  controlled. The same seed always gives the same image and features.
+ *
+ *  Reports features per second, vertices per second, the median and
+ *  99th percentile time per feature, and peak resident memory.
+ *
+ *  Copyright 2020 Sally E. Goldin
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <time.h>
+#include <sys/time.h>
+#include <sys/resource.h>
+
+#include "structures.h"
+#include "bitImage.h"
+#include "distanceTransform.h"
+#include "polyline.h"
+#include "outputBuffer.h"
+#include "transform.h"
+#include "featureMatch.h"
+#include "mapeval.h"
+
+#define PI 3.14159265358979323846
+
+/* settings for one benchmark run */
+typedef struct _benchConfig
+{
+  int width;            /* image width in pixels */
+  int height;           /* image height in pixels */
+  double density;       /* roads per million pixels */
+  int lineWidth;        /* width of drawn roads in pixels */
+  double jitter;        /* standard deviation of vertex jitter, pixels */
+  int vertices;         /* vertices per road */
+  int tolerance;        /* search radius in pixels */
+  int repeat;           /* number of times to match all the features */
+  unsigned int seed;    /* random number seed */
+  char* outprefix;      /* if not NULL, write <outprefix>.rgb and .txt */
+  MAPEVAL_OPTIONS_T options;  /* search method and output format */
+} BENCH_CONFIG_T;
+
+/* explain arguments */
+void usage()
+{
+  printf("Usage:\n");
+  printf("  vectorizeBench [options]\n\n");
+  printf("  Options:\n");
+  printf("     -size <w>x<h>     - image size in pixels (default 2048x2048)\n");
+  printf("     -density <d>      - roads per million pixels (default 100)\n");
+  printf("     -linewidth <n>    - road width in pixels (default 3)\n");
+  printf("     -jitter <s>       - standard deviation of reference vertex\n");
+  printf("                         displacement, in pixels (default 1.0)\n");
+  printf("     -vertices <n>     - vertices per road (default 20)\n");
+  printf("     -tolerance <n>    - search radius in pixels (default 5)\n");
+  printf("     -repeat <n>       - match all features n times (default 5)\n");
+  printf("     -seed <n>         - random number seed (default 1)\n");
+  printf("     -nearest          - use the distance transform search\n");
+  printf("     -copy             - time the COPY writer instead of the SQL writer\n");
+  printf("     -write <prefix>   - also write <prefix>.rgb and <prefix>.txt, an image\n");
+  printf("                         and parameter file that guidedVectorize can read\n");
+  exit(0);
+}
+
+/* Return a uniformly distributed random number in [0,1) */
+double uniformRandom()
+{
+  return rand() / ((double) RAND_MAX + 1.0);
+}
+
+/* Return a normally distributed random number with mean 0
+ * (Box-Muller transform)
+ * @param sigma   standard deviation
+ */
+double normalRandom(double sigma)
+{
+  double u1 = uniformRandom();
+  double u2 = uniformRandom();
+  if (sigma <= 0.0)
+     return 0.0;
+  return sigma * sqrt(-2.0 * log(1.0 - u1)) * cos(2.0 * PI * u2);
+}
+
+/* Draw a filled disk of WHITE pixels, clipped to the image
+ * @param pImage   image to draw in
+ * @param cx       center x
+ * @param cy       center y
+ * @param radius   radius in pixels; 0 draws a single pixel
+ */
+void drawDisk(BITIMAGE_T* pImage, int cx, int cy, double radius)
+{
+  int r = (int) ceil(radius);
+  int dx, dy;
+  for (dy = -r; dy <= r; dy++)
+     {
+     for (dx = -r; dx <= r; dx++)
+        {
+	int x = cx + dx;
+	int y = cy + dy;
+	if ((dx*dx + dy*dy > radius*radius + 0.5) ||
+	    (x < 0) || (x >= pImage->width) || (y < 0) || (y >= pImage->height))
+	   continue;
+	setBit(pImage,x,y);
+	}
+     }
+}
+
+/* Draw a road segment 'lineWidth' pixels wide
+ * @param pImage     image to draw in
+ * @param x1,y1      start of segment
+ * @param x2,y2      end of segment
+ * @param lineWidth  road width in pixels
+ */
+void drawSegment(BITIMAGE_T* pImage, double x1, double y1, double x2, double y2,
+		 int lineWidth)
+{
+  double length = sqrt((x2 - x1)*(x2 - x1) + (y2 - y1)*(y2 - y1));
+  int steps = (int) ceil(length * 2) + 1;   /* half pixel steps */
+  double radius = (lineWidth - 1) / 2.0;
+  int i = 0;
+  for (i = 0; i <= steps; i++)
+     {
+     double t = (double) i / steps;
+     drawDisk(pImage,(int) floor(x1 + t*(x2 - x1) + 0.5),
+	      (int) floor(y1 + t*(y2 - y1) + 0.5),radius);
+     }
+}
+
+/* Create the road image and the reference features
+ * @param pConfig    benchmark settings
+ * @param pImage     empty image to draw the roads in
+ * @param pRoadCount returns the number of roads
+ * @return array of reference vertices in pixel coordinates,
+ *         'vertices' x,y pairs per road
+ */
+double* generateRoads(BENCH_CONFIG_T* pConfig, BITIMAGE_T* pImage, int* pRoadCount)
+{
+  int roadCount = (int) (pConfig->density * pConfig->width * pConfig->height / 1.0e6 + 0.5);
+  int nv = pConfig->vertices;
+  double* refs = NULL;
+  int i, j;
+  if (roadCount < 1)
+     roadCount = 1;
+  refs = (double*) calloc((size_t) roadCount * nv * 2,sizeof(double));
+  if (refs == NULL)
+     {
+     printf("Error allocating reference vertices\n");
+     exit(3);
+     }
+  srand(pConfig->seed);
+  for (i = 0; i < roadCount; i++)
+     {
+     double x = uniformRandom() * pConfig->width;
+     double y = uniformRandom() * pConfig->height;
+     double heading = uniformRandom() * 2.0 * PI;
+     double* pRef = refs + (size_t) i * nv * 2;
+     for (j = 0; j < nv; j++)
+        {
+	double nextX, nextY, step;
+	pRef[2*j] = x + normalRandom(pConfig->jitter);
+	pRef[2*j + 1] = y + normalRandom(pConfig->jitter);
+	if (j == nv - 1)
+	   break;
+	/* next vertex 10 to 40 pixels on, turning up to 30 degrees */
+	heading += (uniformRandom() - 0.5) * PI / 3.0;
+	step = 10.0 + uniformRandom() * 30.0;
+	nextX = x + step * cos(heading);
+	nextY = y + step * sin(heading);
+	/* turn back at the edges of the image */
+	if ((nextX < 0) || (nextX >= pConfig->width))
+	   {
+	   heading = PI - heading;
+	   nextX = x - (nextX - x);
+	   }
+	if ((nextY < 0) || (nextY >= pConfig->height))
+	   {
+	   heading = -heading;
+	   nextY = y - (nextY - y);
+	   }
+	drawSegment(pImage,x,y,nextX,nextY,pConfig->lineWidth);
+	x = nextX;
+	y = nextY;
+	}
+     }
+  *pRoadCount = roadCount;
+  return refs;
+}
+
+/* Write the image as 3 bytes per pixel and the reference features
+ * as a text parameter file, so guidedVectorize can be run on the
+ * same data. Pixel coordinates are written as meters with 1 meter
+ * cells centered on 0,0.
+ * @param pConfig    benchmark settings
+ * @param pImage     road image
+ * @param refs       reference vertices from generateRoads
+ * @param roadCount  number of roads
+ * @return TRUE if both files were written
+ */
+BOOL writeBenchFiles(BENCH_CONFIG_T* pConfig, BITIMAGE_T* pImage,
+		     double* refs, int roadCount)
+{
+  char filename[256];
+  FILE* pOut = NULL;
+  BYTE* row = NULL;
+  int x, y, i, j;
+  sprintf(filename,"%s.rgb",pConfig->outprefix);
+  pOut = fopen(filename,"wb");
+  row = (BYTE*) malloc(pImage->width * 3);
+  if ((pOut == NULL) || (row == NULL))
+     {
+     printf("Error opening output image %s\n",filename);
+     free(row);
+     return FALSE;
+     }
+  for (y = 0; y < pImage->height; y++)
+     {
+     for (x = 0; x < pImage->width; x++)
+        row[3*x] = row[3*x + 1] = row[3*x + 2] = bitval(pImage,x,y) ? WHITE : BLACK;
+     fwrite(row,3,pImage->width,pOut);
+     }
+  free(row);
+  fclose(pOut);
+  sprintf(filename,"%s.txt",pConfig->outprefix);
+  pOut = fopen(filename,"w");
+  if (pOut == NULL)
+     {
+     printf("Error opening output parameter file %s\n",filename);
+     return FALSE;
+     }
+  fprintf(pOut,"%d 0.0 0.0 1.0 1.0 1.0 1 %d\n",roadCount,pConfig->tolerance);
+  for (i = 0; i < roadCount; i++)
+     {
+     double* pRef = refs + (size_t) i * pConfig->vertices * 2;
+     fprintf(pOut,"%d",i + 1);
+     for (j = 0; j < pConfig->vertices; j++)
+        fprintf(pOut,"%s%.3lf %.3lf",(j == 0) ? " " : ", ",
+		pRef[2*j] - pImage->width/2,pImage->height/2 - pRef[2*j + 1]);
+     fprintf(pOut,"\n");
+     }
+  fclose(pOut);
+  return TRUE;
+}
+
+/* Convert reference vertices to pixels, the way guidedVectorize
+ * does, and store them in the reference polyline
+ * @param pJob      job holding the georeferencing
+ * @param pRef      road vertices, x,y pairs in pixels
+ * @param count     number of vertices
+ * @param pLine     polyline to fill
+ */
+void loadReference(MAPEVAL_JOB_T* pJob, double* pRef, int count,
+		   POLYLINE_T* pLine)
+{
+  int width = pJob->width;
+  int height = pJob->height;
+  int i = 0;
+  resetPolyline(pLine);
+  reservePolyline(pLine,count);
+  for (i = 0; i < count; i++)
+     {
+     int col, row;
+     double xy[2];
+     xy[0] = pRef[2*i] - width/2;
+     xy[1] = height/2 - pRef[2*i + 1];
+     worldToPixels(&pJob->georef,xy,1,&col,&row);
+     appendPolylinePoint(pLine,col,row,0.0);
+     }
+}
+
+/* Return elapsed time between two clock readings in microseconds */
+double elapsedMicros(struct timespec* pStart, struct timespec* pEnd)
+{
+  return (pEnd->tv_sec - pStart->tv_sec) * 1.0e6 +
+         (pEnd->tv_nsec - pStart->tv_nsec) / 1.0e3;
+}
+
+/* comparison function for sorting latencies */
+int compareDouble(const void* p1, const void* p2)
+{
+  double d1 = *(const double*) p1;
+  double d2 = *(const double*) p2;
+  return (d1 < d2) ? -1 : ((d1 > d2) ? 1 : 0);
+}
+
+/* Return the value at percentile 'p' of a sorted array */
+double percentile(double* sorted, long count, double p)
+{
+  long i = (long) ceil(p / 100.0 * count) - 1;
+  if (i < 0)
+     i = 0;
+  if (i >= count)
+     i = count - 1;
+  return sorted[i];
+}
+
+/* Process the arguments into the configuration
+ * @param argc     Argument count from main
+ * @param argv     Arguments from main
+ * @param pConfig  Settings to update
+ */
+void parseOptions(int argc, char* argv[], BENCH_CONFIG_T* pConfig)
+{
+  int i = 0;
+  for (i = 1; i < argc; i++)
+     {
+     BOOL bValue = (i + 1 < argc);
+     if (strcmp(argv[i],"-nearest") == 0)
+        pConfig->options.searchMode = SEARCH_NEAREST;
+     else if (strcmp(argv[i],"-copy") == 0)
+        pConfig->options.bCopyOutput = TRUE;
+     else if (bValue && (strcmp(argv[i],"-size") == 0))
+        {
+	if (sscanf(argv[++i],"%dx%d",&pConfig->width,&pConfig->height) != 2)
+	   usage();
+	}
+     else if (bValue && (strcmp(argv[i],"-density") == 0))
+        pConfig->density = atof(argv[++i]);
+     else if (bValue && (strcmp(argv[i],"-linewidth") == 0))
+        pConfig->lineWidth = atoi(argv[++i]);
+     else if (bValue && (strcmp(argv[i],"-jitter") == 0))
+        pConfig->jitter = atof(argv[++i]);
+     else if (bValue && (strcmp(argv[i],"-vertices") == 0))
+        pConfig->vertices = atoi(argv[++i]);
+     else if (bValue && (strcmp(argv[i],"-tolerance") == 0))
+        pConfig->tolerance = atoi(argv[++i]);
+     else if (bValue && (strcmp(argv[i],"-repeat") == 0))
+        pConfig->repeat = atoi(argv[++i]);
+     else if (bValue && (strcmp(argv[i],"-seed") == 0))
+        pConfig->seed = (unsigned int) atoi(argv[++i]);
+     else if (bValue && (strcmp(argv[i],"-write") == 0))
+        pConfig->outprefix = argv[++i];
+     else
+        usage();
+     }
+  if ((pConfig->width <= 0) || (pConfig->height <= 0) ||
+      (pConfig->lineWidth < 1) || (pConfig->vertices < 2) ||
+      (pConfig->repeat < 1) || (pConfig->tolerance < 0))
+     usage();
+}
+
+/* Main function generates the data, then matches and writes every
+ * feature 'repeat' times, timing each one.
+ */
+int main(int argc, char* argv[])
+{
+  BENCH_CONFIG_T config;
+  BITIMAGE_T* pImage = NULL;
+  MAPEVAL_JOB_T* pJob = NULL;
+  double* refs = NULL;
+  double* latency = NULL;
+  FEATURE_MATCH_T match;
+  struct timespec start, end, runStart, runEnd;
+  struct rusage resources;
+  int roadCount = 0;
+  int featureCount = 0;
+  long samples = 0;
+  long vertexCount = 0;
+  long matchedCount = 0;
+  double totalSeconds = 0.0;
+  double mapMillis = 0.0;
+  int r, i;
+
+  memset(&config,0,sizeof(config));
+  config.width = 2048;
+  config.height = 2048;
+  config.density = 100.0;
+  config.lineWidth = 3;
+  config.jitter = 1.0;
+  config.vertices = 20;
+  config.tolerance = 5;
+  config.repeat = 5;
+  config.seed = 1;
+  initMapevalOptions(&config.options);
+  parseOptions(argc,argv,&config);
+
+  pJob = newMapevalJob(&config.options,config.width,config.height,NULL);
+  pImage = newBitImage(config.width,config.height);
+  if ((pJob == NULL) || (pImage == NULL))
+     {
+     printf("Error allocating %d x %d image\n",config.width,config.height);
+     exit(3);
+     }
+  /* georeferencing that maps the generated pixels onto themselves */
+  pJob->cellsize = 1.0;
+  setGeoref(&pJob->georef,0.0,0.0,1.0,1.0,config.width,config.height);
+  pJob->pImage = pImage;
+  pJob->tolerance = config.tolerance;
+  pJob->expId = 1;
+  pJob->dataId = 1;
+  refs = generateRoads(&config,pImage,&roadCount);
+  if ((config.outprefix != NULL) &&
+      (!writeBenchFiles(&config,pImage,refs,roadCount)))
+     exit(4);
+  if (config.options.searchMode == SEARCH_NEAREST)
+     {
+     clock_gettime(CLOCK_MONOTONIC,&start);
+     pJob->nearestMap = buildNearestMap(pImage);
+     clock_gettime(CLOCK_MONOTONIC,&end);
+     if (pJob->nearestMap == NULL)
+        exit(3);
+     mapMillis = elapsedMicros(&start,&end) / 1000.0;
+     }
+  latency = (double*) calloc((size_t) roadCount * config.repeat,sizeof(double));
+  pJob->pOut = openOutBuf("/dev/null");
+  pJob->pSql = openOutBuf("/dev/null");
+  if ((latency == NULL) || (pJob->pOut == NULL) || (pJob->pSql == NULL))
+     {
+     printf("Error allocating latency array or opening /dev/null\n");
+     exit(3);
+     }
+  initFeatureMatch(&match);
+  for (r = 0; r < config.repeat; r++)
+     {
+     featureCount = 0;
+     clock_gettime(CLOCK_MONOTONIC,&runStart);
+     for (i = 0; i < roadCount; i++)
+        {
+	loadReference(pJob,refs + (size_t) i * config.vertices * 2,
+		      config.vertices,&match.ref);
+	match.refFeatureId = i + 1;
+	clock_gettime(CLOCK_MONOTONIC,&start);
+	matchFeature(pJob,&match,pImage,config.tolerance);
+	matchedCount += match.line.count;
+	writeFeatureMatch(pJob,&match,&featureCount);
+	clock_gettime(CLOCK_MONOTONIC,&end);
+	latency[samples++] = elapsedMicros(&start,&end);
+	vertexCount += config.vertices;
+	}
+     clock_gettime(CLOCK_MONOTONIC,&runEnd);
+     totalSeconds += elapsedMicros(&runStart,&runEnd) / 1.0e6;
+     }
+  flushOutBuf(pJob->pOut);
+  flushOutBuf(pJob->pSql);
+  qsort(latency,samples,sizeof(double),compareDouble);
+  getrusage(RUSAGE_SELF,&resources);
+
+  printf("image %dx%d, %d roads of %d vertices, line width %d, jitter %.2lf, tolerance %d, %s search, %s output\n",
+	 config.width,config.height,roadCount,config.vertices,config.lineWidth,
+	 config.jitter,config.tolerance,
+	 (config.options.searchMode == SEARCH_NEAREST) ? "nearest" : "spiral",
+	 config.options.bCopyOutput ? "COPY" : "SQL");
+  printf("  %d repeats: %ld features, %ld vertices, %.1lf%% of vertices matched, %d features written per repeat\n",
+	 config.repeat,samples,vertexCount,100.0 * matchedCount / vertexCount,featureCount);
+  if (config.options.searchMode == SEARCH_NEAREST)
+     printf("  distance transform: %.3lf ms\n",mapMillis);
+  printf("  features/s %.0lf   vertices/s %.0lf\n",
+	 samples / totalSeconds,vertexCount / totalSeconds);
+  printf("  per feature: p50 %.2lf us   p99 %.2lf us   max %.2lf us\n",
+	 percentile(latency,samples,50.0),percentile(latency,samples,99.0),
+	 latency[samples - 1]);
+  printf("  peak RSS %ld KB\n",resources.ru_maxrss);
+
+  releasePolylines(pJob,&match);
+  /* closes the output files and frees the image and the map */
+  freeMapevalJob(pJob);
+  free(refs);
+  free(latency);
+  return 0;
+}
@@ -0,0 +1,403 @@
+/* wkbToParam.c
+ *  
+ *  Converts reference features fetched from PostGIS into a binary
+ *  parameter file for guidedVectorize. The georeferencing values
+ *  for the header are given on the command line. Standard input 
+ *  has one row per line: the reference feature Id, a space, and 
+ *  the geometry as hex encoded WKB or EWKB, e.g. from
+ *    encode(ST_AsBinary(geom),'hex')
+ *  Every LINESTRING in the geometry becomes one feature in the output
+ *  (so a MULTILINESTRING produces several features with the same Id).
+ *  Points and polygons are ignored. The refcount in the header is the
+ *  number of rows read, as in the text file written by the server.
+ *  With -cache, the linestrings of a whole uploaded data set are 
+ *  written to a reference cache file (see refCache.h) instead, 
+ *  unclipped, for guidedVectorize -refcache.
+ *  All messages go to stderr, since the server runs this with
+ *  its standard output connected to the HTTP response.
+ *
+ * Copyright 2020 Sally E. Goldin
+ * 
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ * 
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ * 
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+
+#include "structures.h"
+#include "paramReader.h"
+#include "polyline.h"
+#include "refCache.h"
+
+/* WKB geometry types that we need to know about */
+#define WKB_POINT 1
+#define WKB_LINESTRING 2
+#define WKB_POLYGON 3
+#define WKB_MULTIPOINT 4
+#define WKB_MULTILINESTRING 5
+#define WKB_MULTIPOLYGON 6
+#define WKB_COLLECTION 7
+
+/* EWKB flags in the type word */
+#define EWKB_Z 0x80000000
+#define EWKB_M 0x40000000
+#define EWKB_SRID 0x20000000
+
+/* buffer for the x,y coordinates of one linestring */
+double * coords = NULL;
+int coordCapacity = 0;   /* number of points coords can hold */
+
+/* if TRUE, linestrings are collected for a reference cache file
+ * rather than written to a parameter file; set by -cache
+ */
+BOOL bCache = FALSE;
+COORD_LIST_T cachePoints;   /* points of all the lines collected */
+int * cacheRefIds = NULL;   /* reference feature Id of each line */
+int * cacheStarts = NULL;   /* first point of each line, and the end */
+int cacheLines = 0;         /* number of lines collected */
+int cacheCapacity = 0;      /* number of lines the arrays can hold */
+
+void usage()
+{
+  fprintf(stderr,"Convert hex WKB reference features into a binary parameter file for guidedVectorize\n\n");
+  fprintf(stderr,"  wkbToParam <outfile> <centerX> <centerY> <cellsize> <cellsizeX> <cellsizeY> <dataId> <tolerance>\n\n");
+  fprintf(stderr,"     outfile    - binary parameter file to create\n");
+  fprintf(stderr,"     centerX/Y  - coordinates of the image center (EPSG:3857 meters)\n");
+  fprintf(stderr,"     cellsize   - pixel size in meters; cellsizeX, cellsizeY per direction\n");
+  fprintf(stderr,"     dataId     - QueryDataId\n");
+  fprintf(stderr,"     tolerance  - search tolerance in meters\n\n");
+  fprintf(stderr,"  wkbToParam -cache <cachefile> <dataId>\n\n");
+  fprintf(stderr,"     cachefile  - reference cache file to create, holding all the\n");
+  fprintf(stderr,"                  lines unclipped, for guidedVectorize -refcache\n");
+  fprintf(stderr,"     dataId     - uploaddata Id of the reference data set\n\n");
+  fprintf(stderr,"  Standard input has one line per reference feature: <id> <hex WKB>\n");
+  fprintf(stderr,"  with coordinates already in EPSG:3857.\n\n");
+  exit(1);
+}
+
+/* Convert a hex string to bytes, in place
+ * @param hex     NUL terminated hex string; overwritten with the bytes
+ * @return number of bytes, or -1 if the string is not valid hex
+ */
+int hexToBytes(char* hex)
+{
+  unsigned char* bytes = (unsigned char*) hex;
+  int count = 0;
+  while ((hex[0] != '\0') && (hex[1] != '\0'))
+     {
+     int i;
+     int value = 0;
+     for (i = 0; i < 2; i++)
+        {
+	char c = hex[i];
+	value <<= 4;
+	if ((c >= '0') && (c <= '9'))
+	   value |= c - '0';
+	else if ((c >= 'a') && (c <= 'f'))
+	   value |= c - 'a' + 10;
+	else if ((c >= 'A') && (c <= 'F'))
+	   value |= c - 'A' + 10;
+	else
+	   return -1;
+        }
+     bytes[count++] = (unsigned char) value;
+     hex += 2;
+     }
+  if (hex[0] != '\0')
+     return -1;
+  return count;
+}
+
+/* Get a 32 bit unsigned integer in the given byte order
+ * @param bytes       first byte
+ * @param bLittle     TRUE for little endian (NDR), FALSE for big endian (XDR)
+ * @return value
+ */
+unsigned int getWkbInt(unsigned char* bytes, BOOL bLittle)
+{
+  if (bLittle)
+     return bytes[0] | (bytes[1] << 8) | (bytes[2] << 16) | 
+	    ((unsigned int) bytes[3] << 24);
+  return bytes[3] | (bytes[2] << 8) | (bytes[1] << 16) | 
+	 ((unsigned int) bytes[0] << 24);
+}
+
+/* Get a 64 bit double in the given byte order
+ * @param bytes       first byte
+ * @param bLittle     TRUE for little endian (NDR), FALSE for big endian (XDR)
+ * @return value
+ */
+double getWkbDouble(unsigned char* bytes, BOOL bLittle)
+{
+  unsigned long long bits = 0;
+  double value;
+  int i;
+  for (i = 0; i < 8; i++)
+     bits = (bits << 8) | bytes[bLittle ? 7 - i : i];
+  memcpy(&value,&bits,sizeof(value));
+  return value;
+}
+
+/* Add one linestring to the lines collected for the cache
+ * @param refId       reference feature Id
+ * @param count       number of points
+ * @param xy          x and y of each point, interleaved
+ */
+void addCacheLine(int refId, int count, double* xy)
+{
+  int i = 0;
+  if (cacheLines + 1 >= cacheCapacity)
+     {
+     cacheCapacity = (cacheCapacity > 0) ? cacheCapacity * 2 : 1024;
+     cacheRefIds = realloc(cacheRefIds,cacheCapacity * sizeof(int));
+     cacheStarts = realloc(cacheStarts,cacheCapacity * sizeof(int));
+     if ((cacheRefIds == NULL) || (cacheStarts == NULL))
+        {
+	fprintf(stderr,"Error allocating cache index for %d lines\n",cacheCapacity);
+	exit(3);
+        }
+     }
+  cacheRefIds[cacheLines] = refId;
+  cacheStarts[cacheLines] = cachePoints.count;
+  for (i = 0; i < count; i++)
+     appendCoord(&cachePoints,xy[2*i],xy[2*i + 1]);
+  cacheLines++;
+  cacheStarts[cacheLines] = cachePoints.count;
+}
+
+/* Parse one geometry from WKB and write its linestrings. 
+ * Calls itself for the members of multi geometries and collections.
+ * @param bytes       WKB data
+ * @param length      number of bytes of data
+ * @param pOffset     position of the geometry; updated to the byte after it
+ * @param refId       reference feature Id
+ * @param pOut        binary parameter file, NULL if collecting
+ *                    lines for the cache
+ * @return TRUE if successful, FALSE if the WKB is invalid
+ */
+BOOL convertGeometry(unsigned char* bytes, int length, int* pOffset,
+		     int refId, FILE* pOut)
+{
+  int offset = *pOffset;
+  BOOL bLittle;
+  unsigned int type;
+  int baseType;
+  int dims = 2;
+  unsigned int count;
+  unsigned int i;
+  if (offset + 5 > length)
+     return FALSE;
+  bLittle = (bytes[offset] == 1);
+  type = getWkbInt(bytes + offset + 1,bLittle);
+  offset += 5;
+  /* ISO WKB uses 1000s for Z, 2000s for M, 3000s for ZM */
+  baseType = (type & 0x0FFFFFFF) % 1000;
+  switch ((type & 0x0FFFFFFF) / 1000)
+     {
+     case 1:
+     case 2:
+       dims = 3;
+       break;
+     case 3:
+       dims = 4;
+       break;
+     }
+  if (type & EWKB_Z)
+     dims++;
+  if (type & EWKB_M)
+     dims++;
+  if (type & EWKB_SRID)
+     offset += 4;
+  if (baseType == WKB_POINT)
+     {
+     offset += dims * 8;
+     }
+  else
+     {
+     if (offset + 4 > length)
+        return FALSE;
+     count = getWkbInt(bytes + offset,bLittle);
+     offset += 4;
+     if (baseType == WKB_LINESTRING)
+        {
+	if ((count > (unsigned int) (length - offset) / (dims * 8)))
+	   return FALSE;
+	if ((int) count > coordCapacity)
+	   {
+	   coordCapacity = count;
+	   coords = realloc(coords,2 * count * sizeof(double));
+	   if (coords == NULL)
+	      {
+	      fprintf(stderr,"Error allocating coordinates for %u points\n",count);
+	      exit(3);
+	      }
+	   }
+	for (i = 0; i < count; i++)
+	   {
+	   coords[2*i] = getWkbDouble(bytes + offset,bLittle);
+	   coords[2*i + 1] = getWkbDouble(bytes + offset + 8,bLittle);
+	   offset += dims * 8;
+	   }
+	if ((count > 0) && (bCache))
+	   {
+	   addCacheLine(refId,count,coords);
+	   }
+	else if (count > 0)
+	   {
+	   if (!writeParamFeature(pOut,refId,count,coords))
+	      {
+	      fprintf(stderr,"Error writing parameter file - errno is %d\n",errno);
+	      exit(2);
+	      }
+	   }
+	}
+     else if (baseType == WKB_POLYGON)
+        {
+	for (i = 0; i < count; i++)
+	   {
+	   unsigned int points;
+	   if (offset + 4 > length)
+	      return FALSE;
+	   points = getWkbInt(bytes + offset,bLittle);
+	   offset += 4;
+	   if (points > (unsigned int) (length - offset) / (dims * 8))
+	      return FALSE;
+	   offset += points * dims * 8;
+	   }
+	}
+     else if ((baseType == WKB_MULTIPOINT) || (baseType == WKB_MULTILINESTRING) ||
+	      (baseType == WKB_MULTIPOLYGON) || (baseType == WKB_COLLECTION))
+        {
+	for (i = 0; i < count; i++)
+	   {
+	   if (!convertGeometry(bytes,length,&offset,refId,pOut))
+	      return FALSE;
+	   }
+	}
+     else
+        {
+	return FALSE;
+        }
+     }
+  if (offset > length)
+     return FALSE;
+  *pOffset = offset;
+  return TRUE;
+}
+
+/* Read the reference features from standard input, converting 
+ * each one.
+ * @param pOut        binary parameter file, NULL if collecting
+ *                    lines for the cache
+ * @return number of rows read
+ */
+int readRows(FILE* pOut)
+{
+  char* line = NULL;
+  size_t lineSize = 0;
+  int lineNum = 0;
+  int rowCount = 0;
+  while (getline(&line,&lineSize,stdin) > 0)
+     {
+     char* hex = NULL;
+     int refId = 0;
+     int length = 0;
+     int offset = 0;
+     lineNum++;
+     line[strcspn(line,"\r\n")] = '\0';
+     if (line[0] == '\0')
+        continue;
+     hex = strchr(line,' ');
+     if ((hex == NULL) || (sscanf(line,"%d",&refId) != 1))
+        {
+	fprintf(stderr,"Line %d: expected <id> <hex WKB>\n",lineNum);
+	exit(3);
+        }
+     hex++;
+     /* PostgreSQL bytea output may have a \x prefix */
+     if ((hex[0] == '\\') && (hex[1] == 'x'))
+        hex += 2;
+     length = hexToBytes(hex);
+     if (length < 0)
+        {
+	fprintf(stderr,"Line %d: invalid hex WKB\n",lineNum);
+	exit(3);
+        }
+     /* an empty geometry (NULL from the DB) still counts as a row */
+     if ((length > 0) &&
+	 (!convertGeometry((unsigned char*) hex,length,&offset,refId,pOut)))
+        {
+	fprintf(stderr,"Line %d: invalid or unsupported WKB geometry\n",lineNum);
+	exit(3);
+        }
+     rowCount++;
+     }
+  free(line);
+  return rowCount;
+}
+
+int main(int argc, char* argv[])
+{
+  PARAM_HEADER_T header;
+  FILE* pOut = NULL;
+  if ((argc == 4) && (strcmp(argv[1],"-cache") == 0))
+     {
+     int rowCount = 0;
+     bCache = TRUE;
+     memset(&cachePoints,0,sizeof(cachePoints));
+     rowCount = readRows(NULL);
+     if (!writeRefCache(argv[2],atoi(argv[3]),rowCount,cacheLines,
+			cacheRefIds,cacheStarts,&cachePoints))
+        {
+	fprintf(stderr,"Error writing reference cache %s - errno is %d\n",argv[2],errno);
+	exit(2);
+        }
+     free(cacheRefIds);
+     free(cacheStarts);
+     freeCoordList(&cachePoints);
+     free(coords);
+     return 0;
+     }
+  if (argc != 9)
+     usage();
+  memset(&header,0,sizeof(header));
+  header.centerX = atof(argv[2]);
+  header.centerY = atof(argv[3]);
+  header.cellsize = atof(argv[4]);
+  header.cellsizeX = atof(argv[5]);
+  header.cellsizeY = atof(argv[6]);
+  header.dataId = atoi(argv[7]);
+  header.tolerance = atoi(argv[8]);
+  pOut = fopen(argv[1],"wb");
+  if (pOut == NULL)
+     {
+     fprintf(stderr,"Error opening output file %s - errno is %d\n",argv[1],errno);
+     exit(2);
+     }
+  /* write a header now to reserve the space; it is rewritten 
+   * with the row count at the end 
+   */
+  writeParamHeader(pOut,&header);
+  header.refcount = readRows(pOut);
+  free(coords);
+  if ((fseek(pOut,0,SEEK_SET) != 0) || (!writeParamHeader(pOut,&header)) ||
+      (fclose(pOut) != 0))
+     {
+     fprintf(stderr,"Error writing parameter file %s - errno is %d\n",argv[1],errno);
+     exit(2);
+     }
+  return 0;
+}
@@ -284,6 +284,7 @@ create table experiment (id serial primary key,
 			 averagedistance integer,
 			 averagedelta integer,
 			 experimentname varchar(256) default 'Not specified',
+			 vectorizestats jsonb,
 			 created timestamp default current_timestamp);
 
 
@@ -303,12 +304,21 @@ create table pointmatch (experimentid integer references experiment(id),
 --      targetid is feature ID of querylines element, or 0 if not found
 -- 	distance is Hausdorf distance between the two lines or -1 if no match
 --      deltalength is length of reference feature minus length of target feature
+--      frechet is discrete Frechet distance between the two lines or -1 if no match
 --------------------------------------------------
 create table linematch (experimentid integer references experiment(id),
                          refid integer,
 			 targetid integer default 0,
 			 distance float default -1,
-			 deltalength float);
+			 deltalength float,
+			 frechet float default -1);
+
+--------------------------------------------------
+-- Columns added since the first release. Running this script on an
+-- existing database adds them to the tables it already has
+--------------------------------------------------
+alter table experiment add column if not exists vectorizestats jsonb;
+alter table linematch add column if not exists frechet float default -1;
 
 
 
@@ -317,6 +317,7 @@ my $wwwuser = 'apache';
 my $dbname = 'mapevaldata';
 my $homedir = "../../html/MapEval";
 my $tmpdir = "$homedir/tmpdata";
+my $refcachedir = "$homedir/refcache";
 my $logfile = "/tmp/mapeval.log";
 my $server_root = "http://$site/";
 my $scriptName = "http:mapevalServer.pl";
@@ -923,8 +924,7 @@ sub _calcPixSize
 	logentry("Error - conversion of $imgfilename to RGB failed");
 	rollbackAndError("Image conversion to RGB failed");
     }
-    # convert the box bounds to 3857
-    my ($nw_x,$nw_y,$se_x,$se_y);
+    # the box bounds are projected to 3857 by calcPixelSize itself
     my $boxsize = 0.001;
     if ($zoom > 14)  # MUST keep logic in sync with map_API_calls.js: calcBoxSize()
     {
@@ -934,33 +934,14 @@ sub _calcPixSize
     my $selng = $lng + $boxsize;
     my $nwlat = $lat + $boxsize;
     my $selat = $lat - $boxsize;
-    my ($nw_x,$nw_y,$se_x,$se_y);
-    my $sqlcommand = "select ST_AsText(ST_Transform(ST_SetSRID(ST_Point($nwlng, $nwlat),4326),3857)), ST_AsText(ST_Transform(ST_SetSRID(ST_Point($selng, $selat),4326),3857));";
-    my $stmt = $gDbh->prepare($sqlcommand);
-    my $numrows = $stmt->execute;
-    my $gSqlError= $gDbh->err;
-    if ($gSqlError != 0)
+    logentry("About to execute:\n$homedir/calcPixelSize 512 512 $outputfile $nwlng $nwlat $selng $selat -lonlat\n"); 
+    my $returnline = `$homedir/calcPixelSize 512 512 $outputfile $nwlng $nwlat $selng $selat -lonlat`;
+    logentry("Pixel size calculation returned is $returnline");
+    if ($returnline eq '')
     {
-	rollbackAndError;
-    }
-    if ($numrows > 0)
-    {
-	my @row  = $stmt->fetchrow_array;
-	my $nwpoint = $row[0]; 
-	my $sepoint = $row[1]; 
-	$nwpoint =~ /POINT\((\-?\d+.\d+) (\-?\d+.\d+)/; 
-	($nw_x, $nw_y) = ($1, $2);
-	$sepoint =~ /POINT\((\-?\d+.\d+) (\-?\d+.\d+)/; 
-	($se_x, $se_y) = ($1, $2);
-	logentry("About to execute:\n$homedir/calcPixelSize 512 512 $outputfile $nw_x $nw_y $se_x $se_y\n"); 
-	my $returnline = `$homedir/calcPixelSize 512 512 $outputfile $nw_x $nw_y $se_x $se_y`;
-	logentry("Pixel size calculation returned is $returnline");
-	if ($returnline eq '')
-	{
-	    rollbackAndError("Cannot calculate pixel size - probably no box overlay");
-	}
-	@pixsize = split(/[\s]+/,$returnline);
+	rollbackAndError("Cannot calculate pixel size - probably no box overlay");
     }
+    @pixsize = split(/[\s]+/,$returnline);
     return @pixsize;
 }
 # Store data returned from an online provider query
@@ -1115,8 +1096,44 @@ sub newQueryData
 	# get the center as both lng/lat and web mercator
 	#$sqlcommand = "select ST_AsText(center),ST_AsText(ST_Transform(center,3857)) from regions where id = $regionid;";
 	## 15 Oct 2019 New
-	## Use passed center but use PostGIS to transform to web mercator
-	$sqlcommand = "select ST_AsText(ST_Transform(ST_SetSRID(ST_Point($center_x, $center_y),4326),3857))";
+	## Use passed center but transform it to web mercator ourselves,
+	## rather than asking PostGIS to transform one point
+	my ($x, $y) = split(/\s+/,`$homedir/transformPoints -forward $center_x $center_y`);
+	if (($? != 0) || (!defined($y)))
+	{
+	    logentry("Error - cannot transform center $center_x $center_y to web mercator");
+	    rollbackAndError("Cannot transform image center to web mercator");
+	}
+	my ($lng, $lat) = ($center_x,$center_y);
+	#my $pixsize = (156543.03392 * cos(deg2rad($lat))) / (2**($zoom));  # Does this assume a 256 pixel tile?
+	my @pixelsizes = _calcPixSize($imgfilename,$lng,$lat,$zoom);
+	my $pixsize = $pixelsizes[0];
+	my $pixsizeX = $pixelsizes[1];
+	my $pixsizeY = $pixelsizes[2];
+	# assume all images are 512x512 so the origin will be the
+	# center minus 256 * pixelsize (for x; + for y)
+	# 21 July 2020 - investigating different X & Y pixel sizes
+	# Seemed to make accuracy worse so revert to using the average for calculations
+	# However, we still save the different values in the DB
+	my $originx = $x - (256 * $pixsize);
+	my $originy = $y + (256 * $pixsize);
+	my $se_x = $originx + 512 * $pixsize;
+	my $se_y = $originy - 512 * $pixsize;
+	# the corners go back to lng/lat the same way; the box edges
+	# stay straight lines, as ST_Transform of the polygon left them
+	my @corners = split(/\s+/,`$homedir/transformPoints -inverse $originx $originy $se_x $originy $se_x $se_y $originx $se_y`);
+	if (($? != 0) || (scalar(@corners) != 8))
+	{
+	    logentry("Error - transformPoints returned '@corners' for the bounding box");
+	    rollbackAndError("Cannot transform bounding box to lat/long");
+	}
+	my $bbPolyText = "ST_GeomFromText(\'POLYGON(($corners[0] $corners[1],
+                                  $corners[2] $corners[3],
+                                  $corners[4] $corners[5],
+                                  $corners[6] $corners[7],
+                                  $corners[0] $corners[1]))\',4326)";
+
+	$sqlcommand = "update querydata set zoom=$zoom, origin_x = $originx, origin_y = $originy, center_x = $x, center_y = $y, center_lng = $center_x, center_lat = $center_y, pixelsize=$pixsize, pixelsizex=$pixsizeX, pixelsizey=$pixsizeY, boundingbox=$bbPolyText where id = $dataId;";
 	$stmt = $gDbh->prepare($sqlcommand);
 	$numrows = $stmt->execute;
 	$gSqlError= $gDbh->err;
@@ -1125,45 +1142,6 @@ sub newQueryData
 	{
 	    rollbackAndError;
 	}
-	if ($numrows > 0)
-	{
-	    my @row  = $stmt->fetchrow_array;
-	    my $mcenter = $row[0];   # center in web mercator/meters
-	    #$llcenter =~ /POINT\((\-?\d+.\d+) (\-?\d+.\d+)/; 
-	    my ($lng, $lat) = ($center_x,$center_y);
-	    #my $pixsize = (156543.03392 * cos(deg2rad($lat))) / (2**($zoom));  # Does this assume a 256 pixel tile?
-	    my @pixelsizes = _calcPixSize($imgfilename,$lng,$lat,$zoom);
-	    my $pixsize = $pixelsizes[0];
-	    my $pixsizeX = $pixelsizes[1];
-	    my $pixsizeY = $pixelsizes[2];
-	    $mcenter =~ /POINT\((\-?\d+.\d+) (\-?\d+.\d+)/; 
-	    my ($x, $y) = ($1, $2);
-            # assume all images are 512x512 so the origin will be the
-            # center minus 256 * pixelsize (for x; + for y)
-	    # 21 July 2020 - investigating different X & Y pixel sizes
-	    # Seemed to make accuracy worse so revert to using the average for calculations
-	    # However, we still save the different values in the DB
-	    my $originx = $x - (256 * $pixsize);
-	    my $originy = $y + (256 * $pixsize);
-	    my $se_x = $originx + 512 * $pixsize;
-	    my $se_y = $originy - 512 * $pixsize;
-	    my $bbPolyText = "ST_Transform(ST_GeomFromText(\'POLYGON(($originx $originy,
-                                  $se_x $originy,
-                                  $se_x $se_y,
-                                  $originx $se_y,
-                                  $originx $originy))\',3857),4326)";
-
-	    $sqlcommand = "update querydata set zoom=$zoom, origin_x = $originx, origin_y = $originy, center_x = $x, center_y = $y, center_lng = $center_x, center_lat = $center_y, pixelsize=$pixsize, pixelsizex=$pixsizeX, pixelsizey=$pixsizeY, boundingbox=$bbPolyText where id = $dataId;";
-	    $stmt = $gDbh->prepare($sqlcommand);
-	    $numrows = $stmt->execute;
-	    $gSqlError= $gDbh->err;
-	    $gSqlErrorStr = $gDbh->errstr;
-	    if ($gSqlError != 0)
-	    {
-		rollbackAndError;
-	    }
-	}
-
     }
     execSqlCommand("COMMIT;");
     # Points were stored without error so construct the return value as a hash
@@ -1392,6 +1370,78 @@ sub _execSqlFile
     close $fh;
 }
 
+# Bulk load rows written in COPY text format by one of the
+# image processing programs into a table with a single COPY.
+# Arguments (passed)
+#     $copyfile       Path and filename of the COPY data file
+#     $target         Table name and column list to copy into
+sub _copyRows
+{
+    my ($copyfile,$target) = @_;
+    my $fh;
+    if (!open($fh, '<', $copyfile))
+    {
+	sendJsonError("Cannot open the COPY file $copyfile\n");
+    }
+    my $sqlcommand = "COPY $target FROM STDIN;";
+    logentry("In _copyRows - About to execute: |$sqlcommand|\n");
+    $gDbh->do($sqlcommand);
+    $gSqlError= $gDbh->err;
+    $gSqlErrorStr = $gDbh->errstr;
+    if ($gSqlError != 0)
+    {
+	rollbackAndError;
+    }
+    while (my $row = <$fh>)
+    {
+	$gDbh->pg_putcopydata($row);
+    }
+    close $fh;
+    $gDbh->pg_putcopyend();
+    $gSqlError= $gDbh->err;
+    $gSqlErrorStr = $gDbh->errstr;
+    if ($gSqlError != 0)
+    {
+	rollbackAndError;
+    }
+}
+
+# Bulk load the query lines written by guidedVectorize -copy
+# into the querylines table.
+# Arguments (passed)
+#     $copyfile       Path and filename of the COPY data file
+sub _copyQueryLines
+{
+    my $copyfile = shift;
+    _copyRows($copyfile,"querylines (experimentid,dataid,uploadfeatureid,refpointcount,matchpercent,meandistance,stdevdistance,geom)");
+}
+
+# Store the per-stage timings and counts written by guidedVectorize -stats
+# with the experiment. Missing statistics are not an error.
+# Arguments (passed)
+#     $experimentId   DB Id of the experiment
+#     $statsfile      Path and filename of the JSON statistics file
+sub _storeVectorizeStats
+{
+    my ($experimentId,$statsfile) = @_;
+    my $fh;
+    if (!open($fh, '<', $statsfile))
+    {
+	logentry("No vectorization statistics in $statsfile\n");
+	return;
+    }
+    local $/;
+    my $stats = <$fh>;
+    close $fh;
+    my $sqlcommand = "update experiment set vectorizestats = ? where id = ?;";
+    logentry("In _storeVectorizeStats - About to execute: |$sqlcommand| with |$stats|\n");
+    execPreparedSqlCommand($sqlcommand,$stats,$experimentId);
+    if ($gSqlError != 0)
+    {
+	rollbackAndError;
+    }
+}
+
 # Import the shapefile and store the points or lines in the
 # database, associated with a specific upload data set.
 # Arguments (passed)
@@ -1584,6 +1634,9 @@ sub newUploadData
 	my @row  = $stmt->fetchrow_array;
 	$dataId = $row[0];
     }
+    # any reference cache left from an earlier data set with this Id
+    # is stale
+    _removeRefCache($dataId);
     if ($fileformat =~ /^kml$/i )
     {
         # parse and store the KML file
@@ -1786,46 +1839,47 @@ sub _getDataCategory
 	
 }
 
-# try to match two strings (one from reference, one from target)
-# Return a 'match goodness' value (floating point) which is
-# percent of words in strings matched. Will return 0 if either
-# name is empty, 1.0 for a perfect (case insensitive) match
+# Write the points of one data set that fall within the region
+# to a file in COPY text format (id, longitude, latitude, name)
+# for pointMatch.
 # Arguments
-#     refstring            String that provides reference data
-#     chkstring            String we are trying to match
-# Return match score
-sub _matchStrings
-{
-    my ($refstring,$chkstring) = @_;
-    my $score = 0.0;
-    my $score1 = 0.0;
-    my $score2 = 0.0;
-    return $score if (($refstring eq '') or ($chkstring eq ''));
-    my @refwords = split(/ /,$refstring);
-    my $rwcount = @refwords;
-    my @chkwords = split(/ /,$chkstring);
-    my $cwcount = @chkwords;
-    my $matchcount = 0;
-    foreach my $w (@refwords)
-    {
-	$w =~ s/\(|\)//g;  # get rid of parens
-	$matchcount++ if ($chkstring =~ /$w/i);
-    }
-    $score1 = $matchcount / $rwcount;
-    $matchcount = 0;
-    foreach my $w (@chkwords)
-    {
-	$w =~ s/\(|\)//g;  # get rid of parens
-	$matchcount++ if ($refstring =~ /$w/i);
-    }
-    $score2 = $matchcount / $cwcount;
-    $score = max($score1,$score2);
-    return $score;
+#          table                           uploadpoints or querypoints
+#          dataid                          ID of the data set
+#          regionid                        Id of region, used to filter the points
+#          pointfile                       Path and filename of the file to write
+# Return the number of points written
+sub _exportPoints
+{
+    my ($table,$dataId,$regionId,$pointfile) =  @_;
+    my $fh;
+    if (!open($fh, '>', $pointfile))
+    {
+	rollbackAndError("Cannot create the point file $pointfile");
+    }
+    my $sqlcommand = "COPY (select $table.id,ST_X($table.geom),ST_Y($table.geom),$table.featurename from $table,regions where dataid = $dataId and regions.id=$regionId and ST_Within($table.geom,regions.boundingbox)) TO STDOUT;";
+    logentry("In _exportPoints - About to execute: |$sqlcommand|\n");
+    $gDbh->do($sqlcommand);
+    $gSqlError= $gDbh->err;
+    $gSqlErrorStr = $gDbh->errstr;
+    if ($gSqlError != 0)
+    {
+	rollbackAndError;
+    }
+    my $row = "";
+    my $count = 0;
+    while ($gDbh->pg_getcopydata($row) >= 0)
+    {
+	print $fh $row;
+	$count++;
+    }
+    close $fh;
+    return $count;
 }
 
 # Get the point information from the requested data sets and
 # try to find matches for each reference point, based on distance and
-# name. Populates the "pointmatch" table in the DB
+# name. The points are exported to files and matched by pointMatch;
+# the matches are loaded into the "pointmatch" table in the DB
 #  Arguments
 #          experimentid                    ID of row for this experiment
 #          refdataid                       ID of the reference data set
@@ -1843,179 +1897,40 @@ sub _getAndMatchPoints
     $refTable = "querypoints" if $refQuery eq "true";
     my $targetTable = "uploadpoints";
     $targetTable = "querypoints" if $targetQuery eq "true";
-    #start by getting all the reference points
-    my @refPoints;
-    my @refNames;
-    my %ref2targetDistance; # hash that maps joint reference ID/target ID key to interpoint distance
-    my %ref2targetName;     # hash that maps joint refernence ID/target ID key to interpoint name match score
-    my $sqlcommand = "select $refTable.id,$refTable.featurename from $refTable,regions where dataid = $refId and regions.id=$regionId and ST_Within($refTable.geom,regions.boundingbox);";
-    logentry("About to execute: |$sqlcommand|\n");
-    my $stmt = $gDbh->prepare($sqlcommand);
-    my $numrows = $stmt->execute;
-    $gSqlError= $gDbh->err;
-    $gSqlErrorStr = $gDbh->errstr;
-    if ($gSqlError != 0)
-    {
-	sendJsonError($gSqlErrorStr); # dies after sending the error
-    }
-    for (my $i = 0; $i < $numrows; $i++)
-    {
-	my @row  = $stmt->fetchrow_array;
-	push @refPoints,$row[0];
-	push @refNames,$row[1];
-    }
-    if ($numrows == 0)
+    my $refFile = "$tmpdir/refpoints$experimentId.txt";
+    my $targetFile = "$tmpdir/targetpoints$experimentId.txt";
+    my $refcount = _exportPoints($refTable,$refId,$regionId,$refFile);
+    if ($refcount == 0)
     {
 	rollbackAndError("There are no points in the reference data set");
     }
-    #do the same thing for the target points
-    my @targetPoints;
-    my @targetNames;
-    my $sqlcommand = "select $targetTable.id,$targetTable.featurename from $targetTable,regions where dataid = $targetId and regions.id=$regionId and ST_Within($targetTable.geom,regions.boundingbox);";
-    logentry("About to execute: |$sqlcommand|\n");
-    my $stmt = $gDbh->prepare($sqlcommand);
-    my $numrows = $stmt->execute;
-    $gSqlError= $gDbh->err;
-    $gSqlErrorStr = $gDbh->errstr;
-    if ($gSqlError != 0)
-    {
-	rollbackAndError;  # dies after sending the error
-    }
-    for (my $i = 0; $i < $numrows; $i++)
-    {
-	my @row  = $stmt->fetchrow_array;
-	push @targetPoints,$row[0];
-	push @targetNames,$row[1];
-    }
-    if ($numrows == 0)
+    my $targetcount = _exportPoints($targetTable,$targetId,$regionId,$targetFile);
+    if ($targetcount == 0)
     {
 	rollbackAndError("There are no points in the target data set");
     }
-    #now go through the reference point array and calculate the distance to each target point
-    #looking for the min distance - must be less than the threshold
-    my $refcount = @refPoints;
-    my $targetcount = @targetPoints;
     logentry("There are $refcount reference points and $targetcount target points\n");
     # add counts to the DB record
-    $sqlcommand = "update experiment set ref_featurecount=$refcount, target_featurecount = $targetcount where id=$experimentId;";
+    my $sqlcommand = "update experiment set ref_featurecount=$refcount, target_featurecount = $targetcount where id=$experimentId;";
     logentry("About to execute: |$sqlcommand|\n");
     execSqlCommand($sqlcommand);
     if ($gSqlError != 0)
     {
 	rollbackAndError;
     }
-    my $rCount = 0;
-    foreach my $RID (@refPoints)
+    my $options = "";
+    $options = "-names" if ($nameflag eq 'true');
+    my $matchPrefix = "$tmpdir/pointmatch$experimentId";
+    logentry("About to execute:\n$homedir/pointMatch $refFile $targetFile $threshold $experimentId $matchPrefix $options\n");
+    my $results = `$homedir/pointMatch $refFile $targetFile $threshold $experimentId $matchPrefix $options`;
+    if (($? != 0) || ($results ne ""))
     {
-	my $maxDistance = 50000;
-	my $minID = -1;
-	my $metascore = 0;
-	my $tCount = 0;
-	foreach my $TID (@targetPoints)
-	{
-	    my $distance;
-	    $sqlcommand = "select ST_DistanceSpheroid(ref.geom,target.geom,'SPHEROID[\"WGS 84\",6378137,298.257223563]') from $refTable as ref,$targetTable as target where ref.id=$RID and target.id=$TID;";
-	    logentry("About to execute: |$sqlcommand|\n");
-	    $stmt = $gDbh->prepare($sqlcommand);
-	    $numrows = $stmt->execute;
-	    $gSqlError= $gDbh->err;
-	    $gSqlErrorStr = $gDbh->errstr;
-	    if ($gSqlError != 0)
-	    {
-		sendJsonError($gSqlErrorStr); # dies after sending the error
-	    }
-	    if ($numrows > 0)
-	    {
-		my @row  = $stmt->fetchrow_array;
-		$distance = $row[0];
-		$metascore = _matchStrings($refNames[$rCount],$targetNames[$tCount]);
-		my $keystring = "$RID-$TID";
-		$ref2targetDistance{$keystring} = $distance; 
-		$ref2targetName{$keystring} = $metascore;
-		$tCount++;  
-	    } #endif got some rows
-	    else
-	    {
-		sendJsonError("_getAndMatchPoints distance calculation returns 0 rows"); # dies after sending the error
-	    }
-	} #end loop through target IDs
-	$rCount++;
-    } #end loop through reference IDs
-    #now sort the keys based on distance & name match - distances ascending, names descending
-    my @closest = sort { $ref2targetDistance{$a} <=> $ref2targetDistance{$b} } keys %ref2targetDistance;
-    my $keycount = @closest;
-    my @scores = sort { $ref2targetName{$b} <=> $ref2targetName{$a} } keys %ref2targetName;
-    #Run through the reference IDs again. Pick the closest target point. If less than threshold
-    #then remove all other combinations that use that target point so we cannot get any duplicates
-    my $arraylen = @closest;
-    foreach my $RID (@refPoints)
-    {
-	logentry("Matching refId $RID\n");
-	my $TID = "";
-	my $altTID = "";
-	my $maxDistance = 50000;
-	my $metascore = 0;
-	my $altMetascore = 0;
-        my $compoundKey;
-	my $altCompoundKey;
-	my $distance;
-	foreach (@closest)
-	{
-	    if ($_ =~ /^$RID/)
-	    {
-		$compoundKey = $_;
-		last;
-	    }
-	}
-	$compoundKey =~ /[-](\d+)/; 
-	last if ((!$compoundKey) || ($compoundKey eq '')); # we have used up all the target points
-        $TID = $1;
-	$distance = $ref2targetDistance{$compoundKey};
-	$metascore = $ref2targetName{$compoundKey};
-	if (($nameflag eq 'true') && ($metascore != 1.0))
-	{
-	    foreach (@scores)
-	    {
-
-		if ($_ =~ /^$RID/)
-		{
-		$altCompoundKey = $_;
-		last;
-		}
-	    }
-	    $altMetascore = $ref2targetName{$altCompoundKey};
-	    if ($altMetascore == 1.0)
-	    {
-		$altCompoundKey =~ /[-](\d+)/; 
-		$altTID = $1;
-		if ($altTID ne $TID)
-		{
-		    $TID = $altTID;
-		    $distance = $ref2targetDistance{$altCompoundKey};
-		    $metascore = $altMetascore;
-		}
-	    }
-	}    
-	if ($distance > $threshold)  #Q: should we consider the threshold if name match?
-	{
-	    $distance = $maxDistance;
-	    $TID = -1;
-	}
-	#store results in the pointmatch table
-	$sqlcommand = "insert into pointmatch (experimentid,refid,targetid,distance,metascore) values ($experimentId,$RID,$TID,$distance,$metascore);";
-	logentry("About to execute: |$sqlcommand|\n");
-	execSqlCommand($sqlcommand);
-	if ($gSqlError != 0)
-	{
-	    rollbackAndError;
-	}
-	# now clean up all references to $TID in the array - we can just set them to a dummy key so they won't match
-	for (my $i = 0; $i < $arraylen; $i++)
-	{
-	    $closest[$i] = 'DUMMY' if ($closest[$i] =~ /[-]$TID/);  #matches target ID
-	    $scores[$i] = 'DUMMY' if ($scores[$i] =~ /[-]$TID/);  #matches target ID
-	}
-    } #end reference ID loop
+	rollbackAndError("Cannot execute pointMatch -- Error is |$results|");
+    }
+    unlink($refFile,$targetFile);
+    #store results in the pointmatch table
+    _copyRows("$matchPrefix.copy","pointmatch (experimentid,refid,targetid,distance,metascore)");
+    unlink("$matchPrefix.copy");
 }
 
 # Receive pairs of matched points as JSON.
@@ -2114,9 +2029,10 @@ sub _storePointsAndDistances
     }  
 }
 
-# Create a file with the parameters necessary to do guided vectorization
-# Includes georeferencing parameters plus id and  coordinates
-# of each road in the uploadlines table.
+# Create a file with the parameters necessary to do guided vectorization.
+# It holds only the georeferencing parameters; guidedVectorize takes
+# the roads from the reference cache (see _getRefCache) and clips
+# them to the image itself.
 # Arguments (passed)
 #    experimentid         Id of the experiment
 #    threshold            Buffer size in meters
@@ -2127,7 +2043,7 @@ sub _writeParamFile
 {
    my ($experimentId,$threshold,$refId,$targetId) =  @_;
    my ($xcenter,$ycenter,$size,$sizex,$sizey,$count,$bb,$bb_binary);
-   my $filename = "$tmpdir/Param$refId.$targetId.txt";
+   my $filename = "$tmpdir/Param$refId.$targetId.bin";
    logentry("Creating filename |$filename|\n");
    my $sqlcommand = "select center_x,center_y,pixelsize,pixelsizex, pixelsizey, boundingbox,ST_AsText(boundingbox) as bb from querydata where id=$targetId;";
    logentry("About to execute: |$sqlcommand|\n");
@@ -2150,11 +2066,29 @@ sub _writeParamFile
        $sizey = $size;
    }
 
-   # QUERY TO GET ONLY START AND END POINTS
-   #$sqlcommand = "select id, ST_AsText(ST_Transform(ST_StartPoint(ST_Intersection(geom,\'$bb_binary\')),3857)) as start, ST_AsText(ST_Transform(ST_EndPoint(ST_Intersection(geom,\'$bb_binary\')),3857)) as end from uploadlines where dataid=$refId and ST_Intersects(geom,\'$bb_binary\');";
-   # QUERY TO GET FULL INTERSECTION, ALL POINTS
-   $sqlcommand =  "with vars as (select boundingbox from querydata where id=$targetId) select id, ST_AsText(ST_Transform(ST_Intersection(geom,vars.boundingbox),3857)) from uploadlines, vars where dataid=$refId and ST_Intersects(geom,vars.boundingbox);";
-   #$sqlcommand = "select id, ST_AsText(ST_Transform(ST_Intersection(geom,\'$bb_binary\'),3857)) from uploadlines where dataid=$refId and ST_Intersects(geom,\'$bb_binary\');";
+   # with no features on its input wkbToParam writes just the header
+   open(my $converter, "|-", "$homedir/wkbToParam", $filename,
+	$xcenter, $ycenter, $size, $sizex, $sizey, $targetId, int($threshold))
+       or sendJsonError("Can't run wkbToParam for file $filename");
+   close($converter) or sendJsonError("wkbToParam could not write file $filename");
+   return $filename;
+}
+
+# Find the reference cache for an uploaded line data set, building
+# it if it does not exist yet. The cache holds every line of the data
+# set, already projected to EPSG:3857, with an index of their bounding
+# boxes, so each experiment reads only the lines near its image
+# instead of asking the database to clip and project them again.
+# Arguments (passed)
+#    refid                Id of dataset in uploaddata table
+# Returns name of the cache file
+sub _getRefCache
+{
+   my ($refId) =  @_;
+   my $filename = "$refcachedir/refs$refId.cache";
+   return $filename if (-e $filename);
+   mkdir($refcachedir) unless (-d $refcachedir);
+   my $sqlcommand = "select id, encode(ST_AsBinary(ST_Transform(geom,3857)),'hex') from uploadlines where dataid=$refId order by id;";
    logentry("About to execute: |$sqlcommand|\n");
    my $stmt = $gDbh->prepare($sqlcommand);
    my $numrows = $stmt->execute;
@@ -2164,58 +2098,44 @@ sub _writeParamFile
    {
        rollbackAndError;
    }
-   open FILE, ">$filename" or sendJsonError("Can't open file $filename");
-   if ($numrows == 0)
-   {
-       rollbackAndError("No reference features fall within the bounds of the query data");
-   }
-   print FILE "$numrows $xcenter $ycenter $size $sizex $sizey $targetId $threshold\n";
+   # build under a temporary name, so that a request running at the
+   # same time never sees a partly written cache
+   my $tempname = "$filename.$$";
+   open(my $converter, "|-", "$homedir/wkbToParam", "-cache", $tempname, $refId)
+       or sendJsonError("Can't run wkbToParam for file $filename");
    for (my $i=0; $i < $numrows; $i++)
    {
-       my @row  = $stmt->fetchrow_array;
-       # Code to transform and write only start and end points
-       #       my ($id,$start,$end) = @row;
-       #  $start =~ /POINT\((\-?\d+.\d+) (\-?\d+.\d+)/; 
-       #  my ($x1,$y1) = ($1,$2);
-       #  $end =~ /POINT\((\-?\d+.\d+) (\-?\d+.\d+)/; 
-       #  my ($x2,$y2) = ($1,$2);
-       #  print FILE "$id $x1 $y1 $x2 $y2\n";
-       # Code to match Id plus linestring 'LINESTRING(xxxx.xxxx yyyy.yyyy, xxxx.xxxx yyyy.yyyy, xxxx.xxxx yyyy.yyyy)'
-       my ($id,$linestring) = @row;
-       if ($linestring =~ /MULTILINESTRING\((.+?)\)$/)  # intersect can create multi-line strings!
-       {
-	   my $multicoords = $1;
-	   my @substrings = split(/\),\(/,$multicoords);
-	   foreach my $coords (@substrings)
-	   {
-	       $coords =~ s/\(|\)//g;
-	       print FILE "$id $coords\n";
-	   }
-       }
-       else
-       {
-	   $linestring =~ /LINESTRING\((.+?)\)/;
-	   my $coords = $1;
-	   print FILE "$id $coords\n";
-       }
-    }
-   close FILE;
+       my ($id,$wkb) = $stmt->fetchrow_array;
+       $wkb = "" unless defined $wkb;
+       print $converter "$id $wkb\n";
+   }
+   close($converter) or sendJsonError("wkbToParam could not write file $filename");
+   rename($tempname,$filename) or sendJsonError("Can't create reference cache $filename");
    return $filename;
 }
 
-# run the appropriate script on the target image file name to turn it 
-# into a binary image file. The original name of the file is stored in
-# the querydata record. We copy that to a standard file name based
-# on the first word of the provider name, then run the appropriate ImageMagick
-# conversion script, again selected by provider name. We return the name of
-# the converted binary image as the function value.
+# Remove the reference cache for an uploaded data set, if there is
+# one, because its lines have changed or been deleted.
+# Arguments (passed)
+#    dataid               Id of dataset in uploaddata table
+sub _removeRefCache
+{
+   my ($dataId) =  @_;
+   unlink("$refcachedir/refs$dataId.cache");
+}
+
+# Look up the image captured for the target data set and the provider
+# that produced it. The original name of the file is stored in
+# the querydata record. guidedVectorize decodes this JPEG and
+# converts it to a binary image itself, using the binarization
+# settings for the provider (first word of the provider name, lower case).
 #   Arguments 
 #       targetId      Id of querydata record
-#
-sub _convertImage
+# Returns an array with the image file name and the provider
+sub _getQueryImage
 {
   my ($targetId) =  @_;
-  my ($queryimg,$standardimg,$binaryimg,$providername,$convertscript);
+  my ($queryimg,$providername);
   my $sqlcommand = "select p.providername,q.imgfilename from providers p, querydata q where q.id = $targetId and q.providerid = p.id;";
   logentry("About to execute: |$sqlcommand|\n");
   my $stmt = $gDbh->prepare($sqlcommand);
@@ -2234,89 +2154,64 @@ sub _convertImage
     }
   $providername =~ /^(\w+)/;
   my $provider = lc($1);
-  my $stat = system("cp -p $queryimg $tmpdir/$provider.jpg");
-  if ($stat != 0)
-    {
-	rollbackAndError("Cannot copy from $queryimg to $tmpdir/$providername.jpg"); # dies after sending the error
-    }
-  $binaryimg = $tmpdir . "/" . $provider . "binary.rgb";
-  $convertscript = $homedir . "/" . $provider . "_convert.sh";
-  $stat = system("./$convertscript $tmpdir");
-  if ($stat != 0)
+  if (!(-e $queryimg))
     {
-	rollbackAndError("Cannot execute conversion script $convertscript"); # dies after sending the error
+	rollbackAndError("Cannot find query image $queryimg"); # dies after sending the error
     }
-  return $binaryimg;
+  my @results;
+  push @results, $queryimg;
+  push @results, $provider;
+  return @results;
 }
 
 # populate the linematch table by comparing the reference data with the 
-# extracted features from the image. We need to intersect the reference data with
-# the boundaries of the IMAGE, not the region, since the image probably doesn't cover
-# the full region (depending on the zoom). We know the center of the image is the
-# center of the region and also the size of a pixel, so we can calculate the bounds
-# This is saved as part of the querydata record
+# extracted features from the image. The reference data were clipped to
+# the boundaries of the IMAGE, not the region, by guidedVectorize, 
+# and guidedVectorize -compare has already compared each clipped
+# reference line with the lines it matched, writing one linematch row per
+# reference line with the Hausdorff distance, length difference and Frechet
+# distance. We load those rows, then fill in the querylines Id of the match,
+# which guidedVectorize cannot know.
 # Arguments (passed)
 #     experimentid          - ID of the experiment
 #     refdataid             - ID of the uploaddata record
 #     targetdataid          - ID of the querydata record
+#     copyfile              - linematch COPY file written by guidedVectorize
 # Returns an array with element 0 the number of reference lines in the linematch table, element 1 the number of matches
 sub _compareLines
 {
-    my ($experimentId, $refdataId, $targetdataId) = @_;
-    # QUERY TO GET FULL INTERSECTION WITH IMAGE AREA BB, ALL POINTS 
-    my $sqlcommand =  "with vars as (select boundingbox from querydata where id=$targetdataId) select id as refid,ST_Transform(ST_Intersection(geom,vars.boundingbox),3857) as refline from uploadlines, vars where dataid=$refdataId and ST_Intersects(geom,vars.boundingbox);";
+    my ($experimentId, $refdataId, $targetdataId, $copyfile) = @_;
+    _copyRows($copyfile,"linematch (experimentid,refid,distance,deltalength,frechet)");
+    # a reference line split into several parts by the intersection can have
+    # several query lines; use the first
+    my $sqlcommand = "update linematch set targetid = q.qid from (select uploadfeatureid, min(id) as qid from querylines where experimentid=$experimentId group by uploadfeatureid) as q where linematch.experimentid=$experimentId and linematch.refid=q.uploadfeatureid and linematch.distance >= 0;";
     logentry("About to execute: |$sqlcommand|\n");
-    my $stmt = $gDbh->prepare($sqlcommand);
-    my $numrows = $stmt->execute;
-    $gSqlError= $gDbh->err;
-    $gSqlErrorStr = $gDbh->errstr;
+    my $matchCount = execPreparedSqlCommand($sqlcommand);
     if ($gSqlError != 0)
     {
 	rollbackAndError;
     }
-    my @refIdList;
-    my @refGeomList;
-    my $matchCount = 0;
-    my $refCount = $numrows;
-    for (my $i=0; $i < $refCount; $i++)
+    $matchCount = 0 if ($matchCount eq "0E0");
+    # reference lines whose intersection with the image has no lines in it
+    # are not in the parameter file, so guidedVectorize could not write them
+    $sqlcommand = "with vars as (select boundingbox from querydata where id=$targetdataId) insert into linematch (experimentid,refid) select $experimentId, id from uploadlines, vars where dataid=$refdataId and ST_Intersects(geom,vars.boundingbox) and id not in (select refid from linematch where experimentid=$experimentId);";
+    logentry("About to execute: |$sqlcommand|\n");
+    execSqlCommand($sqlcommand);
+    if ($gSqlError != 0)
     {
-	my @row  = $stmt->fetchrow_array;
-	my ($refid,$refline) = @row;
-	# save because we need to exec more SQL for each feature
-	push @refIdList,$refid;
-	push @refGeomList,$refline;
+	rollbackAndError;
     }
-    for (my $i=0; $i < $refCount; $i++)
+    $sqlcommand = "select count(*) from linematch where experimentid=$experimentId;";
+    logentry("About to execute: |$sqlcommand|\n");
+    my $stmt = $gDbh->prepare($sqlcommand);
+    $stmt->execute;
+    $gSqlError= $gDbh->err;
+    $gSqlErrorStr = $gDbh->errstr;
+    if ($gSqlError != 0)
     {
-	# do we have a matching query line?
-	$sqlcommand = "select id as qid,geom as qline from querylines where experimentid=$experimentId and uploadfeatureid=$refIdList[$i];";
-	logentry("About to execute: |$sqlcommand|\n");
-	$stmt = $gDbh->prepare($sqlcommand);
-	$numrows = $stmt->execute;
-	$gSqlError= $gDbh->err;
-	$gSqlErrorStr = $gDbh->errstr;
-	if ($gSqlError != 0)
-	{
-	    rollbackAndError;
-	}
-	if ($numrows == 0)   # no matching line
-	{
-	    $sqlcommand = "insert into linematch (experimentid,refid) values ($experimentId,$refIdList[$i]);";
-	}
-	elsif ($numrows == 1)  #exactly one matching line
-	{
-            $matchCount++;
-	    my @row  = $stmt->fetchrow_array;
-	    my ($qid,$qline) = @row;
-	    $sqlcommand = "insert into linematch (experimentid,refid,targetid,distance,deltalength) values ($experimentId,$refIdList[$i],$qid,ST_HausdorffDistance(\'$refGeomList[$i]\',\'$qline\'),(ST_Length(\'$refGeomList[$i]\') - ST_Length(\'$qline\')));";
-	} # deal with multiple matches later
-	logentry("About to execute: |$sqlcommand|\n");
-	execSqlCommand($sqlcommand);
-	if ($gSqlError != 0)
-	{
-	    rollbackAndError;
-	}
+	rollbackAndError;
     }
+    my ($refCount) = $stmt->fetchrow_array;
     my @results;
     logentry("In _compareLines, refCount is $refCount and matchCount is $matchCount\n");
     push @results, $refCount;
@@ -2625,20 +2520,26 @@ sub calculateMetrics
 	my $zoom = _getZoomFactor($targetId);
 	# write scaling and reference data to parameter file
 	my $paramFilename = _writeParamFile($experimentId,$threshold,$refId,$targetId);
-	# convert the image to binary - depending on the source
-        my $binaryImageName = _convertImage($targetId);
+	my $refCacheFilename = _getRefCache($refId);
+	# find the image; guidedVectorize converts it to binary - depending on the source
+        my ($queryImageName,$provider) = _getQueryImage($targetId);
 	# run guidedVectorize
-        my $results = `$homedir/guidedVectorize 512 512 $binaryImageName $paramFilename $tmpdir/loadresults $experimentId`;
+        my $results = `$homedir/guidedVectorize 512 512 $queryImageName $paramFilename $tmpdir/loadresults $experimentId -provider $provider -copy -compare -stats -refcache $refCacheFilename`;
         if ($results ne "")
         {
 	    sendJsonError("Cannot execute guidedVectorize -- Error is |$results|");
 	} 
 	# load the data into the DB
-	_execSqlFile("$tmpdir/loadresults.sql");
+	_copyQueryLines("$tmpdir/loadresults.copy");
+	_storeVectorizeStats($experimentId,"$tmpdir/loadresults.stats.json");
 	# compare and calculate
-	my @results = _compareLines($experimentId, $refId, $targetId);
+	my @results = _compareLines($experimentId, $refId, $targetId, "$tmpdir/loadresults.linematch.copy");
 	$refcount = $results[0];
 	$matchcount = $results[1];
+	if ($refcount == 0)
+	{
+	    rollbackAndError("No reference features fall within the bounds of the query data");
+	}
 	if ($matchcount == 0)
 	{
 	    $avgdistance = -1;  # signal no matches
@@ -3350,6 +3251,7 @@ sub _deleteUploadDataSet
 	{
 	    $status = 0;
 	}
+	_removeRefCache($dataid) if ($featuretype == 1);
     }
     if ($status)
     {